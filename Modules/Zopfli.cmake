@@ -0,0 +1,31 @@
+# Builds the vendored zopfli library, shared by all tools linking it
+# Caller must ensure ${CMAKE_CURRENT_SOURCE_DIR}/src/external exists
+if(NOT TARGET zopfli)
+	set(zopfli_dir ${CMAKE_CURRENT_SOURCE_DIR}/src/external/zopfli)
+	add_library(zopfli STATIC
+		${zopfli_dir}/zopfli.h
+		${zopfli_dir}/blocksplitter.h
+		${zopfli_dir}/blocksplitter.c
+		${zopfli_dir}/cache.h
+		${zopfli_dir}/cache.c
+		${zopfli_dir}/deflate.h
+		${zopfli_dir}/deflate.c
+		${zopfli_dir}/hash.h
+		${zopfli_dir}/hash.c
+		${zopfli_dir}/katajainen.h
+		${zopfli_dir}/katajainen.c
+		${zopfli_dir}/lz77.h
+		${zopfli_dir}/lz77.c
+		${zopfli_dir}/squeeze.h
+		${zopfli_dir}/squeeze.c
+		${zopfli_dir}/symbols.h
+		${zopfli_dir}/tree.h
+		${zopfli_dir}/tree.c
+		${zopfli_dir}/util.h
+		${zopfli_dir}/util.c
+		${zopfli_dir}/zlib_container.h
+		${zopfli_dir}/zlib_container.c)
+	target_include_directories(zopfli INTERFACE ${zopfli_dir})
+	set_target_properties(zopfli PROPERTIES LINKER_LANGUAGE CXX)
+	unset(zopfli_dir)
+endif()
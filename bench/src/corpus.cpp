@@ -0,0 +1,555 @@
+/*
+ * Copyright (c) 2026 EasyRPG Tools authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#include "corpus.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string_view>
+#include <zlib.h>
+#include "libxyz.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+	// Chunk IDs of the LCF formats (see liblcf)
+	namespace ChunkMap {
+		constexpr uint32_t chipset_id = 0x01;
+		constexpr uint32_t width = 0x02;
+		constexpr uint32_t height = 0x03;
+		constexpr uint32_t lower_layer = 0x47;
+		constexpr uint32_t upper_layer = 0x48;
+		constexpr uint32_t events = 0x51;
+	}
+	namespace ChunkEvent {
+		constexpr uint32_t name = 0x01;
+		constexpr uint32_t x = 0x02;
+		constexpr uint32_t y = 0x03;
+		constexpr uint32_t pages = 0x05;
+	}
+	namespace ChunkEventPage {
+		constexpr uint32_t character_name = 0x15;
+		constexpr uint32_t character_index = 0x16;
+		constexpr uint32_t character_direction = 0x17;
+		constexpr uint32_t trigger = 0x21;
+		constexpr uint32_t event_commands_size = 0x33;
+		constexpr uint32_t event_commands = 0x34;
+	}
+	namespace ChunkMapInfo {
+		constexpr uint32_t name = 0x01;
+		constexpr uint32_t parent_map = 0x02;
+		constexpr uint32_t indentation = 0x03;
+		constexpr uint32_t type = 0x04;
+	}
+	namespace ChunkStart {
+		constexpr uint32_t party_map_id = 0x01;
+		constexpr uint32_t party_x = 0x02;
+		constexpr uint32_t party_y = 0x03;
+	}
+	namespace ChunkDatabase {
+		constexpr uint32_t actors = 0x0B;
+		constexpr uint32_t items = 0x0D;
+		constexpr uint32_t chipsets = 0x14;
+		constexpr uint32_t commonevents = 0x19;
+	}
+	namespace ChunkActor {
+		constexpr uint32_t name = 0x01;
+		constexpr uint32_t title = 0x02;
+	}
+	namespace ChunkItem {
+		constexpr uint32_t name = 0x01;
+		constexpr uint32_t description = 0x02;
+	}
+	namespace ChunkChipset {
+		constexpr uint32_t name = 0x01;
+		constexpr uint32_t chipset_name = 0x02;
+		constexpr uint32_t terrain_data = 0x03;
+		constexpr uint32_t passable_data_lower = 0x04;
+		constexpr uint32_t passable_data_upper = 0x05;
+	}
+	namespace ChunkCommonEvent {
+		constexpr uint32_t name = 0x01;
+		constexpr uint32_t trigger = 0x0B;
+		constexpr uint32_t event_commands_size = 0x15;
+		constexpr uint32_t event_commands = 0x16;
+	}
+
+	// Event command codes
+	constexpr int cmd_end = 10;
+	constexpr int cmd_show_message = 10110;
+	constexpr int cmd_show_message_2 = 20110;
+	constexpr int cmd_show_choice = 10140;
+	constexpr int cmd_show_choice_option = 20140;
+	constexpr int cmd_show_choice_end = 20141;
+	constexpr int cmd_control_switches = 10210;
+	constexpr int cmd_teleport = 10810;
+
+	constexpr int map_type_map = 1;
+	constexpr int map_type_area = 2;
+
+	constexpr int num_chipsets = 4;
+	constexpr int num_charsets = 4;
+
+	// Writes BER compressed integers and chunks as used by LCF
+	class Writer {
+	public:
+		void Int(uint32_t value) {
+			char buf[5];
+			int n = 0;
+			do {
+				buf[n++] = static_cast<char>(value & 0x7F);
+				value >>= 7;
+			} while (value != 0);
+			while (n > 1) {
+				data += static_cast<char>(buf[--n] | 0x80);
+			}
+			data += buf[0];
+		}
+
+		void String(std::string_view s) {
+			Int(s.size());
+			data += s;
+		}
+
+		void Chunk(uint32_t id, const Writer& chunk) {
+			Int(id);
+			Int(chunk.data.size());
+			data += chunk.data;
+		}
+
+		void IntChunk(uint32_t id, int value) {
+			Writer chunk;
+			chunk.Int(value);
+			Chunk(id, chunk);
+		}
+
+		void StringChunk(uint32_t id, std::string_view s) {
+			Writer chunk;
+			chunk.data = s;
+			Chunk(id, chunk);
+		}
+
+		void U16ArrayChunk(uint32_t id, const std::vector<uint16_t>& values) {
+			Writer chunk;
+			chunk.data.reserve(values.size() * 2);
+			for (uint16_t v : values) {
+				chunk.data += static_cast<char>(v & 0xFF);
+				chunk.data += static_cast<char>(v >> 8);
+			}
+			Chunk(id, chunk);
+		}
+
+		void End() {
+			data += '\0';
+		}
+
+		std::string data;
+	};
+
+	struct Command {
+		int code;
+		int indent;
+		std::string string;
+		std::vector<int> parameters;
+	};
+
+	void WriteCommands(Writer& w, uint32_t size_id, uint32_t commands_id, const std::vector<Command>& commands) {
+		Writer chunk;
+		for (const auto& cmd : commands) {
+			chunk.Int(cmd.code);
+			chunk.Int(cmd.indent);
+			chunk.String(cmd.string);
+			chunk.Int(cmd.parameters.size());
+			for (int p : cmd.parameters) {
+				chunk.Int(p);
+			}
+		}
+		// end of list marker
+		chunk.data.append(4, '\0');
+		w.IntChunk(size_id, chunk.data.size());
+		w.Chunk(commands_id, chunk);
+	}
+
+	class Generator {
+	public:
+		Generator(const fs::path& dir, const Corpus::Options& options, Corpus::Stats& stats) :
+			dir(dir), options(options), stats(stats), rng(options.seed), image_rng(options.seed + 1) {}
+
+		bool Run(std::string& error);
+
+	private:
+		// rng() % n instead of the distributions, they differ between standard libraries
+		int Rand(int n) {
+			return static_cast<int>(rng() % static_cast<unsigned>(n));
+		}
+
+		int Rand(int lo, int hi) {
+			return lo + Rand(hi - lo + 1);
+		}
+
+		// Images draw from their own generator, the translated game has none
+		int ImageRand(int n) {
+			return static_cast<int>(image_rng() % static_cast<unsigned>(n));
+		}
+
+		std::string Text(int min_words, int max_words);
+		std::vector<Command> Commands(int num_maps, int width, int height);
+
+		bool WriteFile(const fs::path& path, std::string_view data);
+		bool WriteXyz(const std::string& name, int width, int height);
+		bool WriteImages();
+		bool WriteDatabase();
+		bool WriteMapTree(int num_maps);
+		bool WriteMap(int id, int num_maps);
+
+		fs::path dir;
+		const Corpus::Options& options;
+		Corpus::Stats& stats;
+		std::mt19937 rng;
+		std::mt19937 image_rng;
+		std::string error;
+	};
+
+	std::string Generator::Text(int min_words, int max_words) {
+		static const char* words[] = {
+			"the", "hero", "village", "sword", "castle", "dragon", "potion", "king",
+			"forest", "gold", "quest", "door", "key", "dungeon", "friend", "monster",
+			"welcome", "beware", "treasure", "night", "river", "bridge", "magic", "tower"
+		};
+		constexpr int num_words = sizeof(words) / sizeof(words[0]);
+
+		std::string text;
+		int count = Rand(min_words, max_words);
+		for (int i = 0; i < count; ++i) {
+			if (i > 0) {
+				text += ' ';
+			}
+			text += words[Rand(num_words)];
+		}
+		if (options.translated) {
+			std::transform(text.begin(), text.end(), text.begin(),
+				[](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+		}
+		return text;
+	}
+
+	std::vector<Command> Generator::Commands(int num_maps, int width, int height) {
+		std::vector<Command> commands;
+		int count = Rand(2, 8);
+		for (int i = 0; i < count; ++i) {
+			switch (Rand(5)) {
+				case 0:
+				case 1: {
+					commands.push_back({cmd_show_message, 0, Text(2, 8), {}});
+					int lines = Rand(4);
+					for (int l = 0; l < lines; ++l) {
+						commands.push_back({cmd_show_message_2, 0, Text(2, 8), {}});
+					}
+					break;
+				}
+				case 2: {
+					std::string yes = Text(1, 2);
+					std::string no = Text(1, 2);
+					commands.push_back({cmd_show_choice, 0, yes + "/" + no, {2}});
+					commands.push_back({cmd_show_choice_option, 0, yes, {0}});
+					commands.push_back({cmd_show_message, 1, Text(2, 8), {}});
+					commands.push_back({cmd_end, 1, {}, {}});
+					commands.push_back({cmd_show_choice_option, 0, no, {1}});
+					commands.push_back({cmd_end, 1, {}, {}});
+					commands.push_back({cmd_show_choice_end, 0, {}, {}});
+					break;
+				}
+				case 3: {
+					int id = Rand(1, 200);
+					commands.push_back({cmd_control_switches, 0, {}, {0, id, id, Rand(2)}});
+					break;
+				}
+				default:
+					commands.push_back({cmd_teleport, 0, {},
+						{Rand(1, num_maps), Rand(width), Rand(height), 0}});
+					break;
+			}
+		}
+		commands.push_back({cmd_end, 0, {}, {}});
+		return commands;
+	}
+
+	bool Generator::WriteFile(const fs::path& path, std::string_view data) {
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out.write(data.data(), data.size());
+		if (!out) {
+			error = "Failed writing " + path.string();
+			return false;
+		}
+		stats.bytes += data.size();
+		return true;
+	}
+
+	bool Generator::WriteXyz(const std::string& name, int width, int height) {
+		Xyz::Header header;
+		header.width = static_cast<uint16_t>(width);
+		header.height = static_cast<uint16_t>(height);
+
+		std::vector<uint8_t> decoded(Xyz::DecodedSize(header));
+		for (size_t i = 0; i < Xyz::palette_size; ++i) {
+			decoded[i] = static_cast<uint8_t>(image_rng());
+		}
+
+		// Flat 8x8 blocks with some noisy ones, compresses like drawn graphics
+		uint8_t* pixels = decoded.data() + Xyz::palette_size;
+		for (int by = 0; by < height; by += 8) {
+			for (int bx = 0; bx < width; bx += 8) {
+				uint8_t color = static_cast<uint8_t>(ImageRand(Xyz::palette_entries));
+				bool noise = ImageRand(4) == 0;
+				for (int y = by; y < std::min(by + 8, height); ++y) {
+					for (int x = bx; x < std::min(bx + 8, width); ++x) {
+						pixels[y * width + x] = noise ? static_cast<uint8_t>(color + ImageRand(16)) : color;
+					}
+				}
+			}
+		}
+
+		std::string data(Xyz::header_size, '\0');
+		Xyz::WriteHeader(header, reinterpret_cast<uint8_t*>(&data[0]));
+		uLongf compressed_size = compressBound(decoded.size());
+		data.resize(Xyz::header_size + compressed_size);
+		if (compress2(reinterpret_cast<Bytef*>(&data[Xyz::header_size]), &compressed_size,
+				decoded.data(), decoded.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+			error = "Failed compressing " + name;
+			return false;
+		}
+		data.resize(Xyz::header_size + compressed_size);
+
+		++stats.images;
+		stats.xyz_files.push_back(name);
+		return WriteFile(dir / name, data);
+	}
+
+	bool Generator::WriteImages() {
+		for (int i = 1; i <= num_chipsets; ++i) {
+			if (!WriteXyz("ChipSet/Chipset" + std::to_string(i) + ".xyz", 480, 256)) {
+				return false;
+			}
+		}
+		for (int i = 1; i <= num_charsets; ++i) {
+			if (!WriteXyz("CharSet/Chara" + std::to_string(i) + ".xyz", 288, 256)) {
+				return false;
+			}
+		}
+		int num_pictures = 48 * options.scale;
+		for (int i = 1; i <= num_pictures; ++i) {
+			std::string name = "Picture/Picture" + std::to_string(i) + ".xyz";
+			stats.pictures.push_back(name);
+			if (!WriteXyz(name, (ImageRand(79) + 2) * 8, (ImageRand(59) + 2) * 8)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool Generator::WriteDatabase() {
+		Writer db;
+		db.String("LcfDataBase");
+
+		Writer actors;
+		actors.Int(50);
+		for (int i = 1; i <= 50; ++i) {
+			actors.Int(i);
+			actors.StringChunk(ChunkActor::name, Text(1, 2));
+			actors.StringChunk(ChunkActor::title, Text(1, 3));
+			actors.End();
+		}
+		db.Chunk(ChunkDatabase::actors, actors);
+
+		Writer items;
+		items.Int(200);
+		for (int i = 1; i <= 200; ++i) {
+			items.Int(i);
+			items.StringChunk(ChunkItem::name, Text(1, 2));
+			items.StringChunk(ChunkItem::description, Text(3, 8));
+			items.End();
+		}
+		db.Chunk(ChunkDatabase::items, items);
+
+		Writer chipsets;
+		chipsets.Int(num_chipsets);
+		for (int i = 1; i <= num_chipsets; ++i) {
+			chipsets.Int(i);
+			chipsets.StringChunk(ChunkChipset::name, "Chipset" + std::to_string(i));
+			chipsets.StringChunk(ChunkChipset::chipset_name, "Chipset" + std::to_string(i));
+			chipsets.U16ArrayChunk(ChunkChipset::terrain_data, std::vector<uint16_t>(162, 1));
+			chipsets.StringChunk(ChunkChipset::passable_data_lower, std::string(162, '\x0F'));
+			chipsets.StringChunk(ChunkChipset::passable_data_upper, std::string(144, '\x0F'));
+			chipsets.End();
+		}
+		db.Chunk(ChunkDatabase::chipsets, chipsets);
+
+		Writer common_events;
+		stats.common_events = 400 * options.scale;
+		common_events.Int(stats.common_events);
+		for (int i = 1; i <= stats.common_events; ++i) {
+			common_events.Int(i);
+			common_events.StringChunk(ChunkCommonEvent::name, "CommonEvent" + std::to_string(i));
+			// call only
+			common_events.IntChunk(ChunkCommonEvent::trigger, 5);
+			WriteCommands(common_events, ChunkCommonEvent::event_commands_size,
+				ChunkCommonEvent::event_commands, Commands(1, 20, 15));
+			common_events.End();
+		}
+		db.Chunk(ChunkDatabase::commonevents, common_events);
+		db.End();
+
+		return WriteFile(dir / "RPG_RT.ldb", db.data);
+	}
+
+	bool Generator::WriteMapTree(int num_maps) {
+		struct Info {
+			std::string name;
+			int parent;
+			int type;
+		};
+
+		// Every eighth map starts a new top level entry, areas are appended
+		std::vector<Info> infos(1, {"Bench", 0, 0});
+		for (int i = 1; i <= num_maps; ++i) {
+			int parent = (i % 8 == 1) ? 0 : Rand(std::max(1, i - 8), i - 1);
+			infos.push_back({Text(1, 3), parent, map_type_map});
+		}
+		for (int i = 0; i < num_maps / 6; ++i) {
+			infos.push_back({Text(1, 2), Rand(1, num_maps), map_type_area});
+		}
+
+		std::vector<std::vector<int>> children(infos.size());
+		for (size_t i = 1; i < infos.size(); ++i) {
+			children[infos[i].parent].push_back(static_cast<int>(i));
+		}
+
+		std::vector<int> order;
+		std::vector<int> depth(infos.size(), 0);
+		std::function<void(int)> walk = [&](int id) {
+			order.push_back(id);
+			for (int child : children[id]) {
+				depth[child] = depth[id] + 1;
+				walk(child);
+			}
+		};
+		walk(0);
+
+		Writer lmt;
+		lmt.String("LcfMapTree");
+		lmt.Int(infos.size());
+		for (size_t i = 0; i < infos.size(); ++i) {
+			lmt.Int(i);
+			lmt.StringChunk(ChunkMapInfo::name, infos[i].name);
+			lmt.IntChunk(ChunkMapInfo::parent_map, infos[i].parent);
+			lmt.IntChunk(ChunkMapInfo::indentation, depth[i]);
+			lmt.IntChunk(ChunkMapInfo::type, infos[i].type);
+			lmt.End();
+		}
+		lmt.Int(order.size());
+		for (int id : order) {
+			lmt.Int(id);
+		}
+		// active node
+		lmt.Int(1);
+		lmt.IntChunk(ChunkStart::party_map_id, 1);
+		lmt.IntChunk(ChunkStart::party_x, 0);
+		lmt.IntChunk(ChunkStart::party_y, 0);
+		lmt.End();
+
+		return WriteFile(dir / "RPG_RT.lmt", lmt.data);
+	}
+
+	bool Generator::WriteMap(int id, int num_maps) {
+		int width = Rand(100, 200);
+		int height = Rand(100, 150);
+
+		// Lower chipset tiles mixed with terrain autotiles, upper layer mostly empty
+		std::vector<uint16_t> lower(width * height);
+		std::vector<uint16_t> upper(width * height);
+		for (int i = 0; i < width * height; ++i) {
+			lower[i] = Rand(10) < 7 ? 5000 + Rand(144) : 4000 + Rand(12) * 50 + Rand(47);
+			upper[i] = Rand(5) == 0 ? 10001 + Rand(143) : 10000;
+		}
+
+		Writer lmu;
+		lmu.String("LcfMapUnit");
+		lmu.IntChunk(ChunkMap::chipset_id, Rand(1, num_chipsets));
+		lmu.IntChunk(ChunkMap::width, width);
+		lmu.IntChunk(ChunkMap::height, height);
+		lmu.U16ArrayChunk(ChunkMap::lower_layer, lower);
+		lmu.U16ArrayChunk(ChunkMap::upper_layer, upper);
+
+		Writer events;
+		int num_events = width * height / 40;
+		stats.events += num_events;
+		events.Int(num_events);
+		for (int e = 1; e <= num_events; ++e) {
+			events.Int(e);
+			events.StringChunk(ChunkEvent::name, "EV" + std::to_string(e));
+			events.IntChunk(ChunkEvent::x, Rand(width));
+			events.IntChunk(ChunkEvent::y, Rand(height));
+
+			Writer pages;
+			int num_pages = Rand(1, 3);
+			pages.Int(num_pages);
+			for (int p = 1; p <= num_pages; ++p) {
+				pages.Int(p);
+				pages.StringChunk(ChunkEventPage::character_name, "Chara" + std::to_string(Rand(1, num_charsets)));
+				pages.IntChunk(ChunkEventPage::character_index, Rand(8));
+				pages.IntChunk(ChunkEventPage::character_direction, Rand(4));
+				// action button
+				pages.IntChunk(ChunkEventPage::trigger, 0);
+				WriteCommands(pages, ChunkEventPage::event_commands_size,
+					ChunkEventPage::event_commands, Commands(num_maps, width, height));
+				pages.End();
+			}
+			events.Chunk(ChunkEvent::pages, pages);
+			events.End();
+		}
+		lmu.Chunk(ChunkMap::events, events);
+		lmu.End();
+
+		char name[16];
+		snprintf(name, sizeof(name), "Map%04d.lmu", id);
+		++stats.maps;
+		return WriteFile(dir / name, lmu.data);
+	}
+
+	bool Generator::Run(std::string& error_out) {
+		std::error_code ec;
+		for (const char* sub : {"ChipSet", "CharSet", "Picture"}) {
+			fs::create_directories(dir / sub, ec);
+			if (ec) {
+				error_out = "Failed creating " + (dir / sub).string() + ": " + ec.message();
+				return false;
+			}
+		}
+
+		int num_maps = 12 * options.scale;
+		bool ok = WriteFile(dir / "RPG_RT.ini", "[RPG_RT]\r\nGameTitle=Bench\r\n")
+			&& (options.translated || WriteImages())
+			&& WriteDatabase()
+			&& WriteMapTree(num_maps);
+		for (int id = 1; ok && id <= num_maps; ++id) {
+			ok = WriteMap(id, num_maps);
+		}
+
+		error_out = error;
+		return ok;
+	}
+}
+
+bool Corpus::Generate(const std::string& dir, const Options& options, Stats& stats, std::string& error) {
+	stats = Stats();
+	Generator gen(dir, options, stats);
+	return gen.Run(error);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2026 EasyRPG Tools authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Synthetic RPG Maker 2000 game used by the benchmarks.
+ *
+ * The game has a map tree, a database with many common events, large maps
+ * with dense events and XYZ images of varied sizes. All content is derived
+ * from the seed, so corpora of the same options are identical.
+ */
+namespace Corpus {
+	struct Options {
+		/** Multiplies the number of images, maps and common events */
+		int scale = 1;
+		unsigned seed = 1;
+		/**
+		 * Writes the same game with all texts changed and without the
+		 * images, used as the hardcoded translation when matching with
+		 * lcftrans.
+		 */
+		bool translated = false;
+	};
+
+	struct Stats {
+		int images = 0;
+		int maps = 0;
+		int events = 0;
+		int common_events = 0;
+		uint64_t bytes = 0;
+		/** Pictures in generation order, relative to the game directory */
+		std::vector<std::string> pictures;
+		/** All XYZ images, relative to the game directory */
+		std::vector<std::string> xyz_files;
+	};
+
+	/**
+	 * Writes the game to dir, which is created when missing.
+	 *
+	 * @param dir game directory
+	 * @param options corpus options
+	 * @param stats receives the size of the corpus
+	 * @param error receives the reason of a failure
+	 * @return whether all files were written
+	 */
+	bool Generate(const std::string& dir, const Options& options, Stats& stats, std::string& error);
+}
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2026 EasyRPG Tools authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+// Times the tools on a synthetic game and writes the results as JSON
+
+#include "corpus.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+	struct Benchmark {
+		std::string name;
+		std::string tool;
+		/** Prepares a round, not timed */
+		std::function<bool()> setup;
+		/** Command line of the tool without the executable */
+		std::vector<std::string> args;
+		/** Working directory of the tool, empty for the current one */
+		fs::path cwd;
+		/** Appends the files copied by setup to the command line */
+		bool pass_files = false;
+	};
+
+	struct Result {
+		std::string name;
+		std::vector<double> seconds;
+		bool ok = true;
+	};
+
+	std::string Quote(const std::string& arg) {
+		return "\"" + arg + "\"";
+	}
+
+	int Run(const std::string& exe, const std::vector<std::string>& args, const fs::path& cwd, const fs::path& log) {
+		std::string cmd = Quote(exe);
+		for (const auto& arg : args) {
+			cmd += " " + Quote(arg);
+		}
+		cmd += " > " + Quote(log.string()) + " 2>&1";
+#ifdef _WIN32
+		// cmd.exe strips the outer quotes of the whole line
+		cmd = "\"" + cmd + "\"";
+#endif
+
+		std::error_code ec;
+		fs::path old_cwd = fs::current_path();
+		if (!cwd.empty()) {
+			fs::current_path(cwd, ec);
+			if (ec) {
+				return -1;
+			}
+		}
+		int status = std::system(cmd.c_str());
+		fs::current_path(old_cwd, ec);
+		return status;
+	}
+
+	bool FreshDir(const fs::path& dir) {
+		std::error_code ec;
+		fs::remove_all(dir, ec);
+		return fs::create_directories(dir, ec);
+	}
+
+	bool CopyFiles(const fs::path& from, const std::vector<std::string>& names, const fs::path& to,
+			std::vector<std::string>& copied) {
+		copied.clear();
+		if (!FreshDir(to)) {
+			return false;
+		}
+		for (const auto& name : names) {
+			fs::path target = to / fs::path(name).filename();
+			std::error_code ec;
+			fs::copy_file(from / name, target, ec);
+			if (ec) {
+				return false;
+			}
+			copied.push_back(target.string());
+		}
+		return true;
+	}
+
+	std::string Escape(const std::string& s) {
+		std::string out;
+		for (char c : s) {
+			if (c == '"' || c == '\\') {
+				out += '\\';
+			}
+			out += c;
+		}
+		return out;
+	}
+
+	void WriteJson(std::ostream& out, int scale, int rounds, const Corpus::Stats& stats,
+			const std::vector<Result>& results, const std::vector<std::string>& skipped) {
+		out << "{\n";
+		out << "\t\"version\": 1,\n";
+		out << "\t\"scale\": " << scale << ",\n";
+		out << "\t\"rounds\": " << rounds << ",\n";
+		out << "\t\"corpus\": {\n";
+		out << "\t\t\"images\": " << stats.images << ",\n";
+		out << "\t\t\"maps\": " << stats.maps << ",\n";
+		out << "\t\t\"events\": " << stats.events << ",\n";
+		out << "\t\t\"common_events\": " << stats.common_events << ",\n";
+		out << "\t\t\"bytes\": " << stats.bytes << "\n";
+		out << "\t},\n";
+
+		out << "\t\"results\": [";
+		for (size_t i = 0; i < results.size(); ++i) {
+			const auto& r = results[i];
+			std::vector<double> sorted = r.seconds;
+			std::sort(sorted.begin(), sorted.end());
+
+			out << (i > 0 ? "," : "") << "\n\t\t{\n";
+			out << "\t\t\t\"name\": \"" << Escape(r.name) << "\",\n";
+			out << "\t\t\t\"ok\": " << (r.ok ? "true" : "false") << ",\n";
+			out << "\t\t\t\"seconds\": [";
+			for (size_t s = 0; s < r.seconds.size(); ++s) {
+				out << (s > 0 ? ", " : "") << r.seconds[s];
+			}
+			out << "],\n";
+			if (sorted.empty()) {
+				out << "\t\t\t\"min\": null,\n\t\t\t\"median\": null\n";
+			} else {
+				out << "\t\t\t\"min\": " << sorted.front() << ",\n";
+				out << "\t\t\t\"median\": " << sorted[sorted.size() / 2] << "\n";
+			}
+			out << "\t\t}";
+		}
+		out << "\n\t],\n";
+
+		out << "\t\"skipped\": [";
+		for (size_t i = 0; i < skipped.size(); ++i) {
+			out << (i > 0 ? ", " : "") << "\"" << Escape(skipped[i]) << "\"";
+		}
+		out << "]\n";
+		out << "}\n";
+	}
+
+	void PrintUsage() {
+		std::cout << "Usage: tools_bench [ Options ] TOOL=PATH..." << std::endl;
+		std::cout << "Options:" << std::endl;
+		std::cout << "  -h, --help             This usage message" << std::endl;
+		std::cout << "  -o, --output <file>    JSON result file (default: \"bench.json\")" << std::endl;
+		std::cout << "  -w, --work <dir>       Directory of the corpus and the tool output" << std::endl;
+		std::cout << "                         (default: \"bench-work\")" << std::endl;
+		std::cout << "  -s, --scale <number>   Size of the corpus (default: 1)" << std::endl;
+		std::cout << "  -r, --rounds <number>  Runs of every benchmark (default: 3)" << std::endl << std::endl;
+		std::cout << "TOOL is one of lmu2png, png2xyz, xyz2png, gencache, xyzcrush, lcftrans" << std::endl;
+		std::cout << "and lcfviz. Benchmarks of tools without a path are skipped." << std::endl;
+	}
+
+	bool ParseNumber(const char* arg, int& value) {
+		std::istringstream iss(arg);
+		return (iss >> value) && value > 0;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	std::string output = "bench.json";
+	fs::path work = "bench-work";
+	int scale = 1;
+	int rounds = 3;
+	std::map<std::string, std::string> tools;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "-h" || arg == "--help") {
+			PrintUsage();
+			return EXIT_SUCCESS;
+		} else if ((arg == "-o" || arg == "--output") && has_value) {
+			output = argv[++i];
+		} else if ((arg == "-w" || arg == "--work") && has_value) {
+			work = argv[++i];
+		} else if ((arg == "-s" || arg == "--scale") && has_value) {
+			if (!ParseNumber(argv[++i], scale)) {
+				std::cerr << "--scale option needs a positive number argument." << std::endl;
+				return EXIT_FAILURE;
+			}
+		} else if ((arg == "-r" || arg == "--rounds") && has_value) {
+			if (!ParseNumber(argv[++i], rounds)) {
+				std::cerr << "--rounds option needs a positive number argument." << std::endl;
+				return EXIT_FAILURE;
+			}
+		} else if (size_t eq = arg.find('='); eq != std::string::npos && eq > 0) {
+			tools[arg.substr(0, eq)] = arg.substr(eq + 1);
+		} else {
+			std::cerr << "Invalid argument: \"" << arg << "\"" << std::endl;
+			PrintUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::error_code ec;
+	work = fs::absolute(work, ec);
+	fs::path game = work / "game";
+	fs::path game_translated = work / "game_translated";
+	fs::path out = work / "out";
+
+	// Written on every run, the corpus only depends on the options
+	Corpus::Stats stats;
+	std::string error;
+	Corpus::Options options;
+	options.scale = scale;
+	std::cout << "Generating corpus in " << work.string() << std::endl;
+	if (!Corpus::Generate(game.string(), options, stats, error)) {
+		std::cerr << error << std::endl;
+		return EXIT_FAILURE;
+	}
+	Corpus::Stats translated_stats;
+	options.translated = true;
+	if (!Corpus::Generate(game_translated.string(), options, translated_stats, error)) {
+		std::cerr << error << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// xyzcrush uses zopfli and is much slower than the others, it only gets a part of the pictures
+	std::vector<std::string> crush_files(stats.pictures.begin(),
+		stats.pictures.begin() + std::min<size_t>(stats.pictures.size(), 8 * scale));
+
+	std::vector<std::string> copied;
+	std::vector<std::string> pngs;
+	std::vector<Benchmark> benchmarks = {
+		{"xyz2png", "xyz2png",
+			[&]() { return CopyFiles(game, stats.xyz_files, out / "xyz2png", copied); },
+			{}, out / "xyz2png", true},
+		{"png2xyz", "png2xyz",
+			[&]() { return !pngs.empty() && CopyFiles(out / "xyz2png", pngs, out / "png2xyz", copied); },
+			{}, out / "png2xyz", true},
+		{"xyzcrush", "xyzcrush",
+			[&]() { return CopyFiles(game, crush_files, out / "xyzcrush", copied); },
+			{"-j", "0"}, out / "xyzcrush", true},
+		{"lmu2png", "lmu2png",
+			[&]() { return FreshDir(out / "lmu2png"); },
+			{"--no-cache", "-a", game.string(), "-o", (out / "lmu2png").string()}, {}},
+		{"gencache", "gencache",
+			[&]() { return FreshDir(out / "gencache"); },
+			{"-o", (out / "gencache" / "index.json").string(), game.string()}, {}},
+		{"lcftrans extract", "lcftrans",
+			[&]() { return FreshDir(out / "lcftrans"); },
+			{"-c", "-o", (out / "lcftrans").string(), game.string()}, {}},
+		{"lcftrans merge", "lcftrans",
+			// updates the translation of the last extract run
+			[&]() { std::error_code ec; return !fs::is_empty(out / "lcftrans", ec) && !ec; },
+			{"-u", "-o", (out / "lcftrans").string(), game.string()}, {}},
+		{"lcftrans match", "lcftrans",
+			[&]() { return FreshDir(out / "lcftrans_match"); },
+			{"-m", game_translated.string(), "-o", (out / "lcftrans_match").string(), game.string()}, {}},
+		{"lcfviz", "lcfviz",
+			[&]() { return FreshDir(out / "lcfviz"); },
+			{"-o", (out / "lcfviz" / "graph.dot").string(), game.string()}, {}}
+	};
+
+	std::vector<Result> results;
+	std::vector<std::string> skipped;
+	for (auto& bench : benchmarks) {
+		auto tool = tools.find(bench.tool);
+		if (tool == tools.end()) {
+			skipped.push_back(bench.name);
+			continue;
+		}
+
+		std::cout << "Running " << bench.name << std::flush;
+		Result result;
+		result.name = bench.name;
+		for (int round = 0; round < rounds && result.ok; ++round) {
+			if (!bench.setup()) {
+				result.ok = false;
+				break;
+			}
+
+			std::vector<std::string> args = bench.args;
+			if (bench.pass_files) {
+				args.insert(args.end(), copied.begin(), copied.end());
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			int status = Run(tool->second, args, bench.cwd, out / (bench.tool + ".log"));
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			if (status != 0) {
+				result.ok = false;
+			} else {
+				result.seconds.push_back(elapsed.count());
+			}
+			std::cout << "." << std::flush;
+		}
+		std::cout << (result.ok ? " done" : " failed, see " + (out / (bench.tool + ".log")).string()) << std::endl;
+
+		if (bench.name == "xyz2png" && result.ok) {
+			for (const auto& name : stats.xyz_files) {
+				pngs.push_back(fs::path(name).replace_extension(".png").filename().string());
+			}
+		}
+		results.push_back(result);
+	}
+
+	std::ofstream json(output, std::ios::trunc);
+	WriteJson(json, scale, rounds, stats, results, skipped);
+	if (!json) {
+		std::cerr << "Failed writing " << output << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Results written to " << output << std::endl;
+
+	bool ok = std::all_of(results.begin(), results.end(), [](const Result& r) { return r.ok; });
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
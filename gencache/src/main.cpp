@@ -16,16 +16,52 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <ctime>
+#include <cstdio>
 #include <nlohmann/json.hpp>
+#include <zlib.h>
+#include "stats.h"
+#ifdef HAVE_LCF
+#  include "prefetch.h"
+#endif
 
 using json = nlohmann::json;
 
 const icu::Normalizer2* icu_normalizer;
 const icu::Locale* icu_loc_invariant;
 
+Stats::Counter dirs_read_counter("directories read");
+Stats::Counter dirs_reused_counter("directories reused");
+Stats::Counter files_counter("files listed");
+Stats::Counter checksummed_counter("files checksummed");
+
+/* value of key when it has the type, fallback otherwise. Files of older or
+ * hand-edited runs cannot abort the scan, they are read again instead. */
+template <typename T>
+T checked_value(const json& obj, const char* key, const T& fallback) {
+	if (!obj.is_object()) {
+		return fallback;
+	}
+	auto it = obj.find(key);
+	if (it == obj.end()) {
+		return fallback;
+	}
+	try {
+		return it->get<T>();
+	} catch (const json::exception&) {
+		return fallback;
+	}
+}
+
 std::string strip_ext(const std::string& in_file) {
 	return in_file.substr(0, in_file.find_last_of("."));
 }
@@ -38,6 +74,15 @@ std::string basename(const std::string& in_file) {
 	return in_file.substr(pos + 1);
 }
 
+bool is_ascii(const std::string& in) {
+	for (unsigned char c : in) {
+		if (c >= 0x80) {
+			return false;
+		}
+	}
+	return true;
+}
+
 // utf16 woes
 #ifdef _WIN32
 #  define MYOPENDIR(dir) _wopendir(reinterpret_cast<const wchar_t*>( \
@@ -45,61 +90,536 @@ std::string basename(const std::string& in_file) {
 #  define MYDIRENT struct _wdirent
 #  define MYREADDIR _wreaddir
 #  define MYCLOSEDIR _wclosedir
+#  define MYSTAT(dir, buf) _wstat64(reinterpret_cast<const wchar_t*>( \
+			icu::UnicodeString::fromUTF8(dir).getTerminatedBuffer()), buf)
+#  define MYSTRUCTSTAT struct _stat64
+#  define MYFOPEN(file) _wfopen(reinterpret_cast<const wchar_t*>( \
+			icu::UnicodeString::fromUTF8(file).getTerminatedBuffer()), L"rb")
 #else
 #  define MYOPENDIR(dir) opendir(dir.c_str())
 #  define MYDIRENT struct dirent
 #  define MYREADDIR readdir
 #  define MYCLOSEDIR closedir
+#  define MYSTAT(dir, buf) stat(dir.c_str(), buf)
+#  define MYSTRUCTSTAT struct stat
+#  define MYFOPEN(file) fopen(file.c_str(), "rb")
 #endif
 
-json parse_dir_recursive(const std::string& path, const int depth, const bool first = false) {
-	json r;
-	UErrorCode icu_error = U_ZERO_ERROR;
+/* Writes JSON formatted like json::dump while the values are produced,
+ * the caller is responsible for the key order */
+class json_writer {
+public:
+	json_writer(std::ostream& out, int indent) : out(out), indent(indent) {}
+
+	void begin_object() { begin('{'); }
+	void end_object() { end('}'); }
+
+	void key(const std::string& k) {
+		element();
+		string(k);
+		out << (indent >= 0 ? ": " : ":");
+		after_key = true;
+	}
+
+	void value(const std::string& v) {
+		element();
+		string(v);
+	}
+
+	void value(const json& v) {
+		if (v.is_object()) {
+			begin_object();
+			for (const auto& item : v.items()) {
+				key(item.key());
+				value(item.value());
+			}
+			end_object();
+		} else if (v.is_array()) {
+			begin('[');
+			for (const auto& item : v) {
+				value(item);
+			}
+			end(']');
+		} else {
+			element();
+			out << v.dump();
+		}
+	}
+
+	void null() {
+		element();
+		out << "null";
+	}
+
+private:
+	/* separator and indentation before a key, or before a value that is no
+	 * object member */
+	void element() {
+		if (after_key) {
+			after_key = false;
+			return;
+		}
+		if (levels.empty()) {
+			return;
+		}
+		if (levels.back()) {
+			out << ',';
+		}
+		levels.back() = true;
+		newline(levels.size());
+	}
+
+	void begin(char c) {
+		element();
+		out << c;
+		levels.push_back(false);
+	}
+
+	void end(char c) {
+		if (levels.back()) {
+			newline(levels.size() - 1);
+		}
+		levels.pop_back();
+		out << c;
+	}
+
+	void newline(size_t level) {
+		if (indent >= 0) {
+			out << '\n' << std::string(level * indent, ' ');
+		}
+	}
+
+	void string(const std::string& s) {
+		/* names rarely need escaping */
+		for (unsigned char c : s) {
+			if (c < 0x20 || c == '"' || c == '\\' || c >= 0x80) {
+				out << json(s).dump();
+				return;
+			}
+		}
+		out << '"' << s << '"';
+	}
+
+	std::ostream& out;
+	int indent;
+	bool after_key = false;
+	std::vector<bool> levels; /* open objects and arrays, true after the first element */
+};
+
+/* Cache file, optionally with a gzip compressed copy next to it for web
+ * servers that deliver pre-compressed files */
+class cache_output : public std::streambuf {
+public:
+	bool open(const std::string& filename, bool gzip) {
+		file.open(filename);
+		if (!file) {
+			return false;
+		}
+		if (gzip) {
+			gz = gzopen((filename + ".gz").c_str(), "wb9");
+			if (gz == nullptr) {
+				return false;
+			}
+		}
+		setp(buffer, buffer + sizeof(buffer));
+		return true;
+	}
+
+	bool close() {
+		bool ok = flush();
+		file.close();
+		ok = ok && !file.fail();
+		if (gz != nullptr) {
+			ok = gzclose(gz) == Z_OK && ok;
+			gz = nullptr;
+		}
+		return ok;
+	}
+
+	~cache_output() {
+		if (gz != nullptr) {
+			gzclose(gz);
+		}
+	}
+
+protected:
+	int_type overflow(int_type c) override {
+		if (!flush()) {
+			return traits_type::eof();
+		}
+		if (!traits_type::eq_int_type(c, traits_type::eof())) {
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	int sync() override {
+		return flush() ? 0 : -1;
+	}
+
+private:
+	bool flush() {
+		const auto size = static_cast<unsigned>(pptr() - pbase());
+		setp(buffer, buffer + sizeof(buffer));
+		if (size == 0) {
+			return true;
+		}
+		file.write(buffer, size);
+		if (gz != nullptr && gzwrite(gz, buffer, size) != static_cast<int>(size)) {
+			return false;
+		}
+		return !file.fail();
+	}
+
+	std::ofstream file;
+	gzFile gz = nullptr;
+	char buffer[65536];
+};
+
+/* A directory with its entries in the order they were read */
+struct dir_entry {
+	std::string key;
+	std::string value;
+	int child = -1; /* index of the scanned subdirectory */
+	long long size = -1; /* with checksums, -1 when the file is unreadable */
+	long long mtime = 0;
+	uint32_t crc = 0;
+};
+
+/* Checksum of a listed file, keyed by the path relative to the game */
+struct file_info {
+	std::string rel;
+	const dir_entry* entry;
+};
 
-	/* do not recurse any further */
-	if (depth == 0)
+struct dir_node {
+	std::string path;
+	std::string rel; /* relative to the game directory, key of the fingerprint */
+	int depth = 0;
+	bool first = false;
+	const json* previous = nullptr; /* listing of the last run, may be nullptr */
+	bool opened = false;
+	bool reused = false;
+	json fingerprint = nullptr;
+	json hidden = json::object(); /* subdirectories missing in the listing */
+	std::vector<dir_entry> entries = {};
+};
+
+/* Scans directories on several threads. Reading the metadata of network
+ * storage is slow, so every subdirectory found becomes a new job.
+ *
+ * With the index of an earlier run a directory whose modification time and
+ * inode did not change gets its entries from the old listing. Changes in
+ * subdirectories do not touch the parent, so these are still checked. */
+class dir_scanner {
+public:
+	explicit dir_scanner(int jobs, const json* previous = nullptr, const json* fingerprints = nullptr) :
+		jobs(jobs), previous(previous), fingerprints(fingerprints), start(std::time(nullptr)) {}
+
+	void scan(const std::string& path, const int depth) {
+		nodes.push_back({ path, "", depth, true, previous });
+		if (depth > 0) {
+			pending.push_back(0);
+			outstanding = 1;
+
+			std::vector<std::thread> workers;
+			for (int i = 0; i < jobs; ++i) {
+				workers.emplace_back(&dir_scanner::work, this);
+			}
+			for (auto& t : workers) {
+				t.join();
+			}
+		}
+	}
+
+	/* the listing of the scan, frees it while writing */
+	void write(json_writer& out) {
+		write(out, 0);
+	}
+
+	/* for the next run, changes of the last seconds may still go unnoticed
+	 * with coarse timestamps, these directories are read again. Only complete
+	 * after the listing was written. */
+	json directory_fingerprints() const {
+		json r = json::object();
+		for (const auto& node : nodes) {
+			if (node.fingerprint.is_array() && node.fingerprint[0].get<long long>() + 2 < start) {
+				r[node.rel] = node.fingerprint;
+				if (!node.hidden.empty()) {
+					r[node.rel].push_back(node.hidden);
+				}
+			}
+		}
 		return r;
+	}
+
+	/* size, modification time and CRC32 of the listed files, the sums of
+	 * files with the same size and time as in the last run are kept */
+	void enable_checksums(const json* previous_files, std::time_t previous_time) {
+		checksums = true;
+		this->previous_files = previous_files;
+		this->previous_time = previous_time;
+	}
 
-	auto dir = MYOPENDIR(path);
-	if (dir != nullptr) {
-		if (!first) {
-			r["_dirname"] = basename(path);
+	/* after the listing, the entries are freed afterwards */
+	void write_checksums(json_writer& out) {
+		std::sort(files.begin(), files.end(), [](const file_info& a, const file_info& b) {
+			return a.rel < b.rel;
+		});
+		out.begin_object();
+		for (const auto& file : files) {
+			char crc[9];
+			snprintf(crc, sizeof(crc), "%08x", static_cast<unsigned>(file.entry->crc));
+			out.key(file.rel);
+			out.begin_object();
+			out.key("crc32");
+			out.value(std::string(crc));
+			out.key("mtime");
+			out.value(json(file.entry->mtime));
+			out.key("size");
+			out.value(json(file.entry->size));
+			out.end_object();
+		}
+		out.end_object();
+		files.clear();
+		for (auto& node : nodes) {
+			std::vector<dir_entry>().swap(node.entries);
 		}
+	}
+
+	std::time_t start_time() const {
+		return start;
+	}
+
+	int reused_count() const {
+		return static_cast<int>(std::count_if(nodes.begin(), nodes.end(),
+			[](const dir_node& node) { return node.reused; }));
+	}
+
+private:
+	void work() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			cv.wait(lock, [this] { return !pending.empty() || outstanding == 0; });
+			if (pending.empty()) {
+				return;
+			}
+			int index = pending.back();
+			pending.pop_back();
+
+			/* the deque keeps the node in place while others are added */
+			dir_node& node = nodes[index];
+			lock.unlock();
+			read_dir(node);
+			lock.lock();
+
+			if (--outstanding == 0) {
+				cv.notify_all();
+			}
+		}
+	}
+
+	void add_child(dir_node& node, const std::string& key, const std::string& dirname) {
+		dir_entry entry;
+		entry.key = key;
+
+		/* an old listing only belongs to the same directory name */
+		const json* old = nullptr;
+		if (node.previous != nullptr && node.previous->is_object()) {
+			auto it = node.previous->find(key);
+			if (it != node.previous->end() && it->is_object() && checked_value(*it, "_dirname", std::string()) == dirname) {
+				old = &*it;
+			}
+		}
+
+		std::string rel = node.rel.empty() ? dirname : node.rel + "/" + dirname;
+		std::lock_guard<std::mutex> lock(mutex);
+		entry.child = static_cast<int>(nodes.size());
+		nodes.push_back({ node.path + "/" + dirname, rel, node.depth - 1, false, old });
+		pending.push_back(entry.child);
+		++outstanding;
+		cv.notify_one();
+		node.entries.push_back(entry);
+	}
+
+	std::string rel_path(const dir_node& node, const std::string& name) const {
+		return node.rel.empty() ? name : node.rel + "/" + name;
+	}
+
+	void checksum(const dir_node& node, dir_entry& entry) {
+		const std::string path = node.path + "/" + entry.value;
+		MYSTRUCTSTAT info;
+		/* S_ISREG is missing on Windows */
+		if (MYSTAT(path, &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG) {
+			return;
+		}
+		entry.mtime = static_cast<long long>(info.st_mtime);
+
+		/* unchanged since the last run, with a margin for coarse timestamps */
+		if (previous_files != nullptr && entry.mtime + 2 < previous_time) {
+			auto it = previous_files->find(rel_path(node, entry.value));
+			json::const_iterator crc;
+			if (it != previous_files->end() && it->is_object() &&
+					(crc = it->find("crc32")) != it->end() && crc->is_string() &&
+					checked_value(*it, "size", -1LL) == static_cast<long long>(info.st_size) &&
+					checked_value(*it, "mtime", 0LL) == entry.mtime) {
+				entry.size = static_cast<long long>(info.st_size);
+				entry.crc = static_cast<uint32_t>(std::strtoul(crc->get_ref<const std::string&>().c_str(), nullptr, 16));
+				return;
+			}
+		}
+
+		Stats::Scope scope("checksum");
+		FILE* f = MYFOPEN(path);
+		if (f == nullptr) {
+			return;
+		}
+		checksummed_counter.Add();
+		std::vector<unsigned char> buffer(65536);
+		uLong crc = crc32(0L, Z_NULL, 0);
+		long long size = 0;
+		size_t len;
+		while ((len = fread(buffer.data(), 1, buffer.size(), f)) > 0) {
+			crc = crc32(crc, buffer.data(), static_cast<uInt>(len));
+			size += static_cast<long long>(len);
+		}
+		if (!ferror(f)) {
+			entry.size = size;
+			entry.crc = static_cast<uint32_t>(crc);
+		}
+		fclose(f);
+	}
+
+	bool reuse_dir(dir_node& node) {
+		MYSTRUCTSTAT info;
+		if (MYSTAT(node.path, &info) != 0) {
+			return false;
+		}
+		node.fingerprint = json::array({ static_cast<long long>(info.st_mtime),
+			static_cast<unsigned long long>(info.st_ino) });
+
+		if (node.previous == nullptr || !node.previous->is_object() || fingerprints == nullptr) {
+			return false;
+		}
+		/* anything unexpected counts as changed */
+		auto it = fingerprints->find(node.rel);
+		if (it == fingerprints->end() || !it->is_array() || it->size() < 2 ||
+				(*it)[0] != node.fingerprint[0] || (*it)[1] != node.fingerprint[1]) {
+			return false;
+		}
+
+		/* empty subdirectories are not in the listing but can get files
+		 * without changing this directory, when a file took their name
+		 * the merge order is unknown */
+		json hidden = it->size() > 2 ? (*it)[2] : json::object();
+		if (!hidden.is_object()) {
+			return false;
+		}
+		for (const auto& item : hidden.items()) {
+			if (!item.value().is_string() || node.previous->contains(item.key())) {
+				return false;
+			}
+		}
+
+		/* same entries as before, the listing was merged already */
+		node.opened = true;
+		node.reused = true;
+		dirs_reused_counter.Add();
+		for (const auto& item : node.previous->items()) {
+			if (item.key() == "_dirname") {
+				continue;
+			}
+			if (item.value().is_object()) {
+				if (node.depth > 1) {
+					add_child(node, item.key(), checked_value(item.value(), "_dirname", std::string()));
+				}
+			} else if (item.value().is_string()) {
+				dir_entry entry;
+				entry.key = item.key();
+				entry.value = item.value().get<std::string>();
+				if (checksums) {
+					checksum(node, entry);
+				}
+				files_counter.Add();
+				node.entries.push_back(entry);
+			}
+		}
+		if (node.depth > 1) {
+			for (const auto& item : hidden.items()) {
+				add_child(node, item.key(), item.value().get<std::string>());
+			}
+		}
+		return true;
+	}
+
+	void read_dir(dir_node& node) {
+		UErrorCode icu_error = U_ZERO_ERROR;
+
+		if (reuse_dir(node)) {
+			return;
+		}
+
+		auto dir = MYOPENDIR(node.path);
+		if (dir == nullptr) {
+			return;
+		}
+		node.opened = true;
+		dirs_read_counter.Add();
 
 		MYDIRENT* dent;
 		while ((dent = MYREADDIR(dir)) != nullptr) {
 			std::string dirname;
 			std::string lower_dirname;
-			icu::UnicodeString uni_lower_dirname;
 
-			/* unicode aware lowercase conversion */
 #ifdef _WIN32
 			icu::UnicodeString(dent->d_name).toUTF8String(dirname);
-			uni_lower_dirname = icu::UnicodeString(dent->d_name).toLower(*icu_loc_invariant);
 #else
 			dirname = std::string(dent->d_name);
-			uni_lower_dirname = icu::UnicodeString(dent->d_name, "utf-8").toLower(*icu_loc_invariant);
 #endif
-			/* normalization */
-			icu::UnicodeString normalized_dirname =
-				icu_normalizer->normalize(uni_lower_dirname, icu_error);
-			if (U_FAILURE(icu_error)) {
-				uni_lower_dirname.toUTF8String(lower_dirname);
-				std::cerr << "Failed to normalize \"" << lower_dirname << "\"! Using lowercase conversion." << std::endl;
+			if (is_ascii(dirname)) {
+				/* nearly all names, NFKC does not change them */
+				lower_dirname = dirname;
+				for (auto& c : lower_dirname) {
+					if (c >= 'A' && c <= 'Z') {
+						c += 'a' - 'A';
+					}
+				}
 			} else {
-				normalized_dirname.toUTF8String(lower_dirname);
+				/* unicode aware lowercase conversion */
+#ifdef _WIN32
+				icu::UnicodeString uni_lower_dirname = icu::UnicodeString(dent->d_name).toLower(*icu_loc_invariant);
+#else
+				icu::UnicodeString uni_lower_dirname = icu::UnicodeString(dent->d_name, "utf-8").toLower(*icu_loc_invariant);
+#endif
+				/* normalization, skipped when the name is known to be in NFKC */
+				bool normalized = icu_normalizer->quickCheck(uni_lower_dirname, icu_error) == UNORM_YES;
+				icu::UnicodeString normalized_dirname;
+				if (!normalized && U_SUCCESS(icu_error)) {
+					normalized_dirname = icu_normalizer->normalize(uni_lower_dirname, icu_error);
+				}
+				if (U_FAILURE(icu_error)) {
+					uni_lower_dirname.toUTF8String(lower_dirname);
+					std::lock_guard<std::mutex> lock(mutex);
+					std::cerr << "Failed to normalize \"" << lower_dirname << "\"! Using lowercase conversion." << std::endl;
+					icu_error = U_ZERO_ERROR;
+				} else if (normalized) {
+					uni_lower_dirname.toUTF8String(lower_dirname);
+				} else {
+					normalized_dirname.toUTF8String(lower_dirname);
+				}
 			}
 
 			if (dirname == "_dirname") {
+				std::lock_guard<std::mutex> lock(mutex);
 				std::cerr << "Skipping _dirname: File conflicts with reserved keyword!" << std::endl;
 				continue;
 			}
 
 			/* dig deeper, but skip upper and current directory */
 			if (dent->d_type == DT_DIR && dirname != ".." && dirname != ".") {
-				json temp = parse_dir_recursive(path + "/" + dirname, depth - 1);
-				if (!temp.empty()) {
-					r[lower_dirname] = temp;
+				if (node.depth > 1) {
+					add_child(node, lower_dirname, dirname);
 				}
 			}
 
@@ -117,23 +637,103 @@ json parse_dir_recursive(const std::string& path, const int depth, const bool fi
 
 			/* add files */
 			if (dent->d_type == DT_REG || dent->d_type == DT_LNK) {
-				if (first || keep_extension(lower_dirname)) {
+				dir_entry entry;
+				entry.value = dirname;
+				if (node.first || keep_extension(lower_dirname)) {
 					/* ExFont is a special file in the main directory, needs to be renamed */
 					if (strip_ext(lower_dirname) == "exfont") {
 						lower_dirname = "exfont";
 					}
 
-					r[lower_dirname] = dirname;
+					entry.key = lower_dirname;
 				} else {
-					r[strip_ext(lower_dirname)] = dirname;
+					entry.key = strip_ext(lower_dirname);
+				}
+				if (checksums) {
+					checksum(node, entry);
 				}
+				files_counter.Add();
+				node.entries.push_back(entry);
 			}
 		}
+		MYCLOSEDIR(dir);
 	}
-	MYCLOSEDIR(dir);
 
-	return r;
-}
+	/* merged in read order, later entries with the same name win like
+	 * in a sequential scan. Written while walking the tree, so only the
+	 * listing of a directory is sorted at a time. */
+	void write(json_writer& out, int index) {
+		dir_node& node = nodes[index];
+
+		dir_entry dirname_entry;
+		std::vector<const dir_entry*> sorted;
+		if (node.opened) {
+			if (!node.first) {
+				dirname_entry.key = "_dirname";
+				dirname_entry.value = basename(node.path);
+				sorted.push_back(&dirname_entry);
+			}
+			for (const auto& entry : node.entries) {
+				/* without a listing the subdirectory is left out */
+				if (entry.child < 0 || nodes[entry.child].opened) {
+					sorted.push_back(&entry);
+				}
+			}
+		}
+		if (sorted.empty()) {
+			out.null();
+			return;
+		}
+
+		auto by_key = [](const dir_entry* a, const dir_entry* b) { return a->key < b->key; };
+		std::stable_sort(sorted.begin(), sorted.end(), by_key);
+		auto winners = std::unique(sorted.rbegin(), sorted.rend(), [](const dir_entry* a, const dir_entry* b) {
+			return a->key == b->key;
+		});
+		sorted.erase(sorted.begin(), winners.base());
+
+		out.begin_object();
+		for (const dir_entry* entry : sorted) {
+			out.key(entry->key);
+			if (entry->child >= 0) {
+				write(out, entry->child);
+			} else {
+				out.value(entry->value);
+				if (entry->size >= 0) {
+					files.push_back({ rel_path(node, entry->value), entry });
+				}
+			}
+		}
+		out.end_object();
+
+		for (const auto& entry : node.entries) {
+			if (entry.child < 0) {
+				continue;
+			}
+			auto it = std::lower_bound(sorted.begin(), sorted.end(), &entry, by_key);
+			if (it == sorted.end() || *it != &entry) {
+				node.hidden[entry.key] = basename(nodes[entry.child].path);
+			}
+		}
+		if (!checksums) {
+			std::vector<dir_entry>().swap(node.entries);
+		}
+	}
+
+	int jobs;
+	const json* previous;
+	const json* fingerprints;
+	std::time_t start;
+	bool checksums = false;
+	const json* previous_files = nullptr;
+	std::time_t previous_time = 0;
+	std::vector<file_info> files;
+	std::deque<dir_node> nodes;
+	std::vector<int> pending;
+	int outstanding = 0;
+	std::mutex mutex;
+	std::condition_variable cv;
+};
 
 int main(int argc, const char* argv[]) {
 	struct stat path_info;
@@ -141,9 +741,16 @@ int main(int argc, const char* argv[]) {
 
 	/* defaults */
 	int recursion_depth = 4;
+	int jobs = 8;
 	bool pretty_print = false;
+	bool gzip = false;
+	bool checksums = false;
+	bool prefetch = false;
 	std::string path = ".";
 	std::string output = "index.json";
+	std::string update;
+	bool stats = false;
+	std::string trace_file;
 
 	/* parse command line arguments */
 	for (int i = 1; i < argc; ++i) {
@@ -156,11 +763,42 @@ int main(int argc, const char* argv[]) {
 			std::cout << "  -h, --help             This usage message" << std::endl;
 			std::cout << "  -p, --pretty           Pretty print the JSON contents" << std::endl;
 			std::cout << "  -o, --output <file>    Output file name (default: \"" << output << "\")" << std::endl;
-			std::cout << "  -r, --recurse <depth>  Recursion depth (default: " << std::to_string(recursion_depth) << ")" << std::endl << std::endl;
+			std::cout << "  -r, --recurse <depth>  Recursion depth (default: " << std::to_string(recursion_depth) << ")" << std::endl;
+			std::cout << "  -j, --jobs <number>    Directories read at the same time (default: " << std::to_string(jobs) << ")" << std::endl;
+			std::cout << "  -u, --update <file>    Only read directories that changed since this cache" << std::endl;
+			std::cout << "  -z, --gzip             Also write a gzip compressed copy (<file>.gz)" << std::endl;
+			std::cout << "  -c, --checksums        Add size, modification time and CRC32 of every file" << std::endl;
+#ifdef HAVE_LCF
+			std::cout << "      --prefetch         Add the assets and teleport targets of every map" << std::endl;
+#endif
+			std::cout << "      --stats            Print the time of each phase and the counters to stderr" << std::endl;
+			std::cout << "      --trace <file>     Write the phases as Chrome trace_event JSON to <file>" << std::endl << std::endl;
 			std::cout << "It uses the current directory if not given as argument." << std::endl;
+			std::cout << "Caches written with --update remember the directories, use the same" << std::endl;
+			std::cout << "file for the next run (e.g. -u index.json)." << std::endl;
 			return 0;
 		} else if ((arg == "--pretty") || (arg == "-p")) {
 			pretty_print = true;
+		} else if ((arg == "--gzip") || (arg == "-z")) {
+			gzip = true;
+		} else if ((arg == "--checksums") || (arg == "-c")) {
+			checksums = true;
+		} else if (arg == "--prefetch") {
+#ifdef HAVE_LCF
+			prefetch = true;
+#else
+			std::cerr << "--prefetch needs liblcf, gencache was built without it." << std::endl;
+			return 1;
+#endif
+		} else if (arg == "--stats") {
+			stats = true;
+		} else if (arg == "--trace") {
+			if (i + 1 < argc) {
+				trace_file = argv[++i];
+			} else {
+				std::cerr << "--trace without file name argument." << std::endl;
+				return 1;
+			}
 		} else if ((arg == "--output") || (arg == "-o")) {
 			if (i + 1 < argc) {
 				output = argv[++i];
@@ -179,6 +817,24 @@ int main(int argc, const char* argv[]) {
 				std::cerr << "--recurse without depth argument." << std::endl;
 				return 1;
 			}
+		} else if ((arg == "--jobs") || (arg == "-j")) {
+			if (i + 1 < argc) {
+				std::istringstream iss(argv[++i]);
+				if (!(iss >> jobs) || jobs < 1) {
+					std::cerr << "--jobs option needs a positive number argument." << std::endl;
+					return 1;
+				}
+			} else {
+				std::cerr << "--jobs without number argument." << std::endl;
+				return 1;
+			}
+		} else if ((arg == "--update") || (arg == "-u")) {
+			if (i + 1 < argc) {
+				update = argv[++i];
+			} else {
+				std::cerr << "--update without file name argument." << std::endl;
+				return 1;
+			}
 		} else {
 			if (path == ".") {
 				if (stat(arg.c_str(), &path_info) != 0) {
@@ -204,8 +860,58 @@ int main(int argc, const char* argv[]) {
 
 	icu_loc_invariant = &icu::Locale::getRoot();
 
+	Stats::Session stats_session(stats, trace_file);
+
+	/* listing of the last run, only trusted for the same depth */
+	json previous;
+	const json* previous_cache = nullptr;
+	const json* previous_dirs = nullptr;
+	if (!update.empty()) {
+		Stats::Scope scope("load previous");
+		std::ifstream previous_file(update);
+		if (previous_file) {
+			previous = json::parse(previous_file, nullptr, false);
+		}
+		if (previous.is_object() && previous.contains("cache") && previous.contains("metadata")) {
+			const json fingerprints = checked_value(previous["metadata"], "fingerprints", json::object());
+			if (checked_value(fingerprints, "depth", 0) == recursion_depth && fingerprints.contains("dirs") &&
+					previous["cache"].is_object() && fingerprints["dirs"].is_object()) {
+				previous_cache = &previous["cache"];
+				previous_dirs = &previous["metadata"]["fingerprints"]["dirs"];
+			}
+		}
+		if (previous_cache == nullptr) {
+			std::cerr << "No usable cache in \"" << update << "\", reading all directories." << std::endl;
+		}
+	}
+
 	/* get directory contents */
-	json cache = parse_dir_recursive(path, recursion_depth, true);
+	dir_scanner scanner(jobs, previous_cache, previous_dirs);
+	if (checksums) {
+		/* files are only read again when their size or time changed */
+		const json* previous_files = nullptr;
+		std::time_t previous_time = 0;
+		if (previous_dirs != nullptr && previous.contains("files")) {
+			previous_files = &previous["files"];
+			previous_time = checked_value(previous["metadata"]["fingerprints"], "time", 0LL);
+		}
+		scanner.enable_checksums(previous_files, previous_time);
+	}
+	{
+		Stats::Scope scope("scan");
+		scanner.scan(path, recursion_depth);
+	}
+	if (previous_cache != nullptr) {
+		std::cout << "Reused " << scanner.reused_count() << " unchanged directories." << std::endl;
+	}
+
+	/* manifest of the maps for the web player */
+	json prefetch_manifest;
+#ifdef HAVE_LCF
+	if (prefetch && !Prefetch::Build(path, jobs, prefetch_manifest)) {
+		return 1;
+	}
+#endif
 
 	std::time_t t = std::time(nullptr);
 	// trigraph ?-escapes
@@ -214,25 +920,52 @@ int main(int argc, const char* argv[]) {
 	if (std::strftime(datebuf, sizeof(datebuf), "%F", std::localtime(&t)))
 		date = std::string(datebuf);
 
+	/* write to cache file, keys sorted like json::dump */
+	cache_output cache_file;
+	if (!cache_file.open(output, gzip)) {
+		std::cerr << "Cannot write \"" << output << "\"" << (gzip ? " or its .gz copy" : "") << "!" << std::endl;
+		return 1;
+	}
+	Stats::Scope write_scope("write");
+	std::ostream cache_stream(&cache_file);
+	json_writer writer(cache_stream, pretty_print ? 2 : -1);
+	writer.begin_object();
+	writer.key("cache");
+	scanner.write(writer);
+	if (checksums) {
+		writer.key("files");
+		scanner.write_checksums(writer);
+	}
+
 	/* add metadata */
-	json out = {
-		{
-			"metadata", {
-				{ "version", 2 },
-				{ "date", date }
-			}
-		},
-		{
-			"cache", cache
-		}
+	json metadata = {
+		{ "version", 2 },
+		{ "date", date }
 	};
-
-	/* write to cache file */
-	std::ofstream cache_file;
-	cache_file.open(output);
-	cache_file << out.dump(pretty_print ? 2 : -1);
-	cache_file.close();
-	std::cout << "JSON cache has been written to \"" << output << "\"." << std::endl;
+	if (!update.empty()) {
+		metadata["fingerprints"] = {
+			{ "depth", recursion_depth },
+			{ "dirs", scanner.directory_fingerprints() },
+			{ "time", static_cast<long long>(scanner.start_time()) }
+		};
+	}
+	writer.key("metadata");
+	writer.value(metadata);
+	if (prefetch) {
+		writer.key("prefetch");
+		writer.value(prefetch_manifest);
+	}
+	writer.end_object();
+	if (!cache_file.close()) {
+		std::cerr << "Failed to write \"" << output << "\"!" << std::endl;
+		return 1;
+	}
+	write_scope.Stop();
+	std::cout << "JSON cache has been written to \"" << output << "\"";
+	if (gzip) {
+		std::cout << " and \"" << output << ".gz\"";
+	}
+	std::cout << "." << std::endl;
 
 	return 0;
 }
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2026 gencache authors
+ * This file is released under the ISC License
+ * https://opensource.org/licenses/ISC
+ */
+
+/* only built with liblcf, see HAVE_LCF in the build files */
+#ifdef HAVE_LCF
+
+#include "prefetch.h"
+
+#ifdef _WIN32
+#  include "dirent_win.h"
+#else
+#  include <dirent.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <lcf/reader_util.h>
+#include <lcf/ldb/reader.h>
+#include <lcf/lmt/reader.h>
+#include <lcf/lmu/reader.h>
+#include <lcf/rpg/eventcommand.h>
+#include "stats.h"
+
+using json = nlohmann::json;
+
+namespace {
+	Stats::Counter maps_counter("maps read");
+
+	/* assets of one map of the tree */
+	struct map_assets {
+		int id;
+		std::string file;
+		bool loaded = false;
+		std::string chipset;
+		std::set<std::string> charsets;
+		std::string panorama;
+		std::set<int> teleports;
+	};
+
+	std::string lowercase(std::string name) {
+		for (auto& c : name) {
+			if (c >= 'A' && c <= 'Z') {
+				c += 'a' - 'A';
+			}
+		}
+		return name;
+	}
+
+	std::string map_file(int id) {
+		char name[16];
+		snprintf(name, sizeof(name), "map%04d.lmu", id);
+		return name;
+	}
+
+	void read_map(const std::string& filename, const std::string& encoding,
+			const lcf::rpg::Database& db, map_assets& assets) {
+		Stats::Scope scope("lmu");
+		auto map = lcf::LMU_Reader::Load(filename, encoding);
+		if (!map) {
+			return;
+		}
+		maps_counter.Add();
+
+		if (map->chipset_id > 0 && map->chipset_id <= static_cast<int>(db.chipsets.size())) {
+			assets.chipset = lcf::ToString(db.chipsets[map->chipset_id - 1].chipset_name);
+		}
+		if (map->parallax_flag) {
+			assets.panorama = lcf::ToString(map->parallax_name);
+		}
+
+		/* every page, the player can switch to any of them on the map.
+		 * Teleport targets like in lcfviz, the first parameter is the map. */
+		constexpr auto teleport = static_cast<int32_t>(lcf::rpg::EventCommand::Code::Teleport);
+		for (const auto& ev : map->events) {
+			for (const auto& page : ev.pages) {
+				if (!page.character_name.empty()) {
+					assets.charsets.insert(lcf::ToString(page.character_name));
+				}
+				for (const auto& cmd : page.event_commands) {
+					if (cmd.code == teleport && !cmd.parameters.empty() && cmd.parameters[0] != assets.id) {
+						assets.teleports.insert(cmd.parameters[0]);
+					}
+				}
+			}
+		}
+		assets.loaded = true;
+	}
+}
+
+bool Prefetch::Build(const std::string& path, int jobs, json& manifest) {
+	Stats::Scope scope("prefetch");
+
+	/* lower case name -> name on disk, the first of duplicates wins */
+	std::vector<std::string> names;
+	DIR* dir = opendir(path.c_str());
+	if (dir == nullptr) {
+		std::cerr << "Cannot read \"" << path << "\" for the prefetch manifest!" << std::endl;
+		return false;
+	}
+	struct dirent* dent;
+	while ((dent = readdir(dir)) != nullptr) {
+		names.emplace_back(dent->d_name);
+	}
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+	std::unordered_map<std::string, std::string> files;
+	for (const auto& name : names) {
+		files.emplace(lowercase(name), path + "/" + name);
+	}
+
+	auto find = [&](const std::string& name) {
+		auto it = files.find(name);
+		return it != files.end() ? it->second : std::string();
+	};
+	const std::string ini_file = find("rpg_rt.ini");
+	const std::string database_file = find("rpg_rt.ldb");
+	const std::string maptree_file = find("rpg_rt.lmt");
+	if (database_file.empty() || maptree_file.empty()) {
+		std::cerr << "No RPG_RT.ldb and RPG_RT.lmt in \"" << path << "\", cannot write the prefetch manifest!" << std::endl;
+		return false;
+	}
+
+	/* names are stored in the codepage of the game, like lcfviz */
+	std::string encoding;
+	if (!ini_file.empty()) {
+		encoding = lcf::ReaderUtil::GetEncoding(ini_file);
+	}
+	auto db = lcf::LDB_Reader::Load(database_file, encoding);
+	if (db && encoding.empty()) {
+		encoding = lcf::ReaderUtil::DetectEncoding(*db);
+		db = lcf::LDB_Reader::Load(database_file, encoding);
+	}
+	if (!db) {
+		std::cerr << "Error loading database \"" << database_file << "\"!" << std::endl;
+		return false;
+	}
+	auto tree = lcf::LMT_Reader::Load(maptree_file, encoding);
+	if (!tree) {
+		std::cerr << "Error loading map tree \"" << maptree_file << "\"!" << std::endl;
+		return false;
+	}
+
+	/* only the maps of the tree, areas have no file */
+	std::vector<map_assets> maps;
+	for (const auto& info : tree->maps) {
+		if (info.type != lcf::rpg::TreeMap::MapType_map) {
+			continue;
+		}
+		std::string file = find(map_file(info.ID));
+		if (!file.empty()) {
+			maps.push_back({ info.ID, file });
+		}
+	}
+
+	/* the maps are independent, they are read on several threads */
+	std::atomic<size_t> next_map{0};
+	auto worker = [&]() {
+		for (size_t i = next_map++; i < maps.size(); i = next_map++) {
+			read_map(maps[i].file, encoding, *db, maps[i]);
+		}
+	};
+	jobs = std::max<int>(1, std::min<size_t>(jobs, maps.size()));
+	std::vector<std::thread> workers;
+	for (int i = 1; i < jobs; ++i) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	json entries = json::object();
+	for (const auto& assets : maps) {
+		if (!assets.loaded) {
+			std::cerr << "Error loading map \"" << assets.file << "\", it is not in the prefetch manifest." << std::endl;
+			continue;
+		}
+		json entry = {
+			{ "charsets", assets.charsets },
+			{ "teleports", assets.teleports }
+		};
+		if (!assets.chipset.empty()) {
+			entry["chipset"] = assets.chipset;
+		}
+		if (!assets.panorama.empty()) {
+			entry["panorama"] = assets.panorama;
+		}
+		entries[std::to_string(assets.id)] = std::move(entry);
+	}
+
+	manifest = {
+		{ "start", tree->start.party_map_id },
+		{ "maps", std::move(entries) }
+	};
+	return true;
+}
+
+#endif
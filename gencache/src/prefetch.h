@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2026 gencache authors
+ * This file is released under the ISC License
+ * https://opensource.org/licenses/ISC
+ */
+
+#ifndef GENCACHE_PREFETCH_H
+#define GENCACHE_PREFETCH_H
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+namespace Prefetch {
+	/**
+	 * Reads the database, the map tree and the maps of the game in path and
+	 * collects what every map of the tree is drawn with: the chipset, the
+	 * charsets of all event pages and the panorama, next to the maps the
+	 * teleport commands lead to. With the teleports the player knows which
+	 * assets the next maps need and can fetch them before the first use.
+	 *
+	 * The manifest is { "start": ID, "maps": { "ID": { "chipset": name,
+	 * "charsets": [names], "panorama": name, "teleports": [IDs] } } },
+	 * names are the ones of the database and the maps, not file names.
+	 *
+	 * @param path game directory
+	 * @param jobs maps read at the same time
+	 * @param manifest receives the manifest
+	 * @return false when the database or the map tree cannot be read
+	 */
+	bool Build(const std::string& path, int jobs, nlohmann::json& manifest);
+}
+
+#endif
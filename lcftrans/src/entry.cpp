@@ -7,37 +7,36 @@
 #include "entry.h"
 #include "utils.h"
 
-#include <ostream>
-#include <sstream>
-
-static void write_n(std::ostream& out, const std::vector<std::string>& lines, const std::string& prefix) {
-	std::string first_line;
-	if (!lines.empty()) {
-		first_line = Utils::Escape(lines[0]);
-	}
-
+static void write_n(std::string& out, const std::vector<std::string>& lines, const std::string& prefix) {
+	out += prefix;
 	if (lines.size() <= 1) {
-		out << prefix << " \"" << first_line << "\"\n";
+		out += " \"";
+		if (!lines.empty()) {
+			Utils::AppendEscaped(out, lines[0]);
+		}
+		out += "\"\n";
 	} else {
-		std::stringstream ss(first_line);
-		out << prefix << " \"\"\n";
+		out += " \"\"\n";
 
 		bool write_n = false;
 		for (const auto& line: lines) {
 			if (write_n) {
-				out << "\\n\"\n";
+				out += "\\n\"\n";
 			}
 
-			out << "\"" <<  Utils::Escape(line);
+			out += '"';
+			Utils::AppendEscaped(out, line);
 			write_n = true;
 		}
-		out << "\"\n";
+		out += "\"\n";
 	}
 }
 
-void Entry::write(std::ostream& out) const {
+void Entry::write(std::string& out) const {
 	if (!context.empty()) {
-		out << "msgctxt \"" << context << "\"" << std::endl;
+		out += "msgctxt \"";
+		out += context;
+		out += "\"\n";
 	}
 
 	write_n(out, original, "msgid");
@@ -19,7 +19,8 @@ public:
 	std::string location; // #: // Unused, maybe useful later
 	bool fuzzy = false; // When true write a "#, fuzzy" marker
 
-	void write(std::ostream& out) const;
+	// Appends msgctxt, msgid and msgstr
+	void write(std::string& out) const;
 
 	bool hasTranslation() const;
 };
@@ -4,15 +4,25 @@
  * http://opensource.org/licenses/MIT
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <lcf/encoder.h>
 #include <lcf/reader_util.h>
 #include <lcf/ldb/reader.h>
 #include <argparse.hpp>
 
+#include "manifest.h"
+#include "mapcache.h"
+#include "stats.h"
 #include "translation.h"
+#include "translationmemory.h"
 #include "utils.h"
 
 #ifdef _WIN32
@@ -25,9 +35,9 @@
 #define MAPTREE_FILE "rpg_rt.lmt"
 #define INI_FILE "rpg_rt.ini"
 
-void DumpLdb(const std::string& filename);
-void DumpLmu(const std::string& filename);
-void DumpLmt(const std::string& filename);
+void DumpLdb(const std::string& filename, std::ostream& log, int order);
+void DumpLmu(const std::string& filename, std::ostream& log, int order);
+void DumpLmt(const std::string& filename, std::ostream& log, int order);
 int MatchMode();
 
 namespace {
@@ -37,6 +47,21 @@ namespace {
 	std::vector<std::pair<std::string, std::string>> outdir_files;
 	std::string ini_file, database_file;
 	bool create, update, match = false;
+	int jobs = 0;
+	std::string memory_file;
+	TranslationMemory memory;
+	std::string cache_dir;
+	bool stats = false;
+	std::string trace_file;
+	bool force = false;
+	Manifest last_manifest;
+	std::vector<Manifest::Record> records;
+
+	Stats::Counter maps_counter("maps parsed");
+	Stats::Counter cache_hits_counter("map cache hits");
+	Stats::Counter terms_counter("terms written");
+	Stats::Counter up_to_date_counter("files up to date");
+	Stats::Counter unchanged_counter("po files unchanged");
 }
 
 int main(int argc, char** argv) {
@@ -66,6 +91,23 @@ int main(int argc, char** argv) {
 		.help("When not specified, is read from RPG_RT.ini or auto-detected");
 	cli.add_argument("-o", "--output").store_into(outdir).metavar("OUTDIR")
 		.help("Output directory (default: working directory)");
+	cli.add_argument("-t", "--memory").store_into(memory_file).metavar("FILE")
+		.help("Translation memory (PO file) shared between runs and games.\n"
+			"Fills terms without translation and learns the translations\n"
+			"of updated files. Created when missing.");
+	cli.add_argument("-j", "--jobs").store_into(jobs).metavar("N")
+		.help("Number of files processed at the same time (defaults to\n"
+			"the number of processors)");
+	cli.add_argument("--cache-dir").store_into(cache_dir).metavar("DIR")
+		.help("Keep the terms of the maps in DIR, unchanged maps are not\n"
+			"parsed again. Can be shared with lcfviz.");
+	cli.add_argument("-f", "--force").store_into(force)
+		.help("With --update, also process the files that are unchanged\n"
+			"since the last run, according to the manifest in OUTDIR");
+	cli.add_argument("--stats").store_into(stats)
+		.help("Print the time of each phase and the counters to stderr");
+	cli.add_argument("--trace").store_into(trace_file).metavar("FILE")
+		.help("Write the phases as Chrome trace_event JSON to FILE");
 	// for old encoding argument
 	cli.add_argument("additional").remaining().hidden();
 
@@ -90,12 +132,26 @@ int main(int argc, char** argv) {
 		}
 	}
 
+	if (jobs < 0) {
+		std::cerr << "--jobs: Invalid number of jobs.\n";
+		std::cerr << cli.usage() << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	if (match && !memory_file.empty()) {
+		std::cerr << "--memory: Not allowed together with --match.\n";
+		std::cerr << cli.usage() << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+
 	if (outdir == merge_indir) {
 		std::cerr << "You need to specify a different output directory (-o).\n";
 		std::cerr << cli;
 		std::exit(EXIT_FAILURE);
 	}
 
+	Stats::Session stats_session(stats, trace_file);
+
 	auto full_path = [&](const auto& name) {
 		return indir + "/" + name;
 	};
@@ -178,29 +234,135 @@ int main(int argc, char** argv) {
 	std::cout << "LcfTrans\n";
 	std::cout << "Using encoding " << encoding << "\n";
 
+	if (!memory_file.empty()) {
+		if (memory.load(memory_file)) {
+			std::cout << "Using translation memory " << memory_file << " (" << memory.size() << " terms)\n";
+		} else {
+			std::cout << "Creating translation memory " << memory_file << "\n";
+		}
+	}
+
+	// a different encoding or memory gives different PO files. The memory
+	// is recorded as saved, another run or game changed it when it differs.
+	auto manifest_settings = [&]() {
+		std::string settings = "encoding=" + encoding;
+		if (!memory_file.empty()) {
+			Manifest::FileState memory_state;
+			Manifest::readState(memory_file, memory_state);
+			settings += "\tmemory=" + std::to_string(memory_state.hash);
+		}
+		return settings;
+	};
+	const std::string manifest_file = outdir + "/" + Manifest::filename;
+	if (update && !force) {
+		last_manifest.load(manifest_file, manifest_settings());
+	}
+
 	std::sort(source_files.begin(), source_files.end(), [](const auto& a, const auto& b) {
 		return a.first < b.first;
 	});
 
-	for (const auto& s : source_files) {
-		const auto& name = s.first;
-		const auto& lname = s.second;
-
-		if (lname == DATABASE_FILE) {
-			std::cout << "Parsing Database " << name << "\n";
-			DumpLdb(full_path(name));
-		} else if (lname == MAPTREE_FILE) {
-			std::cout << "Parsing Maptree " << name << "\n";
-			DumpLmt(full_path(name));
-		} else if (Utils::HasExt(lname, ".lmu")) {
-			std::cout << "Parsing Map " << name << "\n";
-			DumpLmu(full_path(name));
+	// Every file is independent, the messages are buffered to print them in order
+	source_files.erase(std::remove_if(source_files.begin(), source_files.end(), [](const auto& s) {
+		return s.second != DATABASE_FILE && s.second != MAPTREE_FILE && !Utils::HasExt(s.second, ".lmu");
+	}), source_files.end());
+
+	records.resize(source_files.size());
+	std::vector<std::string> logs(source_files.size());
+	std::vector<bool> done(source_files.size());
+	size_t next_log = 0;
+	std::mutex log_mutex;
+
+	std::atomic<size_t> next_file{0};
+	auto worker = [&]() {
+		for (size_t i = next_file++; i < source_files.size(); i = next_file++) {
+			const auto& name = source_files[i].first;
+			const auto& lname = source_files[i].second;
+			std::ostringstream log;
+
+			// unchanged game files with untouched PO files give the same PO files again
+			Manifest::Record& record = records[i];
+			record.name = name;
+			const Manifest::Record* last = last_manifest.find(name);
+			bool skip = last && Manifest::upToDate(*last, full_path(name), outdir, record);
+			if (!last && !Manifest::readState(full_path(name), record.source)) {
+				record.name.clear();
+			}
+
+			if (skip) {
+				log << "Skipping " << name << ", unchanged since the last run\n";
+				up_to_date_counter.Add();
+			} else if (lname == DATABASE_FILE) {
+				log << "Parsing Database " << name << "\n";
+				DumpLdb(full_path(name), log, static_cast<int>(i));
+			} else if (lname == MAPTREE_FILE) {
+				log << "Parsing Maptree " << name << "\n";
+				DumpLmt(full_path(name), log, static_cast<int>(i));
+			} else {
+				log << "Parsing Map " << name << "\n";
+				DumpLmu(full_path(name), log, static_cast<int>(i));
+			}
+
+			std::lock_guard<std::mutex> lock(log_mutex);
+			logs[i] = log.str();
+			done[i] = true;
+			for (; next_log < done.size() && done[next_log]; ++next_log) {
+				std::cout << logs[next_log] << std::flush;
+				logs[next_log].clear();
+			}
+		}
+	};
+
+	if (jobs == 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+	jobs = std::max<int>(1, std::min<size_t>(jobs, source_files.size()));
+
+	std::vector<std::thread> workers;
+	for (int i = 1; i < jobs; i++) {
+		workers.emplace_back(worker);
+	}
+	// the main thread parses as well
+	worker();
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	if (!memory_file.empty()) {
+		if (!memory.save(memory_file)) {
+			std::cerr << "Failed writing translation memory " << memory_file << "\n";
+			return 1;
 		}
+		std::cout << "Translation memory " << memory_file << " has " << memory.size() << " terms\n";
+	}
+
+	// files that could not be read are processed again by the next run
+	records.erase(std::remove_if(records.begin(), records.end(), [](const auto& r) {
+		return r.name.empty();
+	}), records.end());
+	Manifest manifest;
+	manifest.assign(std::move(records));
+	if (!manifest.save(manifest_file, manifest_settings())) {
+		std::cerr << "Failed writing manifest " << manifest_file << "\n";
+		return 1;
 	}
 
 	return 0;
 }
 
+// Learns the translations of the output PO, then fills the remaining terms
+static void use_memory(Translation& t, std::ostream& log, int order) {
+	if (memory_file.empty()) {
+		return;
+	}
+
+	memory.add(t, order);
+	int filled = t.Fill(memory);
+	if (filled > 0) {
+		log << " " << filled << (filled == 1 ? " term" : " terms") << " from the translation memory\n";
+	}
+}
+
 static std::string get_outdir_file(const std::string& file) {
 	for (const auto& f : outdir_files) {
 		if (f.second == file) {
@@ -210,83 +372,137 @@ static std::string get_outdir_file(const std::string& file) {
 	return "";
 }
 
-void DumpLdb(const std::string& filename) {
-	TranslationLdb t = Translation::fromLDB(filename, encoding);
+// Reads the existing PO of the output directory
+static Translation read_po(const std::string& filename) {
+	Stats::Scope scope("po read");
+	return Translation::fromPO(filename);
+}
+
+// Writes a PO of the output directory, an unchanged file is not touched.
+// The file is recorded in the manifest entry of the game file order.
+static void write_po(Translation& t, const std::string& name, int order = -1) {
+	Stats::Scope scope("po write");
+	const std::string filename = outdir + "/" + name;
+	std::ostringstream out;
+	t.write(out);
+	const std::string data = out.str();
+	terms_counter.Add(t.getEntries().size());
+
+	std::ifstream infile(filename);
+	if (infile && std::string{std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>()} == data) {
+		unchanged_counter.Add();
+	} else {
+		infile.close();
+		std::ofstream outfile(filename);
+		outfile << data;
+	}
+
+	if (order >= 0 && !records[order].name.empty()) {
+		Manifest::FileState state;
+		if (Manifest::readState(filename, state)) {
+			records[order].outputs.emplace_back(name, state);
+		} else {
+			records[order].name.clear();
+		}
+	}
+}
+
+void DumpLdb(const std::string& filename, std::ostream& log, int order) {
+	TranslationLdb t;
+	{
+		Stats::Scope scope("ldb");
+		t = Translation::fromLDB(filename, encoding);
+	}
 
-	auto dump = [](Translation& ti, const std::string& poname) {
+	auto dump = [&log, order](Translation& ti, const std::string& poname) {
 		if (update) {
 			std::string po = get_outdir_file(Utils::LowerCase(poname + ".po"));
 			if (!po.empty()) {
 				Translation pot;
-				pot = Translation::fromPO(outdir + "/" + po);
+				pot = read_po(outdir + "/" + po);
 				auto stale = ti.Merge(pot);
 				if (!stale.getEntries().empty()) {
 					std::string term = stale.getEntries().size() == 1 ? " term is " : " terms are ";
 
-					std::cout << " " << stale.getEntries().size() << term << "stale\n";
-					std::ofstream outfile(outdir + "/" + poname + ".stale.po");
-					stale.write(outfile);
+					log << " " << stale.getEntries().size() << term << "stale\n";
+					write_po(stale, poname + ".stale.po", order);
 				}
 			}
 		}
+		use_memory(ti, log, order);
 
-		std::ofstream outfile(outdir + "/" + poname + ".po");
-		ti.write(outfile);
+		write_po(ti, poname + ".po", order);
 	};
 
 	auto term = [](const Translation& t) {
 		return std::to_string(t.getEntries().size()) + " " + (t.getEntries().size() == 1 ? "term " : "terms ");
 	};
 
-	std::cout << " " << term(t.terms) << "in the database\n";
+	log << " " << term(t.terms) << "in the database\n";
 	dump(t.terms, "RPG_RT.ldb");
 
-	std::cout << " " << term(t.common_events) << "in Common Events\n";
+	log << " " << term(t.common_events) << "in Common Events\n";
 	dump(t.common_events, "RPG_RT.ldb.common");
 
-	std::cout << " " << term(t.battle_events) << "in Battle Events\n";
+	log << " " << term(t.battle_events) << "in Battle Events\n";
 	dump(t.battle_events, "RPG_RT.ldb.battle");
 }
 
-void DumpLmuLmtInner(const std::string& filename, Translation& t, const std::string& poname) {
+void DumpLmuLmtInner(const std::string& filename, Translation& t, const std::string& poname, std::ostream& log, int order) {
 	(void)filename;
 
 	Translation pot;
 
 	if (t.getEntries().empty()) {
-		std::cout << " Skipped. No terms found.\n";
+		log << " Skipped. No terms found.\n";
 		return;
 	}
 
-	std::cout << " " << t.getEntries().size() << " term" << (t.getEntries().size() == 1 ? "" : "s") << "\n";
+	log << " " << t.getEntries().size() << " term" << (t.getEntries().size() == 1 ? "" : "s") << "\n";
 
 	if (update) {
 		std::string po = get_outdir_file(Utils::LowerCase(poname + ".po"));
 		if (!po.empty()) {
-			pot = Translation::fromPO(outdir + "/" + po);
+			pot = read_po(outdir + "/" + po);
 			auto stale = t.Merge(pot);
 			if (!stale.getEntries().empty()) {
 				std::string term = stale.getEntries().size() == 1 ? " term is " : " terms are ";
-				std::cout << " " << stale.getEntries().size() << term << "stale\n";
-				std::ofstream outfile(outdir + "/" + poname + ".stale.po");
-				stale.write(outfile);
+				log << " " << stale.getEntries().size() << term << "stale\n";
+				write_po(stale, poname + ".stale.po", order);
 			}
 		}
 	}
+	use_memory(t, log, order);
 
-	std::ofstream outfile(outdir + "/" + poname + ".po");
-
-	t.write(outfile);
+	write_po(t, poname + ".po", order);
 }
 
-void DumpLmu(const std::string& filename) {
-	Translation t = Translation::fromLMU(filename, encoding);
-	DumpLmuLmtInner(filename, t, Utils::GetFilename(filename));
+void DumpLmu(const std::string& filename, std::ostream& log, int order) {
+	Translation t;
+	std::string key;
+	if (!cache_dir.empty()) {
+		key = MapCache::Key(filename, encoding);
+	}
+	if (!key.empty() && MapCache::Load(cache_dir, key, t)) {
+		cache_hits_counter.Add();
+	} else {
+		Stats::Scope scope("lmu");
+		t = Translation::fromLMU(filename, encoding);
+		maps_counter.Add();
+		if (!key.empty() && !MapCache::Save(cache_dir, key, t)) {
+			log << " Failed writing map cache " << cache_dir << "\n";
+		}
+	}
+	DumpLmuLmtInner(filename, t, Utils::GetFilename(filename), log, order);
 }
 
-void DumpLmt(const std::string& filename) {
-	Translation t = Translation::fromLMT(filename, encoding);
-	DumpLmuLmtInner(filename, t, "RPG_RT.lmt");
+void DumpLmt(const std::string& filename, std::ostream& log, int order) {
+	Translation t;
+	{
+		Stats::Scope scope("lmt");
+		t = Translation::fromLMT(filename, encoding);
+	}
+	DumpLmuLmtInner(filename, t, "RPG_RT.lmt", log, order);
 }
 
 int MatchMode() {
@@ -311,10 +527,14 @@ int MatchMode() {
 
 		for (const auto& o : outdir_files) {
 			if (s.second == o.second) {
-				Translation src_po = Translation::fromPO(merge_indir + "/" + s.first);
-				Translation dst_po = Translation::fromPO( indir + "/" + o.first);
+				Translation src_po = read_po(merge_indir + "/" + s.first);
+				Translation dst_po = read_po(indir + "/" + o.first);
 				int matched;
-				auto stale = dst_po.Match(src_po, matched);
+				Translation stale;
+				{
+					Stats::Scope scope("match");
+					stale = dst_po.Match(src_po, matched);
+				}
 				std::cout << "Matching " << o.first << "\n";
 				std::cout << " " << matched << " term" << (matched != 1 ? "s" : "") << " matched\n";
 
@@ -332,11 +552,9 @@ int MatchMode() {
 				if (!stale.getEntries().empty()) {
 					std::string term = stale.getEntries().size() == 1 ? " term is " : " terms are ";
 					std::cout << " " << stale.getEntries().size() << term << "unmatched\n";
-					std::ofstream outfile(outdir + "/" + o.first.substr(0, o.first.size() - 3) + ".unmatched.po");
-					stale.write(outfile);
+					write_po(stale, o.first.substr(0, o.first.size() - 3) + ".unmatched.po");
 				}
-				std::ofstream outfile(outdir + "/" + o.first);
-				dst_po.write(outfile);
+				write_po(dst_po, o.first);
 				continue;
 			}
 		}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2020 LcfTrans authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#include "manifest.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string_view>
+
+#include "utils.h"
+
+namespace {
+	// Incremented when the format or the PO output changes
+	constexpr const char* manifest_header = "lcftrans-manifest 1";
+
+	void WriteState(std::ostream& out, const char* type, const std::string& name, const Manifest::FileState& state) {
+		char hex[17];
+		snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(state.hash));
+		out << type << "\t" << name << "\t" << state.size << "\t" << state.mtime << "\t" << hex << "\n";
+	}
+
+	bool ReadState(std::string_view line, std::string& type, std::string& name, Manifest::FileState& state) {
+		auto fields = Utils::Split(line, '\t');
+		if (fields.size() != 5) {
+			return false;
+		}
+		type = fields[0];
+		name = fields[1];
+		std::istringstream iss(fields[2] + " " + fields[3] + " " + fields[4]);
+		return static_cast<bool>(iss >> state.size >> state.mtime >> std::hex >> state.hash);
+	}
+}
+
+bool Manifest::readState(const std::string& filename, FileState& state, const FileState* known) {
+	std::error_code ec;
+	auto size = std::filesystem::file_size(filename, ec);
+	if (ec) {
+		return false;
+	}
+	auto mtime = std::filesystem::last_write_time(filename, ec);
+	if (ec) {
+		return false;
+	}
+
+	state.size = size;
+	state.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+	if (known && known->size == state.size && known->mtime == state.mtime) {
+		state.hash = known->hash;
+		return true;
+	}
+
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) {
+		return false;
+	}
+	std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : data) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	state.hash = hash;
+	// the hash is of the data read, even when the file changed meanwhile
+	state.size = data.size();
+	return true;
+}
+
+bool Manifest::load(const std::string& filename, const std::string& settings) {
+	assign({});
+
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) {
+		return false;
+	}
+	std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+	std::string_view view = data;
+
+	std::string_view line;
+	if (!Utils::ReadLine(view, line) || line != manifest_header ||
+		!Utils::ReadLine(view, line) || line != "settings\t" + settings) {
+		return false;
+	}
+
+	std::vector<Record> loaded;
+	while (Utils::ReadLine(view, line)) {
+		std::string type, name;
+		FileState state;
+		if (!ReadState(line, type, name, state)) {
+			return false;
+		}
+		if (type == "source") {
+			loaded.push_back({ name, state, {} });
+		} else if (type == "output" && !loaded.empty()) {
+			loaded.back().outputs.emplace_back(name, state);
+		} else {
+			return false;
+		}
+	}
+
+	assign(std::move(loaded));
+	return true;
+}
+
+bool Manifest::save(const std::string& filename, const std::string& settings) const {
+	std::ostringstream out;
+	out << manifest_header << "\n";
+	out << "settings\t" << settings << "\n";
+	for (const auto& r : records) {
+		WriteState(out, "source", r.name, r.source);
+		for (const auto& o : r.outputs) {
+			WriteState(out, "output", o.first, o.second);
+		}
+	}
+	std::string data = out.str();
+
+	{
+		std::ifstream in(filename, std::ios::binary);
+		if (in && std::string{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()} == data) {
+			return true;
+		}
+	}
+
+	// write to a temporary file first, like the map cache
+	std::error_code ec;
+	std::string tmp_name = filename + "." + std::to_string(std::random_device{}()) + ".tmp";
+	std::ofstream tmp(tmp_name, std::ios::binary);
+	if (!tmp) {
+		return false;
+	}
+	tmp.write(data.data(), data.size());
+	tmp.close();
+
+	if (!tmp) {
+		std::filesystem::remove(tmp_name, ec);
+		return false;
+	}
+	std::filesystem::rename(tmp_name, filename, ec);
+	if (ec) {
+		std::filesystem::remove(tmp_name, ec);
+		return false;
+	}
+	return true;
+}
+
+const Manifest::Record* Manifest::find(const std::string& name) const {
+	auto it = index.find(name);
+	return it == index.end() ? nullptr : &records[it->second];
+}
+
+bool Manifest::upToDate(const Record& last, const std::string& source_file,
+		const std::string& outdir, Record& current) {
+	current.name = last.name;
+	current.outputs.clear();
+	if (!readState(source_file, current.source, &last.source) ||
+		current.source.size != last.source.size || current.source.hash != last.source.hash) {
+		return false;
+	}
+
+	// a PO edited by the translator is merged again
+	std::vector<std::pair<std::string, FileState>> outputs;
+	for (const auto& o : last.outputs) {
+		FileState state;
+		if (!readState(outdir + "/" + o.first, state, &o.second) ||
+			state.size != o.second.size || state.hash != o.second.hash) {
+			return false;
+		}
+		outputs.emplace_back(o.first, state);
+	}
+
+	current.outputs = std::move(outputs);
+	return true;
+}
+
+void Manifest::assign(std::vector<Record> records) {
+	this->records = std::move(records);
+	index.clear();
+	for (size_t i = 0; i < this->records.size(); ++i) {
+		index[this->records[i].name] = i;
+	}
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2020 LcfTrans authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#ifndef LCFTRANS_MANIFEST
+#define LCFTRANS_MANIFEST
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Fingerprints of the game files and of the PO files written from them,
+ * kept in the output directory. A game file that is unchanged since the
+ * last run, with PO files nobody touched since, gives the same PO files
+ * again and is skipped by --update.
+ */
+class Manifest {
+public:
+	/** Size, modification time and 64 bit FNV-1a hash of a file. */
+	struct FileState {
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		uint64_t hash = 0;
+	};
+
+	/** A game file and the PO files written from it. */
+	struct Record {
+		std::string name;
+		FileState source;
+		std::vector<std::pair<std::string, FileState>> outputs;
+	};
+
+	/** Name of the manifest in the output directory */
+	static constexpr const char* filename = ".lcftrans-manifest";
+
+	/**
+	 * Reads the state of a file. The hash of known is reused when the size
+	 * and the modification time are unchanged, the file is not read then.
+	 * @return false when the file is not readable
+	 */
+	static bool readState(const std::string& filename, FileState& state, const FileState* known = nullptr);
+
+	/**
+	 * @param filename Manifest file
+	 * @param settings Settings of the run, a manifest of other settings is empty
+	 * @return false when there is no manifest with these settings
+	 */
+	bool load(const std::string& filename, const std::string& settings);
+
+	/**
+	 * Writes the manifest when it differs from the file.
+	 * @return false on write errors
+	 */
+	bool save(const std::string& filename, const std::string& settings) const;
+
+	/** @return Record of a game file or nullptr */
+	const Record* find(const std::string& name) const;
+
+	/**
+	 * Checks the game file and the PO files of the record of the last run.
+	 * @param last Record of the last run
+	 * @param source_file Path of the game file
+	 * @param outdir Directory of the PO files
+	 * @param current Receives the current state, the outputs only when up to date
+	 * @return Whether the game file and all PO files are unchanged
+	 */
+	static bool upToDate(const Record& last, const std::string& source_file,
+		const std::string& outdir, Record& current);
+
+	/** Replaces all records */
+	void assign(std::vector<Record> records);
+
+private:
+	std::vector<Record> records;
+	std::unordered_map<std::string, size_t> index;
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2020 LcfTrans authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#include "mapcache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "translation.h"
+
+namespace {
+	// Cache file layout: magic, version, number of entries, then the entries.
+	// Strings are stored with a 32 bit length, lists with a 32 bit count.
+	constexpr char cache_magic[4] = { 'L', 'T', 'M', 'C' };
+	// Incremented when the term extraction changes
+	constexpr uint32_t cache_version = 1;
+
+	std::string CacheFile(const std::string& dir, const std::string& key) {
+		return dir + "/" + key + ".lcftrans";
+	}
+
+	void WriteU32(std::string& out, uint32_t v) {
+		out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+	}
+
+	void WriteString(std::string& out, const std::string& s) {
+		WriteU32(out, static_cast<uint32_t>(s.size()));
+		out += s;
+	}
+
+	void WriteStrings(std::string& out, const std::vector<std::string>& v) {
+		WriteU32(out, static_cast<uint32_t>(v.size()));
+		for (const auto& s : v) {
+			WriteString(out, s);
+		}
+	}
+
+	bool ReadU32(std::string_view& in, uint32_t& v) {
+		if (in.size() < sizeof(v)) {
+			return false;
+		}
+		memcpy(&v, in.data(), sizeof(v));
+		in.remove_prefix(sizeof(v));
+		return true;
+	}
+
+	bool ReadString(std::string_view& in, std::string& s) {
+		uint32_t size;
+		if (!ReadU32(in, size) || in.size() < size) {
+			return false;
+		}
+		s.assign(in.data(), size);
+		in.remove_prefix(size);
+		return true;
+	}
+
+	bool ReadStrings(std::string_view& in, std::vector<std::string>& v) {
+		uint32_t count;
+		if (!ReadU32(in, count) || in.size() / sizeof(uint32_t) < count) {
+			return false;
+		}
+		v.resize(count);
+		for (auto& s : v) {
+			if (!ReadString(in, s)) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+std::string MapCache::Key(const std::string& filename, const std::string& encoding) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) {
+		return "";
+	}
+
+	std::vector<char> data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+
+	// 64 bit FNV-1a of the encoding and the file
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&](const char* p, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= static_cast<unsigned char>(p[i]);
+			hash *= 1099511628211ULL;
+		}
+	};
+	add(encoding.c_str(), encoding.size() + 1);
+	add(data.data(), data.size());
+
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+	return hex;
+}
+
+bool MapCache::Load(const std::string& dir, const std::string& key, Translation& t) {
+	std::ifstream in(CacheFile(dir, key), std::ios::binary);
+	if (!in) {
+		return false;
+	}
+
+	std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+	std::string_view view = data;
+
+	uint32_t version, count;
+	if (view.size() < sizeof(cache_magic) || memcmp(view.data(), cache_magic, sizeof(cache_magic)) != 0) {
+		return false;
+	}
+	view.remove_prefix(sizeof(cache_magic));
+	if (!ReadU32(view, version) || version != cache_version || !ReadU32(view, count)) {
+		return false;
+	}
+
+	Translation cached;
+	for (uint32_t i = 0; i < count; ++i) {
+		Entry e;
+		uint32_t fuzzy;
+		if (!ReadStrings(view, e.original) || !ReadStrings(view, e.translation) ||
+			!ReadString(view, e.context) || !ReadStrings(view, e.info) ||
+			!ReadString(view, e.location) || !ReadU32(view, fuzzy)) {
+			return false;
+		}
+		e.fuzzy = fuzzy != 0;
+		cached.addEntry(std::move(e));
+	}
+	if (!view.empty()) {
+		return false;
+	}
+
+	t = std::move(cached);
+	return true;
+}
+
+bool MapCache::Save(const std::string& dir, const std::string& key, const Translation& t) {
+	std::string data(cache_magic, sizeof(cache_magic));
+	WriteU32(data, cache_version);
+	WriteU32(data, static_cast<uint32_t>(t.getEntries().size()));
+	for (const auto& e : t.getEntries()) {
+		WriteStrings(data, e.original);
+		WriteStrings(data, e.translation);
+		WriteString(data, e.context);
+		WriteStrings(data, e.info);
+		WriteString(data, e.location);
+		WriteU32(data, e.fuzzy ? 1 : 0);
+	}
+
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+
+	// write to a temporary file first, concurrent runs never see partial files
+	std::string filename = CacheFile(dir, key);
+	std::string tmp_name = filename + "." + std::to_string(std::random_device{}()) + ".tmp";
+	std::ofstream out(tmp_name, std::ios::binary);
+	if (!out) {
+		return false;
+	}
+	out.write(data.data(), data.size());
+	out.close();
+
+	if (!out) {
+		std::filesystem::remove(tmp_name, ec);
+		return false;
+	}
+	std::filesystem::rename(tmp_name, filename, ec);
+	if (ec) {
+		std::filesystem::remove(tmp_name, ec);
+		return false;
+	}
+	return true;
+}
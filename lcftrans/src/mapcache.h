@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2020 LcfTrans authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#ifndef LCFTRANS_MAPCACHE
+#define LCFTRANS_MAPCACHE
+
+#include <string>
+
+class Translation;
+
+/**
+ * Terms of the map files extracted by earlier runs.
+ * The cache files are named after a hash of the map file and the encoding,
+ * unchanged maps are not parsed again. The directory can be shared with lcfviz.
+ */
+namespace MapCache {
+	/**
+	 * @param filename Map file
+	 * @param encoding Encoding the terms are extracted with
+	 * @return Key of the cache file, empty when the map is not readable
+	 */
+	std::string Key(const std::string& filename, const std::string& encoding);
+
+	/**
+	 * @param dir Cache directory
+	 * @param key Key from Key()
+	 * @param t Receives the terms
+	 * @return false when there is no valid cached version
+	 */
+	bool Load(const std::string& dir, const std::string& key, Translation& t);
+
+	/**
+	 * Stores the terms, concurrent runs never see partial files.
+	 * @return false on write errors
+	 */
+	bool Save(const std::string& dir, const std::string& key, const Translation& t);
+}
+
+#endif
@@ -5,14 +5,16 @@
  */
 
 #include "translation.h"
+#include "translationmemory.h"
 #include "types.h"
 #include "utils.h"
 
 #include <iostream>
-#include <map>
+#include <limits>
 #include <sstream>
 #include <fstream>
-#include <regex>
+#include <string_view>
+#include <unordered_map>
 #include <lcf/context.h>
 #include <lcf/rpg/eventcommand.h>
 #include <lcf/ldb/reader.h>
@@ -23,69 +25,112 @@
 
 void Translation::write(std::ostream& out) {
 	writeHeader(out);
-	out << std::endl;
+	out << "\n";
 
 	writeEntries(out);
 }
 
 void Translation::writeHeader(std::ostream& out) const {
-	out << "msgid \"\"" << std::endl;
-	out << "msgstr \"\"" << std::endl;
-	out << "\"Project-Id-Version: GAME_NAME 1.0\\n\"" << std::endl;
-	out << "\"Language-Team: YOUR NAME <mail@your.address>\\n\"" << std::endl;
-	out << "\"Language: \\n\"" << std::endl;
-	out << "\"MIME-Version: 1.0\\n\"" << std::endl;
-	out << "\"Content-Type: text/plain; charset=UTF-8\\n\"" << std::endl;
-	out << "\"Content-Transfer-Encoding: 8bit\\n\"" << std::endl;
-	out << "\"X-CreatedBy: LcfTrans\"" << std::endl;
+	out << "msgid \"\"\n";
+	out << "msgstr \"\"\n";
+	out << "\"Project-Id-Version: GAME_NAME 1.0\\n\"\n";
+	out << "\"Language-Team: YOUR NAME <mail@your.address>\\n\"\n";
+	out << "\"Language: \\n\"\n";
+	out << "\"MIME-Version: 1.0\\n\"\n";
+	out << "\"Content-Type: text/plain; charset=UTF-8\\n\"\n";
+	out << "\"Content-Transfer-Encoding: 8bit\\n\"\n";
+	out << "\"X-CreatedBy: LcfTrans\"\n";
 }
 
 void Translation::writeEntries(std::ostream& out) {
-	std::map<std::string, std::vector<Entry*>> items;
-	std::vector<std::string> order;
-	std::vector<Entry*> item;
-	std::string old_context = "\1";
-
-	for (Entry& e : entries) {
-		std::string key = e.context + "\1" + Utils::Join(e.original);
-
-		items[key].push_back(&e);
+	// Entries with the same context and msgid are grouped, the keys are views
+	// into one buffer that is reserved up front so it never moves
+	size_t keys_size = 0;
+	size_t out_size = 0;
+	for (const Entry& e : entries) {
+		keys_size += e.context.size() + 1;
+		for (const auto& line : e.original) {
+			keys_size += line.size() + 1;
+		}
+		for (const auto& line : e.translation) {
+			out_size += line.size() + 4;
+		}
+		for (const auto& info : e.info) {
+			out_size += info.size() + 4;
+		}
+		out_size += e.location.size() + 32;
+	}
+	std::string keys;
+	keys.reserve(keys_size);
+
+	constexpr size_t none = std::numeric_limits<size_t>::max();
+	std::unordered_map<std::string_view, size_t> groups;
+	groups.reserve(entries.size());
+	std::vector<size_t> first; // of every group in order of appearance
+	std::vector<size_t> last;
+	std::vector<size_t> next(entries.size(), none);
+
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const Entry& e = entries[i];
+		size_t start = keys.size();
+		keys += e.context;
+		keys += '\1';
+		for (size_t j = 0; j < e.original.size(); ++j) {
+			if (j > 0) {
+				keys += '\n';
+			}
+			keys += e.original[j];
+		}
 
-		if (old_context != key && items[key].size() == 1) {
-			old_context = key;
-			order.push_back(key);
+		auto ins = groups.try_emplace(std::string_view(keys.data() + start, keys.size() - start), first.size());
+		if (ins.second) {
+			first.push_back(i);
+			last.push_back(i);
+		} else {
+			// Only the first entry of a group is written, the key is not needed
+			keys.resize(start);
+			size_t group = ins.first->second;
+			next[last[group]] = i;
+			last[group] = i;
 		}
 	}
 
-	for (std::string& s : order) {
-		for (Entry* e : items[s]) {
-			if (!e->location.empty()) {
-				out << "#: " << e->location << "\n";
+	std::string buffer;
+	buffer.reserve(out_size + keys_size * 2);
+	for (size_t group = 0; group < first.size(); ++group) {
+		for (size_t i = first[group]; i != none; i = next[i]) {
+			const Entry& e = entries[i];
+			if (!e.location.empty()) {
+				buffer += "#: ";
+				buffer += e.location;
+				buffer += '\n';
 			}
 
-			if (!e->info.empty()) {
-				for (const auto &info: e->info) {
-					out << "#. " << info << "\n";
-				}
+			for (const auto& info: e.info) {
+				buffer += "#. ";
+				buffer += info;
+				buffer += '\n';
 			}
 
-			if (e->fuzzy) {
-				out << "#, fuzzy\n";
+			if (e.fuzzy) {
+				buffer += "#, fuzzy\n";
 			}
 		}
-		items[s][0]->write(out);
+		entries[first[group]].write(buffer);
 
-		out << "\n";
+		buffer += '\n';
 	}
+
+	out.write(buffer.data(), buffer.size());
 }
 
-bool Translation::addEntry(const Entry& entry) {
+bool Translation::addEntry(Entry entry) {
 	if (std::all_of(entry.original.begin(), entry.original.end(), [](const auto& e) {
 		return e.empty();
 	})) {
 		return false;
 	}
-	entries.push_back(entry);
+	entries.push_back(std::move(entry));
 	return true;
 }
 
@@ -94,22 +139,32 @@ const std::vector<Entry>& Translation::getEntries() const {
 }
 
 Translation Translation::Merge(const Translation& from) {
-	auto efrom = from.getEntries();
-
-	// Ignore strings that don't have a translation at all
-	efrom.erase(
-		std::remove_if(efrom.begin(), efrom.end(), [](Entry &e) { return !e.hasTranslation(); }),
-	efrom.end());
+	// Index by msgid, no dedup when parsing LCF files so it can appear multiple times
+	std::unordered_map<std::string, std::vector<Entry*>> index;
+	index.reserve(entries.size());
+	for (auto& e_to : entries) {
+		index[Utils::Join(e_to.original)].push_back(&e_to);
+	}
 
 	// Copy over and find stale entries (entries that are not available in the new translation anymore)
 	Translation stale;
-	for (auto& e_from : efrom) {
+	std::string key;
+	for (const auto& e_from : from.getEntries()) {
+		// Ignore strings that don't have a translation at all
+		if (!e_from.hasTranslation()) {
+			continue;
+		}
+
 		bool found = false;
-		for (auto& e_to : entries) {
-			if (e_from.original == e_to.original) {
-				e_to.translation = e_from.translation;
-				// no dedup when parsing LCF files, don't "continue" here
-				found = true;
+		Utils::JoinInto(key, e_from.original);
+		auto it = index.find(key);
+		if (it != index.end()) {
+			for (Entry* e_to : it->second) {
+				// The joined msgid is ambiguous when a line contains a newline
+				if (e_from.original == e_to->original) {
+					e_to->translation = e_from.translation;
+					found = true;
+				}
 			}
 		}
 		if (!found) {
@@ -120,85 +175,108 @@ Translation Translation::Merge(const Translation& from) {
 	return stale;
 }
 
-Translation Translation::Match(const Translation& from, int& matches) {
-	matches = 0;
-	auto efrom = from.getEntries();
+namespace {
+	// Entries sharing a key in the order of the translation
+	struct MatchCandidates {
+		std::vector<Entry*> entries;
+		size_t next = 0;
 
-	auto starts_with = [](const std::string& line, const std::string& search) {
-		return lcf::StartsWith(line, search);
+		// Entries only get a translation, so the ones before next stay skipped
+		Entry* firstUntranslated() {
+			while (next < entries.size() && entries[next]->hasTranslation()) {
+				++next;
+			}
+			return next < entries.size() ? entries[next] : nullptr;
+		}
 	};
 
-	Translation stale;
-	for (auto& e_from : efrom) {
-		bool found = false;
-		if (!e_from.context.empty()) {
-			// Match by context first
-			for (auto& e_to : entries) {
-				if (e_to.hasTranslation()) {
-					continue;
-				}
+	using MatchIndex = std::unordered_map<std::string, MatchCandidates>;
 
-				if (e_from.context == e_to.context) {
-					// Also ensure that the ID matches to reduce false-positive rate
-					std::string info = Utils::Join(e_from.info, '\n');
-					if (starts_with(info, "ID ")) {
-						std::string info_to = Utils::Join(e_to.info, '\n');
-						if (info != info_to) {
-							continue;
-						}
-					}
+	Entry* findUntranslated(MatchIndex& index, const std::string& key) {
+		auto it = index.find(key);
+		return it == index.end() ? nullptr : it->second.firstUntranslated();
+	}
 
-					e_to.translation = e_from.original;
-					++matches;
-					found = true;
-					break;
-				}
+	// Removes "Line [0-9]+" to compare event locations of different lines
+	std::string StripLineNumbers(const std::string& info) {
+		const std::string line = "Line ";
+		auto is_digit = [&](size_t pos) { return pos < info.size() && info[pos] >= '0' && info[pos] <= '9'; };
+
+		std::string out;
+		size_t pos = 0;
+		size_t found = info.find(line);
+		while (found != std::string::npos) {
+			size_t end = found + line.size();
+			if (!is_digit(end)) {
+				found = info.find(line, found + 1);
+				continue;
 			}
-		} else {
-			std::string info = Utils::Join(e_from.info, '\n');
-			if (starts_with(info, "ID ")) {
-				// Is a event location identifier
-				// Attempt exact match
-				for (auto& e_to : entries) {
-					if (e_to.hasTranslation()) {
-						continue;
-					}
+			while (is_digit(end)) {
+				++end;
+			}
+			out.append(info, pos, found - pos);
+			pos = end;
+			found = info.find(line, pos);
+		}
+		out.append(info, pos, std::string::npos);
+		return out;
+	}
+}
 
-					std::string info_to = Utils::Join(e_to.info, '\n');
-					if (info == info_to) {
-						e_to.translation = e_from.original;
-						found = true;
-						++matches;
-						break;
-					}
-				}
-				// Attempt fuzzy match (Ignore line number)
-				if (!found) {
-					std::regex re("Line [0-9]+");
-					std::string info_cp = info;
-					info.clear();
-					std::regex_replace(std::back_inserter(info), info_cp.begin(), info_cp.end(), re, "");
-					for (auto& e_to : entries) {
-						if (e_to.hasTranslation()) {
-							continue;
-						}
+Translation Translation::Match(const Translation& from, int& matches) {
+	matches = 0;
 
-						std::string info_to_cp = Utils::Join(e_to.info, '\n');
-						std::string info_to;
-						std::regex_replace(std::back_inserter(info_to), info_to_cp.begin(), info_to_cp.end(), re, "");
-						if (info == info_to) {
-							e_to.translation = e_from.original;
-							e_to.fuzzy = true;
-							found = true;
-							++matches;
-							break;
-						}
-					}
+	// Context, context with location, location and location without line number
+	MatchIndex by_context;
+	std::unordered_map<std::string, MatchIndex> by_context_info;
+	MatchIndex by_info;
+	MatchIndex by_info_fuzzy;
+	for (auto& e_to : entries) {
+		std::string info_to = Utils::Join(e_to.info, '\n');
+		if (!e_to.context.empty()) {
+			by_context[e_to.context].entries.push_back(&e_to);
+			by_context_info[e_to.context][info_to].entries.push_back(&e_to);
+		}
+		by_info_fuzzy[StripLineNumbers(info_to)].entries.push_back(&e_to);
+		by_info[std::move(info_to)].entries.push_back(&e_to);
+	}
+
+	Translation stale;
+	std::string info;
+	for (const auto& e_from : from.getEntries()) {
+		Utils::JoinInto(info, e_from.info, '\n');
+		// Is a event location identifier
+		bool has_id = lcf::StartsWith(info, "ID ");
+		Entry* e_to = nullptr;
+		bool fuzzy = false;
+
+		if (!e_from.context.empty()) {
+			// Match by context, also ensure that the ID matches to reduce false-positive rate
+			if (has_id) {
+				auto it = by_context_info.find(e_from.context);
+				if (it != by_context_info.end()) {
+					e_to = findUntranslated(it->second, info);
 				}
+			} else {
+				e_to = findUntranslated(by_context, e_from.context);
+			}
+		} else if (has_id) {
+			// Attempt exact match
+			e_to = findUntranslated(by_info, info);
+			// Attempt fuzzy match (Ignore line number)
+			if (!e_to) {
+				e_to = findUntranslated(by_info_fuzzy, StripLineNumbers(info));
+				fuzzy = true;
 			}
 		}
 
-		if (!found) {
+		if (e_to) {
+			e_to->translation = e_from.original;
+			if (fuzzy) {
+				e_to->fuzzy = true;
+			}
+			++matches;
+		} else {
 			stale.addEntry(e_from);
 		}
 	}
@@ -206,6 +284,21 @@ Translation Translation::Match(const Translation& from, int& matches) {
 	return stale;
 }
 
+int Translation::Fill(const TranslationMemory& memory) {
+	int filled = 0;
+	for (auto& e : entries) {
+		if (e.hasTranslation()) {
+			continue;
+		}
+
+		if (auto translation = memory.lookup(e)) {
+			e.translation = *translation;
+			++filled;
+		}
+	}
+	return filled;
+}
+
 template <typename T> bool isEventCommandString(const lcf::ContextStructBase<T>&) { return false; }
 bool isEventCommandString(const lcf::ContextStructBase<lcf::rpg::EventCommand>& ctx) { return ctx.name == "string"; }
 
@@ -228,10 +321,10 @@ public:
 		}
 
 		Entry e;
-		e.original = lines;
-		e.info = info;
-		e.context = context;
-		t.addEntry(e);
+		e.original = std::move(lines);
+		e.info = std::move(info);
+		e.context = std::move(context);
+		t.addEntry(std::move(e));
 		lines.clear();
 		info.clear();
 		context.clear();
@@ -317,7 +410,7 @@ public:
 			case Cmd::Maniac_ShowStringPicture: {
 				// Show String Picture
 				add_evt_entry();
-				auto tokens = Utils::Split(lcf::ToString(estring), '\x01');
+				auto tokens = Utils::Split(estring, '\x01');
 				if (tokens.size() >= 4) {
 					info.push_back(make_info(ctx));
 					info.push_back("Show String Picture");
@@ -445,7 +538,7 @@ TranslationLdb Translation::fromLDB(const std::string& filename, const std::stri
 			if (ctx.parent->index > -1) {
 				e.info.emplace_back("ID " + std::to_string(ctx.parent->index + 1));
 			}
-			t.terms.addEntry(e);
+			t.terms.addEntry(std::move(e));
 		}
 	});
 
@@ -487,7 +580,7 @@ Translation Translation::fromLMT(const std::string &filename, const std::string
 			Entry e;
 			e.original.emplace_back(lcf::ToString(val));
 			e.info.emplace_back("ID " + std::to_string(ctx.parent->index + 1));
-			t.addEntry(e);
+			t.addEntry(std::move(e));
 		}
 	});
 
@@ -510,9 +603,18 @@ Translation Translation::fromPO(const std::string& filename) {
 
 	Translation t;
 
-	std::ifstream in(filename);
+	// The lines are views into the file, only the strings are copied
+	std::string buffer;
+	std::ifstream in(filename, std::ios::binary);
+	if (in && in.seekg(0, std::ios::end)) {
+		buffer.resize(static_cast<size_t>(in.tellg()));
+		in.seekg(0, std::ios::beg);
+		in.read(&buffer[0], buffer.size());
+		buffer.resize(static_cast<size_t>(in.gcount()));
+	}
+	std::string_view data = buffer;
 
-	std::string line;
+	std::string_view line;
 	std::string_view line_view;
 	bool found_header = false;
 	bool parse_item = false;
@@ -524,13 +626,13 @@ Translation Translation::fromPO(const std::string& filename) {
 		return lcf::StartsWith(line_view, search);
 	};
 
-	auto extract_string = [&](int offset) -> std::string {
+	// Appends the unescaped string to out
+	auto extract_string = [&](int offset, std::string& out) {
 		if (offset >= static_cast<int>(line_view.size())) {
 			std::cerr << "Parse error (Line " << line_number << ") is empty\n";
-			return "";
+			return;
 		}
 
-		std::stringstream out;
 		bool slash = false;
 		bool first_quote = false;
 
@@ -543,7 +645,7 @@ Translation Translation::fromPO(const std::string& filename) {
 					continue;
 				}
 				std::cerr << "Parse error (Line " << line_number << "): Expected \", got " << c << ": " << line << "\n";
-				return "";
+				return;
 			}
 
 			if (!slash && c == '\\') {
@@ -552,13 +654,13 @@ Translation Translation::fromPO(const std::string& filename) {
 				slash = false;
 				switch (c) {
 					case '\\':
-						out << c;
+						out += c;
 						break;
 					case 'n':
-						out << '\n';
+						out += '\n';
 						break;
 					case '"':
-						out << '"';
+						out += '"';
 						break;
 					default:
 						std::cerr << "Parse error (Line " << line_number << "): Expected \\, \\n or \", got " << c << ": " << line << "\n";
@@ -568,44 +670,46 @@ Translation Translation::fromPO(const std::string& filename) {
 				// no-slash
 				if (c == '"') {
 					// done
-					return out.str();
+					return;
 				}
-				out << c;
+				out += c;
 			}
 		}
 
 		std::cerr << "Parse error (Line " << line_number << "): Unterminated line: " << line << "\n";
-		return out.str();
 	};
 
 	auto read_msgctx = [&]() {
-		e.context = extract_string(7);
+		e.context.clear();
+		extract_string(7, e.context);
 	};
 
 	auto read_msgstr = [&]() {
 		// Parse multiply lines until empty line or comment
-		std::string msgstr = extract_string(6);
+		std::string msgstr;
+		extract_string(6, msgstr);
 
-		while (Utils::ReadLine(in, line)) {
+		while (Utils::ReadLine(data, line)) {
 			line_view = Utils::TrimWhitespace(line);
 			++line_number;
 			if (line_view.empty() || starts_with("#")) {
 				break;
 			}
-			msgstr += extract_string(0);
+			extract_string(0, msgstr);
 		}
 
 		parse_item = false;
 		e.translation = Utils::Split(msgstr);
-		t.addEntry(e);
+		t.addEntry(std::move(e));
 		e = Entry();
 	};
 
 	auto read_msgid = [&]() {
 		// Parse multiply lines until empty line or msgstr is encountered
-		std::string msgid = extract_string(5);
+		std::string msgid;
+		extract_string(5, msgid);
 
-		while (Utils::ReadLine(in, line)) {
+		while (Utils::ReadLine(data, line)) {
 			line_view = Utils::TrimWhitespace(line);
 			++line_number;
 			if (line_view.empty() || starts_with("msgstr")) {
@@ -613,7 +717,7 @@ Translation Translation::fromPO(const std::string& filename) {
 				read_msgstr();
 				return;
 			}
-			msgid += extract_string(0);
+			extract_string(0, msgid);
 		}
 		e.original = Utils::Split(msgid);
 	};
@@ -624,9 +728,9 @@ Translation Translation::fromPO(const std::string& filename) {
 		}
 
 		// Parse multiply lines until empty line, msgctxt or msgid is encountered
-		e.info.push_back(line.substr(3));
+		e.info.emplace_back(line.substr(3));
 
-		while (Utils::ReadLine(in, line)) {
+		while (Utils::ReadLine(data, line)) {
 			line_view = Utils::TrimWhitespace(line);
 			++line_number;
 			if (line.empty() || starts_with("msgctx") || starts_with("msgid")) {
@@ -639,7 +743,7 @@ Translation Translation::fromPO(const std::string& filename) {
 			}
 			else if (starts_with("#.")) {
 				if (line.length() > 3) {
-					e.info.push_back(line.substr(3));
+					e.info.emplace_back(line.substr(3));
 				}
 			} else {
 				std::cerr << "Parse error (Line " << line_number << ") " << line << " (" << line << "). Expected #., msgctx or msgid\n";
@@ -648,7 +752,7 @@ Translation Translation::fromPO(const std::string& filename) {
 		}
 	};
 
-	while (Utils::ReadLine(in, line)) {
+	while (Utils::ReadLine(data, line)) {
 		line_view = Utils::TrimWhitespace(line);
 		++line_number;
 		if (!found_header) {
@@ -13,6 +13,7 @@
 #include "entry.h"
 
 struct TranslationLdb;
+class TranslationMemory;
 
 class Translation
 {
@@ -23,7 +24,11 @@ public:
 
 	void writeEntries(std::ostream& out);
 
-	bool addEntry(const Entry& entry);
+	/**
+	 * Adds the entry, skipped when the msgid is empty.
+	 * Pass temporaries or use std::move to avoid copying the strings.
+	 */
+	bool addEntry(Entry entry);
 
 	const std::vector<Entry>& getEntries() const;
 
@@ -38,6 +43,13 @@ public:
 	 */
 	Translation Match(const Translation& from, int& matches);
 
+	/**
+	 * Copies the translations of the memory to entries without translation.
+	 * @param memory Translation memory to look the msgids up in
+	 * @return Number of filled entries
+	 */
+	int Fill(const TranslationMemory& memory);
+
 	static TranslationLdb fromLDB(const std::string& filename, const std::string& encoding);
 	static Translation fromLMT(const std::string& filename, const std::string& encoding);
 	static Translation fromLMU(const std::string& filename, const std::string& encoding);
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2020 LcfTrans authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#include "translationmemory.h"
+#include "translation.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <fstream>
+
+bool TranslationMemory::load(const std::string& filename) {
+	if (!std::ifstream(filename)) {
+		return false;
+	}
+
+	Translation t = Translation::fromPO(filename);
+	for (const auto& e : t.getEntries()) {
+		if (e.hasTranslation()) {
+			memory[key(e)] = e;
+		}
+	}
+	return true;
+}
+
+bool TranslationMemory::save(const std::string& filename) {
+	for (auto& l : learned) {
+		memory[l.first] = std::move(l.second.entry);
+	}
+	learned.clear();
+
+	std::vector<const std::string*> keys;
+	keys.reserve(memory.size());
+	for (const auto& m : memory) {
+		keys.push_back(&m.first);
+	}
+	std::sort(keys.begin(), keys.end(), [](const std::string* a, const std::string* b) {
+		return *a < *b;
+	});
+
+	Translation t;
+	for (const std::string* k : keys) {
+		t.addEntry(memory[*k]);
+	}
+
+	std::ofstream outfile(filename);
+	t.write(outfile);
+	return static_cast<bool>(outfile);
+}
+
+const std::vector<std::string>* TranslationMemory::lookup(const Entry& entry) const {
+	auto it = memory.find(key(entry));
+	return it == memory.end() ? nullptr : &it->second.translation;
+}
+
+void TranslationMemory::add(const Translation& t, int order) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const auto& e : t.getEntries()) {
+		if (!e.hasTranslation()) {
+			continue;
+		}
+
+		// Only the msgid, context and msgstr are remembered
+		Learned l;
+		l.entry.context = e.context;
+		l.entry.original = e.original;
+		l.entry.translation = e.translation;
+		l.order = order;
+
+		auto ins = learned.try_emplace(key(e), l);
+		if (!ins.second && ins.first->second.order > order) {
+			ins.first->second = std::move(l);
+		}
+	}
+}
+
+size_t TranslationMemory::size() const {
+	return memory.size();
+}
+
+std::string TranslationMemory::key(const Entry& entry) {
+	// Whitespace around the lines does not change the meaning
+	std::string k = entry.context + "\1";
+	for (size_t i = 0; i < entry.original.size(); ++i) {
+		if (i > 0) {
+			k += '\n';
+		}
+		k += Utils::TrimWhitespace(entry.original[i]);
+	}
+	return k;
+}
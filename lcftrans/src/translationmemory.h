@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2020 LcfTrans authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#ifndef LCFTRANS_TRANSLATIONMEMORY
+#define LCFTRANS_TRANSLATIONMEMORY
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "entry.h"
+
+class Translation;
+
+/**
+ * Translations of earlier runs and other games, stored as a PO file.
+ * Lookups only see the loaded file. Translations added while processing
+ * are saved for the next run, so the result does not depend on the order
+ * in which the files are processed.
+ */
+class TranslationMemory {
+public:
+	/**
+	 * @param filename PO file of the memory
+	 * @return false when the file does not exist yet
+	 */
+	bool load(const std::string& filename);
+
+	bool save(const std::string& filename);
+
+	/**
+	 * @param entry Entry to translate
+	 * @return Translation of an entry with the same context and msgid or nullptr
+	 */
+	const std::vector<std::string>* lookup(const Entry& entry) const;
+
+	/**
+	 * Remembers the translated entries, can be called from several threads.
+	 * @param t Translation to learn from
+	 * @param order When files translate a msgid differently the lowest order wins
+	 */
+	void add(const Translation& t, int order);
+
+	size_t size() const;
+
+private:
+	static std::string key(const Entry& entry);
+
+	struct Learned {
+		Entry entry;
+		int order;
+	};
+
+	std::unordered_map<std::string, Entry> memory;
+	std::unordered_map<std::string, Learned> learned;
+	std::mutex mutex;
+};
+
+#endif
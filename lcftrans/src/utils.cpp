@@ -7,28 +7,26 @@
 #include "utils.h"
 
 #include <algorithm>
-#include <sstream>
+#include <iterator>
 
-std::string Utils::GetFilename(const std::string& str) {
-	std::string s = str;
+std::string Utils::GetFilename(std::string_view str) {
+	// Filename
 #ifdef _WIN32
-	std::replace(s.begin(), s.end(), '\\', '/');
+	size_t found = str.find_last_of("/\\");
+#else
+	size_t found = str.find_last_of('/');
 #endif
-	// Extension
-	size_t found = s.find_last_of('.');
-	if (found != std::string::npos)
-	{
-		s = s.substr(0, found);
+	if (found != std::string_view::npos) {
+		str.remove_prefix(found + 1);
 	}
 
-	// Filename
-	found = s.find_last_of('/');
-	if (found == std::string::npos)	{
-		return s;
+	// Extension
+	found = str.find_last_of('.');
+	if (found != std::string_view::npos) {
+		str = str.substr(0, found);
 	}
 
-	s = s.substr(found + 1);
-	return s;
+	return std::string(str);
 }
 
 bool Utils::HasExt(const std::string& path, const std::string& ext) {
@@ -44,91 +42,83 @@ bool Utils::HasExt(const std::string& path, const std::string& ext) {
 }
 
 std::string Utils::Join(const std::vector<std::string>& lines, char join_char) {
+	std::string ret;
+	JoinInto(ret, lines, join_char);
+	return ret;
+}
+
+void Utils::JoinInto(std::string& out, const std::vector<std::string>& lines, char join_char) {
+	out.clear();
 	if (lines.empty()) {
-		return "";
+		return;
 	}
 
-	std::string ret;
+	size_t size = lines.size() - 1;
 	for (const std::string& s : lines) {
-		ret += s + join_char;
+		size += s.size();
+	}
+	out.reserve(size);
+
+	out += lines[0];
+	for (size_t i = 1; i < lines.size(); ++i) {
+		out += join_char;
+		out += lines[i];
 	}
-	ret.pop_back(); // remove last join_char
-	return ret;
 }
 
-std::vector<std::string> Utils::Split(const std::string& line, char split_char) {
+std::vector<std::string> Utils::Split(std::string_view line, char split_char) {
 	std::vector<std::string> tokens;
-	std::string cur_token;
+	tokens.reserve(std::count(line.begin(), line.end(), split_char) + 1);
 
-	for (auto c: line) {
-		if (c == split_char) {
-			tokens.push_back(cur_token);
-			cur_token.clear();
-			continue;
-		}
-
-		cur_token.push_back(c);
+	for (size_t found = line.find(split_char); found != std::string_view::npos; found = line.find(split_char)) {
+		tokens.emplace_back(line.substr(0, found));
+		line.remove_prefix(found + 1);
 	}
-
-	tokens.push_back(cur_token);
+	tokens.emplace_back(line);
 
 	return tokens;
 }
 
-std::string Utils::LowerCase(const std::string& in) {
-	auto lower = [](char& c) -> char {
+std::string Utils::LowerCase(std::string in) {
+	LowerCaseInPlace(in);
+	return in;
+}
+
+void Utils::LowerCaseInPlace(std::string& str) {
+	for (char& c : str) {
 		if (c >= 'A' && c <= 'Z') {
-			return c + 'a' - 'A';
-		} else {
-			return c;
+			c += 'a' - 'A';
 		}
-	};
-
-	std::string data = in;
-	std::transform(data.begin(), data.end(), data.begin(), lower);
-	return data;
+	}
 }
 
 std::string Utils::RemoveControlChars(std::string_view s) {
 	// RPG_RT ignores any control characters within messages.
-	std::string out = lcf::ToString(s);
-	auto iter = std::remove_if(out.begin(), out.end(), [](const char ch) { return (ch >= 0x0 && ch <= 0x1F) || ch == 0x7F; });
-	out.erase(iter, out.end());
+	std::string out;
+	out.reserve(s.size());
+	std::copy_if(s.begin(), s.end(), std::back_inserter(out), [](const char ch) { return !((ch >= 0x0 && ch <= 0x1F) || ch == 0x7F); });
 	return out;
 }
 
-// based on https://stackoverflow.com/questions/6089231/
-bool Utils::ReadLine(std::istream& is, std::string& line_out) {
-	std::istream::sentry se(is, true);
-	std::streambuf* sb = is.rdbuf();
-
-	if (!is) {
+bool Utils::ReadLine(std::string_view& data, std::string_view& line_out) {
+	if (data.empty()) {
 		return false;
 	}
 
-	line_out.clear();
+	size_t end = data.find_first_of("\r\n");
+	if (end == std::string_view::npos) {
+		// Also handle the case when the last line has no line ending
+		line_out = data;
+		data = {};
+		return true;
+	}
 
-	for(;;) {
-		int c = sb->sbumpc();
-		switch (c) {
-			case '\n':
-				return true;
-			case '\r':
-				if (sb->sgetc() == '\n') {
-					sb->sbumpc();
-				}
-				return true;
-			case EOF:
-				// Also handle the case when the last line has no line ending
-				if (line_out.empty()) {
-					is.setstate(std::ios::eofbit);
-					return false;
-				}
-				return true;
-			default:
-				line_out += (char)c;
-		}
+	line_out = data.substr(0, end);
+	if (data[end] == '\r' && end + 1 < data.size() && data[end + 1] == '\n') {
+		++end;
 	}
+	data.remove_prefix(end + 1);
+	return true;
 }
 
 std::string_view Utils::TrimWhitespace(std::string_view s) {
@@ -179,20 +169,17 @@ std::vector<std::string> Utils::GetChoices(lcf::Span<lcf::rpg::EventCommand> lis
 	return s_choices;
 }
 
-std::string Utils::Escape(const std::string& str) {
-	std::stringstream s;
+void Utils::AppendEscaped(std::string& out, const std::string& str) {
 	for (char c : str) {
 		switch (c) {
 			case '"':
-				s << "\\\"";
+				out += "\\\"";
 				break;
 			case '\\':
-				s << "\\\\";
+				out += "\\\\";
 				break;
 			default:
-				s << c;
+				out += c;
 		}
 	}
-
-	return s.str();
 }
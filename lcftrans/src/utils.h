@@ -14,18 +14,21 @@
 #include <string_view>
 
 namespace Utils {
-	std::string GetFilename(const std::string& str);
+	std::string GetFilename(std::string_view str);
 	bool HasExt(const std::string& path, const std::string& ext);
 	std::string Join(const std::vector<std::string>& lines, char join_char = '\n');
-	std::vector<std::string> Split(const std::string& line, char split_char = '\n');
-	std::string LowerCase(const std::string &in);
+	// Like Join, reuses the memory of out
+	void JoinInto(std::string& out, const std::vector<std::string>& lines, char join_char = '\n');
+	std::vector<std::string> Split(std::string_view line, char split_char = '\n');
+	std::string LowerCase(std::string in);
+	void LowerCaseInPlace(std::string& str);
 	std::string RemoveControlChars(std::string_view s);
-	bool ReadLine(std::istream& is, std::string& line_out);
+	bool ReadLine(std::string_view& data, std::string_view& line_out);
 	std::string_view TrimWhitespace(std::string_view s);
 
 	std::vector<std::string> GetChoices(lcf::Span<lcf::rpg::EventCommand> list, int start_index);
 
-	std::string Escape(const std::string& str);
+	void AppendEscaped(std::string& out, const std::string& str);
 }
 
 #endif
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020 LcfViz authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#include "graph.h"
+
+#include <algorithm>
+
+Graph::Graph(const std::vector<int>& nodes, const std::vector<std::pair<int, int>>& edges) {
+	ids = nodes;
+	for (const auto& e : edges) {
+		ids.push_back(e.first);
+		ids.push_back(e.second);
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	index.reserve(ids.size());
+	for (size_t i = 0; i < ids.size(); ++i) {
+		index[ids[i]] = static_cast<int>(i);
+	}
+
+	// Counting sort by source, keeps the order of the targets stable
+	std::vector<std::pair<int, int>> unique_edges;
+	unique_edges.reserve(edges.size());
+	edge_keys.reserve(edges.size());
+	offsets.assign(ids.size() + 1, 0);
+	for (const auto& e : edges) {
+		if (edge_keys.insert(EdgeKey(e.first, e.second)).second) {
+			unique_edges.emplace_back(index[e.first], index[e.second]);
+			++offsets[unique_edges.back().first + 1];
+		}
+	}
+	for (size_t n = 0; n < ids.size(); ++n) {
+		offsets[n + 1] += offsets[n];
+	}
+
+	targets.resize(unique_edges.size());
+	std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+	for (const auto& e : unique_edges) {
+		targets[fill[e.first]++] = e.second;
+	}
+
+	reachable.assign(ids.size(), false);
+}
+
+void Graph::FindReachable(int start, int depth_limit) {
+	reachable.assign(ids.size(), false);
+
+	auto it = index.find(start);
+	if (it == index.end()) {
+		return;
+	}
+
+	// Breadth first, every node is reached on its lowest depth first
+	std::vector<int> depth(ids.size(), -1);
+	std::vector<int> queue;
+	queue.reserve(ids.size());
+	queue.push_back(it->second);
+	depth[it->second] = 0;
+
+	for (size_t q = 0; q < queue.size(); ++q) {
+		int n = queue[q];
+		reachable[n] = true;
+		if (depth_limit >= 0 && depth[n] >= depth_limit) {
+			continue;
+		}
+		for (size_t i = offsets[n]; i < offsets[n + 1]; ++i) {
+			int t = targets[i];
+			if (depth[t] == -1) {
+				depth[t] = depth[n] + 1;
+				queue.push_back(t);
+			}
+		}
+	}
+}
+
+bool Graph::IsReachable(int id) const {
+	auto it = index.find(id);
+	return it != index.end() && reachable[it->second];
+}
+
+bool Graph::HasEdge(int from, int to) const {
+	return edge_keys.count(EdgeKey(from, to)) > 0;
+}
+
+uint64_t Graph::EdgeKey(int from, int to) {
+	return (static_cast<uint64_t>(static_cast<uint32_t>(from)) << 32) | static_cast<uint32_t>(to);
+}
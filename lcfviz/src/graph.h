@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2020 LcfViz authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#ifndef LCFVIZ_GRAPH
+#define LCFVIZ_GRAPH
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/**
+ * Teleport graph of a game, stored as compressed sparse rows.
+ * Map IDs are translated to dense indices in ascending ID order.
+ */
+class Graph {
+public:
+	/**
+	 * @param nodes map IDs
+	 * @param edges teleports in the order they were found, duplicates are ignored
+	 */
+	Graph(const std::vector<int>& nodes, const std::vector<std::pair<int, int>>& edges);
+
+	/**
+	 * Marks all nodes that are at most depth_limit edges away from start.
+	 *
+	 * @param start map ID of the start node
+	 * @param depth_limit maximal depth, negative for no limit
+	 */
+	void FindReachable(int start, int depth_limit);
+
+	/** @return whether the node was marked by FindReachable */
+	bool IsReachable(int id) const;
+
+	/** @return whether there is a teleport from one map to the other */
+	bool HasEdge(int from, int to) const;
+
+	/**
+	 * Calls func(from, to) for every edge, ordered by the source ID.
+	 * Edges of the same source are in the order they were found.
+	 */
+	template <typename F>
+	void ForEachEdge(F&& func) const {
+		for (size_t n = 0; n < ids.size(); ++n) {
+			for (size_t i = offsets[n]; i < offsets[n + 1]; ++i) {
+				func(ids[n], ids[targets[i]]);
+			}
+		}
+	}
+
+private:
+	static uint64_t EdgeKey(int from, int to);
+
+	std::vector<int> ids;
+	std::unordered_map<int, int> index;
+	std::vector<size_t> offsets;
+	std::vector<int> targets;
+	std::unordered_set<uint64_t> edge_keys;
+	std::vector<bool> reachable;
+};
+
+#endif
@@ -8,19 +8,27 @@
 // Do not write diagnostics to stdout (dot file output uses it), always use stderr
 
 #include <algorithm>
-#include <climits>
+#include <atomic>
 #include <cstring>
 #include <fstream>
-#include <functional>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <argparse.hpp>
 #include <lcf/encoder.h>
 #include <lcf/reader_util.h>
 #include <lcf/lmt/reader.h>
-#include <lcf/lmu/reader.h>
 #include <lcf/rpg/treemap.h>
 #include <lcf/ldb/reader.h>
 
+#include "graph.h"
+#include "mapcache.h"
+#include "output.h"
+#include "stats.h"
+#include "teleports.h"
 #include "utils.h"
 
 #ifdef _WIN32
@@ -34,6 +42,7 @@
 #define INI_FILE "rpg_rt.ini"
 
 void ParseLmt(const std::string& filename);
+void ParseLmu(const std::string& filename, int id, std::vector<std::pair<int, int>>& edges, std::ostream& log);
 
 const std::string help_epilog = R"(Example usage:
   lcfviz YOURGAME | dot -Goverlap=false -Gsplines=true -Tpng -o graph.png
@@ -45,13 +54,28 @@ namespace {
 	/* config */
 	std::string encoding, indir;
 	std::vector<std::pair<std::string, std::string>> source_files;
-	std::vector<std::pair<int, int>> targets_per_map;
-	std::vector<std::pair<int, std::string>> maps;
+	// lower case name -> name on disk
+	std::unordered_map<std::string, std::string> source_names;
+	// map ID and file of the maps in the map tree
+	std::vector<std::pair<int, std::string>> map_files;
+	std::vector<TreeEntry> tree_entries;
 
 	int depth_limit = -1;
 	std::string outfile;
 	bool remove_unreachable = false;
 	int start_map_id = -1;
+	int jobs = 0;
+	std::string cache_dir;
+	bool cluster = false;
+	std::string split_dir;
+	std::string json_file;
+	std::atomic<bool> cache_failed{false};
+	bool stats = false;
+	std::string trace_file;
+
+	Stats::Counter maps_counter("maps parsed");
+	Stats::Counter cache_hits_counter("map cache hits");
+	Stats::Counter teleports_counter("teleports");
 }
 
 int main(int argc, char** argv) {
@@ -76,6 +100,23 @@ int main(int argc, char** argv) {
 	cli.add_argument("-s", "--start").store_into(start_map_id).scan<'i', int>()
 		.help("Initial node of the graph (default: start party position)")
 		.metavar("ID");
+	cli.add_argument("-j", "--jobs").store_into(jobs).metavar("N")
+		.help("Number of maps scanned at the same time (defaults to\n"
+			"the number of processors)");
+	cli.add_argument("-c", "--cluster").store_into(cluster)
+		.help("Group the nodes in clusters by their parent in the map tree");
+	cli.add_argument("--split").store_into(split_dir).metavar("DIR")
+		.help("Also write one dot file per top level entry of the map\n"
+			"tree to DIR");
+	cli.add_argument("--json").store_into(json_file).metavar("FILE")
+		.help("Also write the nodes, map tree areas and edges as JSON");
+	cli.add_argument("--cache-dir").store_into(cache_dir).metavar("DIR")
+		.help("Keep the teleports of the maps in DIR, unchanged maps are\n"
+			"not parsed again. Can be shared with lcftrans.");
+	cli.add_argument("--stats").store_into(stats)
+		.help("Print the time of each phase and the counters to stderr");
+	cli.add_argument("--trace").store_into(trace_file).metavar("FILE")
+		.help("Write the phases as Chrome trace_event JSON to FILE");
 	// for old encoding argument
 	cli.add_argument("additional").remaining().hidden();
 
@@ -93,6 +134,12 @@ int main(int argc, char** argv) {
 		remove_unreachable = true;
 	}
 
+	if (jobs < 0) {
+		std::cerr << "--jobs: Invalid number of jobs.\n";
+		std::cerr << cli.usage() << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+
 	// for old encoding argument
 	if (auto additional_args = cli.present<std::vector<std::string>>("additional")) {
 		if(additional_args.value().size() > 1) {
@@ -105,6 +152,8 @@ int main(int argc, char** argv) {
 		}
 	}
 
+	Stats::Session stats_session(stats, trace_file);
+
 	auto full_path = [&](const auto& name) {
 		return indir + "/" + name;
 	};
@@ -165,6 +214,10 @@ int main(int argc, char** argv) {
 	std::sort(source_files.begin(), source_files.end(), [](const auto& a, const auto& b) {
 		return a.first < b.first;
 	});
+	for (const auto& s : source_files) {
+		// on duplicates the first name wins
+		source_names.emplace(s.second, s.first);
+	}
 
 	bool parsed_lmt = false;
 	// Only process maps that are part of the map tree
@@ -184,133 +237,133 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 
-	std::stable_sort(targets_per_map.begin(), targets_per_map.end(), [](const auto& a, const auto& b) {
-		return a.first < b.first;
-	});
-	std::stable_sort(maps.begin(), maps.end(), [](const auto& a, const auto& b) {
-		return std::tie(a.first, a.second) < std::tie(b.first, b.second);
-	});
-	targets_per_map.erase(std::unique(targets_per_map.begin(), targets_per_map.end()), targets_per_map.end());
-
-	// Detect nodes that are unreachable from the start map
-	// Pair of: map ID, highest depth seen
-	std::vector<std::pair<int,int>> visited;
-	depth_limit = depth_limit < 0 ? INT_MAX : depth_limit;
-	std::function<void(int,int)> depth_search;
-	depth_search = [&](int cur_node, int cur_depth) {
-		auto v_it = std::find_if(visited.begin(), visited.end(), [&](const auto &val) {
-			return val.first == cur_node;
-		});
-		if (cur_depth > depth_limit) {
-			return;
-		}
-		if (v_it == visited.end()) {
-			visited.emplace_back(cur_node, cur_depth);
-		} else {
-			if (v_it->second < cur_depth) {
-				// node was already seen on a lower level -> abort
-				return;
-			} else {
-				v_it->second = cur_depth;
+	// Every map is scanned independently, the edges are merged in map tree order
+	std::vector<std::vector<std::pair<int, int>>> edges_per_map(map_files.size());
+	std::vector<std::string> logs(map_files.size());
+	std::vector<bool> done(map_files.size());
+	size_t next_log = 0;
+	std::mutex log_mutex;
+
+	std::atomic<size_t> next_map{0};
+	auto worker = [&]() {
+		for (size_t i = next_map++; i < map_files.size(); i = next_map++) {
+			std::ostringstream log;
+			ParseLmu(full_path(map_files[i].second), map_files[i].first, edges_per_map[i], log);
+
+			std::lock_guard<std::mutex> lock(log_mutex);
+			logs[i] = log.str();
+			done[i] = true;
+			for (; next_log < done.size() && done[next_log]; ++next_log) {
+				std::cerr << "Parsing Map " << map_files[next_log].second << "\n" << logs[next_log];
+				logs[next_log].clear();
 			}
 		}
-
-		auto it = std::find_if(targets_per_map.begin(), targets_per_map.end(), [&](const auto& val) {
-			return val.first == cur_node;
-		});
-		for(; it->first == cur_node; ++it) {
-			depth_search(it->second, cur_depth + 1);
-		}
 	};
-	if (remove_unreachable) {
-		depth_search(start_map_id, 0);
+
+	if (jobs == 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
 	}
+	jobs = std::max<int>(1, std::min<size_t>(jobs, map_files.size()));
 
-	*out << "strict digraph G {\n";
+	std::vector<std::thread> workers;
+	for (int i = 1; i < jobs; i++) {
+		workers.emplace_back(worker);
+	}
+	// the main thread scans as well
+	worker();
+	for (auto& t : workers) {
+		t.join();
+	}
 
-	// Output all nodes (if reachable)
-	for (const auto& map : maps) {
-		if (remove_unreachable && std::find_if(visited.begin(), visited.end(), [&](const auto& val) {
-			return val.first == map.first;
-		}) == visited.end()){
-			continue;
-		}
+	if (cache_failed) {
+		std::cerr << "Failed writing map cache " << cache_dir << "\n";
+	}
 
-		*out << map.first << " [label=\"" << map.second << "\"";
-		if (start_map_id == map.first) {
-			*out << " shape=box style=filled fillcolor=gray";
-		}
-		*out << "];\n";
+	std::vector<std::pair<int, int>> targets_per_map;
+	for (const auto& edges : edges_per_map) {
+		targets_per_map.insert(targets_per_map.end(), edges.begin(), edges.end());
 	}
 
-	// Output edges
-	std::vector<std::pair<int, int>> pending_erase;
-	for (const auto& map : targets_per_map) {
-		if (remove_unreachable && (
-			std::find_if(visited.begin(), visited.end(), [&](const auto& val) {
-				return val.first == map.first;
-			}) == visited.end() ||
-			std::find_if(visited.begin(), visited.end(), [&](const auto& val) {
-				return val.first == map.second;
-			}) == visited.end())
-			) {
-			// Target or source node not in set
-			continue;
-		}
+	std::stable_sort(tree_entries.begin(), tree_entries.end(), [](const auto& a, const auto& b) {
+		return std::tie(a.id, a.name) < std::tie(b.id, b.name);
+	});
 
-		if (std::find_if(pending_erase.begin(), pending_erase.end(), [&](const auto& val) {
-			return map.first == val.first && map.second == val.second;
-		}) != pending_erase.end()) {
-			// Is reverse edge of a bidirectional node
-			continue;
-		};
-
-		// Detect bidirection
-		bool both = false;
-		auto find_it = std::find_if(targets_per_map.begin(), targets_per_map.end(), [&](const auto& val) {
-			return val.second == map.first && val.first == map.second;
-		});
-		if (find_it != targets_per_map.end()) {
-			both = true;
-			pending_erase.emplace_back(find_it->first, find_it->second);
+	std::vector<int> nodes;
+	nodes.reserve(tree_entries.size() + 1);
+	for (const auto& entry : tree_entries) {
+		if (!entry.area) {
+			nodes.push_back(entry.id);
 		}
+	}
+	nodes.push_back(start_map_id);
+	Stats::Scope graph_scope("graph");
+	Graph graph(nodes, targets_per_map);
 
-		*out << map.first << " -> " << map.second;
-		if (both) {
-			*out << " [dir=both]";
+	// Detect nodes that are unreachable from the start map
+	if (remove_unreachable) {
+		graph.FindReachable(start_map_id, depth_limit);
+	}
+
+	graph_scope.Stop();
+
+	Stats::Scope output_scope("output");
+	GraphOutput output(tree_entries, graph, start_map_id, remove_unreachable);
+	output.WriteDot(*out, cluster);
+
+	if (!split_dir.empty() && !output.WriteSplitDot(split_dir, cluster)) {
+		std::cerr << "Failed writing dot files to " << split_dir << "\n";
+		return 1;
+	}
+
+	if (!json_file.empty()) {
+		std::ofstream json(json_file);
+		if (json) {
+			output.WriteJson(json);
+			json.close();
+		}
+		if (!json) {
+			std::cerr << "Failed writing " << json_file << "\n";
+			return 1;
 		}
-		*out << ";\n";
 	}
-	*out << "}\n";
 
 	return 0;
 }
 
-template<typename T>
-void parse_event(const lcf::ContextStructBase<T>&, int) {}
-
-template<>
-void parse_event(const lcf::ContextStructBase<lcf::rpg::EventCommand>& ctx, int id) {
-	if (ctx.name != "string") {
+void ParseLmu(const std::string& filename, int id, std::vector<std::pair<int, int>>& edges, std::ostream& log) {
+	Stats::Scope scope("lmu");
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) {
 		return;
 	}
+	std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
 
-	if (static_cast<lcf::rpg::EventCommand::Code>(ctx.obj->code) == lcf::rpg::EventCommand::Code::Teleport) {
-		int target_id = ctx.obj->parameters[0];
-		if (id != target_id)
-			targets_per_map.emplace_back(id, target_id);
+	std::vector<int> targets;
+	std::string key;
+	if (!cache_dir.empty()) {
+		key = MapCache::Key(data);
 	}
-}
 
-void ParseLmu(const std::string& filename, int id) {
-	const auto map = lcf::LMU_Reader::Load(filename, encoding);
-	if (!map) {
-		return;
+	if (!key.empty() && MapCache::Load(cache_dir, key, targets)) {
+		cache_hits_counter.Add();
+	} else {
+		maps_counter.Add();
+		if (!Teleports::FromLmu(data, targets)) {
+			log << "Error loading map " << filename << "\n";
+			return;
+		}
+
+		if (!key.empty() && !MapCache::Save(cache_dir, key, targets)) {
+			cache_failed = true;
+		}
 	}
 
-	lcf::rpg::ForEachString(*map.get(), [&](const auto&, const auto& ctx) {
-		parse_event(ctx, id);
-	});
+	teleports_counter.Add(targets.size());
+	for (int target_id : targets) {
+		if (id != target_id) {
+			edges.emplace_back(id, target_id);
+		}
+	}
 }
 
 template<typename T>
@@ -318,11 +371,15 @@ void parse_map(const lcf::ContextStructBase<T>&) {}
 
 template<>
 void parse_map(const lcf::ContextStructBase<lcf::rpg::MapInfo>& ctx) {
+	if (ctx.obj->type == lcf::rpg::TreeMap::MapType_area) {
+		tree_entries.push_back({ctx.obj->ID, ctx.obj->parent_map, lcf::ToString(ctx.obj->name), true});
+		return;
+	}
 	if (ctx.obj->type != lcf::rpg::TreeMap::MapType_map) {
 		return;
 	}
 
-	maps.emplace_back(ctx.obj->ID, lcf::ToString(ctx.obj->name));
+	tree_entries.push_back({ctx.obj->ID, ctx.obj->parent_map, lcf::ToString(ctx.obj->name), false});
 	int id = ctx.obj->ID;
 	std::string name = "map";
 	if (id < 10) {
@@ -333,21 +390,14 @@ void parse_map(const lcf::ContextStructBase<lcf::rpg::MapInfo>& ctx) {
 		name += "0";
 	}
 	name += std::to_string(id) + ".lmu";
-	auto res = std::find_if(source_files.begin(), source_files.end(), [&](const auto& val) {
-		return val.second == name;
-	});
-
-	auto full_path = [&](const auto& name) {
-		return indir + "/" + name;
-	};
-
-	if (res != source_files.end()) {
-		std::cerr << "Parsing Map " << res->first << "\n";
-		ParseLmu(full_path(res->first), id);
+	auto res = source_names.find(name);
+	if (res != source_names.end()) {
+		map_files.emplace_back(id, res->second);
 	}
 }
 
 void ParseLmt(const std::string& filename) {
+	Stats::Scope scope("lmt");
 	auto tree = lcf::LMT_Reader::Load(filename, encoding);
 
 	if (!tree) {
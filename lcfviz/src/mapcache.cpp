@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020 LcfViz authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#include "mapcache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+namespace {
+	// Cache file layout: magic, version, number of targets, then the targets
+	constexpr char cache_magic[4] = { 'L', 'V', 'M', 'C' };
+	// Incremented when the teleport detection changes
+	constexpr uint32_t cache_version = 1;
+
+	std::string CacheFile(const std::string& dir, const std::string& key) {
+		return dir + "/" + key + ".lcfviz";
+	}
+}
+
+std::string MapCache::Key(std::string_view data) {
+	// 64 bit FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (char c : data) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ULL;
+	}
+
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+	return hex;
+}
+
+bool MapCache::Load(const std::string& dir, const std::string& key, std::vector<int>& targets) {
+	std::ifstream in(CacheFile(dir, key), std::ios::binary);
+	if (!in) {
+		return false;
+	}
+
+	std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+
+	char magic[4];
+	uint32_t header[2];
+	if (data.size() < sizeof(magic) + sizeof(header)) {
+		return false;
+	}
+	memcpy(magic, data.data(), sizeof(magic));
+	memcpy(header, data.data() + sizeof(magic), sizeof(header));
+	if (memcmp(magic, cache_magic, sizeof(magic)) != 0 || header[0] != cache_version
+		|| data.size() != sizeof(magic) + sizeof(header) + header[1] * sizeof(int32_t)) {
+		return false;
+	}
+
+	targets.resize(header[1]);
+	const char* p = data.data() + sizeof(magic) + sizeof(header);
+	for (auto& t : targets) {
+		int32_t v;
+		memcpy(&v, p, sizeof(v));
+		p += sizeof(v);
+		t = v;
+	}
+	return true;
+}
+
+bool MapCache::Save(const std::string& dir, const std::string& key, const std::vector<int>& targets) {
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+
+	// write to a temporary file first, concurrent runs never see partial files
+	std::string filename = CacheFile(dir, key);
+	std::string tmp_name = filename + "." + std::to_string(std::random_device{}()) + ".tmp";
+	std::ofstream out(tmp_name, std::ios::binary);
+	if (!out) {
+		return false;
+	}
+
+	uint32_t header[2] = { cache_version, static_cast<uint32_t>(targets.size()) };
+	out.write(cache_magic, sizeof(cache_magic));
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+	for (int t : targets) {
+		int32_t v = t;
+		out.write(reinterpret_cast<const char*>(&v), sizeof(v));
+	}
+	out.close();
+
+	if (!out) {
+		std::filesystem::remove(tmp_name, ec);
+		return false;
+	}
+	std::filesystem::rename(tmp_name, filename, ec);
+	if (ec) {
+		std::filesystem::remove(tmp_name, ec);
+		return false;
+	}
+	return true;
+}
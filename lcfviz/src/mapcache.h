@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2020 LcfViz authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#ifndef LCFVIZ_MAPCACHE
+#define LCFVIZ_MAPCACHE
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Teleport targets of the map files found by earlier runs.
+ * The cache files are named after a hash of the map file, unchanged maps
+ * are not parsed again. The directory can be shared with lcftrans.
+ */
+namespace MapCache {
+	/**
+	 * @param data Content of the map file
+	 * @return Key of the cache file
+	 */
+	std::string Key(std::string_view data);
+
+	/**
+	 * @param dir Cache directory
+	 * @param key Key from Key()
+	 * @param targets Receives the target map IDs of the teleports
+	 * @return false when there is no valid cached version
+	 */
+	bool Load(const std::string& dir, const std::string& key, std::vector<int>& targets);
+
+	/**
+	 * Stores the targets, concurrent runs never see partial files.
+	 * @return false on write errors
+	 */
+	bool Save(const std::string& dir, const std::string& key, const std::vector<int>& targets);
+}
+
+#endif
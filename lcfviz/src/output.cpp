@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2020 LcfViz authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#include "output.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+#include "graph.h"
+
+namespace {
+	void WriteJsonString(std::ostream& out, const std::string& s) {
+		out << '"';
+		for (char c : s) {
+			switch (c) {
+				case '"':
+					out << "\\\"";
+					break;
+				case '\\':
+					out << "\\\\";
+					break;
+				case '\n':
+					out << "\\n";
+					break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						char buf[7];
+						snprintf(buf, sizeof(buf), "\\u%04x", c);
+						out << buf;
+					} else {
+						out << c;
+					}
+			}
+		}
+		out << '"';
+	}
+}
+
+GraphOutput::GraphOutput(const std::vector<TreeEntry>& entries, const Graph& graph, int start_map_id, bool reachable_only) :
+	entries(entries), graph(graph), start_map_id(start_map_id), reachable_only(reachable_only) {
+	for (size_t e = 0; e < entries.size(); ++e) {
+		index.emplace(entries[e].id, e);
+	}
+
+	// Entries without a known parent are top level
+	std::vector<bool> has_parent(entries.size());
+	std::vector<std::vector<size_t>> tree_children(entries.size());
+	for (size_t e = 0; e < entries.size(); ++e) {
+		size_t p = Find(entries[e].parent);
+		if (p != all && p != e) {
+			tree_children[p].push_back(e);
+			has_parent[e] = true;
+		}
+	}
+
+	shown.resize(entries.size());
+	subtree_shown.resize(entries.size());
+	top.assign(entries.size(), all);
+	for (size_t e = 0; e < entries.size(); ++e) {
+		shown[e] = !entries[e].area && (!reachable_only || graph.IsReachable(entries[e].id));
+	}
+
+	// Assigns the top level entry to a subtree, the children are only
+	// taken over when visited first so parent cycles become a tree as well
+	children.resize(entries.size());
+	std::vector<size_t> stack;
+	auto walk = [&](size_t root) {
+		roots.push_back(root);
+		stack.push_back(root);
+		top[root] = root;
+		while (!stack.empty()) {
+			size_t e = stack.back();
+			stack.pop_back();
+			for (size_t c : tree_children[e]) {
+				if (top[c] == all) {
+					top[c] = root;
+					children[e].push_back(c);
+					stack.push_back(c);
+				}
+			}
+		}
+	};
+	for (size_t e = 0; e < entries.size(); ++e) {
+		if (!has_parent[e]) {
+			walk(e);
+		}
+	}
+	// Parent cycles of broken map trees
+	for (size_t e = 0; e < entries.size(); ++e) {
+		if (top[e] == all) {
+			walk(e);
+		}
+	}
+
+	// Children have a higher ID than their parent in a regular map tree,
+	// repeat until nothing changes for the others
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t e = entries.size(); e-- > 0;) {
+			bool s = shown[e];
+			for (size_t c : children[e]) {
+				s = s || subtree_shown[c];
+			}
+			if (s && !subtree_shown[e]) {
+				subtree_shown[e] = true;
+				changed = true;
+			}
+		}
+	}
+}
+
+size_t GraphOutput::Find(int id) const {
+	auto it = index.find(id);
+	return it == index.end() ? all : it->second;
+}
+
+bool GraphOutput::IsShownEdge(int from, int to) const {
+	// Target or source node not in set
+	return !reachable_only || (graph.IsReachable(from) && graph.IsReachable(to));
+}
+
+void GraphOutput::WriteNode(std::ostream& out, size_t e, const char* indent, const char* style) const {
+	out << indent << entries[e].id << " [label=\"" << entries[e].name << "\"";
+	if (style) {
+		out << " " << style;
+	} else if (start_map_id == entries[e].id) {
+		out << " shape=box style=filled fillcolor=gray";
+	}
+	out << "];\n";
+}
+
+void GraphOutput::WriteTree(std::ostream& out, size_t e, int depth) const {
+	std::string indent(depth, '\t');
+
+	if (children[e].empty()) {
+		if (shown[e]) {
+			WriteNode(out, e, indent.c_str(), nullptr);
+		}
+		return;
+	}
+
+	if (!subtree_shown[e]) {
+		return;
+	}
+
+	out << indent << "subgraph cluster_" << entries[e].id << " {\n";
+	out << indent << "\tlabel=\"" << entries[e].name << "\";\n";
+	if (shown[e]) {
+		WriteNode(out, e, (indent + "\t").c_str(), nullptr);
+	}
+	for (size_t c : children[e]) {
+		WriteTree(out, c, depth + 1);
+	}
+	out << indent << "}\n";
+}
+
+void GraphOutput::WriteDot(std::ostream& out, bool cluster) const {
+	WriteDot(out, cluster, all);
+}
+
+void GraphOutput::WriteDot(std::ostream& out, bool cluster, size_t top_entry) const {
+	out << "strict digraph G {\n";
+
+	// Output all nodes (if reachable)
+	if (cluster) {
+		for (size_t r : roots) {
+			if (top_entry == all || r == top_entry) {
+				WriteTree(out, r, 1);
+			}
+		}
+	} else {
+		for (size_t e = 0; e < entries.size(); ++e) {
+			if (shown[e] && (top_entry == all || top[e] == top_entry)) {
+				WriteNode(out, e, "", nullptr);
+			}
+		}
+	}
+
+	// Output edges
+	std::set<int> external;
+	graph.ForEachEdge([&](int from, int to) {
+		if (!IsShownEdge(from, to)) {
+			return;
+		}
+
+		bool inside = true;
+		if (top_entry != all) {
+			size_t f = Find(from);
+			if (f == all || top[f] != top_entry) {
+				return;
+			}
+			size_t t = Find(to);
+			inside = t != all && top[t] == top_entry;
+		}
+
+		// Detect bidirection, the edge with the lower source ID is printed
+		bool both = graph.HasEdge(to, from);
+		if (both && inside && from > to) {
+			// Is reverse edge of a bidirectional node
+			return;
+		}
+
+		if (!inside) {
+			external.insert(to);
+		}
+
+		out << from << " -> " << to;
+		if (both) {
+			out << " [dir=both]";
+		}
+		out << ";\n";
+	});
+
+	// Targets in other parts of the tree
+	for (int id : external) {
+		size_t e = Find(id);
+		if (e != all && !entries[e].area) {
+			WriteNode(out, e, "", "style=dashed");
+		} else {
+			out << id << " [style=dashed];\n";
+		}
+	}
+
+	out << "}\n";
+}
+
+bool GraphOutput::WriteSplitDot(const std::string& dir, bool cluster) const {
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+
+	for (size_t r : roots) {
+		if (!subtree_shown[r]) {
+			continue;
+		}
+
+		std::ofstream out(dir + "/" + std::to_string(entries[r].id) + ".dot");
+		if (!out) {
+			return false;
+		}
+		WriteDot(out, cluster, r);
+		out.close();
+		if (!out) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void GraphOutput::WriteJson(std::ostream& out) const {
+	out << "{\n\"start\": " << start_map_id << ",\n\"nodes\": [";
+
+	const char* sep = "\n";
+	for (size_t e = 0; e < entries.size(); ++e) {
+		if (!shown[e]) {
+			continue;
+		}
+		out << sep << "{\"id\": " << entries[e].id << ", \"name\": ";
+		WriteJsonString(out, entries[e].name);
+		out << ", \"parent\": " << entries[e].parent << "}";
+		sep = ",\n";
+	}
+
+	out << "\n],\n\"areas\": [";
+	sep = "\n";
+	for (size_t e = 0; e < entries.size(); ++e) {
+		if (children[e].empty() || !subtree_shown[e]) {
+			continue;
+		}
+		out << sep << "{\"id\": " << entries[e].id << ", \"name\": ";
+		WriteJsonString(out, entries[e].name);
+		out << ", \"parent\": " << entries[e].parent << "}";
+		sep = ",\n";
+	}
+
+	out << "\n],\n\"edges\": [";
+	sep = "\n";
+	graph.ForEachEdge([&](int from, int to) {
+		if (!IsShownEdge(from, to)) {
+			return;
+		}
+
+		bool both = graph.HasEdge(to, from);
+		if (both && from > to) {
+			return;
+		}
+
+		out << sep << "{\"from\": " << from << ", \"to\": " << to << ", \"both\": " << (both ? "true" : "false") << "}";
+		sep = ",\n";
+	});
+	out << "\n]\n}\n";
+}
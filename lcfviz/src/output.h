@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2020 LcfViz authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#ifndef LCFVIZ_OUTPUT
+#define LCFVIZ_OUTPUT
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Graph;
+
+/** Map or area of the map tree */
+struct TreeEntry {
+	int id;
+	int parent;
+	std::string name;
+	bool area; // folder without a map
+};
+
+/**
+ * Writes the graph as DOT or JSON. Nodes are written in ID order, edges
+ * in the order of Graph::ForEachEdge. Bidirectional edges are written once.
+ */
+class GraphOutput {
+public:
+	/**
+	 * @param entries maps and areas of the map tree, sorted by ID
+	 * @param graph teleport graph
+	 * @param start_map_id start node, highlighted
+	 * @param reachable_only when true only the reachable nodes of graph are written
+	 */
+	GraphOutput(const std::vector<TreeEntry>& entries, const Graph& graph, int start_map_id, bool reachable_only);
+
+	/**
+	 * @param out DOT output
+	 * @param cluster group the nodes in subgraph clusters by map tree parent
+	 */
+	void WriteDot(std::ostream& out, bool cluster) const;
+
+	/**
+	 * Writes one DOT file per top level entry of the map tree, named after
+	 * its ID. Teleports leaving it point to dashed nodes.
+	 *
+	 * @param dir output directory, created when missing
+	 * @param cluster see WriteDot
+	 * @return false on write errors
+	 */
+	bool WriteSplitDot(const std::string& dir, bool cluster) const;
+
+	/**
+	 * Writes the maps, the areas of the map tree that contain written maps
+	 * and the edges as JSON.
+	 */
+	void WriteJson(std::ostream& out) const;
+
+private:
+	static constexpr size_t all = static_cast<size_t>(-1);
+
+	// index of the entry with ID id or all
+	size_t Find(int id) const;
+	bool IsShownEdge(int from, int to) const;
+	void WriteNode(std::ostream& out, size_t e, const char* indent, const char* style) const;
+	void WriteTree(std::ostream& out, size_t e, int depth) const;
+	void WriteDot(std::ostream& out, bool cluster, size_t top) const;
+
+	const std::vector<TreeEntry>& entries;
+	const Graph& graph;
+	int start_map_id;
+	bool reachable_only;
+
+	std::unordered_map<int, size_t> index;
+	std::vector<std::vector<size_t>> children;
+	std::vector<size_t> roots;
+	// top level ancestor of every entry
+	std::vector<size_t> top;
+	std::vector<bool> shown;
+	// entry or any of its children is shown
+	std::vector<bool> subtree_shown;
+};
+
+#endif
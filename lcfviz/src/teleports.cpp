@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020 LcfViz authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#include "teleports.h"
+
+#include <cstdint>
+#include <lcf/rpg/eventcommand.h>
+
+namespace {
+	// Chunk IDs of the LCF map format (see liblcf)
+	constexpr uint32_t chunk_map_events = 0x51;
+	constexpr uint32_t chunk_event_pages = 0x05;
+	constexpr uint32_t chunk_page_event_commands = 0x34;
+
+	class Reader {
+	public:
+		explicit Reader(std::string_view data) : data(data) {}
+
+		bool Eof() const {
+			return data.empty();
+		}
+
+		// BER compressed integer as used by LCF
+		bool ReadInt(uint32_t& value) {
+			value = 0;
+			for (int i = 0; i < 5 && !data.empty(); ++i) {
+				unsigned char c = static_cast<unsigned char>(data.front());
+				data.remove_prefix(1);
+				value = (value << 7) | (c & 0x7F);
+				if ((c & 0x80) == 0) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool Read(size_t size, std::string_view& out) {
+			if (data.size() < size) {
+				return false;
+			}
+			out = data.substr(0, size);
+			data.remove_prefix(size);
+			return true;
+		}
+
+	private:
+		std::string_view data;
+	};
+
+	// Calls func(id, chunk) for every chunk of a struct, until the 0 terminator
+	template <typename F>
+	bool ReadStruct(Reader& r, F&& func) {
+		while (!r.Eof()) {
+			uint32_t id, size;
+			if (!r.ReadInt(id)) {
+				return false;
+			}
+			if (id == 0) {
+				return true;
+			}
+			std::string_view chunk;
+			if (!r.ReadInt(size) || !r.Read(size, chunk)) {
+				return false;
+			}
+			Reader chunk_reader(chunk);
+			if (!func(id, chunk_reader)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Array of structs: count, then the ID and the chunks of every element
+	template <typename F>
+	bool ReadStructArray(Reader& r, F&& func) {
+		uint32_t count;
+		if (!r.ReadInt(count)) {
+			return false;
+		}
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t id;
+			if (!r.ReadInt(id) || !ReadStruct(r, func)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Commands follow each other until the end of the chunk:
+	// code, indent, string, number of parameters and the parameters
+	bool ReadEventCommands(Reader& r, std::vector<int>& targets) {
+		constexpr auto teleport = static_cast<uint32_t>(lcf::rpg::EventCommand::Code::Teleport);
+
+		while (!r.Eof()) {
+			uint32_t code, indent, string_size, param_count;
+			std::string_view str;
+			if (!r.ReadInt(code)) {
+				return false;
+			}
+			if (code == 0) {
+				// end of list marker
+				continue;
+			}
+			if (!r.ReadInt(indent) || !r.ReadInt(string_size) || !r.Read(string_size, str) || !r.ReadInt(param_count)) {
+				return false;
+			}
+			for (uint32_t i = 0; i < param_count; ++i) {
+				uint32_t param;
+				if (!r.ReadInt(param)) {
+					return false;
+				}
+				if (i == 0 && code == teleport) {
+					targets.push_back(static_cast<int32_t>(param));
+				}
+			}
+		}
+		return true;
+	}
+}
+
+bool Teleports::FromLmu(std::string_view data, std::vector<int>& targets) {
+	Reader r(data);
+
+	uint32_t header_size;
+	std::string_view header;
+	if (!r.ReadInt(header_size) || !r.Read(header_size, header) || header != "LcfMapUnit") {
+		return false;
+	}
+
+	targets.clear();
+	return ReadStruct(r, [&](uint32_t id, Reader& map_chunk) {
+		if (id != chunk_map_events) {
+			return true;
+		}
+		return ReadStructArray(map_chunk, [&](uint32_t id, Reader& event_chunk) {
+			if (id != chunk_event_pages) {
+				return true;
+			}
+			return ReadStructArray(event_chunk, [&](uint32_t id, Reader& page_chunk) {
+				if (id != chunk_page_event_commands) {
+					return true;
+				}
+				return ReadEventCommands(page_chunk, targets);
+			});
+		});
+	});
+}
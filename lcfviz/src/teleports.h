@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2020 LcfViz authors
+ * This file is released under the MIT License
+ * http://opensource.org/licenses/MIT
+ */
+
+#ifndef LCFVIZ_TELEPORTS
+#define LCFVIZ_TELEPORTS
+
+#include <string_view>
+#include <vector>
+
+namespace Teleports {
+	/**
+	 * Reads the target map IDs of the teleport commands of a map file.
+	 * Only the event commands are decoded, the tile layers and all other
+	 * chunks are skipped using their chunk sizes.
+	 *
+	 * @param data Content of the map file (LMU)
+	 * @param targets Receives the target IDs in event, page and command order
+	 * @return false when data is not a valid map file
+	 */
+	bool FromLmu(std::string_view data, std::vector<int>& targets);
+}
+
+#endif
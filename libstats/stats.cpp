@@ -0,0 +1,188 @@
+/*
+ * This file is part of libstats. Copyright (c) 2026 libstats authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * libstats is Free/Libre Open Source Software, released under the MIT License.
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ */
+
+#include "stats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Stats::detail::enabled{false};
+
+namespace {
+	struct Phase {
+		const char* name;
+		uint64_t calls = 0;
+		int64_t total = 0;
+	};
+
+	struct Event {
+		const char* name;
+		int thread;
+		int64_t start;
+		int64_t duration;
+	};
+
+	struct State {
+		std::mutex mutex;
+		// in order of first use
+		std::vector<Phase> phases;
+		std::vector<Event> events;
+		std::vector<const Stats::Counter*> counters;
+		bool summary = false;
+		std::string trace_file;
+		int64_t origin = 0;
+	};
+
+	// Counters register during static initialization, so no global object
+	State& GetState() {
+		static State state;
+		return state;
+	}
+
+	int ThreadId() {
+		static std::atomic<int> next_id{0};
+		thread_local int id = next_id++;
+		return id;
+	}
+
+	void AppendEscaped(std::ostream& out, const char* s) {
+		for (; *s; ++s) {
+			if (*s == '"' || *s == '\\') {
+				out << '\\';
+			}
+			out << *s;
+		}
+	}
+
+	// microseconds as used by the trace_event format
+	double Micro(int64_t ns) {
+		return ns / 1000.0;
+	}
+
+	void WriteSummary(std::ostream& out, const State& state, int64_t end) {
+		// slowest phases first
+		std::vector<Phase> phases = state.phases;
+		std::stable_sort(phases.begin(), phases.end(), [](const Phase& a, const Phase& b) {
+			return a.total > b.total;
+		});
+
+		out << std::fixed << std::setprecision(2);
+		out << "Phase                           Calls    Total ms\n";
+		for (const auto& phase : phases) {
+			out << std::left << std::setw(28) << phase.name << std::right
+				<< std::setw(9) << phase.calls
+				<< std::setw(12) << phase.total / 1e6 << "\n";
+		}
+		if (!state.counters.empty()) {
+			out << "Counter                                  Value\n";
+			for (const auto* counter : state.counters) {
+				out << std::left << std::setw(28) << counter->Name() << std::right
+					<< std::setw(18) << counter->Value() << "\n";
+			}
+		}
+		out << "Wall time: " << (end - state.origin) / 1e6 << " ms"
+			<< " (phases of worker threads are summed up)\n";
+		out.unsetf(std::ios::floatfield);
+	}
+
+	bool WriteTrace(const std::string& filename, const State& state, int64_t end) {
+		std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+		out << std::fixed << std::setprecision(3);
+		out << "{\"traceEvents\":[\n";
+		for (const auto& event : state.events) {
+			out << "{\"name\":\"";
+			AppendEscaped(out, event.name);
+			out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+				<< ",\"ts\":" << Micro(event.start - state.origin)
+				<< ",\"dur\":" << Micro(event.duration) << "},\n";
+		}
+		// counter totals at the end of the run
+		out << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":"
+			<< Micro(end - state.origin) << ",\"args\":{";
+		for (size_t i = 0; i < state.counters.size(); ++i) {
+			out << (i > 0 ? "," : "") << "\"";
+			AppendEscaped(out, state.counters[i]->Name());
+			out << "\":" << state.counters[i]->Value();
+		}
+		out << "}}\n],\"displayTimeUnit\":\"ms\"}\n";
+		return static_cast<bool>(out);
+	}
+}
+
+Stats::Counter::Counter(const char* name) : name(name) {
+	State& state = GetState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.counters.push_back(this);
+}
+
+void Stats::detail::Record(const char* name, int64_t start, int64_t end) {
+	State& state = GetState();
+	int thread = ThreadId();
+
+	std::lock_guard<std::mutex> lock(state.mutex);
+	Phase* phase = nullptr;
+	for (auto& p : state.phases) {
+		if (p.name == name || strcmp(p.name, name) == 0) {
+			phase = &p;
+			break;
+		}
+	}
+	if (!phase) {
+		state.phases.push_back({name});
+		phase = &state.phases.back();
+	}
+	++phase->calls;
+	phase->total += end - start;
+
+	if (!state.trace_file.empty()) {
+		state.events.push_back({name, thread, start, end - start});
+	}
+}
+
+void Stats::Enable(bool summary, const std::string& trace_file) {
+	if (!summary && trace_file.empty()) {
+		return;
+	}
+
+	State& state = GetState();
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.summary = summary;
+		state.trace_file = trace_file;
+		state.origin = detail::Now();
+	}
+	// the main thread gets the first id
+	ThreadId();
+	detail::enabled = true;
+}
+
+bool Stats::Finish() {
+	if (!Enabled()) {
+		return true;
+	}
+	detail::enabled = false;
+
+	int64_t end = detail::Now();
+	State& state = GetState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+
+	if (state.summary) {
+		WriteSummary(std::cerr, state, end);
+	}
+	if (!state.trace_file.empty() && !WriteTrace(state.trace_file, state, end)) {
+		std::cerr << "Failed writing trace file " << state.trace_file << "\n";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is part of libstats. Copyright (c) 2026 libstats authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * libstats is Free/Libre Open Source Software, released under the MIT License.
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ */
+
+#ifndef LIBSTATS_H
+#define LIBSTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Phase timers and counters shared by the tools.
+ *
+ * Nothing is recorded until Enable is called, a disabled timer or counter
+ * costs one relaxed atomic load. Timers are meant for phases (reading a
+ * file, drawing a layer), not for single pixels or tiles.
+ */
+namespace Stats {
+	namespace detail {
+		extern std::atomic<bool> enabled;
+
+		/** @return nanoseconds of the steady clock */
+		inline int64_t Now() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		void Record(const char* name, int64_t start, int64_t end);
+	}
+
+	inline bool Enabled() {
+		return detail::enabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Starts recording, call it before any worker thread is started.
+	 *
+	 * @param summary print the phases and counters to stderr in Finish
+	 * @param trace_file write a Chrome trace_event file in Finish, ignored when empty
+	 */
+	void Enable(bool summary, const std::string& trace_file);
+
+	/**
+	 * Writes the summary and the trace requested by Enable.
+	 * Does nothing when not enabled.
+	 *
+	 * @return false when the trace file could not be written
+	 */
+	bool Finish();
+
+	/** Enables recording for the lifetime of the object and calls Finish at the end. */
+	class Session {
+	public:
+		Session(bool summary, const std::string& trace_file) {
+			Enable(summary, trace_file);
+		}
+
+		~Session() {
+			Finish();
+		}
+
+		Session(const Session&) = delete;
+		Session& operator=(const Session&) = delete;
+	};
+
+	/**
+	 * Named counter, define it with static storage duration, e.g.
+	 * static Stats::Counter cache_hits("cache hits");
+	 */
+	class Counter {
+	public:
+		explicit Counter(const char* name);
+
+		Counter(const Counter&) = delete;
+		Counter& operator=(const Counter&) = delete;
+
+		void Add(uint64_t n = 1) {
+			if (Enabled()) {
+				value.fetch_add(n, std::memory_order_relaxed);
+			}
+		}
+
+		const char* Name() const {
+			return name;
+		}
+
+		uint64_t Value() const {
+			return value.load(std::memory_order_relaxed);
+		}
+
+	private:
+		const char* name;
+		std::atomic<uint64_t> value{0};
+	};
+
+	/**
+	 * Times the enclosing block as the phase name. Phases of the same name
+	 * are summed up, name must be a string literal.
+	 */
+	class Scope {
+	public:
+		explicit Scope(const char* name) : name(name) {
+			if (Enabled()) {
+				start = detail::Now();
+			}
+		}
+
+		~Scope() {
+			Stop();
+		}
+
+		/** Ends the phase before the end of the block. */
+		void Stop() {
+			if (start != 0) {
+				detail::Record(name, start, detail::Now());
+				start = 0;
+			}
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		const char* name;
+		int64_t start = 0;
+	};
+}
+
+#endif
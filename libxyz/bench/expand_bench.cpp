@@ -0,0 +1,64 @@
+/*
+ * This file is part of libxyz. Copyright (c) 2026 libxyz authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * libxyz is Free/Libre Open Source Software, released under the MIT License.
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ */
+
+// Compares ExpandPixels against the scalar loop on a synthetic image
+
+#include "libxyz.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+	template <typename F>
+	double MeasureMpx(F func, const Xyz::ImageView& view, std::vector<uint8_t>& dst, int rounds) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < rounds; i++) {
+			func(view, Xyz::PixelFormat::BGRA, dst.data(), 0);
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return static_cast<double>(view.width) * view.height * rounds / elapsed.count() / 1e6;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	int width = 640;
+	int height = 480;
+	int rounds = argc > 1 ? std::atoi(argv[1]) : 500;
+
+	Xyz::Header header;
+	header.width = width;
+	header.height = height;
+
+	std::vector<uint8_t> decoded(Xyz::DecodedSize(header));
+	std::mt19937 rng(1234);
+	for (auto& b : decoded) {
+		b = rng() & 0xFF;
+	}
+	Xyz::ImageView view = Xyz::MakeView(header, decoded.data());
+
+	std::vector<uint8_t> scalar(width * height * 4);
+	std::vector<uint8_t> best(width * height * 4);
+
+	double scalar_mpx = MeasureMpx(Xyz::ExpandPixelsScalar, view, scalar, rounds);
+	double best_mpx = MeasureMpx(Xyz::ExpandPixels, view, best, rounds);
+
+	if (memcmp(scalar.data(), best.data(), scalar.size()) != 0) {
+		std::cerr << "Kernel " << Xyz::ExpandKernelName() << " differs from scalar output.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "scalar: " << scalar_mpx << " Mpx/s\n"
+		<< Xyz::ExpandKernelName() << ": " << best_mpx << " Mpx/s\n";
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+/*
+ * This file is part of libxyz. Copyright (c) 2026 libxyz authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * libxyz is Free/Libre Open Source Software, released under the MIT License.
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ */
+
+#include "fileio.h"
+
+#include <algorithm>
+#include <random>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace Xyz {
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+bool MappedFile::Open(const std::string& filename) {
+	Close();
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+		nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(handle, &file_size) || static_cast<uint64_t>(file_size.QuadPart) > SIZE_MAX) {
+		CloseHandle(handle);
+		return false;
+	}
+	size = static_cast<size_t>(file_size.QuadPart);
+
+	if (size > 0) {
+		// the view keeps the mapping alive after the handles are closed
+		HANDLE map = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (map) {
+			mapping = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(map);
+		}
+
+		if (mapping) {
+			data = static_cast<const uint8_t*>(mapping);
+		} else {
+			buffer.resize(size);
+			size_t got = 0;
+			while (got < size) {
+				DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - got, 1 << 30));
+				DWORD n = 0;
+				if (!ReadFile(handle, buffer.data() + got, chunk, &n, nullptr) || n == 0) {
+					break;
+				}
+				got += n;
+			}
+			if (got != size) {
+				CloseHandle(handle);
+				Close();
+				return false;
+			}
+			data = buffer.data();
+		}
+	}
+	CloseHandle(handle);
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+		close(fd);
+		return false;
+	}
+	size = static_cast<size_t>(st.st_size);
+
+	if (size > 0) {
+		void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr != MAP_FAILED) {
+			mapping = addr;
+			data = static_cast<const uint8_t*>(addr);
+#ifdef POSIX_MADV_SEQUENTIAL
+			// inflate reads the file once from front to back
+			posix_madvise(addr, size, POSIX_MADV_SEQUENTIAL);
+#endif
+		} else {
+			buffer.resize(size);
+			size_t got = 0;
+			while (got < size) {
+				ssize_t n = read(fd, buffer.data() + got, size - got);
+				if (n <= 0) {
+					break;
+				}
+				got += static_cast<size_t>(n);
+			}
+			if (got != size) {
+				close(fd);
+				Close();
+				return false;
+			}
+			data = buffer.data();
+		}
+	}
+	close(fd);
+#endif
+
+	return true;
+}
+
+void MappedFile::Close() {
+	if (mapping) {
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+#else
+		munmap(mapping, size);
+#endif
+		mapping = nullptr;
+	}
+	data = nullptr;
+	size = 0;
+	std::vector<uint8_t>().swap(buffer);
+}
+
+void MappedFile::Prefetch(size_t max_size) const {
+	if (!mapping) {
+		return;
+	}
+
+	size_t length = std::min(size, max_size);
+#ifdef POSIX_MADV_WILLNEED
+	posix_madvise(mapping, length, POSIX_MADV_WILLNEED);
+#endif
+
+	// the advice is only a hint, touching every page waits for the reads
+	uint8_t sum = 0;
+	for (size_t pos = 0; pos < length; pos += 4096) {
+		sum ^= data[pos];
+	}
+	volatile uint8_t sink = sum;
+	(void)sink;
+}
+
+AtomicFile::~AtomicFile() {
+	Discard();
+}
+
+bool AtomicFile::Open(const std::string& filename) {
+	Discard();
+
+	// same directory as the destination, a rename across file systems is no rename
+	this->filename = filename;
+	temp_filename = filename + "." + std::to_string(std::random_device{}()) + ".tmp";
+	file = fopen(temp_filename.c_str(), "wb");
+	if (!file) {
+		temp_filename.clear();
+		return false;
+	}
+	return true;
+}
+
+bool AtomicFile::Write(const void* data, size_t size) {
+	return file && fwrite(data, 1, size, file) == size;
+}
+
+bool AtomicFile::Commit() {
+	if (!file) {
+		return false;
+	}
+
+	bool ok = fflush(file) == 0 && !ferror(file);
+	ok = fclose(file) == 0 && ok;
+	file = nullptr;
+
+	if (ok) {
+#ifdef _WIN32
+		ok = MoveFileExA(temp_filename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		ok = rename(temp_filename.c_str(), filename.c_str()) == 0;
+#endif
+	}
+	if (!ok) {
+		remove(temp_filename.c_str());
+	}
+	temp_filename.clear();
+	return ok;
+}
+
+void AtomicFile::Discard() {
+	if (file) {
+		fclose(file);
+		file = nullptr;
+	}
+	if (!temp_filename.empty()) {
+		remove(temp_filename.c_str());
+		temp_filename.clear();
+	}
+}
+
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of libxyz. Copyright (c) 2026 libxyz authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * libxyz is Free/Libre Open Source Software, released under the MIT License.
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ */
+
+#ifndef LIBXYZ_FILEIO_H
+#define LIBXYZ_FILEIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * File access shared by the converters: inputs are mapped into memory,
+ * outputs only appear under their final name once they are complete.
+ */
+namespace Xyz {
+	/**
+	 * Read only view of a whole file. The file is memory mapped, when the
+	 * system cannot map it the content is read into a buffer instead.
+	 */
+	class MappedFile {
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		/** Maps filename, a previously opened file is closed first. */
+		bool Open(const std::string& filename);
+
+		void Close();
+
+		/**
+		 * Reads the mapping into memory, so that the later accesses
+		 * do not wait for the storage. Used to read files ahead.
+		 *
+		 * @param max_size only the first max_size bytes are read, bounds
+		 *   the memory held by the files waiting in a read ahead window
+		 */
+		void Prefetch(size_t max_size = SIZE_MAX) const;
+
+		/** @return file content, nullptr for empty files */
+		const uint8_t* Data() const {
+			return data;
+		}
+
+		size_t Size() const {
+			return size;
+		}
+
+	private:
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+		/** start of the mapping, nullptr when the buffer is used */
+		void* mapping = nullptr;
+		std::vector<uint8_t> buffer;
+	};
+
+	/**
+	 * Output file written under a temporary name in the directory of the
+	 * destination. Commit renames it over the destination, so an aborted
+	 * run never leaves a truncated file behind. Without Commit the
+	 * temporary file is removed.
+	 */
+	class AtomicFile {
+	public:
+		AtomicFile() = default;
+		~AtomicFile();
+
+		AtomicFile(const AtomicFile&) = delete;
+		AtomicFile& operator=(const AtomicFile&) = delete;
+
+		/** Creates the temporary file for filename. */
+		bool Open(const std::string& filename);
+
+		/** @return stdio handle of the temporary file, e.g. for libpng */
+		FILE* Handle() const {
+			return file;
+		}
+
+		/** Appends size bytes, returns false on error. */
+		bool Write(const void* data, size_t size);
+
+		/** Closes the file and replaces the destination, returns false on error. */
+		bool Commit();
+
+		/** Closes and removes the temporary file. */
+		void Discard();
+
+	private:
+		std::string filename;
+		std::string temp_filename;
+		FILE* file = nullptr;
+	};
+}
+
+#endif
@@ -0,0 +1,483 @@
+/*
+ * This file is part of libxyz. Copyright (c) 2026 libxyz authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * libxyz is Free/Libre Open Source Software, released under the MIT License.
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ */
+
+#include "libxyz.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  define LIBXYZ_X86
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  endif
+#endif
+
+#if defined(LIBXYZ_X86) && (defined(__GNUC__) || defined(__clang__))
+#  define LIBXYZ_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#  define LIBXYZ_TARGET_AVX2
+#endif
+
+namespace Xyz {
+
+bool ParseHeader(const uint8_t* data, size_t size, Header& header) {
+	if (size < header_size || memcmp(data, "XYZ1", 4) != 0) {
+		return false;
+	}
+
+	header.width = data[4] | (data[5] << 8);
+	header.height = data[6] | (data[7] << 8);
+	return true;
+}
+
+void WriteHeader(const Header& header, uint8_t* out) {
+	memcpy(out, "XYZ1", 4);
+	out[4] = header.width & 0xFF;
+	out[5] = header.width >> 8;
+	out[6] = header.height & 0xFF;
+	out[7] = header.height >> 8;
+}
+
+bool IsPlausible(const Header& header, uint64_t file_size) {
+	if (header.width == 0 || header.height == 0) {
+		return false;
+	}
+
+	// zlib header and adler32 checksum
+	if (file_size < header_size + 6) {
+		return false;
+	}
+
+	uint64_t compressed = file_size - header_size;
+	uint64_t decoded = DecodedSize(header);
+
+	// deflate cannot expand data more than 1032:1
+	if (decoded > compressed * 1032) {
+		return false;
+	}
+
+	// same bound as compressBound, with slack for trailing bytes
+	uint64_t bound = decoded + (decoded >> 12) + (decoded >> 14) + (decoded >> 25) + 13;
+	return compressed <= bound + 1024;
+}
+
+ImageView MakeView(const Header& header, const uint8_t* decoded) {
+	ImageView view;
+	view.width = header.width;
+	view.height = header.height;
+	view.palette = decoded;
+	view.pixels = decoded + palette_size;
+	return view;
+}
+
+bool Decode(const uint8_t* data, size_t size, uint8_t* out, size_t out_size, ImageView& view) {
+	Header header;
+	if (!ParseHeader(data, size, header)) {
+		return false;
+	}
+
+	size_t decoded_size = DecodedSize(header);
+	if (out_size < decoded_size) {
+		return false;
+	}
+
+	z_stream strm = {};
+	if (inflateInit(&strm) != Z_OK) {
+		return false;
+	}
+
+	strm.next_in = const_cast<Bytef*>(data + header_size);
+	strm.avail_in = static_cast<uInt>(size - header_size);
+	strm.next_out = out;
+	strm.avail_out = static_cast<uInt>(decoded_size);
+
+	// same result as uncompress, but the size must match the header
+	int status = inflate(&strm, Z_FINISH);
+	inflateEnd(&strm);
+
+	if (status != Z_STREAM_END || strm.avail_out != 0) {
+		return false;
+	}
+
+	view = MakeView(header, out);
+	return true;
+}
+
+bool Decode(const uint8_t* data, size_t size, std::vector<uint8_t>& out, ImageView& view) {
+	Header header;
+	if (!ParseHeader(data, size, header)) {
+		return false;
+	}
+
+	out.resize(DecodedSize(header));
+	return Decode(data, size, out.data(), out.size(), view);
+}
+
+namespace {
+	using ExpandRowFunc = void (*)(const uint32_t* lut, const uint8_t* src, uint8_t* dst, int width);
+
+	// Builds the 32 bit pixel of every palette entry in the final byte order
+	void BuildLut(const ImageView& view, PixelFormat format, uint32_t* lut) {
+		for (int i = 0; i < palette_entries; i++) {
+			const uint8_t* color = view.Color(i);
+			uint8_t px[4];
+			if (format == PixelFormat::RGBA) {
+				px[0] = color[0];
+				px[2] = color[2];
+			} else {
+				px[0] = color[2];
+				px[2] = color[0];
+			}
+			px[1] = color[1];
+			px[3] = 255;
+			memcpy(&lut[i], px, 4);
+		}
+	}
+
+	void ExpandRowScalar(const uint32_t* lut, const uint8_t* src, uint8_t* dst, int width) {
+		int x = 0;
+		for (; x + 4 <= width; x += 4) {
+			memcpy(dst + x * 4, &lut[src[x]], 4);
+			memcpy(dst + x * 4 + 4, &lut[src[x + 1]], 4);
+			memcpy(dst + x * 4 + 8, &lut[src[x + 2]], 4);
+			memcpy(dst + x * 4 + 12, &lut[src[x + 3]], 4);
+		}
+		for (; x < width; x++) {
+			memcpy(dst + x * 4, &lut[src[x]], 4);
+		}
+	}
+
+#ifdef LIBXYZ_X86
+	// Gathers 8 table entries per instruction
+	LIBXYZ_TARGET_AVX2
+	void ExpandRowAvx2(const uint32_t* lut, const uint8_t* src, uint8_t* dst, int width) {
+		int x = 0;
+		for (; x + 8 <= width; x += 8) {
+			__m128i idx8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x));
+			__m256i idx = _mm256_cvtepu8_epi32(idx8);
+			__m256i px = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), idx, 4);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), px);
+		}
+		ExpandRowScalar(lut, src + x, dst + x * 4, width - x);
+	}
+
+	bool CpuHasAvx2() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		// OSXSAVE and AVX, and the OS saves the YMM registers
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 ||
+				(_xgetbv(0) & 6) != 6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+		return __builtin_cpu_supports("avx2");
+#else
+		return false;
+#endif
+	}
+#endif
+
+	struct ExpandKernel {
+		ExpandRowFunc func;
+		const char* name;
+	};
+
+	// Chosen once on first use
+	const ExpandKernel& GetExpandKernel() {
+		static const ExpandKernel kernel = []() {
+#ifdef LIBXYZ_X86
+			if (CpuHasAvx2()) {
+				return ExpandKernel { ExpandRowAvx2, "avx2" };
+			}
+#endif
+			return ExpandKernel { ExpandRowScalar, "scalar" };
+		}();
+		return kernel;
+	}
+
+	void ExpandWith(ExpandRowFunc func, const ImageView& view, PixelFormat format, uint8_t* dst, size_t stride) {
+		if (stride == 0) {
+			stride = static_cast<size_t>(view.width) * 4;
+		}
+
+		uint32_t lut[palette_entries];
+		BuildLut(view, format, lut);
+
+		for (int y = 0; y < view.height; y++) {
+			func(lut, view.Row(y), dst + y * stride, view.width);
+		}
+	}
+}
+
+void ExpandPixels(const ImageView& view, PixelFormat format, uint8_t* dst, size_t stride) {
+	ExpandWith(GetExpandKernel().func, view, format, dst, stride);
+}
+
+void ExpandPixelsScalar(const ImageView& view, PixelFormat format, uint8_t* dst, size_t stride) {
+	ExpandWith(ExpandRowScalar, view, format, dst, stride);
+}
+
+const char* ExpandKernelName() {
+	return GetExpandKernel().name;
+}
+
+Reader::Reader() {
+	inflateInit(&strm);
+}
+
+Reader::~Reader() {
+	inflateEnd(&strm);
+}
+
+Reader::Result Reader::Open(const std::string& filename) {
+	file.close();
+	file.clear();
+	file.open(filename, std::ios::binary);
+	if (!file) {
+		header = Header();
+		return Result::IoError;
+	}
+
+	return Open([this](uint8_t* buf, size_t len) {
+		file.read(reinterpret_cast<char*>(buf), len);
+		return static_cast<size_t>(file.gcount());
+	});
+}
+
+Reader::Result Reader::Open(const uint8_t* data, size_t size) {
+	inflateReset(&strm);
+	strm.avail_in = 0;
+	header = Header();
+	source = nullptr;
+	memory = nullptr;
+	memory_left = 0;
+
+	if (!ParseHeader(data, size, header)) {
+		return Result::NotXyz;
+	}
+
+	// inflated straight from data, nothing is copied into the chunk
+	memory = data + header_size;
+	memory_left = size - header_size;
+	return Result::Ok;
+}
+
+Reader::Result Reader::Open(ReadFunc read) {
+	// allow reuse for the next file
+	inflateReset(&strm);
+	strm.avail_in = 0;
+	header = Header();
+	source = std::move(read);
+	memory = nullptr;
+	memory_left = 0;
+
+	uint8_t data[header_size];
+	size_t got = 0;
+	while (got < header_size) {
+		size_t n = source(data + got, header_size - got);
+		if (n == 0) {
+			return Result::NotXyz;
+		}
+		got += n;
+	}
+
+	if (!ParseHeader(data, header_size, header)) {
+		return Result::NotXyz;
+	}
+
+	return Result::Ok;
+}
+
+bool Reader::Read(uint8_t* out, size_t len) {
+	strm.next_out = out;
+	strm.avail_out = static_cast<uInt>(len);
+
+	while (strm.avail_out > 0) {
+		if (strm.avail_in == 0) {
+			if (memory_left > 0) {
+				size_t n = std::min<size_t>(memory_left, UINT_MAX);
+				strm.next_in = const_cast<Bytef*>(memory);
+				strm.avail_in = static_cast<uInt>(n);
+				memory += n;
+				memory_left -= n;
+			} else if (source) {
+				strm.next_in = chunk;
+				strm.avail_in = static_cast<uInt>(source(chunk, sizeof(chunk)));
+			}
+			if (strm.avail_in == 0) {
+				// truncated
+				return false;
+			}
+		}
+
+		int status = inflate(&strm, Z_NO_FLUSH);
+		if (status == Z_STREAM_END) {
+			return strm.avail_out == 0;
+		} else if (status != Z_OK) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Writer::Writer(int level) {
+	ready = deflateInit(&strm, level) == Z_OK;
+}
+
+Writer::~Writer() {
+	if (ready) {
+		deflateEnd(&strm);
+	}
+}
+
+bool Writer::Begin(const Header& header, WriteFunc write) {
+	// allow reuse for the next file
+	sink = std::move(write);
+	written = 0;
+	if (!ready || deflateReset(&strm) != Z_OK) {
+		return false;
+	}
+
+	uint8_t data[header_size];
+	WriteHeader(header, data);
+	return sink(data, header_size);
+}
+
+bool Writer::Write(const uint8_t* data, size_t size) {
+	while (size > 0) {
+		size_t n = std::min<size_t>(size, UINT_MAX);
+		strm.next_in = const_cast<Bytef*>(data);
+		strm.avail_in = static_cast<uInt>(n);
+		if (!Deflate(Z_NO_FLUSH)) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool Writer::Finish() {
+	strm.next_in = Z_NULL;
+	strm.avail_in = 0;
+	return Deflate(Z_FINISH);
+}
+
+bool Writer::Deflate(int flush) {
+	if (!ready) {
+		return false;
+	}
+
+	int status;
+	do {
+		strm.next_out = chunk;
+		strm.avail_out = sizeof(chunk);
+		status = deflate(&strm, flush);
+		if (status == Z_STREAM_ERROR) {
+			return false;
+		}
+		size_t have = sizeof(chunk) - strm.avail_out;
+		if (have > 0 && !sink(chunk, have)) {
+			return false;
+		}
+		written += have;
+	} while (strm.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+	return true;
+}
+
+void ThumbnailSize(const Header& header, int max_size, int& width, int& height) {
+	width = header.width;
+	height = header.height;
+
+	if (max_size <= 0 || (width <= max_size && height <= max_size)) {
+		return;
+	}
+
+	if (width >= height) {
+		height = std::max(1, height * max_size / width);
+		width = max_size;
+	} else {
+		width = std::max(1, width * max_size / height);
+		height = max_size;
+	}
+}
+
+bool DecodeThumbnail(Reader& reader, int max_size, PixelFormat format,
+		std::vector<uint8_t>& pixels, int& width, int& height) {
+	const Header& header = reader.GetHeader();
+	if (header.width == 0 || header.height == 0) {
+		return false;
+	}
+	ThumbnailSize(header, max_size, width, height);
+
+	uint8_t palette[palette_size];
+	if (!reader.Read(palette, sizeof(palette))) {
+		return false;
+	}
+
+	int r = format == PixelFormat::RGBA ? 0 : 2;
+	int b = 2 - r;
+
+	// output column of every source column
+	std::vector<int> column(header.width);
+	for (int x = 0; x < header.width; x++) {
+		column[x] = static_cast<int>(static_cast<int64_t>(x) * width / header.width);
+	}
+
+	std::vector<uint8_t> row(header.width);
+	std::vector<uint32_t> sums(width * 4);
+	pixels.resize(static_cast<size_t>(width) * height * 4);
+
+	int out_y = 0;
+	for (int y = 0; y < header.height; y++) {
+		if (!reader.Read(row.data(), row.size())) {
+			return false;
+		}
+
+		for (int x = 0; x < header.width; x++) {
+			const uint8_t* color = &palette[row[x] * 3];
+			uint32_t* sum = &sums[column[x] * 4];
+			sum[0] += color[0];
+			sum[1] += color[1];
+			sum[2] += color[2];
+			sum[3] += 1;
+		}
+
+		// last source row of this output row
+		int next_y = static_cast<int>(static_cast<int64_t>(y + 1) * height / header.height);
+		if (next_y != out_y) {
+			uint8_t* dst = &pixels[static_cast<size_t>(out_y) * width * 4];
+			for (int x = 0; x < width; x++) {
+				uint32_t* sum = &sums[x * 4];
+				// every output column has a source column, unless the header lies
+				uint32_t count = std::max<uint32_t>(sum[3], 1);
+				dst[x * 4 + r] = (sum[0] + count / 2) / count;
+				dst[x * 4 + 1] = (sum[1] + count / 2) / count;
+				dst[x * 4 + b] = (sum[2] + count / 2) / count;
+				dst[x * 4 + 3] = 255;
+			}
+			std::fill(sums.begin(), sums.end(), 0);
+			out_y = next_y;
+		}
+	}
+
+	return true;
+}
+
+}
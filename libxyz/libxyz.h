@@ -0,0 +1,233 @@
+/*
+ * This file is part of libxyz. Copyright (c) 2026 libxyz authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * libxyz is Free/Libre Open Source Software, released under the MIT License.
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ */
+
+#ifndef LIBXYZ_H
+#define LIBXYZ_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+/**
+ * Shared XYZ image codec.
+ *
+ * An XYZ1 file is an 8 byte header (magic, width, height as little endian
+ * 16 bit values) followed by a zlib stream holding the 256 entry RGB palette
+ * and one palette index per pixel.
+ */
+namespace Xyz {
+	constexpr size_t header_size = 8;
+	constexpr int palette_entries = 256;
+	constexpr size_t palette_size = palette_entries * 3;
+
+	struct Header {
+		uint16_t width = 0;
+		uint16_t height = 0;
+	};
+
+	/** Parses the file header, returns false when the data is no XYZ1 file. */
+	bool ParseHeader(const uint8_t* data, size_t size, Header& header);
+
+	/** Writes the header_size bytes of the file header to out. */
+	void WriteHeader(const Header& header, uint8_t* out);
+
+	/** @return size of the uncompressed palette and pixels */
+	inline size_t DecodedSize(const Header& header) {
+		return palette_size + static_cast<size_t>(header.width) * header.height;
+	}
+
+	/** Read only view of decoded XYZ data, borrows the decoded buffer. */
+	struct ImageView {
+		uint16_t width = 0;
+		uint16_t height = 0;
+		/** palette_entries RGB triplets */
+		const uint8_t* palette = nullptr;
+		/** width * height palette indices, top-down */
+		const uint8_t* pixels = nullptr;
+
+		const uint8_t* Color(uint8_t index) const {
+			return palette + index * 3;
+		}
+
+		const uint8_t* Row(int y) const {
+			return pixels + static_cast<size_t>(y) * width;
+		}
+	};
+
+	/** Files above this size are not thumbnailed, decoding them stalls the file manager. */
+	constexpr uint64_t thumbnail_max_file_size = 64 * 1024 * 1024;
+
+	/**
+	 * Cheap sanity check of the header against the file size, done before
+	 * anything is inflated. Rejects empty images and compressed sizes that
+	 * no zlib stream of the decoded size can have.
+	 *
+	 * @param header parsed header
+	 * @param file_size size of the whole file
+	 * @return whether decoding is worth a try
+	 */
+	bool IsPlausible(const Header& header, uint64_t file_size);
+
+	/** Creates a view of DecodedSize(header) bytes of palette and pixels. */
+	ImageView MakeView(const Header& header, const uint8_t* decoded);
+
+	/**
+	 * Inflates an XYZ file into a caller provided buffer.
+	 *
+	 * @param data whole file content
+	 * @param size size of data
+	 * @param out receives palette and pixels
+	 * @param out_size size of out, at least DecodedSize of the header
+	 * @param view on success points into out
+	 * @return false on invalid header, too small buffer or corrupt data
+	 */
+	bool Decode(const uint8_t* data, size_t size, uint8_t* out, size_t out_size, ImageView& view);
+
+	/** Same as above but resizes out to the decoded size. */
+	bool Decode(const uint8_t* data, size_t size, std::vector<uint8_t>& out, ImageView& view);
+
+	/** Byte order of expanded 32 bit pixels. */
+	enum class PixelFormat {
+		RGBA,
+		BGRA
+	};
+
+	/**
+	 * Expands palette indices to opaque 32 bit pixels.
+	 * Uses AVX2 gathers when the CPU supports them.
+	 *
+	 * @param view decoded image
+	 * @param format byte order of the written pixels
+	 * @param dst receives height rows of width pixels
+	 * @param stride bytes between the rows in dst, 0 for width * 4
+	 */
+	void ExpandPixels(const ImageView& view, PixelFormat format, uint8_t* dst, size_t stride = 0);
+
+	/** Portable variant of ExpandPixels, used as reference by the benchmark. */
+	void ExpandPixelsScalar(const ImageView& view, PixelFormat format, uint8_t* dst, size_t stride = 0);
+
+	/** @return name of the kernel ExpandPixels picked for this CPU */
+	const char* ExpandKernelName();
+
+	/** Inflates an XYZ file in fixed size chunks. */
+	class Reader {
+	public:
+		enum class Result {
+			Ok,
+			IoError,
+			NotXyz
+		};
+
+		/** Fills buf with up to len bytes of the file, returns 0 at the end. */
+		using ReadFunc = std::function<size_t(uint8_t* buf, size_t len)>;
+
+		Reader();
+		~Reader();
+
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		/** Opens filename and reads the header, the reader can be reused. */
+		Result Open(const std::string& filename);
+
+		/** Reads the header through read, the remaining file is read on demand. */
+		Result Open(ReadFunc read);
+
+		/**
+		 * Reads from a file already in memory, e.g. a MappedFile.
+		 * The data is inflated in place and must outlive the reader.
+		 */
+		Result Open(const uint8_t* data, size_t size);
+
+		/** Inflates exactly len bytes to out, returns false on error. */
+		bool Read(uint8_t* out, size_t len);
+
+		const Header& GetHeader() const {
+			return header;
+		}
+
+	private:
+		std::ifstream file;
+		ReadFunc source;
+		const uint8_t* memory = nullptr;
+		size_t memory_left = 0;
+		z_stream strm = {};
+		Header header;
+		uint8_t chunk[64 * 1024];
+	};
+
+	/**
+	 * Deflates an XYZ file while the palette and pixels are produced and
+	 * passes the output on in fixed size chunks, so no compressed image
+	 * is kept in memory.
+	 */
+	class Writer {
+	public:
+		/** Stores size bytes of the file, returns false on error. */
+		using WriteFunc = std::function<bool(const uint8_t* data, size_t size)>;
+
+		/** @param level zlib compression level */
+		explicit Writer(int level = Z_BEST_COMPRESSION);
+		~Writer();
+
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		/** Writes the header through write and starts the zlib stream, the writer can be reused. */
+		bool Begin(const Header& header, WriteFunc write);
+
+		/** Compresses the next size bytes of palette and pixels, returns false on error. */
+		bool Write(const uint8_t* data, size_t size);
+
+		/** Flushes the end of the zlib stream, returns false on error. */
+		bool Finish();
+
+		/** @return compressed bytes written since Begin, without the header */
+		size_t Written() const {
+			return written;
+		}
+
+	private:
+		bool Deflate(int flush);
+
+		WriteFunc sink;
+		z_stream strm = {};
+		bool ready = false;
+		size_t written = 0;
+		uint8_t chunk[64 * 1024];
+	};
+
+	/**
+	 * Calculates the size of a thumbnail fitting into max_size x max_size
+	 * with the aspect ratio of the image. Images are never enlarged.
+	 */
+	void ThumbnailSize(const Header& header, int max_size, int& width, int& height);
+
+	/**
+	 * Decodes an opened image directly into a thumbnail of ThumbnailSize.
+	 * Rows are box filtered while they are inflated, so only one source row
+	 * and one row of sums are kept besides the output.
+	 *
+	 * @param reader opened reader, positioned at the palette
+	 * @param max_size maximum width and height of the thumbnail
+	 * @param format byte order of the written pixels
+	 * @param pixels receives width * height opaque 32 bit pixels, top-down
+	 * @param width receives the thumbnail width
+	 * @param height receives the thumbnail height
+	 * @return false on corrupt data or an empty image
+	 */
+	bool DecodeThumbnail(Reader& reader, int max_size, PixelFormat format,
+		std::vector<uint8_t>& pixels, int& width, int& height);
+}
+
+#endif
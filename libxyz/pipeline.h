@@ -0,0 +1,154 @@
+/*
+ * This file is part of libxyz. Copyright (c) 2026 libxyz authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * libxyz is Free/Libre Open Source Software, released under the MIT License.
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ */
+
+#ifndef LIBXYZ_PIPELINE_H
+#define LIBXYZ_PIPELINE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Xyz {
+	/**
+	 * Runs a batch conversion as read-ahead, compute and write-behind
+	 * stages, so waiting for slow storage overlaps with the CPU work.
+	 *
+	 * read runs on its own thread and fills the next job, it returns false
+	 * when there are no more jobs. compute runs on threads worker threads,
+	 * worker is the index of the thread for per-thread state. write runs
+	 * on the calling thread in read order and returns false to stop, the
+	 * remaining jobs are then dropped. At most threads + read_ahead jobs
+	 * are between read and write.
+	 *
+	 * @param threads number of compute threads
+	 * @param read_ahead jobs read before a compute thread is free
+	 * @param read prepares the next job
+	 * @param compute converts a job
+	 * @param write stores a converted job
+	 */
+	template <typename Job>
+	void RunPipeline(int threads, int read_ahead,
+			const std::function<bool(Job&)>& read,
+			const std::function<void(Job&, int worker)>& compute,
+			const std::function<bool(Job&)>& write) {
+		enum class State {
+			Read,
+			Computing,
+			Computed
+		};
+
+		struct Slot {
+			Job job;
+			State state = State::Read;
+		};
+
+		threads = std::max(threads, 1);
+		const size_t max_jobs = threads + std::max(read_ahead, 0);
+
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<std::unique_ptr<Slot>> window;
+		bool read_done = false;
+		bool stop = false;
+
+		std::thread reader([&]() {
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					cv.wait(lock, [&]() { return stop || window.size() < max_jobs; });
+					if (stop) {
+						break;
+					}
+				}
+
+				std::unique_ptr<Slot> slot(new Slot());
+				if (!read(slot->job)) {
+					break;
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				window.push_back(std::move(slot));
+				cv.notify_all();
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			read_done = true;
+			cv.notify_all();
+		});
+
+		std::vector<std::thread> workers;
+		for (int worker = 0; worker < threads; worker++) {
+			workers.emplace_back([&, worker]() {
+				for (;;) {
+					std::unique_lock<std::mutex> lock(mutex);
+					Slot* slot = nullptr;
+					cv.wait(lock, [&]() {
+						if (stop) {
+							return true;
+						}
+						for (auto& s : window) {
+							if (s->state == State::Read) {
+								slot = s.get();
+								return true;
+							}
+						}
+						return read_done;
+					});
+					if (!slot) {
+						break;
+					}
+
+					slot->state = State::Computing;
+					lock.unlock();
+					compute(slot->job, worker);
+					lock.lock();
+					slot->state = State::Computed;
+					cv.notify_all();
+				}
+			});
+		}
+
+		for (;;) {
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [&]() {
+				return (!window.empty() && window.front()->state == State::Computed) ||
+					(read_done && window.empty());
+			});
+			if (window.empty()) {
+				break;
+			}
+
+			// only computed slots are removed, the workers keep no pointer to them
+			std::unique_ptr<Slot> slot = std::move(window.front());
+			window.pop_front();
+			cv.notify_all();
+			lock.unlock();
+
+			if (!write(slot->job)) {
+				lock.lock();
+				stop = true;
+				cv.notify_all();
+				break;
+			}
+		}
+
+		reader.join();
+		for (auto& t : workers) {
+			t.join();
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,207 @@
+/* kernel_bench.cpp, timings of the blitter and the chipset generation.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// Runs the kernels on in-memory surfaces, without any file I/O
+
+// Headers
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <FreeImage.h>
+#include "blit.h"
+#include "chipset.h"
+
+namespace {
+	constexpr int BASE_WIDTH = 480;
+	constexpr int BASE_HEIGHT = 256;
+	constexpr int CHARSET_WIDTH = 288;
+	constexpr int CHARSET_HEIGHT = 256;
+	constexpr int OUTPUT_WIDTH = 640;
+	constexpr int OUTPUT_HEIGHT = 480;
+
+	struct BlitPos {
+		int sx, sy, dx, dy;
+	};
+
+	// Random colors, a quarter of the pixels is transparent like in chipsets
+	BitmapPtr MakeBitmap(int width, int height, std::mt19937 &rng) {
+		BitmapPtr dib(FreeImage_Allocate(width, height, 32));
+		BlitSurface surface(dib.get());
+		for (int y = 0; y < height; y++) {
+			uint8_t *row = surface.Row(y);
+			for (int x = 0; x < width; x++) {
+				uint32_t pixel = rng();
+				if (rng() % 4 == 0) {
+					pixel &= ~FI_RGBA_ALPHA_MASK;
+				} else {
+					pixel |= FI_RGBA_ALPHA_MASK;
+				}
+				memcpy(row + x * 4, &pixel, 4);
+			}
+		}
+		return dib;
+	}
+
+	// Positions inside both surfaces, so nothing gets clipped
+	std::vector<BlitPos> MakePositions(const BlitSurface &src, const BlitSurface &dst, int w, int h, std::mt19937 &rng) {
+		std::vector<BlitPos> positions(4096);
+		for (auto &pos : positions) {
+			pos.sx = rng() % (src.width - w + 1);
+			pos.sy = rng() % (src.height - h + 1);
+			pos.dx = rng() % (dst.width - w + 1);
+			pos.dy = rng() % (dst.height - h + 1);
+		}
+		return positions;
+	}
+
+	// Per pixel version of Blit::Keyed
+	void KeyedReference(const BlitSurface &src, const BlitPos &pos, const BlitSurface &dst, int w, int h) {
+		for (int y = 0; y < h; y++) {
+			const uint8_t *s = src.Row(pos.sy + y) + pos.sx * 4;
+			uint8_t *d = dst.Row(pos.dy + y) + pos.dx * 4;
+			for (int x = 0; x < w; x++) {
+				uint32_t pixel;
+				memcpy(&pixel, s + x * 4, 4);
+				if (pixel & FI_RGBA_ALPHA_MASK) {
+					memcpy(d + x * 4, &pixel, 4);
+				}
+			}
+		}
+	}
+
+	bool SameContent(const RenderTarget &a, const RenderTarget &b) {
+		return memcmp(a.Pixels(), b.Pixels(), static_cast<size_t>(a.Width()) * a.Height() * 4) == 0;
+	}
+
+	template <typename F>
+	double Seconds(F func) {
+		auto start = std::chrono::steady_clock::now();
+		func();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+	// Fixed size color keyed copies, checked against the reference first
+	template<int W, int H>
+	bool BenchKeyed(const char *name, const BlitSurface &src, int rounds, std::mt19937 &rng) {
+		RenderTarget expected(OUTPUT_WIDTH, OUTPUT_HEIGHT);
+		RenderTarget output(OUTPUT_WIDTH, OUTPUT_HEIGHT);
+		auto positions = MakePositions(src, output.Surface(), W, H, rng);
+
+		for (const auto &pos : positions) {
+			KeyedReference(src, pos, expected.Surface(), W, H);
+			Blit::Keyed<W, H>(src, pos.sx, pos.sy, output.Surface(), pos.dx, pos.dy);
+		}
+		if (!SameContent(expected, output)) {
+			std::cerr << name << " differs from the per pixel copy.\n";
+			return false;
+		}
+
+		double seconds = Seconds([&]() {
+			for (int i = 0; i < rounds; i++) {
+				for (const auto &pos : positions) {
+					Blit::Keyed<W, H>(src, pos.sx, pos.sy, output.Surface(), pos.dx, pos.dy);
+				}
+			}
+		});
+		double blits = static_cast<double>(positions.size()) * rounds;
+		std::cout << name << ": " << blits / seconds / 1e6 << " Mblits/s, "
+			<< blits * W * H / seconds / 1e6 << " Mpx/s\n";
+		return true;
+	}
+
+	// Tile IDs of all layers and tile types, as stored in the maps
+	std::vector<unsigned short> MakeTiles(int count, std::mt19937 &rng) {
+		std::vector<unsigned short> tiles(count);
+		for (auto &tile : tiles) {
+			switch (rng() % 6) {
+				case 0: // water A-C
+					tile = (rng() % 3) * 1000 + (rng() % 20) * 50 + rng() % 47;
+					break;
+				case 1:
+					tile = TILETYPE::ANIMATED + (rng() % 3) * 50;
+					break;
+				case 2:
+					tile = TILETYPE::TERRAIN + (rng() % 12) * 50 + rng() % 50;
+					break;
+				case 3:
+				case 4:
+					tile = TILETYPE::LOWER + rng() % 144;
+					break;
+				default:
+					tile = TILETYPE::UPPER + rng() % 144;
+					break;
+			}
+		}
+		return tiles;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	int rounds = argc > 1 ? std::atoi(argv[1]) : 200;
+	if (rounds <= 0) {
+		std::cerr << "Usage: lmu2png_bench [rounds]\n";
+		return EXIT_FAILURE;
+	}
+
+	std::mt19937 rng(1234);
+	BitmapPtr base = MakeBitmap(BASE_WIDTH, BASE_HEIGHT, rng);
+	BitmapPtr charset = MakeBitmap(CHARSET_WIDTH, CHARSET_HEIGHT, rng);
+	BlitSurface base_surface(base.get());
+
+	std::cout << "Blit::Keyed\n";
+	bool ok = BenchKeyed<HALF_TILE, HALF_TILE>("  8x8 quarter", base_surface, rounds, rng)
+		&& BenchKeyed<TILE_SIZE, HALF_TILE>("  16x8 wide", base_surface, rounds, rng)
+		&& BenchKeyed<TILE_SIZE, TILE_SIZE>("  16x16 tile", base_surface, rounds, rng)
+		&& BenchKeyed<24, 32>("  24x32 sprite", BlitSurface(charset.get()), rounds, rng);
+	if (!ok) {
+		return EXIT_FAILURE;
+	}
+
+	// The constructor draws the whole 512x720 atlas
+	int atlas_rounds = std::max(1, rounds / 20);
+	double atlas_seconds = Seconds([&]() {
+		for (int i = 0; i < atlas_rounds; i++) {
+			Chipset chipset(base.get());
+		}
+	});
+	std::cout << "Chipset(" << CHIPSET_WIDTH << "x" << CHIPSET_HEIGHT << " atlas): "
+		<< atlas_seconds / atlas_rounds * 1e3 << " ms\n";
+
+	// One frame covers the output with the tiles, the animation advances
+	Chipset chipset(base.get());
+	RenderTarget output(OUTPUT_WIDTH, OUTPUT_HEIGHT);
+	constexpr int tiles_x = OUTPUT_WIDTH / TILE_SIZE;
+	constexpr int tiles_y = OUTPUT_HEIGHT / TILE_SIZE;
+	auto tiles = MakeTiles(tiles_x * tiles_y, rng);
+	double tile_seconds = Seconds([&]() {
+		for (int i = 0; i < rounds; i++) {
+			for (int y = 0; y < tiles_y; y++) {
+				for (int x = 0; x < tiles_x; x++) {
+					chipset.RenderTile(output.Surface(), x, y, tiles[y * tiles_x + x], i);
+				}
+			}
+		}
+	});
+	std::cout << "Chipset::RenderTile: "
+		<< static_cast<double>(tiles.size()) * rounds / tile_seconds / 1e6 << " Mtiles/s\n";
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,308 @@
+/* animation.cpp, animated PNG output.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// Headers
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include "animation.h"
+#include "blit.h"
+#include "chipset.h"
+#include "chipsetcache.h"
+#include "pngwriter.h"
+
+namespace {
+	// RPG_RT runs at 60 frames per second, the animated tiles advance every
+	// 6 frames and water every 24 or, with the fast setting, 12 frames
+	constexpr int ticks_per_second = 60;
+	constexpr int animated_ticks = 6;
+	constexpr int water_slow_ticks = 24;
+	constexpr int water_fast_ticks = 12;
+
+	struct Frame {
+		AnimationFrame step;
+		int ticks;
+	};
+
+	// Tiles of one row that are all water or all animated tiles
+	struct Run {
+		int x, y, width;
+		bool water;
+	};
+
+	std::vector<Frame> Timeline(const MapData& data, bool has_water, bool has_animated) {
+		static const int reciprocating[4] = { 0, 1, 2, 1 };
+		int water_ticks = data.water_fast ? water_fast_ticks : water_slow_ticks;
+		int water_steps = data.water_cycle ? 3 : 4;
+
+		// one loop of the animations that are used
+		int period = animated_ticks;
+		if (has_water) {
+			period = std::lcm(period, water_ticks * water_steps);
+		}
+		if (has_animated) {
+			period = std::lcm(period, animated_ticks * 4);
+		}
+
+		std::vector<Frame> frames;
+		for (int t = 0; t < period; t += animated_ticks) {
+			AnimationFrame step;
+			if (has_water) {
+				int i = (t / water_ticks) % water_steps;
+				step.water = data.water_cycle ? i : reciprocating[i];
+			}
+			if (has_animated) {
+				step.animated = (t / animated_ticks) % 4;
+			}
+
+			if (!frames.empty() && frames.back().step == step) {
+				frames.back().ticks += animated_ticks;
+			} else {
+				frames.push_back({ step, animated_ticks });
+			}
+		}
+		return frames;
+	}
+
+	std::vector<Run> AnimatedRuns(const MapData& data) {
+		std::vector<Run> runs;
+		if (data.conf.no_lowertiles) {
+			return runs;
+		}
+
+		// water and animated tiles only exist on the lower layer
+		const auto &map = *data.map;
+		for (int y = 0; y < map.height; y++) {
+			for (int x = 0; x < map.width; x++) {
+				uint16_t tid = map.lower_layer[x + y * map.width];
+				if (tid >= TILETYPE::TERRAIN) {
+					continue;
+				}
+				bool water = tid < TILETYPE::ANIMATED;
+				if (!runs.empty() && runs.back().y == y && runs.back().x + runs.back().width == x
+					&& runs.back().water == water) {
+					runs.back().width++;
+				} else {
+					runs.push_back({ x, y, 1, water });
+				}
+			}
+		}
+		return runs;
+	}
+}
+
+bool WriteAnimation(MapData& data, const std::string& filename, int png_level,
+	ErrorCallbackFunc error_cb, ErrorCallbackParam param) {
+	L2IConfig conf = data.conf;
+	std::shared_ptr<Chipset> gen = ChipsetCache::Instance().Get(conf.chipset, conf.cache_dir, conf.verbose);
+	if (!gen) {
+		error_cb("Unable to create chipset image.", param);
+		return false;
+	}
+
+	std::vector<Run> runs = AnimatedRuns(data);
+	bool has_water = std::any_of(runs.begin(), runs.end(), [](const Run& run) { return run.water; });
+	bool has_animated = std::any_of(runs.begin(), runs.end(), [](const Run& run) { return !run.water; });
+	std::vector<Frame> frames = Timeline(data, has_water, has_animated);
+	if (conf.verbose) {
+		error_cb("Writing " + std::to_string(frames.size()) + " frames", param);
+	}
+
+	EventLayers events;
+	if (!conf.no_events) {
+		events = ResolveEvents(data.map, conf);
+	}
+
+	// the image shown so far, every frame is compared against it
+	int width = data.map->width * TILE_SIZE;
+	int height = data.map->height * TILE_SIZE;
+	RenderPtr canvas;
+	try {
+		canvas = std::make_unique<RenderTarget>(width, height);
+	} catch (const std::bad_alloc&) {
+		error_cb("Unable to create output image.", param);
+		return false;
+	}
+	if (!conf.no_background) {
+		DrawBackground(*canvas, data.map, conf);
+	}
+	RenderLayers(*canvas, gen.get(), data.csflag.data(), data.map, conf, events);
+
+	auto save_error = [&]() {
+		error_cb("Error saving \"" + filename + "\".", param);
+		return false;
+	};
+
+	PngWriter png;
+	if (!png.Open(filename, width, height, png_level, nullptr, static_cast<int>(frames.size()))) {
+		return save_error();
+	}
+
+	const BlitSurface &output = canvas->Surface();
+	PngFrame first;
+	first.width = width;
+	first.height = height;
+	first.delay_num = frames[0].ticks;
+	first.delay_den = ticks_per_second;
+	if (!png.BeginFrame(first)) {
+		return save_error();
+	}
+	for (int y = 0; y < height; y++) {
+		if (!png.WriteRow(output.Row(y))) {
+			return save_error();
+		}
+	}
+
+	// the runs are drawn one tile row at a time, on all cores
+	L2IConfig run_conf = conf;
+	run_conf.threads = 1;
+	run_conf.verbose = false;
+	int threads = conf.threads > 0 ? conf.threads : static_cast<int>(std::thread::hardware_concurrency());
+	threads = std::max(1, threads);
+
+	std::vector<uint8_t> row;
+	std::vector<uint8_t> mask;
+	for (size_t f = 1; f < frames.size(); f++) {
+		const AnimationFrame &step = frames[f].step;
+		const AnimationFrame &previous = frames[f - 1].step;
+
+		std::vector<const Run *> dirty;
+		for (const auto &run : runs) {
+			if (run.water ? step.water != previous.water : step.animated != previous.animated) {
+				dirty.push_back(&run);
+			}
+		}
+
+		std::vector<RenderPtr> parts(dirty.size());
+		try {
+			for (size_t i = 0; i < dirty.size(); i++) {
+				parts[i] = std::make_unique<RenderTarget>(dirty[i]->width * TILE_SIZE, TILE_SIZE,
+					dirty[i]->x * TILE_SIZE, dirty[i]->y * TILE_SIZE);
+			}
+		} catch (const std::bad_alloc&) {
+			error_cb("Unable to create output image.", param);
+			return false;
+		}
+
+		auto draw_parts = [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				if (!run_conf.no_background) {
+					DrawBackground(*parts[i], data.map, run_conf);
+				}
+				RenderLayers(*parts[i], gen.get(), data.csflag.data(), data.map, run_conf, events, step);
+			}
+		};
+		size_t count = (parts.size() + threads - 1) / threads;
+		std::vector<std::thread> workers;
+		for (size_t i = count; i < parts.size(); i += count) {
+			workers.emplace_back(draw_parts, i, std::min(i + count, parts.size()));
+		}
+		draw_parts(0, std::min(count, parts.size()));
+		for (auto &t : workers) {
+			t.join();
+		}
+
+		// area of the pixels that changed
+		int x0 = width, y0 = height, x1 = 0, y1 = 0;
+		for (const auto &part : parts) {
+			const BlitSurface &surface = part->Surface();
+			for (int y = 0; y < surface.height; y++) {
+				const uint8_t *src = surface.Row(y);
+				const uint8_t *dst = output.Row(part->OriginY() + y) + part->OriginX() * 4;
+				for (int x = 0; x < surface.width; x++) {
+					if (memcmp(src + x * 4, dst + x * 4, 4) != 0) {
+						x0 = std::min(x0, part->OriginX() + x);
+						x1 = std::max(x1, part->OriginX() + x + 1);
+						y0 = std::min(y0, part->OriginY() + y);
+						y1 = std::max(y1, part->OriginY() + y + 1);
+					}
+				}
+			}
+		}
+
+		PngFrame frame;
+		frame.delay_num = frames[f].ticks;
+		frame.delay_den = ticks_per_second;
+		frame.blend = true;
+		if (x0 >= x1) {
+			// nothing visible changed, a transparent pixel keeps the timing
+			frame.width = 1;
+			frame.height = 1;
+			row.assign(4, 0);
+			if (!png.BeginFrame(frame) || !png.WriteRow(row.data())) {
+				return save_error();
+			}
+			continue;
+		}
+
+		// Update the canvas. Unchanged pixels stay transparent and are
+		// blended over the previous frame, unless a changed one is not
+		// opaque, then the whole area is replaced.
+		frame.x = x0;
+		frame.y = y0;
+		frame.width = x1 - x0;
+		frame.height = y1 - y0;
+		mask.assign(static_cast<size_t>(frame.width) * frame.height, 0);
+		for (const auto &part : parts) {
+			const BlitSurface &surface = part->Surface();
+			for (int y = 0; y < surface.height; y++) {
+				const uint8_t *src = surface.Row(y);
+				uint8_t *dst = output.Row(part->OriginY() + y) + part->OriginX() * 4;
+				for (int x = 0; x < surface.width; x++) {
+					if (memcmp(src + x * 4, dst + x * 4, 4) == 0) {
+						continue;
+					}
+					memcpy(dst + x * 4, src + x * 4, 4);
+					mask[static_cast<size_t>(part->OriginY() + y - y0) * frame.width + part->OriginX() + x - x0] = 1;
+					if (src[x * 4 + FI_RGBA_ALPHA] != 255) {
+						frame.blend = false;
+					}
+				}
+			}
+		}
+
+		if (!png.BeginFrame(frame)) {
+			return save_error();
+		}
+		row.resize(static_cast<size_t>(frame.width) * 4);
+		for (int y = 0; y < frame.height; y++) {
+			const uint8_t *src = output.Row(y0 + y) + x0 * 4;
+			if (!frame.blend) {
+				memcpy(row.data(), src, row.size());
+			} else {
+				const uint8_t *changed = &mask[static_cast<size_t>(y) * frame.width];
+				for (int x = 0; x < frame.width; x++) {
+					if (changed[x]) {
+						memcpy(&row[x * 4], src + x * 4, 4);
+					} else {
+						memset(&row[x * 4], 0, 4);
+					}
+				}
+			}
+			if (!png.WriteRow(row.data())) {
+				return save_error();
+			}
+		}
+	}
+
+	if (!png.Close()) {
+		return save_error();
+	}
+	return true;
+}
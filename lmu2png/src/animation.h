@@ -0,0 +1,31 @@
+/* animation.h, animated PNG output.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+// Headers
+#include <string>
+#include "main.h"
+#include "utils.h"
+
+// Writes the map as animated PNG with moving water and animated tiles. The
+// map is rendered once, every following frame only re-renders the tiles
+// whose animation step changed and stores the pixels that differ.
+bool WriteAnimation(MapData& data, const std::string& filename, int png_level,
+	ErrorCallbackFunc error_cb, ErrorCallbackParam param = nullptr);
+
+#endif
@@ -0,0 +1,224 @@
+/* blit.cpp, color keyed copies between 32bpp or 8bpp surfaces.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// Headers
+#include <algorithm>
+#include <iostream>
+#include "blit.h"
+
+BlitSurface::BlitSurface(FIBITMAP *dib) {
+	if (!dib || (FreeImage_GetBPP(dib) != 32 && FreeImage_GetBPP(dib) != 8)) {
+		return;
+	}
+
+	bpp = FreeImage_GetBPP(dib) / 8;
+	width = FreeImage_GetWidth(dib);
+	height = FreeImage_GetHeight(dib);
+	// FreeImage stores the bottom row first
+	pixels = FreeImage_GetScanLine(dib, height - 1);
+	stride = -static_cast<ptrdiff_t>(FreeImage_GetPitch(dib));
+}
+
+RenderTarget::RenderTarget(int width, int height, int origin_x, int origin_y, int bpp) :
+	m_Pixels(static_cast<size_t>(width) * height * bpp), m_OriginX(origin_x), m_OriginY(origin_y) {
+	m_Surface.pixels = m_Pixels.data();
+	m_Surface.stride = static_cast<ptrdiff_t>(width) * bpp;
+	m_Surface.bpp = bpp;
+	m_Surface.width = width;
+	m_Surface.height = height;
+}
+
+void Blit::Copy(const BlitSurface &src, const BlitSurface &dst) {
+	if (!src || !dst || src.bpp != dst.bpp) {
+		return;
+	}
+
+	int w = std::min(src.width, dst.width);
+	int h = std::min(src.height, dst.height);
+	for (int y = 0; y < h; y++) {
+		memcpy(dst.Row(y), src.Row(y), static_cast<size_t>(w) * dst.bpp);
+	}
+}
+
+void Blit::Scale(const BlitSurface &src, const BlitSurface &dst, int width, int height, int x, int y) {
+	if (!src || !dst || src.bpp != dst.bpp || width <= 0 || height <= 0) {
+		return;
+	}
+
+	// source column of every destination pixel
+	int bpp = dst.bpp;
+	int w = std::max(0, std::min(dst.width, width - x));
+	int h = std::max(0, std::min(dst.height, height - y));
+	std::vector<int> columns(w);
+	for (int dx = 0; dx < w; dx++) {
+		columns[dx] = static_cast<int>(static_cast<int64_t>(dx + x) * src.width / width) * bpp;
+	}
+
+	int last_sy = -1;
+	for (int dy = 0; dy < h; dy++) {
+		int sy = static_cast<int>(static_cast<int64_t>(dy + y) * src.height / height);
+		uint8_t *d = dst.Row(dy);
+		if (sy == last_sy) {
+			// upscaling repeats rows
+			memcpy(d, dst.Row(dy - 1), static_cast<size_t>(w) * bpp);
+			continue;
+		}
+
+		const uint8_t *s = src.Row(sy);
+		if (bpp == 1) {
+			for (int dx = 0; dx < w; dx++) {
+				d[dx] = s[columns[dx]];
+			}
+		} else {
+			for (int dx = 0; dx < w; dx++) {
+				memcpy(d + dx * 4, s + columns[dx], 4);
+			}
+		}
+		last_sy = sy;
+	}
+}
+
+void Blit::Tile(const BlitSurface &src, const BlitSurface &dst, int x, int y) {
+	if (!src || !dst || src.bpp != dst.bpp) {
+		return;
+	}
+
+	int bpp = dst.bpp;
+	int sx = x % src.width;
+	for (int dy = 0; dy < dst.height; dy++) {
+		const uint8_t *s = src.Row((dy + y) % src.height);
+		uint8_t *d = dst.Row(dy);
+		// the first copy starts inside of the source row
+		for (int dx = 0, from = sx; dx < dst.width; from = 0) {
+			int w = std::min(src.width - from, dst.width - dx);
+			memcpy(d + dx * bpp, s + from * bpp, static_cast<size_t>(w) * bpp);
+			dx += w;
+		}
+	}
+}
+
+void Blit::Downscale(const BlitSurface &src, const BlitSurface &dst, int factor) {
+	if (!src || !dst || src.bpp != 4 || dst.bpp != 4 || factor < 1) {
+		return;
+	}
+
+	int w = std::min(dst.width, src.width / factor);
+	int h = std::min(dst.height, src.height / factor);
+	int area = factor * factor;
+	for (int y = 0; y < h; y++) {
+		uint8_t *d = dst.Row(y);
+		for (int x = 0; x < w; x++, d += 4) {
+			unsigned sum[4] = {};
+			int opaque = 0;
+			for (int sy = 0; sy < factor; sy++) {
+				const uint8_t *s = src.Row(y * factor + sy) + static_cast<ptrdiff_t>(x) * factor * 4;
+				for (int sx = 0; sx < factor; sx++, s += 4) {
+					if (s[FI_RGBA_ALPHA] == 0) {
+						continue;
+					}
+					opaque++;
+					for (int c = 0; c < 4; c++) {
+						sum[c] += s[c];
+					}
+				}
+			}
+
+			if (opaque * 2 < area) {
+				memset(d, 0, 4);
+				continue;
+			}
+			for (int c = 0; c < 4; c++) {
+				d[c] = static_cast<uint8_t>((sum[c] + opaque / 2) / opaque);
+			}
+		}
+	}
+}
+
+void Blit::Fill(const BlitSurface &dst, const RGBQUAD &color) {
+	if (dst.bpp != 4) {
+		return;
+	}
+
+	uint8_t pixel[4];
+	pixel[FI_RGBA_RED] = color.rgbRed;
+	pixel[FI_RGBA_GREEN] = color.rgbGreen;
+	pixel[FI_RGBA_BLUE] = color.rgbBlue;
+	pixel[FI_RGBA_ALPHA] = color.rgbReserved;
+
+	for (int y = 0; y < dst.height; y++) {
+		uint8_t *row = dst.Row(y);
+		for (int x = 0; x < dst.width; x++) {
+			memcpy(row + x * 4, pixel, 4);
+		}
+	}
+}
+
+void Blit::Fill(const BlitSurface &dst, uint8_t index) {
+	if (dst.bpp != 1) {
+		return;
+	}
+
+	for (int y = 0; y < dst.height; y++) {
+		memset(dst.Row(y), index, dst.width);
+	}
+}
+
+void Blit::Rect(const BlitSurface &src, int sx, int sy, const BlitSurface &dst, int dx, int dy, int w, int h) {
+	if (!src || !dst || src.bpp != dst.bpp) {
+		std::cout << "Source or Destination have wrong format.\n";
+		return;
+	}
+
+	// Sanitize src dims
+	if ((sx < 0) || (sy < 0) || (sx + w > src.width) || (sy + h > src.height)) {
+		std::cout << "Source dimension error.\n";
+		return;
+	}
+
+	// Event special case: draw only part on borders
+	if (dx < 0) {
+		sx -= dx;
+		w += dx;
+		dx = 0;
+	}
+	if (dy < 0) {
+		sy -= dy;
+		h += dy;
+		dy = 0;
+	}
+	if (dx + w > dst.width) {
+		w = dst.width - dx;
+	}
+	if (dy + h > dst.height) {
+		h = dst.height - dy;
+	}
+
+	if ((w <= 0) || (h <= 0)) {
+		return;
+	}
+
+	const uint8_t *s = src.Row(sy) + sx * src.bpp;
+	uint8_t *d = dst.Row(dy) + dx * dst.bpp;
+	for (int y = 0; y < h; y++) {
+		if (dst.bpp == 1) {
+			Blit::CopyKeyed8(s, d, w);
+		} else {
+			Blit::CopyKeyed(s, d, w);
+		}
+		s += src.stride;
+		d += dst.stride;
+	}
+}
@@ -0,0 +1,219 @@
+/* blit.h, color keyed copies between 32bpp or 8bpp surfaces.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef BLIT_H
+#define BLIT_H
+
+// Headers
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <FreeImage.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define BLIT_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	include <arm_neon.h>
+#	define BLIT_NEON
+#endif
+
+// A 32bpp or 8bpp surface, format and dimensions are checked once on creation.
+// Rows are addressed from the top, FreeImage bitmaps get a negative stride.
+// 8bpp surfaces hold indices of a shared palette, index 0 is transparent.
+struct BlitSurface {
+	uint8_t *pixels = nullptr; // top row
+	ptrdiff_t stride = 0;      // bytes from one row to the row below
+	int width = 0;
+	int height = 0;
+	int bpp = 4;               // bytes per pixel, 4 or 1
+
+	BlitSurface() = default;
+	// Empty when dib is missing or neither 32bpp nor 8bpp
+	explicit BlitSurface(FIBITMAP *dib);
+
+	uint8_t *Row(int y) const { return pixels + y * stride; }
+	explicit operator bool() const { return pixels != nullptr; }
+};
+
+// Top-down, tightly packed 32bpp image the renderer draws into. Pixels use
+// the FreeImage byte order, so chipsets and charsets are copied unchanged.
+// Indexed targets use 1 byte per pixel, see IndexedScene.
+// A target can cover only a part of the map, starting at the origin.
+class RenderTarget {
+public:
+	// Throws std::bad_alloc when the image does not fit into memory
+	RenderTarget(int width, int height, int origin_x = 0, int origin_y = 0, int bpp = 4);
+	RenderTarget(const RenderTarget&) = delete;
+	RenderTarget& operator=(const RenderTarget&) = delete;
+
+	const BlitSurface& Surface() const { return m_Surface; }
+	int Width() const { return m_Surface.width; }
+	int Height() const { return m_Surface.height; }
+	// Map position of the top left pixel
+	int OriginX() const { return m_OriginX; }
+	int OriginY() const { return m_OriginY; }
+	const uint8_t *Pixels() const { return m_Pixels.data(); }
+
+private:
+	std::vector<uint8_t> m_Pixels;
+	BlitSurface m_Surface;
+	int m_OriginX;
+	int m_OriginY;
+};
+using RenderPtr = std::unique_ptr<RenderTarget>;
+
+namespace Blit {
+	// Copies count pixels, skipping fully transparent source pixels
+	inline void CopyKeyed(const uint8_t *src, uint8_t *dst, int count) {
+		int x = 0;
+#if defined(BLIT_SSE2)
+		const __m128i alpha = _mm_set1_epi32(static_cast<int>(FI_RGBA_ALPHA_MASK));
+		const __m128i zero = _mm_setzero_si128();
+		for (; x + 4 <= count; x += 4) {
+			__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4));
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + x * 4));
+			// all ones where the source is transparent and dst is kept
+			__m128i keep = _mm_cmpeq_epi32(_mm_and_si128(s, alpha), zero);
+			d = _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4), d);
+		}
+#elif defined(BLIT_NEON)
+		const uint32x4_t alpha = vdupq_n_u32(FI_RGBA_ALPHA_MASK);
+		for (; x + 4 <= count; x += 4) {
+			uint32x4_t s = vld1q_u32(reinterpret_cast<const uint32_t *>(src + x * 4));
+			uint32x4_t d = vld1q_u32(reinterpret_cast<const uint32_t *>(dst + x * 4));
+			uint32x4_t opaque = vtstq_u32(s, alpha);
+			vst1q_u32(reinterpret_cast<uint32_t *>(dst + x * 4), vbslq_u32(opaque, s, d));
+		}
+#endif
+		src += x * 4;
+		dst += x * 4;
+		for (int n = count - x; n > 0; n--, src += 4, dst += 4) {
+			uint32_t s;
+			memcpy(&s, src, 4);
+			if (s & FI_RGBA_ALPHA_MASK) {
+				memcpy(dst, &s, 4);
+			}
+		}
+	}
+
+	// Copies count palette indices, skipping the transparent index 0
+	inline void CopyKeyed8(const uint8_t *src, uint8_t *dst, int count) {
+		int x = 0;
+#if defined(BLIT_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		for (; x + 16 <= count; x += 16) {
+			__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + x));
+			__m128i keep = _mm_cmpeq_epi8(s, zero);
+			d = _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), d);
+		}
+#elif defined(BLIT_NEON)
+		for (; x + 16 <= count; x += 16) {
+			uint8x16_t s = vld1q_u8(src + x);
+			uint8x16_t d = vld1q_u8(dst + x);
+			uint8x16_t opaque = vtstq_u8(s, s);
+			vst1q_u8(dst + x, vbslq_u8(opaque, s, d));
+		}
+#endif
+		for (; x + 8 <= count; x += 8) {
+			// 8 pixels at once, the quarter tiles are 8 pixels wide
+			uint64_t s, d;
+			memcpy(&s, src + x, 8);
+			memcpy(&d, dst + x, 8);
+			uint64_t low = 0x7F7F7F7F7F7F7F7FULL;
+			// high bit set in every byte that is not zero
+			uint64_t opaque = (((s & low) + low) | s) & ~low;
+			uint64_t mask = (opaque >> 7) * 0xFF;
+			d = (s & mask) | (d & ~mask);
+			memcpy(dst + x, &d, 8);
+		}
+		for (; x < count; x++) {
+			if (src[x]) {
+				dst[x] = src[x];
+			}
+		}
+	}
+
+	// Fixed size copy, the caller guarantees both rectangles are inside and
+	// use the same pixel size
+	template<int W, int H>
+	inline void Keyed(const BlitSurface &src, int sx, int sy, const BlitSurface &dst, int dx, int dy) {
+		if (dst.bpp == 1) {
+			const uint8_t *s = src.Row(sy) + sx;
+			uint8_t *d = dst.Row(dy) + dx;
+			for (int y = 0; y < H; y++) {
+				CopyKeyed8(s, d, W);
+				s += src.stride;
+				d += dst.stride;
+			}
+			return;
+		}
+
+		const uint8_t *s = src.Row(sy) + sx * 4;
+		uint8_t *d = dst.Row(dy) + dx * 4;
+		for (int y = 0; y < H; y++) {
+			CopyKeyed(s, d, W);
+			s += src.stride;
+			d += dst.stride;
+		}
+	}
+
+	// Color keyed copy of a w x h rectangle, clipped to the destination.
+	// Rectangles reaching outside of the source and surfaces of different
+	// pixel sizes are rejected.
+	void Rect(const BlitSurface &src, int sx, int sy, const BlitSurface &dst, int dx, int dy, int w, int h);
+
+	// Opaque copy of the whole source to the top left corner of dst
+	void Copy(const BlitSurface &src, const BlitSurface &dst);
+
+	// Opaque nearest neighbour copy of the source stretched to width x height,
+	// dst receives the part starting at x, y
+	void Scale(const BlitSurface &src, const BlitSurface &dst, int width, int height, int x = 0, int y = 0);
+
+	// Opaque copy of the source repeated from the top left corner, dst
+	// receives the part starting at x, y
+	void Tile(const BlitSurface &src, const BlitSurface &dst, int x = 0, int y = 0);
+
+	// Box filtered copy of a 32bpp source reduced by factor in both
+	// directions. A pixel gets the average of the opaque pixels of its
+	// block and stays transparent unless most of them are opaque, so color
+	// keyed graphics remain keyed.
+	void Downscale(const BlitSurface &src, const BlitSurface &dst, int factor);
+
+	// Sets every pixel of a 32bpp dst to color
+	void Fill(const BlitSurface &dst, const RGBQUAD &color);
+
+	// Sets every pixel of an 8bpp dst to the palette index
+	void Fill(const BlitSurface &dst, uint8_t index);
+
+	// Like Rect, but uses the fixed size copy when nothing is clipped
+	template<int W, int H>
+	inline void Checked(const BlitSurface &src, int sx, int sy, const BlitSurface &dst, int dx, int dy) {
+		if (src.bpp == dst.bpp && sx >= 0 && sy >= 0 && sx + W <= src.width && sy + H <= src.height &&
+			dx >= 0 && dy >= 0 && dx + W <= dst.width && dy + H <= dst.height) {
+			Keyed<W, H>(src, sx, sy, dst, dx, dy);
+		} else {
+			Rect(src, sx, sy, dst, dx, dy, W, H);
+		}
+	}
+}
+
+#endif
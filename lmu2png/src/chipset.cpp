@@ -25,7 +25,9 @@
 Chipset::Chipset(FIBITMAP *Surface) {
 	// Set base surface, used for generating the tileset
 	m_Base.reset(FreeImage_Clone(Surface));
-	m_Chipset.reset(FreeImage_Allocate(CHIPSET_WIDTH, CHIPSET_HEIGHT, 32));
+	m_Chipset.reset(FreeImage_Allocate(CHIPSET_WIDTH, CHIPSET_HEIGHT, FreeImage_GetBPP(Surface)));
+	m_BaseSurface = BlitSurface(m_Base.get());
+	m_ChipsetSurface = BlitSurface(m_Chipset.get());
 	int CurrentTile = 0;
 
 	// Generate water tiles A-C
@@ -39,14 +41,14 @@ Chipset::Chipset(FIBITMAP *Surface) {
 
 		for (int frame = 0; frame<3; frame++) {
 			for (int comb = 0; comb<47; comb++, CurrentTile++)
-				RenderWaterTile(m_Chipset.get(), CurrentTile, frame, border, water, comb);
+				RenderWaterTile(m_ChipsetSurface, CurrentTile, frame, border, water, comb);
 		}
 	}
 
 	// Generate water depth tiles
 	for (int depth = 1; depth<4; depth+=2) {
 		for (int i=0; i<48; i++, CurrentTile++)
-			RenderDepthTile(m_Chipset.get(), CurrentTile, i, depth);
+			RenderDepthTile(m_ChipsetSurface, CurrentTile, i, depth);
 	}
 
 	// Generate animated tiles
@@ -56,14 +58,14 @@ Chipset::Chipset(FIBITMAP *Surface) {
 			int y = (CurrentTile/TILES_IN_ROW)*TILE_SIZE;
 			int sX = 48+j*TILE_SIZE, sY = 64+i*TILE_SIZE;
 
-			DrawFull(m_Chipset.get(), x, y, sX, sY);
+			DrawFull(m_ChipsetSurface, x, y, sX, sY);
 		}
 	}
 
 	// Generate terrain tiles
 	for (int terrain=0; terrain<12; terrain++) {
 		for (int comb=0; comb<50; comb++, CurrentTile++)
-			RenderTerrainTile(m_Chipset.get(), CurrentTile, terrain, comb);
+			RenderTerrainTile(m_ChipsetSurface, CurrentTile, terrain, comb);
 	}
 
 	// Generate common tiles
@@ -73,18 +75,24 @@ Chipset::Chipset(FIBITMAP *Surface) {
 		int sX = 192+((i%6)*TILE_SIZE)+(i/96)*96;
 		int sY = ((i/6)%TILE_SIZE)*TILE_SIZE;
 
-		DrawFull(m_Chipset.get(), x, y, sX, sY);
+		DrawFull(m_ChipsetSurface, x, y, sX, sY);
 	}
 }
 
+Chipset::Chipset(BitmapPtr Atlas, int TileSize) :
+	m_Chipset(std::move(Atlas)),
+	m_ChipsetSurface(m_Chipset.get()),
+	m_TileSize(TileSize) {
+	// The base surface is only needed for generating
+}
+
 Chipset::~Chipset() {
-	//FreeImage_Save(FIF_PNG, m_Chipset.get(), "_chipset.png");
 }
 
-void Chipset::RenderTile(FIBITMAP *dest, int tile_x, int tile_y,
+void Chipset::RenderTile(const BlitSurface &dest, int tile_x, int tile_y,
 	unsigned short Tile, int Frame) {
-	tile_x *= TILE_SIZE;
-	tile_y *= TILE_SIZE;
+	tile_x *= m_TileSize;
+	tile_y *= m_TileSize;
 
 	if (Tile >= TILETYPE::UPPER) {               // Upper layer tiles
 		Tile = Tile - TILETYPE::UPPER + 0x04FB;
@@ -102,10 +110,24 @@ void Chipset::RenderTile(FIBITMAP *dest, int tile_x, int tile_y,
 		Tile = WaterType*141+WaterTile+(Frame*47);
 	}
 
-	DrawSurface(dest, tile_x, tile_y, ((Tile&0x1F)<<4), ((Tile>>5)<<4), TILE_SIZE, TILE_SIZE, false);
+	int sX = (Tile&0x1F)*m_TileSize, sY = (Tile>>5)*m_TileSize;
+	switch (m_TileSize) {
+		case TILE_SIZE:
+			Blit::Checked<TILE_SIZE, TILE_SIZE>(m_ChipsetSurface, sX, sY, dest, tile_x, tile_y);
+			break;
+		case TILE_SIZE/2:
+			Blit::Checked<TILE_SIZE/2, TILE_SIZE/2>(m_ChipsetSurface, sX, sY, dest, tile_x, tile_y);
+			break;
+		case TILE_SIZE/4:
+			Blit::Checked<TILE_SIZE/4, TILE_SIZE/4>(m_ChipsetSurface, sX, sY, dest, tile_x, tile_y);
+			break;
+		default:
+			Blit::Rect(m_ChipsetSurface, sX, sY, dest, tile_x, tile_y, m_TileSize, m_TileSize);
+			break;
+	}
 }
 
-void Chipset::RenderWaterTile(FIBITMAP *dest, unsigned short Tile, int Frame, int Border, int Water, int Combination) {
+void Chipset::RenderWaterTile(const BlitSurface &dest, unsigned short Tile, int Frame, int Border, int Water, int Combination) {
 	int x = (Tile%TILES_IN_ROW)*TILE_SIZE;
 	int y = (Tile/TILES_IN_ROW)*TILE_SIZE;
 	int SFrame = Frame*16, SBorder = Border*48;
@@ -234,7 +256,7 @@ void Chipset::RenderWaterTile(FIBITMAP *dest, unsigned short Tile, int Frame, in
 	}
 }
 
-void Chipset::RenderTerrainTile(FIBITMAP *dest, unsigned short Tile, int Terrain, int Combination) {
+void Chipset::RenderTerrainTile(const BlitSurface &dest, unsigned short Tile, int Terrain, int Combination) {
 	int x = (Tile%TILES_IN_ROW)*TILE_SIZE;
 	int y = (Tile/TILES_IN_ROW)*TILE_SIZE;
 	Terrain += 4;
@@ -362,7 +384,7 @@ void Chipset::RenderTerrainTile(FIBITMAP *dest, unsigned short Tile, int Terrain
 	}
 }
 
-void Chipset::RenderDepthTile(FIBITMAP *dest, unsigned short Tile, int Number, int Depth) {
+void Chipset::RenderDepthTile(const BlitSurface &dest, unsigned short Tile, int Number, int Depth) {
 	int x = (Tile%TILES_IN_ROW)*TILE_SIZE;
 	int y = (Tile/TILES_IN_ROW)*TILE_SIZE;
 	int Frame = Number/16;
@@ -374,34 +396,34 @@ void Chipset::RenderDepthTile(FIBITMAP *dest, unsigned short Tile, int Number, i
 	DrawEdges(dest, x, y, sX, sY, DepthCombination);
 }
 
-void Chipset::DrawSurface(FIBITMAP *dest, int dX, int dY, int sX, int sY, int sW, int sH, bool fromBase) {
-	FIBITMAP* src = fromBase ? m_Base.get() : m_Chipset.get();
+void Chipset::DrawSurface(const BlitSurface &dest, int dX, int dY, int sX, int sY, int sW, int sH, bool fromBase) {
+	const BlitSurface &src = fromBase ? m_BaseSurface : m_ChipsetSurface;
 
 	if (sW == -1)
-		sW = FreeImage_GetWidth(src);
+		sW = src.width;
 	if (sH == -1)
-		sH = FreeImage_GetHeight(src);
+		sH = src.height;
 
-	CustomAlphaCombine(src, sX, sY, dest, dX, dY, sW, sH);
+	Blit::Rect(src, sX, sY, dest, dX, dY, sW, sH);
 }
 
-inline void Chipset::DrawFull(FIBITMAP *dest, int x, int y, int sX, int sY) {
-	DrawSurface(dest, x, y, sX, sY, TILE_SIZE, TILE_SIZE);
+inline void Chipset::DrawFull(const BlitSurface &dest, int x, int y, int sX, int sY) {
+	Blit::Checked<TILE_SIZE, TILE_SIZE>(m_BaseSurface, sX, sY, dest, x, y);
 }
 
-inline void Chipset::DrawQuarter(FIBITMAP *dest, int x, int y, int sX, int sY) {
-	DrawSurface(dest, x, y, sX, sY, HALF_TILE, HALF_TILE);
+inline void Chipset::DrawQuarter(const BlitSurface &dest, int x, int y, int sX, int sY) {
+	Blit::Checked<HALF_TILE, HALF_TILE>(m_BaseSurface, sX, sY, dest, x, y);
 }
 
-inline void Chipset::DrawWide(FIBITMAP *dest, int x, int y, int sX, int sY) {
-	DrawSurface(dest, x, y, sX, sY, TILE_SIZE, HALF_TILE);
+inline void Chipset::DrawWide(const BlitSurface &dest, int x, int y, int sX, int sY) {
+	Blit::Checked<TILE_SIZE, HALF_TILE>(m_BaseSurface, sX, sY, dest, x, y);
 }
 
-inline void Chipset::DrawTall(FIBITMAP *dest, int x, int y, int sX, int sY) {
-	DrawSurface(dest, x, y, sX, sY, HALF_TILE, TILE_SIZE);
+inline void Chipset::DrawTall(const BlitSurface &dest, int x, int y, int sX, int sY) {
+	Blit::Checked<HALF_TILE, TILE_SIZE>(m_BaseSurface, sX, sY, dest, x, y);
 }
 
-inline void Chipset::DrawEdges(FIBITMAP *dest, int x, int y, int sX, int sY, int Combination) {
+inline void Chipset::DrawEdges(const BlitSurface &dest, int x, int y, int sX, int sY, int Combination) {
 	if (Combination&BIT(0))
 		DrawQuarter(dest, x,           y,           sX,           sY);           // top left
 	if (Combination&BIT(1))
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <FreeImage.h>
 #include "utils.h"
+#include "blit.h"
 
 constexpr int TILE_SIZE=16;
 constexpr int HALF_TILE=TILE_SIZE/2;
@@ -45,26 +46,35 @@ struct Chipset {
 		// as their properties and the methods for correctly displaying them.
 		BitmapPtr m_Base;    // Chipset's base surface!
 		BitmapPtr m_Chipset; // Chipset's precalculated surface
+		BlitSurface m_BaseSurface;
+		BlitSurface m_ChipsetSurface;
+		int m_TileSize = TILE_SIZE; // of the precalculated surface
 
 	// --- Methods declaration ---------------------------------------------
 	public:
 		Chipset() = delete;
 		explicit Chipset(FIBITMAP *Surface);
+		// Adopts an already precalculated surface, smaller tile sizes are
+		// used for reduced scale previews
+		explicit Chipset(BitmapPtr Atlas, int TileSize = TILE_SIZE);
 		~Chipset();
 
-		void RenderTile(FIBITMAP *dest, int tile_x, int tile_y, unsigned short Tile, int Frame);
-		void RenderWaterTile(FIBITMAP *dest, unsigned short Tile, int Frame, int Border, int Water, int Combination);
-		void RenderDepthTile(FIBITMAP *dest, unsigned short Tile, int Number, int Depth);
-		void RenderTerrainTile(FIBITMAP *dest, unsigned short Tile, int Terrain, int Combination);
-		void DrawSurface(FIBITMAP *dest, int dX, int dY, int sX, int sY, int sW, int sH, bool fromBase = true);
+		FIBITMAP *GetAtlas() const { return m_Chipset.get(); }
+		int TileSize() const { return m_TileSize; }
+
+		void RenderTile(const BlitSurface &dest, int tile_x, int tile_y, unsigned short Tile, int Frame);
+		void RenderWaterTile(const BlitSurface &dest, unsigned short Tile, int Frame, int Border, int Water, int Combination);
+		void RenderDepthTile(const BlitSurface &dest, unsigned short Tile, int Number, int Depth);
+		void RenderTerrainTile(const BlitSurface &dest, unsigned short Tile, int Terrain, int Combination);
+		void DrawSurface(const BlitSurface &dest, int dX, int dY, int sX, int sY, int sW, int sH, bool fromBase = true);
 
 	private:
 		// Tile drawing helper functions
-		void DrawFull(FIBITMAP *dest, int x, int y, int sX, int sY);
-		void DrawQuarter(FIBITMAP *dest, int x, int y, int sX, int sY);
-		void DrawWide(FIBITMAP *dest, int x, int y, int sX, int sY);
-		void DrawTall(FIBITMAP *dest, int x, int y, int sX, int sY);
-		void DrawEdges(FIBITMAP *dest, int x, int y, int sX, int sY, int Combination);
+		void DrawFull(const BlitSurface &dest, int x, int y, int sX, int sY);
+		void DrawQuarter(const BlitSurface &dest, int x, int y, int sX, int sY);
+		void DrawWide(const BlitSurface &dest, int x, int y, int sX, int sY);
+		void DrawTall(const BlitSurface &dest, int x, int y, int sX, int sY);
+		void DrawEdges(const BlitSurface &dest, int x, int y, int sX, int sY, int Combination);
 };
 
 #endif
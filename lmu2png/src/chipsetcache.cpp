@@ -0,0 +1,314 @@
+/* chipsetcache.cpp, reuse of precalculated chipsets.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// Headers
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+#include "chipsetcache.h"
+#include "indexed.h"
+#include "stats.h"
+
+namespace {
+	Stats::Counter memory_hits_counter("chipset memory cache hits");
+	Stats::Counter disk_hits_counter("chipset disk cache hits");
+	Stats::Counter generated_counter("chipsets generated");
+	Stats::Counter scaled_counter("chipsets scaled");
+	Stats::Counter indexed_counter("chipsets indexed");
+
+	// Cache file layout: magic, version, width, height, then the rows of
+	// the surface from top to bottom in FreeImage pixel order.
+	constexpr char atlas_magic[4] = { 'L', '2', 'P', 'A' };
+	// Low byte is incremented when the tile generation in Chipset changes,
+	// the pixel order of the platform is part of the version as well
+	constexpr uint32_t atlas_version = 1 | (FI_RGBA_RED << 8) | (FI_RGBA_ALPHA << 12);
+
+	std::string HashFile(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			return "";
+		}
+
+		std::vector<char> data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+
+		// 64 bit FNV-1a
+		uint64_t hash = 14695981039346656037ULL;
+		for (char c : data) {
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ULL;
+		}
+
+		char hex[17];
+		snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+		return hex;
+	}
+
+	BitmapPtr LoadAtlas(const std::string& filename) {
+		std::ifstream in(filename, std::ios::binary);
+		if (!in) {
+			return nullptr;
+		}
+
+		char magic[4];
+		uint32_t header[3];
+		in.read(magic, sizeof(magic));
+		in.read(reinterpret_cast<char *>(header), sizeof(header));
+		if (!in || memcmp(magic, atlas_magic, sizeof(magic)) != 0 || header[0] != atlas_version
+			|| header[1] != CHIPSET_WIDTH || header[2] != CHIPSET_HEIGHT) {
+			return nullptr;
+		}
+
+		BitmapPtr atlas{FreeImage_Allocate(CHIPSET_WIDTH, CHIPSET_HEIGHT, 32)};
+		if (!atlas) {
+			return nullptr;
+		}
+
+		for (int y = 0; y < CHIPSET_HEIGHT; y++) {
+			in.read(reinterpret_cast<char *>(FreeImage_GetScanLine(atlas.get(), CHIPSET_HEIGHT - 1 - y)),
+				CHIPSET_WIDTH * 4);
+		}
+		if (!in) {
+			return nullptr;
+		}
+
+		return atlas;
+	}
+
+	bool SaveAtlas(const std::string& filename, FIBITMAP *atlas) {
+		// write to a temporary file first, concurrent runs never see partial files
+		std::string tmp_name = filename + "." + std::to_string(std::random_device{}()) + ".tmp";
+		std::ofstream out(tmp_name, std::ios::binary);
+		if (!out) {
+			return false;
+		}
+
+		uint32_t header[3] = { atlas_version, CHIPSET_WIDTH, CHIPSET_HEIGHT };
+		out.write(atlas_magic, sizeof(atlas_magic));
+		out.write(reinterpret_cast<const char *>(header), sizeof(header));
+		for (int y = 0; y < CHIPSET_HEIGHT; y++) {
+			out.write(reinterpret_cast<const char *>(FreeImage_GetScanLine(atlas, CHIPSET_HEIGHT - 1 - y)),
+				CHIPSET_WIDTH * 4);
+		}
+		out.close();
+
+		std::error_code ec;
+		if (!out) {
+			std::filesystem::remove(tmp_name, ec);
+			return false;
+		}
+		std::filesystem::rename(tmp_name, filename, ec);
+		if (ec) {
+			std::filesystem::remove(tmp_name, ec);
+			return false;
+		}
+		return true;
+	}
+
+	std::shared_ptr<Chipset> CreateChipset(const std::string& path, const std::string& cache_dir, bool verbose) {
+		Stats::Scope scope("chipset");
+		std::string cache_file;
+		if (!path.empty() && !cache_dir.empty()) {
+			std::string hash = HashFile(path);
+			if (!hash.empty()) {
+				cache_file = cache_dir + "/" + hash + ".atlas";
+			}
+		}
+
+		if (!cache_file.empty()) {
+			BitmapPtr atlas = LoadAtlas(cache_file);
+			if (atlas) {
+				if (verbose) {
+					std::cerr << "Using cached ChipSet \"" << cache_file << "\"\n";
+				}
+				disk_hits_counter.Add();
+				return std::make_shared<Chipset>(std::move(atlas));
+			}
+		}
+
+		BitmapPtr chipset_img;
+		if (!path.empty()) {
+			chipset_img.reset(LoadImage(path, true));
+		}
+
+		if (!chipset_img) {
+			if (verbose) {
+				std::cerr << "Using empty chipset image.\n";
+			}
+
+			chipset_img.reset(FreeImage_Allocate(CHIPSET_WIDTH, CHIPSET_HEIGHT, 32));
+			if (!chipset_img) {
+				return nullptr;
+			}
+
+			// nothing worth to be stored
+			cache_file.clear();
+		}
+
+		auto chipset = std::make_shared<Chipset>(chipset_img.get());
+		generated_counter.Add();
+
+		if (!cache_file.empty()) {
+			std::error_code ec;
+			std::filesystem::create_directories(cache_dir, ec);
+			if (!SaveAtlas(cache_file, chipset->GetAtlas()) && verbose) {
+				std::cerr << "Unable to write ChipSet cache \"" << cache_file << "\".\n";
+			}
+		}
+
+		return chipset;
+	}
+
+	std::shared_ptr<Chipset> ScaleChipset(const std::shared_ptr<Chipset>& chipset, int scale) {
+		if (!chipset) {
+			return nullptr;
+		}
+
+		Stats::Scope scope("chipset");
+		BitmapPtr atlas{FreeImage_Allocate(CHIPSET_WIDTH / scale, CHIPSET_HEIGHT / scale, 32)};
+		if (!atlas) {
+			return nullptr;
+		}
+		// the tiles are aligned to the scale, no pixel of a neighbour is mixed in
+		Blit::Downscale(BlitSurface(chipset->GetAtlas()), BlitSurface(atlas.get()), scale);
+		scaled_counter.Add();
+		return std::make_shared<Chipset>(std::move(atlas), TILE_SIZE / scale);
+	}
+
+	std::shared_ptr<Chipset> CreateIndexedChipset(const std::string& path, SharedPalette& palette) {
+		Stats::Scope scope("chipset");
+		BitmapPtr original(LoadImage(path, true, true));
+		if (!original || FreeImage_GetBPP(original.get()) != 8) {
+			return nullptr;
+		}
+		BitmapPtr chipset_img(palette.Remap(original.get(), true));
+		if (!chipset_img) {
+			return nullptr;
+		}
+		indexed_counter.Add();
+		return std::make_shared<Chipset>(chipset_img.get());
+	}
+
+	// the modification time keeps long running processes (GUI) up to date
+	std::string FileKey(const std::string& path) {
+		std::string key = path;
+		std::error_code ec;
+		auto mtime = std::filesystem::last_write_time(path, ec);
+		if (!ec) {
+			key += "|" + std::to_string(mtime.time_since_epoch().count());
+		}
+		return key;
+	}
+}
+
+ChipsetCache& ChipsetCache::Instance() {
+	static ChipsetCache instance;
+	return instance;
+}
+
+std::shared_ptr<Chipset> ChipsetCache::Get(const std::string& path, const std::string& cache_dir, bool verbose,
+	int scale) {
+	std::string key = FileKey(path);
+	if (scale > 1) {
+		key += "|1/" + std::to_string(scale);
+	}
+
+	return Lookup(key, [&]() {
+		Entry entry;
+		entry.chipset = scale > 1 ? ScaleChipset(Get(path, cache_dir, verbose), scale)
+			: CreateChipset(path, cache_dir, verbose);
+		return entry;
+	}).chipset;
+}
+
+std::shared_ptr<Chipset> ChipsetCache::GetIndexed(const std::string& path, SharedPalette& palette) {
+	Entry entry = Lookup(FileKey(path) + "|indexed", [&]() {
+		auto colors = std::make_shared<SharedPalette>();
+		Entry created;
+		created.chipset = CreateIndexedChipset(path, *colors);
+		created.palette = std::move(colors);
+		return created;
+	});
+
+	if (entry.chipset) {
+		palette = *entry.palette;
+	}
+	return entry.chipset;
+}
+
+ChipsetCache::Entry ChipsetCache::Lookup(const std::string& key, const std::function<Entry()>& create) {
+	std::promise<Entry> promise;
+	std::shared_future<Entry> entry;
+	bool created = false;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_Chipsets.find(key);
+		if (it != m_Chipsets.end()) {
+			// may still be generated by another thread
+			entry = it->second;
+			memory_hits_counter.Add();
+		} else {
+			entry = promise.get_future().share();
+			m_Chipsets.emplace(key, entry);
+			created = true;
+		}
+	}
+
+	// generate without holding the lock, other chipsets can be built meanwhile
+	if (created) {
+		try {
+			promise.set_value(create());
+		} catch (...) {
+			// the waiting threads get the error, the next call tries again
+			promise.set_exception(std::current_exception());
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Chipsets.erase(key);
+			throw;
+		}
+	}
+
+	return entry.get();
+}
+
+std::string DefaultChipsetCacheDir() {
+#ifdef _WIN32
+	const char *local = getenv("LOCALAPPDATA");
+	if (local && *local) {
+		return std::string(local) + "/EasyRPG/lmu2png";
+	}
+#else
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	if (xdg && *xdg) {
+		return std::string(xdg) + "/lmu2png";
+	}
+	const char *home = getenv("HOME");
+	if (home && *home) {
+#	ifdef __APPLE__
+		return std::string(home) + "/Library/Caches/lmu2png";
+#	else
+		return std::string(home) + "/.cache/lmu2png";
+#	endif
+	}
+#endif
+	return "";
+}
@@ -0,0 +1,72 @@
+/* chipsetcache.h, reuse of precalculated chipsets.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef CHIPSETCACHE_H
+#define CHIPSETCACHE_H
+
+// Headers
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "chipset.h"
+
+class SharedPalette;
+
+// Generating the precalculated chipset surface takes thousands of small blits,
+// so every chipset is built only once per process and image version. When a cache directory is
+// set, the surface is also stored on disk, keyed by a hash of the image file.
+class ChipsetCache {
+public:
+	// Process wide instance, shared by all rendered maps
+	static ChipsetCache& Instance();
+
+	// Returns the chipset for image file path, an empty path or a failing
+	// image gives an empty chipset. Returns nullptr when out of memory.
+	// With scale 2, 4 or 8 the tiles are box filtered to 1/scale of their
+	// size, these chipsets are derived from the full one and only kept in
+	// memory.
+	std::shared_ptr<Chipset> Get(const std::string& path, const std::string& cache_dir, bool verbose,
+		int scale = 1);
+
+	// Returns the 8 bit chipset for paletted image file path, its colors
+	// are converted to a new SharedPalette that is copied to palette, so
+	// the chipset has to be the first graphic of the palette. These
+	// chipsets are only kept in memory. Returns nullptr when the image is
+	// not paletted or has too many colors.
+	std::shared_ptr<Chipset> GetIndexed(const std::string& path, SharedPalette& palette);
+
+private:
+	struct Entry {
+		std::shared_ptr<Chipset> chipset;
+		// colors of indexed chipsets
+		std::shared_ptr<const SharedPalette> palette;
+	};
+
+	// Returns the entry for key, create is called only by the first thread
+	// asking for it
+	Entry Lookup(const std::string& key, const std::function<Entry()>& create);
+
+	std::map<std::string, std::shared_future<Entry>> m_Chipsets;
+	std::mutex m_Mutex;
+};
+
+// Platform specific user cache directory for lmu2png, empty if unknown
+std::string DefaultChipsetCacheDir();
+
+#endif
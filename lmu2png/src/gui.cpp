@@ -14,12 +14,16 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <cstdio>
+#include <new>
 #include "gui.h"
 #include <wx/filedlg.h>
 #include <wx/aboutdlg.h>
 #include <wx/dcbuffer.h>
 #include <wx/rawbmp.h>
 #include "main.h"
+#include "blit.h"
+#include "layers.h"
+#include "rendercontrol.h"
 
 wxIMPLEMENT_APP_NO_MAIN(Lmu2Png);
 
@@ -184,6 +188,10 @@ MyFrame::MyFrame():
 	SetStatusDefault();
 }
 
+MyFrame::~MyFrame() {
+	StopRender();
+}
+
 void MyFrame::OnBrowse(wxCommandEvent& event) {
 	wxString title = "";
 	wxString wildcard = "";
@@ -223,6 +231,12 @@ void MyFrame::OnBrowse(wxCommandEvent& event) {
 		wildcard, wxFD_OPEN|wxFD_FILE_MUST_EXIST);
 	if (dlg.ShowModal() == wxID_CANCEL) return;
 
+	if (state == &m_mapSelected) {
+		// the old map is not needed anymore
+		StopRender();
+		SetStatusText("Map selected");
+	}
+
 	*state = true;
 	st->SetLabel(dlg.GetPath());
 	st->SetToolTip(dlg.GetPath());
@@ -235,6 +249,7 @@ void MyFrame::OnReset(wxCommandEvent& event) {
 void MyFrame::ResetPath(int id) {
 	switch (id) {
 		case Event_ResetMap:
+			StopRender();
 			m_stMap->SetLabel("Not selected");
 			m_stMap->SetToolTip("");
 			m_mapSelected = false;
@@ -265,6 +280,9 @@ void MyFrame::OnOptionChange(wxCommandEvent& WXUNUSED(event)) {
 
 void MyFrame::OnGenerate(wxCommandEvent& WXUNUSED(event)) {
 	SetStatusText("Generating Image");
+	// read the files again
+	StopRender();
+	m_layers.reset();
 	CallAfter(&MyFrame::Update);
 }
 
@@ -309,17 +327,32 @@ void MyFrame::OnSave(wxCommandEvent& WXUNUSED(event)) {
 }
 
 void guiErrorCallback(const std::string& error, ErrorCallbackParam param) {
+	// called from the render thread
 	MyFrame *instance = static_cast<MyFrame*>(param);
-	instance->SetStatusText("Error: " + error);
+	instance->CallAfter([instance, error]() {
+		instance->SetStatusText("Error: " + error);
+	});
+}
+
+void MyFrame::StopRender() {
+	if (m_control) {
+		m_control->Cancel();
+	}
+	if (m_worker.joinable()) {
+		m_worker.join();
+	}
+	m_control.reset();
 }
 
 void MyFrame::Update() {
-	wxBusyCursor wait;
 	L2IConfig conf = {};
 
-	m_canvas->Clear();
+	// at most one render at a time, it is owning the layers
+	StopRender();
 
 	if(!m_mapSelected) {
+		m_layers.reset();
+		m_canvas->Clear();
 		SetStatusDefault();
 		return;
 	}
@@ -346,15 +379,45 @@ void MyFrame::Update() {
 	conf.verbose = true;
 #endif
 
-	// generate image
-	int w, h;
-	unsigned char *pixels = makeImage(conf, w, h, guiErrorCallback, (void *)this);
-	if(!pixels) return;
+	// load and render the map only for other files, layer options just
+	// combine the kept layers again
+	bool load = !m_layers || !m_layers->IsFor(conf);
+	if(load) {
+		m_canvas->Clear();
+		m_layers.reset();
+	}
+
+	auto control = std::make_shared<RenderControl>([this](int percent) {
+		CallAfter([this, percent]() {
+			SetStatusText(wxString::Format("Generating Image... %d%%", percent));
+		});
+	});
+	conf.control = control.get();
+	m_control = control;
+
+	m_worker = std::thread([this, conf, control, load]() {
+		if(load) {
+			m_layers = makeLayers(conf, guiErrorCallback, (void *)this);
+			if(!m_layers) return;
+		}
+
+		std::shared_ptr<RenderTarget> img;
+		try {
+			img = m_layers->Compose(conf);
+		} catch (const std::bad_alloc&) {
+			guiErrorCallback("Unable to create output image.", (void *)this);
+			return;
+		}
+		if(control->IsCancelled()) return;
 
-	m_canvas->Load(pixels, w, h);
-	delete[] pixels;
+		CallAfter([this, control, img]() {
+			// a newer render was started meanwhile
+			if(control != m_control) return;
 
-	SetStatusText("Image generated!");
+			m_canvas->Load(*img);
+			SetStatusText("Image generated!");
+		});
+	});
 }
 
 wxBEGIN_EVENT_TABLE(MyCanvas, wxScrolledWindow)
@@ -375,24 +438,29 @@ void MyCanvas::Clear() {
 	Refresh();
 }
 
-void MyCanvas::Load(unsigned char *pixels, int w, int h) {
-	m_bmp = std::make_unique<wxBitmap>(w, h, 32);
-	if(!m_bmp->Ok()) return;
+void MyCanvas::Load(const RenderTarget &img) {
+	int w = img.Width();
+	int h = img.Height();
+	// toggled layers give an image of the same size
+	if(!m_bmp->IsOk() || m_bmp->GetWidth() != w || m_bmp->GetHeight() != h) {
+		m_bmp = std::make_unique<wxBitmap>(w, h, 32);
+		if(!m_bmp->Ok()) return;
+	}
 
 	wxAlphaPixelData bmdata(*m_bmp);
 	if(!bmdata) return;
 
-	// convert image
-	unsigned char *src = pixels;
+	// convert image, read directly from the render target
 	wxAlphaPixelData::Iterator dst(bmdata);
 	for(int y = 0; y<h; y++) {
+		const unsigned char *src = img.Surface().Row(y);
 		dst.MoveTo(bmdata, 0, y);
 		for(int x = 0; x < w; x++) {
 			// wxBitmap contains rgb values pre-multiplied with alpha
-			unsigned char a = src[3];
-			dst.Red() = src[0] * a / 255;
-			dst.Green() = src[1] * a / 255;
-			dst.Blue() = src[2] * a / 255;
+			unsigned char a = src[FI_RGBA_ALPHA];
+			dst.Red() = src[FI_RGBA_RED] * a / 255;
+			dst.Green() = src[FI_RGBA_GREEN] * a / 255;
+			dst.Blue() = src[FI_RGBA_BLUE] * a / 255;
 			dst.Alpha() = a;
 			dst++;
 			src += 4;
@@ -17,11 +17,16 @@
 #define GUI_H
 
 #include <memory>
+#include <thread>
 #include "wx/wxprec.h"
 #ifndef WX_PRECOMP
 	#include "wx/wx.h"
 #endif
 
+class RenderTarget;
+class MapLayers;
+class RenderControl;
+
 class Lmu2Png : public wxApp {
 public:
 	Lmu2Png() {}
@@ -33,7 +38,7 @@ public:
 	MyCanvas(wxWindow *parent);
 
 	void Clear();
-	void Load(unsigned char *pixels, int w, int h);
+	void Load(const RenderTarget &img);
 	bool Save(wxString path);
 	void OnPaint(wxPaintEvent &event);
 
@@ -46,8 +51,10 @@ private:
 class MyFrame : public wxFrame {
 public:
 	MyFrame();
+	~MyFrame() override;
 
 	void Update();
+	void StopRender();
 
 	void OnBrowse(wxCommandEvent& event);
 	void OnReset(wxCommandEvent& event);
@@ -73,6 +80,12 @@ private:
 	// app state
 	bool m_mapSelected, m_dbSelected, m_csSelected;
 
+	// loaded map, kept while only layer options change. Only the render
+	// thread uses it while a render runs.
+	std::shared_ptr<MapLayers> m_layers;
+	std::shared_ptr<RenderControl> m_control;
+	std::thread m_worker;
+
 	wxDECLARE_EVENT_TABLE();
 };
 
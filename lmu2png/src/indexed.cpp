@@ -0,0 +1,197 @@
+/* indexed.cpp, 8 bit rendering of maps with paletted graphics.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// Headers
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <lcf/rpg/map.h>
+#include "indexed.h"
+#include "chipset.h"
+#include "chipsetcache.h"
+#include "stats.h"
+
+static Stats::Counter indexed_counter("maps rendered in 8 bit");
+
+SharedPalette::SharedPalette() {
+	// transparent, all channels 0 like the pixels of an empty RenderTarget
+	m_Colors.push_back(0);
+	m_Index[0] = 0;
+}
+
+int SharedPalette::Add(uint8_t red, uint8_t green, uint8_t blue) {
+	uint8_t pixel[4];
+	pixel[FI_RGBA_RED] = red;
+	pixel[FI_RGBA_GREEN] = green;
+	pixel[FI_RGBA_BLUE] = blue;
+	pixel[FI_RGBA_ALPHA] = 0xFF;
+	uint32_t color;
+	memcpy(&color, pixel, 4);
+
+	auto it = m_Index.find(color);
+	if (it != m_Index.end()) {
+		return it->second;
+	}
+	if (m_Colors.size() >= 256) {
+		return -1;
+	}
+
+	uint8_t index = static_cast<uint8_t>(m_Colors.size());
+	m_Colors.push_back(color);
+	m_Index[color] = index;
+	return index;
+}
+
+FIBITMAP* SharedPalette::Remap(FIBITMAP *dib, bool keyed) {
+	if (!dib || FreeImage_GetBPP(dib) != 8) {
+		return nullptr;
+	}
+
+	int width = FreeImage_GetWidth(dib);
+	int height = FreeImage_GetHeight(dib);
+	bool used[256] = {};
+	for (int y = 0; y < height; y++) {
+		const uint8_t *row = FreeImage_GetScanLine(dib, y);
+		for (int x = 0; x < width; x++) {
+			used[row[x]] = true;
+		}
+	}
+
+	// unused entries are not merged, they would only fill the palette
+	const RGBQUAD *palette = FreeImage_GetPalette(dib);
+	int colors = FreeImage_GetColorsUsed(dib);
+	uint8_t lut[256] = {};
+	for (int i = 0; i < 256; i++) {
+		if (!used[i] || (keyed && i == 0)) {
+			continue;
+		}
+		RGBQUAD color = i < colors ? palette[i] : RGBQUAD{0, 0, 0, 0};
+		int index = Add(color.rgbRed, color.rgbGreen, color.rgbBlue);
+		if (index < 0) {
+			return nullptr;
+		}
+		lut[i] = static_cast<uint8_t>(index);
+	}
+
+	BitmapPtr output(FreeImage_Allocate(width, height, 8));
+	if (!output) {
+		return nullptr;
+	}
+	for (int y = 0; y < height; y++) {
+		const uint8_t *src = FreeImage_GetScanLine(dib, y);
+		uint8_t *dst = FreeImage_GetScanLine(output.get(), y);
+		for (int x = 0; x < width; x++) {
+			dst[x] = lut[src[x]];
+		}
+	}
+	return output.release();
+}
+
+IndexedScene::~IndexedScene() = default;
+
+std::unique_ptr<IndexedScene> IndexedScene::Create(const MapData& data) {
+	Stats::Scope scope("palette");
+	const L2IConfig &conf = data.conf;
+	std::unique_ptr<IndexedScene> scene(new IndexedScene());
+
+	auto fail = [&](const std::string& reason) {
+		if (conf.verbose) {
+			std::cerr << "Rendering in 32 bit, " << reason << ".\n";
+		}
+		return nullptr;
+	};
+
+	// Loads an asset and converts it to the palette of the scene
+	auto load = [&](const std::string& path, bool keyed, Image& image) {
+		BitmapPtr original(LoadImage(path, keyed, true));
+		if (!original || FreeImage_GetBPP(original.get()) != 8) {
+			return false;
+		}
+		image.bitmap.reset(scene->m_Palette.Remap(original.get(), keyed));
+		image.surface = BlitSurface(image.bitmap.get());
+		return static_cast<bool>(image.surface);
+	};
+
+	// shared by the maps using the same chipset, it starts the palette
+	scene->m_Chipset = ChipsetCache::Instance().GetIndexed(conf.chipset, scene->m_Palette);
+	if (!scene->m_Chipset) {
+		return fail("the chipset is not paletted or has too many colors");
+	}
+
+	if (!conf.no_events) {
+		std::set<std::string> names;
+		for (const lcf::rpg::Event& ev : data.map->events) {
+			const lcf::rpg::EventPage* evp = DrawnPage(ev, conf);
+			if (evp && !evp->character_name.empty()) {
+				names.insert(lcf::ToString(evp->character_name));
+			}
+		}
+
+		for (const std::string& name : names) {
+			Image &charset = scene->m_Charsets[name];
+			std::string path{FindResource("CharSet", name)};
+			if (path.empty()) {
+				// the events are skipped when drawing
+				std::cout << "Charset \"" << name << "\" not found.\n";
+				continue;
+			}
+			if (!load(path, true, charset)) {
+				return fail("charset \"" + name + "\" is not paletted or has too many colors");
+			}
+		}
+	}
+
+	std::string pname = lcf::ToString(data.map->parallax_name);
+	if (!conf.no_background && !pname.empty()) {
+		scene->m_Filter = conf.panorama_filter;
+		if (scene->m_Filter != PanoramaFilter::Nearest && scene->m_Filter != PanoramaFilter::Tile) {
+			return fail("the panorama filter blends colors");
+		}
+		std::string path{FindResource("Panorama", pname)};
+		if (!path.empty() && !load(path, false, scene->m_Panorama)) {
+			return fail("the panorama is not paletted or has too many colors");
+		}
+	} else if (!conf.no_background) {
+		int black = scene->m_Palette.Add(0, 0, 0);
+		if (black < 0) {
+			return fail("there is no palette entry left for black");
+		}
+		scene->m_Black = static_cast<uint8_t>(black);
+	}
+
+	indexed_counter.Add();
+	return scene;
+}
+
+const BlitSurface* IndexedScene::GetCharset(const std::string& name) const {
+	auto it = m_Charsets.find(name);
+	return it != m_Charsets.end() && it->second.surface ? &it->second.surface : nullptr;
+}
+
+void IndexedScene::DrawPanorama(const RenderTarget& output_img, int width, int height) const {
+	if (!m_Panorama.surface) {
+		std::cout << "Unable to create parallax background.\n";
+		return;
+	}
+
+	// nearest and tile are cheap enough for every band, nothing is cached
+	if (m_Filter == PanoramaFilter::Tile) {
+		Blit::Tile(m_Panorama.surface, output_img.Surface(), output_img.OriginX(), output_img.OriginY());
+	} else {
+		Blit::Scale(m_Panorama.surface, output_img.Surface(), width, height,
+			output_img.OriginX(), output_img.OriginY());
+	}
+}
@@ -0,0 +1,94 @@
+/* indexed.h, 8 bit rendering of maps with paletted graphics.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef INDEXED_H
+#define INDEXED_H
+
+// Headers
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <FreeImage.h>
+#include "blit.h"
+#include "utils.h"
+
+// Colors of the paletted graphics of a map merged into one palette. Entry 0
+// is the transparent color key of chipsets and charsets, the others are
+// opaque. Colors are 32 bit values in FreeImage pixel order.
+class SharedPalette {
+public:
+	SharedPalette();
+
+	// Index of an opaque color, -1 when the palette is full
+	int Add(uint8_t red, uint8_t green, uint8_t blue);
+
+	// Returns a copy of the 8 bit dib with the indices of this palette, the
+	// colors its pixels use are added. Index 0 of keyed images stays
+	// transparent. Returns nullptr when the colors do not fit.
+	FIBITMAP* Remap(FIBITMAP *dib, bool keyed);
+
+	const std::vector<uint32_t>& Colors() const { return m_Colors; }
+
+private:
+	std::vector<uint32_t> m_Colors;
+	std::unordered_map<uint32_t, uint8_t> m_Index;
+};
+
+// The chipset, charsets and panorama of one map converted to a shared
+// palette. Blits then move 1 instead of 4 bytes per pixel and the map
+// is written as paletted PNG without counting its colors.
+class IndexedScene {
+public:
+	// Loads the graphics the map is drawn with. Returns nullptr when one
+	// of them is not paletted, the colors do not fit into 256 entries or
+	// the panorama is scaled with interpolation, the map has to be
+	// rendered in 32 bit then.
+	static std::unique_ptr<IndexedScene> Create(const MapData& data);
+	~IndexedScene();
+
+	Chipset* GetChipset() const { return m_Chipset.get(); }
+
+	// nullptr when the charset is missing
+	const BlitSurface* GetCharset(const std::string& name) const;
+
+	// Draws the panorama scaled to width x height like DrawPanorama
+	void DrawPanorama(const RenderTarget& output_img, int width, int height) const;
+
+	// Index of black, for maps without a panorama
+	uint8_t Black() const { return m_Black; }
+
+	const SharedPalette& Palette() const { return m_Palette; }
+
+private:
+	IndexedScene() = default;
+
+	struct Image {
+		BitmapPtr bitmap;
+		BlitSurface surface;
+	};
+
+	SharedPalette m_Palette;
+	std::shared_ptr<Chipset> m_Chipset;
+	std::map<std::string, Image> m_Charsets;
+	Image m_Panorama;
+	PanoramaFilter m_Filter = PanoramaFilter::Nearest;
+	uint8_t m_Black = 0;
+};
+
+#endif
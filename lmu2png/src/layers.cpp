@@ -0,0 +1,172 @@
+/* layers.cpp, separately rendered map layers.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// Headers
+#include <iostream>
+#include <new>
+#include "chipset.h"
+#include "chipsetcache.h"
+#include "layers.h"
+#include "rendercontrol.h"
+
+namespace {
+	// Surfaces of a map with 100x100 tiles take 10 MiB each
+	constexpr size_t layers_limit = 1024 * 1024 * 1024;
+}
+
+MapLayers::MapLayers(const L2IConfig& request, MapData data) :
+	m_Request(request), m_Data(std::move(data)) {
+	m_Request.control = nullptr;
+	m_Chipset = ChipsetCache::Instance().Get(m_Data.conf.chipset, m_Data.conf.cache_dir, m_Data.conf.verbose);
+	if (!m_Chipset) {
+		throw std::bad_alloc();
+	}
+
+	size_t layer_size = static_cast<size_t>(m_Data.map->width) * m_Data.map->height * TILE_SIZE * TILE_SIZE * 4;
+	m_KeepLayers = layer_size * LayerCount <= layers_limit;
+
+	// the control belongs to this render only
+	RenderControl *control = m_Data.conf.control;
+	m_Data.conf.control = nullptr;
+	if (!m_KeepLayers) {
+		return;
+	}
+
+	L2IConfig conf = m_Data.conf;
+	conf.control = control;
+	if (control) {
+		control->Start(4 * m_Data.map->height);
+	}
+
+	m_Layers[Background] = NewLayer();
+	DrawBackground(*m_Layers[Background], m_Data.map, conf);
+
+	// a cancelled render leaves the layers incomplete, the caller drops them
+	RenderTiles(conf, LowerTilesBelow, false, LAYER::LOWER);
+	RenderTiles(conf, UpperTilesBelow, true, LAYER::LOWER);
+	RenderTiles(conf, LowerTilesAbove, false, LAYER::UPPER);
+	RenderTiles(conf, UpperTilesAbove, true, LAYER::UPPER);
+	if (!control || !control->IsCancelled()) {
+		RenderEvents();
+	}
+}
+
+bool MapLayers::IsFor(const L2IConfig& request) const {
+	return request.map == m_Request.map && request.database == m_Request.database
+		&& request.chipset == m_Request.chipset && request.encoding == m_Request.encoding;
+}
+
+RenderPtr MapLayers::Compose(const L2IConfig& conf) {
+	if (!m_KeepLayers) {
+		L2IConfig render_conf = m_Data.conf;
+		render_conf.no_background = conf.no_background;
+		render_conf.no_lowertiles = conf.no_lowertiles;
+		render_conf.no_uppertiles = conf.no_uppertiles;
+		render_conf.no_events = conf.no_events;
+		render_conf.ignore_conditions = conf.ignore_conditions;
+		render_conf.simulate_movement = conf.simulate_movement;
+		render_conf.control = conf.control;
+		if (conf.control) {
+			// both tile passes
+			conf.control->Start(2 * m_Data.map->height);
+		}
+
+		RenderPtr output = NewLayer();
+		RenderCore(*output, m_Data.csflag.data(), m_Data.map, render_conf);
+		return output;
+	}
+
+	if (conf.ignore_conditions != m_Data.conf.ignore_conditions
+		|| conf.simulate_movement != m_Data.conf.simulate_movement) {
+		m_Data.conf.ignore_conditions = conf.ignore_conditions;
+		m_Data.conf.simulate_movement = conf.simulate_movement;
+		RenderEvents();
+	}
+
+	const bool visible[LayerCount] = {
+		!conf.no_background,
+		!conf.no_lowertiles, !conf.no_uppertiles, !conf.no_events,
+		!conf.no_lowertiles, !conf.no_uppertiles, !conf.no_events
+	};
+
+	RenderPtr output = NewLayer();
+	const BlitSurface &dst = output->Surface();
+	for (int i = 0; i < LayerCount; i++) {
+		if (!visible[i] || !m_Layers[i]) {
+			continue;
+		}
+
+		const BlitSurface &src = m_Layers[i]->Surface();
+		if (i == Background) {
+			// opaque, the panorama image may contain transparent pixels
+			Blit::Copy(src, dst);
+		} else {
+			// every pass only draws color keyed, so this gives the same
+			// pixels as drawing the passes into one surface
+			Blit::Rect(src, 0, 0, dst, 0, 0, src.width, src.height);
+		}
+	}
+
+	return output;
+}
+
+RenderPtr MapLayers::NewLayer() const {
+	return std::make_unique<RenderTarget>(m_Data.map->width * TILE_SIZE, m_Data.map->height * TILE_SIZE);
+}
+
+void MapLayers::RenderTiles(L2IConfig conf, Layer layer, bool upper_layer, LAYER flaglayer) {
+	if (conf.control && conf.control->IsCancelled()) {
+		return;
+	}
+
+	const auto &tiles = upper_layer ? m_Data.map->upper_layer : m_Data.map->lower_layer;
+	bool empty = std::none_of(tiles.begin(), tiles.end(), [&](uint16_t tid) {
+		return TileLayer(m_Data.csflag.data(), tid, upper_layer) == flaglayer;
+	});
+	if (empty) {
+		m_Layers[layer].reset();
+		if (conf.control) {
+			conf.control->Step(m_Data.map->height);
+		}
+		return;
+	}
+
+	conf.no_lowertiles = upper_layer;
+	conf.no_uppertiles = !upper_layer;
+
+	m_Layers[layer] = NewLayer();
+	DrawTiles(*m_Layers[layer], m_Chipset.get(), m_Data.csflag.data(), m_Data.map, conf, flaglayer);
+}
+
+void MapLayers::RenderEvents() {
+	EventLayers events = ResolveEvents(m_Data.map, m_Data.conf);
+
+	auto render = [&](Layer layer, const std::vector<std::vector<EventSprite>*>& sprites) {
+		m_Layers[layer].reset();
+		for (const auto *list : sprites) {
+			if (list->empty()) {
+				continue;
+			}
+			if (!m_Layers[layer]) {
+				m_Layers[layer] = NewLayer();
+			}
+			DrawEvents(*m_Layers[layer], m_Chipset.get(), *list);
+		}
+	};
+
+	render(EventsBelow, { &events[static_cast<int>(LAYER::LOWER)], &events[static_cast<int>(LAYER::UPPER)] });
+	render(EventsAbove, { &events[static_cast<int>(LAYER::EVENTS)] });
+}
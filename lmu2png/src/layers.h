@@ -0,0 +1,70 @@
+/* layers.h, separately rendered map layers.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef LAYERS_H
+#define LAYERS_H
+
+// Headers
+#include <array>
+#include <memory>
+#include "blit.h"
+#include "main.h"
+#include "utils.h"
+
+// Keeps a loaded map and every drawing pass in its own surface, so showing
+// or hiding layers only combines the surfaces again instead of loading and
+// rendering the whole map. Used by the graphical tool. Maps too large for
+// keeping all passes are rendered again from the loaded map instead.
+class MapLayers {
+public:
+	// Renders all layers of data, request holds the files and encoding
+	// asked for. Throws std::bad_alloc when the layers do not fit into memory.
+	// The render can be followed and stopped with the control of data.conf.
+	MapLayers(const L2IConfig& request, MapData data);
+
+	// Whether the layers were rendered from the same files and encoding
+	bool IsFor(const L2IConfig& request) const;
+
+	// Combines the layers enabled in conf. Changed event options render the
+	// event layers again. Throws std::bad_alloc like the constructor.
+	// When the control of conf is cancelled the image is incomplete.
+	RenderPtr Compose(const L2IConfig& conf);
+
+private:
+	// In drawing order, see RenderCore
+	enum Layer {
+		Background,
+		LowerTilesBelow,
+		UpperTilesBelow,
+		EventsBelow,
+		LowerTilesAbove,
+		UpperTilesAbove,
+		EventsAbove,
+		LayerCount
+	};
+
+	RenderPtr NewLayer() const;
+	void RenderTiles(L2IConfig conf, Layer layer, bool upper_layer, LAYER flaglayer);
+	void RenderEvents();
+
+	L2IConfig m_Request;
+	MapData m_Data;
+	bool m_KeepLayers;
+	std::shared_ptr<Chipset> m_Chipset;
+	std::array<RenderPtr, LayerCount> m_Layers; // nullptr when nothing is drawn
+};
+
+#endif
@@ -17,11 +17,22 @@
 // Headers
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <map>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <argparse.hpp>
 #include <lcf/reader_lcf.h>
 #include <lcf/ldb/reader.h>
@@ -35,6 +46,15 @@
 #include <FreeImage.h>
 
 #include "chipset.h"
+#include "animation.h"
+#include "blit.h"
+#include "chipsetcache.h"
+#include "indexed.h"
+#include "layers.h"
+#include "pngwriter.h"
+#include "pyramid.h"
+#include "rendercontrol.h"
+#include "stats.h"
 #include "xyzplugin.h"
 #include "main.h"
 #include "utils.h"
@@ -43,8 +63,47 @@ void MyFreeImageMessageHandler(FREE_IMAGE_FORMAT /* fif */, const char *message)
 	std::cout << "FreeImage error: " << message << "\n";
 }
 
+// How the command line tool writes maps
+struct OutputMode {
+	bool stream = false;     // render in bands, write PNG rows as they are done
+	bool animate = false;    // animated PNG with moving water and animated tiles
+	std::string pyramid;     // directory for z/x/y tiles
+	int tile_size = 256;
+	int png_level = Z_BEST_COMPRESSION;
+	bool indexed = false;    // 8 bit rendering when the graphics share a palette
+};
+
+// Rows rendered at once when streaming, bounds memory for the largest maps
+constexpr int stream_band_height = 64 * TILE_SIZE;
+
+// scene is nullptr for bands rendered in 32 bit
+using BandSink = std::function<bool(const RenderTarget &band, int width, int height, const IndexedScene *scene)>;
+using ScenePtr = std::unique_ptr<IndexedScene>;
+
+static Stats::Counter maps_counter("maps rendered");
+
+// registered on startup, FreeImage writes XYZ files through the plugin
+static FREE_IMAGE_FORMAT xyz_format = FIF_UNKNOWN;
+
 // internal functions
-static BitmapPtr process(L2IConfig conf, ErrorCallbackFunc error_cb, ErrorCallbackParam param = nullptr);
+static void setupProject(L2IConfig &conf, std::string path);
+static bool openMap(L2IConfig &conf, ErrorCallbackFunc error_cb, ErrorCallbackParam param = nullptr);
+static bool loadMap(MapData &data, L2IConfig conf, const lcf::rpg::Database *db, ErrorCallbackFunc error_cb,
+	ErrorCallbackParam param = nullptr);
+static RenderPtr renderMap(L2IConfig conf, const lcf::rpg::Database *db, ScenePtr *scene, ErrorCallbackFunc error_cb,
+	ErrorCallbackParam param = nullptr);
+static bool renderBands(L2IConfig conf, const lcf::rpg::Database *db, int band_height, bool indexed,
+	const BandSink &sink, ErrorCallbackFunc error_cb, ErrorCallbackParam param = nullptr);
+static bool processAll(L2IConfig conf, const std::string &game_dir, const std::string &output_dir,
+	const OutputMode &mode, int jobs);
+static bool writeMap(const L2IConfig &conf, const lcf::rpg::Database *db, const OutputMode &mode,
+	const std::string &output);
+static bool saveImage(const RenderTarget &img, const std::string &filename, int level,
+	const IndexedScene *scene = nullptr);
+static void makePalette(PngPalette &palette, const IndexedScene &scene);
+static bool isXyzFile(const std::string &filename);
+static bool saveXyz(const RenderTarget &img, const std::string &filename, int level,
+	const IndexedScene *scene = nullptr);
 static void cliErrorCallback(const std::string& error, ErrorCallbackParam param = nullptr);
 
 int main(int argc, char** argv) {
@@ -55,11 +114,19 @@ int main(int argc, char** argv) {
 
 		// Register our error handler and plugin
 		FreeImage_SetOutputMessage(MyFreeImageMessageHandler);
-		FreeImage_RegisterLocalPlugin(InitXYZ);
+		xyz_format = static_cast<FREE_IMAGE_FORMAT>(FreeImage_RegisterLocalPlugin(InitXYZ));
 	};
 
 	std::string output;
+	std::string game_dir;
+	std::string filter = "bicubic";
+	OutputMode mode;
+	bool fast_png = false;
+	int jobs = 0;
+	bool stats = false;
+	std::string trace_file;
 	L2IConfig conf = {};
+	conf.scale = 1;
 
 	// add usage and help messages
 	argparse::ArgumentParser cli("lmu2png", PACKAGE_VERSION);
@@ -72,9 +139,15 @@ int main(int argc, char** argv) {
 		"Homepage " PACKAGE_URL " - Report bugs at: " PACKAGE_BUGREPORT);
 
 	// Parse arguments
-	cli.add_argument("mapfile").required().store_into(conf.map)
+	cli.add_argument("mapfile").nargs(argparse::nargs_pattern::optional).store_into(conf.map)
 		.help("Map file to render")
 		.metavar("MapXXXX.lmu");
+	cli.add_argument("-a", "--all").store_into(game_dir)
+		.help("Render all maps of the game in DIR instead of a single map")
+		.metavar("DIR");
+	cli.add_argument("-j", "--jobs").store_into(jobs)
+		.help("Number of threads used for rendering (defaults to the\n"
+			"number of processors)").metavar("N");
 	cli.add_argument("-e", "--encoding").store_into(conf.encoding)
 		.help("Project encoding (defaults to autodetection)")
 		.metavar("ENC");
@@ -85,14 +158,53 @@ int main(int argc, char** argv) {
 		.help("Chipset file to use; if unspecified, will be read from\n"
 			"the database").metavar("IMG");
 	cli.add_argument("-o", "--output").store_into(output)
-		.help("Set the output filepath (defaults to map name)")
-		.metavar("PNG");
+		.help("Set the output filepath (defaults to map name), a name ending\n"
+			"in .xyz writes an XYZ image; when using --all this is the\n"
+			"output directory").metavar("PNG");
+#ifdef HAVE_NLOHMANN_JSON
+	cli.add_argument("-i", "--index").store_into(conf.index)
+		.help("Use a gencache file listing for the game folder instead of\n"
+			"reading the directories").metavar("JSON");
+#endif
+	cli.add_argument("--cache-dir").store_into(conf.cache_dir)
+		.help("Directory for storing precalculated chipsets (defaults to\n"
+			"the user cache directory)").metavar("DIR");
+	cli.add_argument("--stream").store_into(mode.stream)
+		.help("Render the map in parts and write the PNG file meanwhile,\n"
+			"needs less memory for huge maps").flag();
+	cli.add_argument("--animate").store_into(mode.animate)
+		.help("Write an animated PNG with moving water and animated tiles").flag();
+	cli.add_argument("--pyramid").store_into(mode.pyramid)
+		.help("Write a tile pyramid DIR/Z/X/Y.png for web map viewers\n"
+			"instead of a PNG file").metavar("DIR");
+	cli.add_argument("--tile-size").store_into(mode.tile_size)
+		.help("Size of the pyramid tiles, a multiple of 16 (defaults to 256)")
+		.metavar("PX");
+	cli.add_argument("--png-level").store_into(mode.png_level)
+		.help("Compression of the PNG files from 0 (fastest) to 9 (smallest,\n"
+			"default)").metavar("LEVEL");
+	cli.add_argument("--fast-png").store_into(fast_png)
+		.help("Write the PNG files quickly with low compression, same as\n"
+			"--png-level 1").flag();
+	cli.add_argument("--indexed").store_into(mode.indexed)
+		.help("Render in 8 bit when all graphics of a map are paletted and\n"
+			"their colors fit into one palette, falls back to 32 bit\n"
+			"otherwise. Needs the nearest or tile filter for panoramas").flag();
+	cli.add_argument("--scale").store_into(conf.scale)
+		.help("Render a preview at 1/N of the map size, N is 1, 2, 4 or 8\n"
+			"(defaults to 1). Tiles and charsets are box filtered once").metavar("N");
+	cli.add_argument("--no-cache").store_into(conf.no_cache)
+		.help("Do not read or write precalculated chipsets on disk").flag();
 	cli.add_argument("--verbose").store_into(conf.verbose)
 		.help("Explain what is being done").flag();
 
 	cli.add_group("Graphic Options");
 	cli.add_argument("-B", "--no-background").store_into(conf.no_background)
 		.help("Do not draw the parallax background").flag();
+	cli.add_argument("-F", "--filter").store_into(filter)
+		.choices("nearest", "box", "bilinear", "bicubic", "tile")
+		.help("Scaling of the parallax background to the map size, \"tile\"\n"
+			"repeats it unscaled (defaults to bicubic)").metavar("FILTER");
 	cli.add_argument("-L", "--no-lowertiles").store_into(conf.no_lowertiles)
 		.help("Do not draw lower layer tiles").flag();
 	cli.add_argument("-U", "--no-uppertiles").store_into(conf.no_uppertiles)
@@ -105,9 +217,63 @@ int main(int argc, char** argv) {
 	cli.add_argument("-M", "--simulate-movement").store_into(conf.simulate_movement)
 		.help("For event pages with certain animation types, draw the middle\n"
 			"frame instead of the frame specified for the page").flag();
+	cli.add_argument("--stats").store_into(stats)
+		.help("Print the time of each phase and the counters to stderr");
+	cli.add_argument("--trace").store_into(trace_file).metavar("FILE")
+		.help("Write the phases as Chrome trace_event JSON to FILE");
 
 	try {
 		cli.parse_args(argc, argv);
+
+		if (conf.map.empty() && game_dir.empty()) {
+			throw std::runtime_error("mapfile: 1 argument(s) expected. 0 provided.");
+		}
+		if (!conf.map.empty() && !game_dir.empty()) {
+			throw std::runtime_error("mapfile: Not allowed together with --all.");
+		}
+		if (jobs < 0) {
+			throw std::runtime_error("--jobs: Invalid number of jobs.");
+		}
+
+		const std::map<std::string, PanoramaFilter> filters = {
+			{ "nearest", PanoramaFilter::Nearest },
+			{ "box", PanoramaFilter::Box },
+			{ "bilinear", PanoramaFilter::Bilinear },
+			{ "bicubic", PanoramaFilter::Bicubic },
+			{ "tile", PanoramaFilter::Tile }
+		};
+		conf.panorama_filter = filters.at(filter);
+
+		if (mode.animate && (mode.stream || !mode.pyramid.empty())) {
+			throw std::runtime_error("--animate: Not allowed together with --stream or --pyramid.");
+		}
+		if (mode.indexed && (mode.animate || !mode.pyramid.empty())) {
+			throw std::runtime_error("--indexed: Not allowed together with --animate or --pyramid.");
+		}
+		if (conf.scale != 1 && conf.scale != 2 && conf.scale != 4 && conf.scale != 8) {
+			throw std::runtime_error("--scale: Must be 1, 2, 4 or 8.");
+		}
+		if (conf.scale > 1 && (mode.animate || mode.indexed || !mode.pyramid.empty())) {
+			throw std::runtime_error("--scale: Not allowed together with --animate, --indexed or --pyramid.");
+		}
+		if (game_dir.empty() && isXyzFile(output) && (mode.stream || mode.animate || !mode.pyramid.empty())) {
+			throw std::runtime_error("--output: XYZ files are only written for still images.");
+		}
+		if (!mode.pyramid.empty() && !output.empty()) {
+			throw std::runtime_error("--pyramid: Not allowed together with --output.");
+		}
+		if (mode.tile_size <= 0 || mode.tile_size % TILE_SIZE != 0) {
+			throw std::runtime_error("--tile-size: Must be a multiple of 16.");
+		}
+		if (mode.png_level < 0 || mode.png_level > 9) {
+			throw std::runtime_error("--png-level: Must be between 0 and 9.");
+		}
+		if (fast_png) {
+			if (cli.is_used("--png-level")) {
+				throw std::runtime_error("--fast-png: Not allowed together with --png-level.");
+			}
+			mode.png_level = Z_BEST_SPEED;
+		}
 	} catch (const std::exception& err) {
 #ifdef WITH_GUI
 		if(err.what() == std::string{"mapfile: 1 argument(s) expected. 0 provided."}) {
@@ -128,58 +294,93 @@ int main(int argc, char** argv) {
 
 	handleFreeImage();
 
+	Stats::Session stats_session(stats, trace_file);
+
+	if ((mode.stream || !mode.pyramid.empty()) && conf.panorama_filter != PanoramaFilter::Nearest
+		&& conf.panorama_filter != PanoramaFilter::Tile) {
+		// interpolated backgrounds can only be scaled as a whole
+		if (cli.is_used("--filter")) {
+			std::cerr << "Using nearest filter for the parallax background when rendering in parts.\n";
+		}
+		conf.panorama_filter = PanoramaFilter::Nearest;
+	}
+
+	if (!game_dir.empty()) {
+		return processAll(conf, game_dir, output, mode, jobs) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	// generate image
-	auto img = process(conf, cliErrorCallback);
-	if (!img) {
-		std::exit(EXIT_FAILURE);
+	conf.threads = jobs;
+	if (!openMap(conf, cliErrorCallback)) {
+		return EXIT_FAILURE;
 	}
 
-	// save image
 	if (output.empty()){
 		output = conf.map.substr(0, conf.map.length() - 3) + "png";
 	}
 
-	if (!FreeImage_Save(FIF_PNG, img.get(), output.c_str(), PNG_Z_BEST_COMPRESSION)) {
-		cliErrorCallback("Error saving \"" + output + "\".");
-		std::exit(EXIT_FAILURE);
+	if (!writeMap(conf, nullptr, mode, mode.pyramid.empty() ? output : mode.pyramid)) {
+		return EXIT_FAILURE;
 	}
 
 	return EXIT_SUCCESS;
 }
 
-static BitmapPtr process(L2IConfig conf, ErrorCallbackFunc error_cb, ErrorCallbackParam param) {
+static void setupProject(L2IConfig &conf, std::string path) {
+	CollectResourcePaths(path, conf.index);
+
+	if (conf.encoding.empty()) {
+		conf.encoding = lcf::ReaderUtil::GetEncoding(path + "RPG_RT.ini");
+	}
+
+	if (conf.no_cache) {
+		conf.cache_dir.clear();
+	} else if (conf.cache_dir.empty()) {
+		conf.cache_dir = DefaultChipsetCacheDir();
+	}
+}
+
+static bool openMap(L2IConfig &conf, ErrorCallbackFunc error_cb, ErrorCallbackParam param) {
 	if (!Exists(conf.map)) {
 		error_cb("Input map file " + conf.map +" cannot be found.", param);
-		return nullptr;
+		return false;
 	}
 
-	std::string path = GetFileDirectory(conf.map);
-	CollectResourcePaths(path);
+	setupProject(conf, GetFileDirectory(conf.map));
+	return true;
+}
 
-	if (conf.encoding.empty()) {
-		conf.encoding = lcf::ReaderUtil::GetEncoding(path + "RPG_RT.ini");
-	}
+
+static bool loadMap(MapData &data, L2IConfig conf, const lcf::rpg::Database *db, ErrorCallbackFunc error_cb,
+	ErrorCallbackParam param) {
+	Stats::Scope scope("load map");
+	std::string path = GetFileDirectory(conf.map);
 
 	std::unique_ptr<lcf::rpg::Map> map(lcf::LMU_Reader::Load(conf.map, conf.encoding));
 	if (!map) {
 		error_cb(lcf::LcfReader::GetError(), param);
-		return nullptr;
+		return false;
 	}
 
 	// ChipSet flags
-	uint8_t csflag[65536] = {0};
+	std::vector<uint8_t> csflag(65536, 0);
+	bool water_cycle = false;
+	bool water_fast = false;
 	if (conf.chipset.empty()) {
 		// Get chipset from database
-		if (conf.database.empty()) {
-			conf.database = path + "RPG_RT.ldb";
-		}
-
-		auto db = lcf::LDB_Reader::Load(conf.database, conf.encoding);
+		std::unique_ptr<lcf::rpg::Database> db_loaded;
 		if (!db) {
-			error_cb(lcf::LcfReader::GetError(), param);
-			return nullptr;
+			if (conf.database.empty()) {
+				conf.database = path + "RPG_RT.ldb";
+			}
+
+			db_loaded = lcf::LDB_Reader::Load(conf.database, conf.encoding);
+			if (!db_loaded) {
+				error_cb(lcf::LcfReader::GetError(), param);
+				return false;
+			}
+			db = db_loaded.get();
 		}
-
 		assert(map->chipset_id <= static_cast<int>(db->chipsets.size()));
 		const auto &cs = db->chipsets[map->chipset_id - 1];
 		std::string chipset_base(cs.chipset_name);
@@ -191,37 +392,34 @@ static BitmapPtr process(L2IConfig conf, ErrorCallbackFunc error_cb, ErrorCallba
 		conf.chipset = FindResource("ChipSet", chipset_base);
 		if (conf.chipset.empty()) {
 			error_cb("Chipset " + chipset_base + " cannot be found.", param);
-			return nullptr;
+			return false;
 		}
 
 		// Load flags.
 		// The first 18 in lower cover various zones.
 		// Water A/B/C
 		for (int i = 0; i < 3; i++) {
-			memset(csflag + (1000 * i), cs.passable_data_lower[i], 1000);
+			memset(csflag.data() + (1000 * i), cs.passable_data_lower[i], 1000);
 		}
 		// Animated tiles, made up of 3 sets of 50.
 		for (int i = 0; i < 3; i++) {
-			memset(csflag + 3000 + (i * 50), cs.passable_data_lower[3 + i], 50);
+			memset(csflag.data() + 3000 + (i * 50), cs.passable_data_lower[3 + i], 50);
 		}
 		// Terrain ATs, made up of 12 sets of 50.
 		for (int i = 0; i < 12; i++) {
-			memset(csflag + 4000 + (i * 50), cs.passable_data_lower[6 + i], 50);
+			memset(csflag.data() + 4000 + (i * 50), cs.passable_data_lower[6 + i], 50);
 		}
 		// Lower/upper 144-tile pages, made up of 144 individual flag bytes per page.
 		for (int i = 0; i < 144; i++) {
 			csflag[5000 + i] = cs.passable_data_lower[18 + i];
 			csflag[10000 + i] = cs.passable_data_upper[i];
 		}
+
+		water_cycle = cs.animation_type == lcf::rpg::Chipset::AnimationType_cyclic;
+		water_fast = cs.animation_speed == lcf::rpg::Chipset::AnimationSpeed_fast;
 	} else {
 		// Not doing chipset search, set defaults compatible with older lmu2png versions
-		memset(csflag + 10000, 0x10, 144);
-	}
-
-	BitmapPtr output_img{FreeImage_Allocate(map->width * TILE_SIZE, map->height * TILE_SIZE, 32)};
-	if (!output_img) {
-		error_cb("Unable to create output image.", param);
-		return nullptr;
+		memset(csflag.data() + 10000, 0x10, 144);
 	}
 
 	if (!conf.no_events) {
@@ -232,55 +430,387 @@ static BitmapPtr process(L2IConfig conf, ErrorCallbackFunc error_cb, ErrorCallba
 			[](const auto& ev1, const auto& ev2) { return ev1.y < ev2.y; });
 	}
 
-	RenderCore(output_img.get(), csflag, map, conf);
+	data.conf = conf;
+	data.map = std::move(map);
+	data.csflag = std::move(csflag);
+	data.water_cycle = water_cycle;
+	data.water_fast = water_fast;
+	return true;
+}
+
+// With scene the map is rendered in 8 bit if possible, scene receives the
+// palette then
+static RenderPtr renderMap(L2IConfig conf, const lcf::rpg::Database *db, ScenePtr *scene, ErrorCallbackFunc error_cb,
+	ErrorCallbackParam param) {
+	MapData data;
+	if (!loadMap(data, conf, db, error_cb, param)) {
+		return nullptr;
+	}
+
+	if (scene) {
+		*scene = IndexedScene::Create(data);
+	}
+	const IndexedScene *indexed = scene ? scene->get() : nullptr;
+
+	RenderPtr output_img;
+	int tile = ScaledTileSize(data.conf);
+	try {
+		output_img = std::make_unique<RenderTarget>(data.map->width * tile, data.map->height * tile,
+			0, 0, indexed ? 1 : 4);
+	} catch (const std::bad_alloc&) {
+		error_cb("Unable to create output image.", param);
+		return nullptr;
+	}
+
+	RenderCore(*output_img, data.csflag.data(), data.map, data.conf, indexed);
 
 	return output_img;
 }
 
-static void cliErrorCallback(const std::string& error, ErrorCallbackParam) {
-	// Simply tell about the error
-	std::cerr << error << "\n";
+static bool renderBands(L2IConfig conf, const lcf::rpg::Database *db, int band_height, bool indexed,
+	const BandSink &sink, ErrorCallbackFunc error_cb, ErrorCallbackParam param) {
+	MapData data;
+	if (!loadMap(data, conf, db, error_cb, param)) {
+		return false;
+	}
+
+	ScenePtr scene;
+	if (indexed) {
+		scene = IndexedScene::Create(data);
+	}
+
+	// only one band of the image exists at a time
+	int tile = ScaledTileSize(data.conf);
+	int width = data.map->width * tile;
+	int height = data.map->height * tile;
+	for (int y = 0; y < height; y += band_height) {
+		RenderPtr band;
+		try {
+			band = std::make_unique<RenderTarget>(width, std::min(band_height, height - y), 0, y, scene ? 1 : 4);
+		} catch (const std::bad_alloc&) {
+			error_cb("Unable to create output image.", param);
+			return false;
+		}
+
+		RenderCore(*band, data.csflag.data(), data.map, data.conf, scene.get());
+		if (!sink(*band, width, height, scene.get())) {
+			return false;
+		}
+	}
+
+	return true;
 }
 
-#ifdef WITH_GUI
-unsigned char *makeImage(L2IConfig conf, int &w, int &h, ErrorCallbackFunc error_cb,
-	ErrorCallbackParam param) {
+static bool processAll(L2IConfig conf, const std::string &game_dir, const std::string &output_dir,
+	const OutputMode &mode, int jobs) {
+	std::string path = game_dir;
+	if (path.back() != '/' && path.back() != '\\') {
+		path += "/";
+	}
 
-	// generate image
-	auto img = process(conf, error_cb, param);
-	if (!img) {
-		return nullptr;
+	// Collect MapXXXX.lmu files
+	std::vector<std::string> maps;
+	std::error_code ec;
+	for (const auto &entry : std::filesystem::directory_iterator(path, ec)) {
+		std::string name = entry.path().filename().string();
+		std::string lower = name;
+		std::transform(lower.begin(), lower.end(), lower.begin(),
+			[](unsigned char c) { return std::tolower(c); });
+
+		if (lower.size() == 11 && lower.compare(0, 3, "map") == 0 && lower.compare(7, 4, ".lmu") == 0
+			&& std::all_of(lower.begin() + 3, lower.begin() + 7, [](unsigned char c) { return std::isdigit(c); })) {
+			maps.emplace_back(name);
+		}
 	}
+	if (ec) {
+		cliErrorCallback("Game directory " + game_dir + " cannot be read.");
+		return false;
+	}
+	if (maps.empty()) {
+		cliErrorCallback("No maps found in " + game_dir + ".");
+		return false;
+	}
+	std::sort(maps.begin(), maps.end());
 
-	w = FreeImage_GetWidth(img.get());
-	h = FreeImage_GetHeight(img.get());
-	int bytespp = FreeImage_GetBPP(img.get()) / 8;
-	assert(bytespp == 4);
+	if (!output_dir.empty()) {
+		std::filesystem::create_directories(output_dir, ec);
+		if (ec) {
+			cliErrorCallback("Output directory " + output_dir + " cannot be created: " + ec.message() + ".");
+			return false;
+		}
+	}
 
-	// create buffer
-	unsigned char *img_data = new unsigned char[w * h * bytespp];
-	if(!img_data) {
-		return nullptr;
+	// Everything shared by the maps is done only once
+	setupProject(conf, path);
+
+	std::unique_ptr<lcf::rpg::Database> db;
+	if (conf.chipset.empty()) {
+		if (conf.database.empty()) {
+			conf.database = path + "RPG_RT.ldb";
+		}
+
+		Stats::Scope scope("load database");
+		db = lcf::LDB_Reader::Load(conf.database, conf.encoding);
+		if (!db) {
+			cliErrorCallback(lcf::LcfReader::GetError());
+			return false;
+		}
+	}
+
+	std::string out_path = output_dir.empty() ? path : output_dir + "/";
+
+	if (jobs == 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
 	}
+	// spare threads go to the tile layers of each map
+	int map_jobs = std::min<int>(jobs, maps.size());
+	conf.threads = std::max(1, jobs / map_jobs);
+	jobs = map_jobs;
+
+	std::atomic<size_t> next_map{0};
+	std::atomic<bool> success{true};
+	auto worker = [&]() {
+		for (size_t i = next_map++; i < maps.size(); i = next_map++) {
+			L2IConfig map_conf = conf;
+			map_conf.map = path + maps[i];
+
+			if (conf.verbose) {
+				cliErrorCallback("Rendering \"" + maps[i] + "\"");
+			}
+
+			std::string name = maps[i].substr(0, maps[i].length() - 4);
+			std::string output = mode.pyramid.empty() ? out_path + name + ".png" : mode.pyramid + "/" + name;
+			if (!writeMap(map_conf, db.get(), mode, output)) {
+				cliErrorCallback("Error rendering \"" + maps[i] + "\".");
+				success = false;
+			}
+		}
+	};
 
-	// copy for use in a wxBitmap
-	unsigned char *dst = img_data;
-	for(int y = 0; y < h; y++) {
-		// set position to upper left corner
-		BYTE *src_bits = FreeImage_GetScanLine(img.get(), h - 1 - y);
+	std::vector<std::thread> workers;
+	for (int i = 1; i < jobs; i++) {
+		workers.emplace_back(worker);
+	}
+	// the main thread renders as well
+	worker();
+	for (auto &t : workers) {
+		t.join();
+	}
 
-		for(int x = 0; x < w; x++) {
-			dst[0] = src_bits[FI_RGBA_RED];
-			dst[1] = src_bits[FI_RGBA_GREEN];
-			dst[2] = src_bits[FI_RGBA_BLUE];
-			dst[3] = src_bits[FI_RGBA_ALPHA];
+	return success;
+}
 
-			// next pixel
-			src_bits += bytespp;
-			dst += bytespp;
+static bool writeMap(const L2IConfig &conf, const lcf::rpg::Database *db, const OutputMode &mode,
+	const std::string &output) {
+	bool saved = true;
+
+	if (!mode.pyramid.empty()) {
+		std::unique_ptr<TilePyramid> pyramid;
+		auto sink = [&](const RenderTarget &band, int width, int height, const IndexedScene *) {
+			if (!pyramid) {
+				pyramid = std::make_unique<TilePyramid>(output, width, height, mode.tile_size,
+					mode.png_level);
+				if (conf.verbose) {
+					cliErrorCallback("Writing zoom levels 0 to " + std::to_string(pyramid->MaxZoom()));
+				}
+			}
+			saved = pyramid->AddBand(band.Surface());
+			return saved;
+		};
+		if (!renderBands(conf, db, mode.tile_size, false, sink, cliErrorCallback) && saved) {
+			return false;
 		}
+	} else if (mode.animate) {
+		// reports its own errors
+		MapData data;
+		return loadMap(data, conf, db, cliErrorCallback) && WriteAnimation(data, output, mode.png_level,
+			cliErrorCallback);
+	} else if (mode.stream) {
+		PngWriter png;
+		auto sink = [&](const RenderTarget &band, int width, int height, const IndexedScene *scene) {
+			if (band.OriginY() == 0) {
+				PngPalette palette;
+				if (scene) {
+					makePalette(palette, *scene);
+				}
+				saved = png.Open(output, width, height, mode.png_level, scene ? &palette : nullptr);
+			}
+			for (int y = 0; saved && y < band.Height(); y++) {
+				saved = scene ? png.WriteIndexedRow(band.Surface().Row(y)) : png.WriteRow(band.Surface().Row(y));
+			}
+			if (saved && band.OriginY() + band.Height() == height) {
+				saved = png.Close();
+			}
+			return saved;
+		};
+		int band_height = stream_band_height / TILE_SIZE * ScaledTileSize(conf);
+		if (!renderBands(conf, db, band_height, mode.indexed, sink, cliErrorCallback) && saved) {
+			return false;
+		}
+	} else {
+		ScenePtr scene;
+		auto img = renderMap(conf, db, mode.indexed ? &scene : nullptr, cliErrorCallback);
+		if (!img) {
+			return false;
+		}
+		if (isXyzFile(output)) {
+			saved = saveXyz(*img, output, mode.png_level, scene.get());
+		} else {
+			saved = saveImage(*img, output, mode.png_level, scene.get());
+		}
+	}
+
+	if (!saved) {
+		cliErrorCallback("Error saving \"" + output + "\".");
+	} else {
+		maps_counter.Add();
+	}
+	return saved;
+}
+
+static bool saveImage(const RenderTarget &img, const std::string &filename, int level,
+	const IndexedScene *scene) {
+	Stats::Scope scope("png encode");
+	const BlitSurface &surface = img.Surface();
+	if (scene) {
+		// the pixels already are palette indices
+		PngPalette palette;
+		makePalette(palette, *scene);
+		PngWriter png;
+		if (!png.Open(filename, surface.width, surface.height, level, &palette)) {
+			return false;
+		}
+		for (int y = 0; y < surface.height; y++) {
+			if (!png.WriteIndexedRow(surface.Row(y))) {
+				return false;
+			}
+		}
+		return png.Close();
+	}
+
+	// most maps use few colors, then the smaller paletted format is written
+	PngPalette palette;
+	bool paletted = true;
+	for (int y = 0; paletted && y < surface.height; y++) {
+		paletted = palette.AddRow(surface.Row(y), surface.width);
 	}
 
-	return img_data;
+	PngWriter png;
+	if (!png.Open(filename, surface.width, surface.height, level, paletted ? &palette : nullptr)) {
+		return false;
+	}
+	for (int y = 0; y < surface.height; y++) {
+		if (!png.WriteRow(surface.Row(y))) {
+			return false;
+		}
+	}
+	return png.Close();
+}
+
+static void makePalette(PngPalette &palette, const IndexedScene &scene) {
+	for (uint32_t color : scene.Palette().Colors()) {
+		palette.Add(color);
+	}
+}
+
+static bool isXyzFile(const std::string &filename) {
+	if (filename.size() < 4) {
+		return false;
+	}
+	std::string ext = filename.substr(filename.size() - 4);
+	std::transform(ext.begin(), ext.end(), ext.begin(),
+		[](unsigned char c) { return std::tolower(c); });
+	return ext == ".xyz";
+}
+
+static bool saveXyz(const RenderTarget &img, const std::string &filename, int level,
+	const IndexedScene *scene) {
+	Stats::Scope scope("xyz encode");
+	// XYZ images have no alpha channel, transparent pixels are written black
+	const BlitSurface &surface = img.Surface();
+	std::vector<uint32_t> colors;
+	PngPalette palette;
+	if (scene) {
+		colors = scene->Palette().Colors();
+	} else {
+		for (int y = 0; y < surface.height; y++) {
+			if (!palette.AddRow(surface.Row(y), surface.width)) {
+				cliErrorCallback("XYZ images can only hold maps with up to 256 colors.");
+				return false;
+			}
+		}
+		colors = palette.Colors();
+	}
+
+	BitmapPtr dib(FreeImage_Allocate(surface.width, surface.height, 8));
+	if (!dib) {
+		return false;
+	}
+	RGBQUAD *dib_palette = FreeImage_GetPalette(dib.get());
+	std::unordered_map<uint32_t, uint8_t> index;
+	for (size_t i = 0; i < colors.size(); i++) {
+		uint8_t pixel[4];
+		memcpy(pixel, &colors[i], 4);
+		dib_palette[i].rgbRed = pixel[FI_RGBA_RED];
+		dib_palette[i].rgbGreen = pixel[FI_RGBA_GREEN];
+		dib_palette[i].rgbBlue = pixel[FI_RGBA_BLUE];
+		index[colors[i]] = static_cast<uint8_t>(i);
+	}
+
+	// FreeImage stores the lines bottom-up
+	for (int y = 0; y < surface.height; y++) {
+		const uint8_t *row = surface.Row(y);
+		BYTE *line = FreeImage_GetScanLine(dib.get(), surface.height - 1 - y);
+		if (scene) {
+			memcpy(line, row, surface.width);
+			continue;
+		}
+		uint32_t last = 0;
+		uint8_t last_index = 0;
+		for (int x = 0; x < surface.width; x++) {
+			uint32_t color;
+			memcpy(&color, row + x * 4, 4);
+			if (x == 0 || color != last) {
+				last = color;
+				last_index = index[color];
+			}
+			line[x] = last_index;
+		}
+	}
+
+	return FreeImage_Save(xyz_format, dib.get(), filename.c_str(), XYZ_LEVEL(level));
+}
+
+static void cliErrorCallback(const std::string& error, ErrorCallbackParam) {
+	// Simply tell about the error, the lock keeps lines of parallel renders apart
+	static std::mutex output_mutex;
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::cerr << error << "\n";
+}
+
+#ifdef WITH_GUI
+std::unique_ptr<MapLayers> makeLayers(L2IConfig conf, ErrorCallbackFunc error_cb, ErrorCallbackParam param) {
+	L2IConfig request = conf;
+	if (!openMap(conf, error_cb, param)) {
+		return nullptr;
+	}
+
+	// events are sorted on load, needed once they are shown
+	conf.no_events = false;
+	MapData data;
+	if (!loadMap(data, conf, nullptr, error_cb, param)) {
+		return nullptr;
+	}
+
+	try {
+		auto layers = std::make_unique<MapLayers>(request, std::move(data));
+		if (conf.control && conf.control->IsCancelled()) {
+			return nullptr;
+		}
+		return layers;
+	} catch (const std::bad_alloc&) {
+		error_cb("Unable to create output image.", param);
+		return nullptr;
+	}
 }
 #endif
@@ -18,17 +18,37 @@
 #define MAIN_H
 
 // Headers
+#include <memory>
 #include <string>
 
 // Types
+class RenderTarget;
+class MapLayers;
+class RenderControl;
 using ErrorCallbackParam = void *;
 using ErrorCallbackFunc = void (*) (const std::string&, ErrorCallbackParam);
 
+// How the parallax background is fit to the map
+enum class PanoramaFilter {
+	Bicubic,
+	Bilinear,
+	Box,
+	Nearest,
+	Tile // repeated at original size
+};
+
 using L2IConfig = struct l2i_config_t {
 	std::string database;
 	std::string chipset;
 	std::string encoding;
 	std::string map;
+	std::string cache_dir;
+	std::string index;
+	int threads;
+	int scale; // 2, 4 or 8 draw the map at 1/scale of its size, 0 or 1 at full size
+	PanoramaFilter panorama_filter;
+	RenderControl *control; // progress and cancellation, may be nullptr
+	bool no_cache;
 	bool verbose;
 	bool no_background;
 	bool no_lowertiles;
@@ -39,7 +59,7 @@ using L2IConfig = struct l2i_config_t {
 };
 
 #ifdef WITH_GUI
-unsigned char * makeImage(L2IConfig conf, int &w, int &h, ErrorCallbackFunc error_cb,
+std::unique_ptr<MapLayers> makeLayers(L2IConfig conf, ErrorCallbackFunc error_cb,
 	ErrorCallbackParam param = nullptr);
 #endif
 
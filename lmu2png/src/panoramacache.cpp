@@ -0,0 +1,141 @@
+/* panoramacache.cpp, reuse of scaled parallax backgrounds.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// Headers
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include "panoramacache.h"
+#include "utils.h"
+
+namespace {
+	// Scaled panoramas of 500x500 maps take 256 MiB each, keep about two
+	constexpr size_t cache_limit = 512 * 1024 * 1024;
+
+	std::shared_ptr<const RenderTarget> CreatePanorama(const std::string& path, int width, int height,
+		PanoramaFilter filter, bool verbose, int scale) {
+		BitmapPtr image{LoadImage(path)};
+		BlitSurface source(image.get());
+		if (!source) {
+			return nullptr;
+		}
+
+		if (filter == PanoramaFilter::Tile) {
+			width = std::max(1, source.width / scale);
+			height = std::max(1, source.height / scale);
+		}
+
+		if (verbose) {
+			std::cerr << "Scaling Panorama \"" << path << "\" to " << width << "x" << height << "\n";
+		}
+
+		try {
+			auto target = std::make_shared<RenderTarget>(width, height);
+
+			if (filter == PanoramaFilter::Tile && scale > 1 && source.width >= scale && source.height >= scale) {
+				Blit::Downscale(source, target->Surface(), scale);
+			} else if (filter == PanoramaFilter::Tile) {
+				Blit::Copy(source, target->Surface());
+			} else if (filter == PanoramaFilter::Nearest) {
+				Blit::Scale(source, target->Surface(), width, height);
+			} else {
+				FREE_IMAGE_FILTER fi_filter = FILTER_BICUBIC;
+				if (filter == PanoramaFilter::Box) {
+					fi_filter = FILTER_BOX;
+				} else if (filter == PanoramaFilter::Bilinear) {
+					fi_filter = FILTER_BILINEAR;
+				}
+
+				BitmapPtr scaled{FreeImage_Rescale(image.get(), width, height, fi_filter)};
+				if (!scaled) {
+					return nullptr;
+				}
+				Blit::Copy(BlitSurface(scaled.get()), target->Surface());
+			}
+
+			return target;
+		} catch (const std::bad_alloc&) {
+			return nullptr;
+		}
+	}
+}
+
+PanoramaCache& PanoramaCache::Instance() {
+	static PanoramaCache instance;
+	return instance;
+}
+
+std::shared_ptr<const RenderTarget> PanoramaCache::Get(const std::string& path, int width, int height,
+	PanoramaFilter filter, bool verbose, int scale) {
+	// tiled panoramas do not depend on the map size, only on the scale
+	if (filter == PanoramaFilter::Tile) {
+		width = 0;
+		height = 0;
+	} else {
+		scale = 1;
+	}
+	scale = std::max(1, scale);
+
+	std::string key = path + "|" + std::to_string(width) + "x" + std::to_string(height)
+		+ "|" + std::to_string(static_cast<int>(filter)) + "|1/" + std::to_string(scale);
+	std::error_code ec;
+	auto mtime = std::filesystem::last_write_time(path, ec);
+	if (!ec) {
+		key += "|" + std::to_string(mtime.time_since_epoch().count());
+	}
+
+	std::promise<std::shared_ptr<const RenderTarget>> promise;
+	std::shared_future<std::shared_ptr<const RenderTarget>> panorama;
+	bool create = false;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_Panoramas.find(key);
+		if (it != m_Panoramas.end()) {
+			// may still be scaled by another thread
+			it->second.last_use = ++m_Clock;
+			panorama = it->second.image;
+		} else {
+			size_t bytes = static_cast<size_t>(width) * height * 4;
+			Trim(bytes);
+			panorama = promise.get_future().share();
+			m_Panoramas.emplace(key, Entry{panorama, bytes, ++m_Clock});
+			m_Bytes += bytes;
+			create = true;
+		}
+	}
+
+	// scale without holding the lock, other panoramas can be built meanwhile
+	if (create) {
+		promise.set_value(CreatePanorama(path, width, height, filter, verbose, scale));
+	}
+
+	return panorama.get();
+}
+
+void PanoramaCache::Trim(size_t bytes) {
+	// images still used by a renderer stay alive through their shared_ptr
+	while (!m_Panoramas.empty() && m_Bytes + bytes > cache_limit) {
+		auto oldest = m_Panoramas.begin();
+		for (auto it = m_Panoramas.begin(); it != m_Panoramas.end(); ++it) {
+			if (it->second.last_use < oldest->second.last_use) {
+				oldest = it;
+			}
+		}
+		m_Bytes -= oldest->second.bytes;
+		m_Panoramas.erase(oldest);
+	}
+}
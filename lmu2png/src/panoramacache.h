@@ -0,0 +1,62 @@
+/* panoramacache.h, reuse of scaled parallax backgrounds.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef PANORAMACACHE_H
+#define PANORAMACACHE_H
+
+// Headers
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "blit.h"
+#include "main.h"
+
+// Scaling a panorama to the size of a large map is by far the most expensive
+// part of drawing the background. Maps of a game share few panoramas and
+// sizes, so the result is kept per image, size and filter for later maps.
+class PanoramaCache {
+public:
+	// Process wide instance, shared by all rendered maps
+	static PanoramaCache& Instance();
+
+	// Returns the panorama at path scaled to width x height with filter.
+	// The tile filter returns the unscaled image, or the image box filtered
+	// to 1/scale of its size for reduced scale previews. Returns nullptr
+	// when the image cannot be loaded or does not fit into memory.
+	std::shared_ptr<const RenderTarget> Get(const std::string& path, int width, int height,
+		PanoramaFilter filter, bool verbose, int scale = 1);
+
+private:
+	struct Entry {
+		std::shared_future<std::shared_ptr<const RenderTarget>> image;
+		size_t bytes;
+		uint64_t last_use;
+	};
+
+	// Drops least recently used entries until bytes more fit into the limit
+	void Trim(size_t bytes);
+
+	std::map<std::string, Entry> m_Panoramas;
+	std::mutex m_Mutex;
+	size_t m_Bytes = 0;
+	uint64_t m_Clock = 0;
+};
+
+#endif
@@ -0,0 +1,413 @@
+/* pngwriter.cpp, row by row PNG output.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// Headers
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <FreeImage.h>
+#include "pngwriter.h"
+
+namespace {
+	constexpr size_t idat_size = 64 * 1024;
+	// fdAT chunks start with the sequence number
+	constexpr size_t sequence_size = 4;
+	// highest compression level that skips the filter heuristic
+	constexpr int fast_level = 3;
+
+	void PutBE32(uint8_t *out, uint32_t value) {
+		out[0] = value >> 24;
+		out[1] = value >> 16;
+		out[2] = value >> 8;
+		out[3] = value;
+	}
+
+	void PutBE16(uint8_t *out, uint16_t value) {
+		out[0] = value >> 8;
+		out[1] = value;
+	}
+
+	uint8_t Paeth(int a, int b, int c) {
+		int p = a + b - c;
+		int pa = std::abs(p - a);
+		int pb = std::abs(p - b);
+		int pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc) {
+			return a;
+		}
+		return pb <= pc ? b : c;
+	}
+}
+
+bool PngPalette::AddRow(const uint8_t *row, int width) {
+	uint32_t last = 0;
+	for (int x = 0; x < width; x++) {
+		uint32_t color;
+		memcpy(&color, row + x * 4, 4);
+		// runs of one color are common, skip the set lookup for them
+		if ((x > 0 && color == last) || !m_Seen.insert(color).second) {
+			last = color;
+			continue;
+		}
+		last = color;
+		m_Colors.push_back(color);
+		if (m_Colors.size() > 256) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool PngPalette::Add(uint32_t color) {
+	if (m_Seen.insert(color).second) {
+		m_Colors.push_back(color);
+	}
+	return m_Colors.size() <= 256;
+}
+
+PngWriter::~PngWriter() {
+	if (m_StreamOpen) {
+		deflateEnd(&m_Stream);
+	}
+}
+
+bool PngWriter::Open(const std::string& filename, int width, int height, int level,
+	const PngPalette *palette, int frames) {
+	m_File.open(filename, std::ios::binary);
+	if (!m_File) {
+		return false;
+	}
+
+	m_Width = width;
+	m_Height = height;
+	m_Frames = frames;
+	m_Frame = -1;
+	m_Sequence = 0;
+	m_Level = level;
+	m_Paletted = palette != nullptr;
+	m_Out.resize(sequence_size + idat_size);
+
+	// an animation gets its rows once the first frame is started
+	StartRows(width, frames > 0 ? 0 : height);
+
+	if (deflateInit(&m_Stream, level) != Z_OK) {
+		return false;
+	}
+	m_StreamOpen = true;
+	m_Stream.next_out = m_Out.data() + sequence_size;
+	m_Stream.avail_out = static_cast<uInt>(idat_size);
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	m_File.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+	// 8 bit RGBA or palette indices, no interlacing
+	uint8_t ihdr[13] = {};
+	PutBE32(ihdr, width);
+	PutBE32(ihdr + 4, height);
+	ihdr[8] = 8;
+	ihdr[9] = m_Paletted ? 3 : 6;
+	if (!WriteChunk("IHDR", ihdr, sizeof(ihdr))) {
+		return false;
+	}
+	if (m_Paletted && !WritePalette(*palette)) {
+		return false;
+	}
+
+	if (frames > 0) {
+		// played in an endless loop
+		uint8_t actl[8] = {};
+		PutBE32(actl, frames);
+		return WriteChunk("acTL", actl, sizeof(actl));
+	}
+	return true;
+}
+
+bool PngWriter::BeginFrame(const PngFrame& frame) {
+	if (!m_StreamOpen || m_Rows != m_FrameHeight || m_Frame + 1 >= m_Frames) {
+		return false;
+	}
+	if (frame.width <= 0 || frame.height <= 0 || frame.x < 0 || frame.y < 0
+		|| frame.x + frame.width > m_Width || frame.y + frame.height > m_Height) {
+		return false;
+	}
+	// the first frame is the image shown without animation support
+	if (m_Frame < 0 && (frame.width != m_Width || frame.height != m_Height || frame.blend)) {
+		return false;
+	}
+
+	m_Frame++;
+	if (m_Frame > 0 && deflateReset(&m_Stream) != Z_OK) {
+		return false;
+	}
+	StartRows(frame.width, frame.height);
+
+	uint8_t fctl[26] = {};
+	PutBE32(fctl, m_Sequence++);
+	PutBE32(fctl + 4, frame.width);
+	PutBE32(fctl + 8, frame.height);
+	PutBE32(fctl + 12, frame.x);
+	PutBE32(fctl + 16, frame.y);
+	PutBE16(fctl + 20, frame.delay_num);
+	PutBE16(fctl + 22, frame.delay_den);
+	fctl[24] = 0; // nothing is disposed, the next frame starts from this one
+	fctl[25] = frame.blend ? 1 : 0;
+	return WriteChunk("fcTL", fctl, sizeof(fctl));
+}
+
+void PngWriter::StartRows(int width, int height) {
+	m_FrameHeight = height;
+	m_Rows = 0;
+	size_t row_size = static_cast<size_t>(width) * (m_Paletted ? 1 : 4);
+	m_Row.assign(row_size, 0);
+	m_Prev.assign(row_size, 0);
+	m_Filtered.assign(row_size + 1, 0);
+	m_Best.assign(row_size + 1, 0);
+}
+
+bool PngWriter::WritePalette(const PngPalette& palette) {
+	// translucent colors first, the alpha values of the opaque rest can
+	// be left out of the tRNS chunk
+	std::vector<uint32_t> colors = palette.Colors();
+	std::stable_partition(colors.begin(), colors.end(), [](uint32_t color) {
+		return (color & FI_RGBA_ALPHA_MASK) != FI_RGBA_ALPHA_MASK;
+	});
+
+	std::vector<uint8_t> plte;
+	std::vector<uint8_t> trns;
+	m_Index.clear();
+	for (size_t i = 0; i < colors.size(); i++) {
+		uint8_t pixel[4];
+		memcpy(pixel, &colors[i], 4);
+		plte.push_back(pixel[FI_RGBA_RED]);
+		plte.push_back(pixel[FI_RGBA_GREEN]);
+		plte.push_back(pixel[FI_RGBA_BLUE]);
+		if (pixel[FI_RGBA_ALPHA] != 255) {
+			trns.push_back(pixel[FI_RGBA_ALPHA]);
+		}
+		m_Index[colors[i]] = static_cast<uint8_t>(i);
+	}
+	for (size_t i = 0; i < palette.Colors().size(); i++) {
+		m_Remap[i] = m_Index[palette.Colors()[i]];
+	}
+
+	// the PLTE chunk needs at least one entry
+	if (plte.empty()) {
+		plte.assign(3, 0);
+	}
+	if (!WriteChunk("PLTE", plte.data(), plte.size())) {
+		return false;
+	}
+	return trns.empty() || WriteChunk("tRNS", trns.data(), trns.size());
+}
+
+bool PngWriter::WriteRow(const uint8_t *row) {
+	if (!m_StreamOpen || m_Rows >= m_FrameHeight) {
+		return false;
+	}
+
+	size_t row_size = m_Row.size();
+	if (m_Paletted) {
+		uint32_t last = 0;
+		uint8_t index = 0;
+		for (size_t x = 0; x < row_size; x++) {
+			uint32_t color;
+			memcpy(&color, row + x * 4, 4);
+			if (x == 0 || color != last) {
+				auto it = m_Index.find(color);
+				if (it == m_Index.end()) {
+					return false;
+				}
+				index = it->second;
+				last = color;
+			}
+			m_Row[x] = index;
+		}
+
+		// like libpng, palette indices are not filtered
+		m_Best[0] = 0;
+		memcpy(&m_Best[1], m_Row.data(), row_size);
+	} else {
+		for (size_t x = 0; x < row_size; x += 4) {
+			m_Row[x] = row[x + FI_RGBA_RED];
+			m_Row[x + 1] = row[x + FI_RGBA_GREEN];
+			m_Row[x + 2] = row[x + FI_RGBA_BLUE];
+			m_Row[x + 3] = row[x + FI_RGBA_ALPHA];
+		}
+		FilterRow();
+	}
+
+	return FinishRow();
+}
+
+bool PngWriter::WriteIndexedRow(const uint8_t *row) {
+	if (!m_StreamOpen || m_Rows >= m_FrameHeight || !m_Paletted) {
+		return false;
+	}
+
+	size_t row_size = m_Row.size();
+	for (size_t x = 0; x < row_size; x++) {
+		m_Row[x] = m_Remap[row[x]];
+	}
+	m_Best[0] = 0;
+	memcpy(&m_Best[1], m_Row.data(), row_size);
+
+	return FinishRow();
+}
+
+bool PngWriter::FinishRow() {
+	m_Prev.swap(m_Row);
+	m_Rows++;
+	if (!Deflate(m_Best.data(), m_Best.size(), Z_NO_FLUSH)) {
+		return false;
+	}
+
+	// every frame has its own zlib stream
+	return m_Frames == 0 || m_Rows < m_FrameHeight || Deflate(nullptr, 0, Z_FINISH);
+}
+
+void PngWriter::FilterRow() {
+	size_t row_size = m_Row.size();
+	const uint8_t *row = m_Row.data();
+	const uint8_t *prev = m_Prev.data();
+
+	// uncompressed data does not get smaller by filtering
+	if (m_Level == Z_NO_COMPRESSION) {
+		m_Best[0] = 0;
+		memcpy(&m_Best[1], row, row_size);
+		return;
+	}
+
+	// Same heuristic as libpng: every filter is tried and the one with the
+	// smallest sum of the filtered bytes as signed values is used. Trying
+	// them takes longer than fast compression, then Paeth is always used.
+	bool fast = m_Level <= fast_level;
+	unsigned long best_sum = ~0UL;
+	for (int filter = fast ? 4 : 0; filter < 5; filter++) {
+		uint8_t *out = &m_Filtered[1];
+		m_Filtered[0] = filter;
+
+		// one loop per filter, the first pixel has no left neighbour
+		switch (filter) {
+			case 0:
+				memcpy(out, row, row_size);
+				break;
+			case 1:
+				memcpy(out, row, 4);
+				for (size_t i = 4; i < row_size; i++) {
+					out[i] = row[i] - row[i - 4];
+				}
+				break;
+			case 2:
+				for (size_t i = 0; i < row_size; i++) {
+					out[i] = row[i] - prev[i];
+				}
+				break;
+			case 3:
+				for (size_t i = 0; i < 4; i++) {
+					out[i] = row[i] - prev[i] / 2;
+				}
+				for (size_t i = 4; i < row_size; i++) {
+					out[i] = row[i] - (row[i - 4] + prev[i]) / 2;
+				}
+				break;
+			case 4:
+				for (size_t i = 0; i < 4; i++) {
+					out[i] = row[i] - prev[i];
+				}
+				for (size_t i = 4; i < row_size; i++) {
+					out[i] = row[i] - Paeth(row[i - 4], prev[i], prev[i - 4]);
+				}
+				break;
+		}
+
+		if (fast) {
+			m_Best.swap(m_Filtered);
+			break;
+		}
+
+		unsigned long sum = 0;
+		for (size_t i = 0; i < row_size; i++) {
+			sum += static_cast<unsigned>(std::abs(static_cast<int8_t>(out[i])));
+		}
+		if (sum < best_sum) {
+			best_sum = sum;
+			m_Best.swap(m_Filtered);
+		}
+	}
+}
+
+bool PngWriter::Close() {
+	if (!m_StreamOpen || m_Rows != m_FrameHeight || m_Frame + 1 != m_Frames) {
+		return false;
+	}
+
+	bool ok = m_Frames > 0 || Deflate(nullptr, 0, Z_FINISH);
+	deflateEnd(&m_Stream);
+	m_StreamOpen = false;
+
+	ok = ok && WriteChunk("IEND", nullptr, 0);
+	m_File.close();
+	return ok && !m_File.fail();
+}
+
+bool PngWriter::WriteChunk(const char *type, const uint8_t *data, size_t size) {
+	uint8_t length[4];
+	PutBE32(length, static_cast<uint32_t>(size));
+	uLong crc = crc32(0L, reinterpret_cast<const Bytef *>(type), 4);
+	if (size > 0) {
+		crc = crc32(crc, data, static_cast<uInt>(size));
+	}
+	uint8_t crc_bytes[4];
+	PutBE32(crc_bytes, static_cast<uint32_t>(crc));
+
+	m_File.write(reinterpret_cast<const char *>(length), 4);
+	m_File.write(type, 4);
+	m_File.write(reinterpret_cast<const char *>(data), size);
+	m_File.write(reinterpret_cast<const char *>(crc_bytes), 4);
+	return static_cast<bool>(m_File);
+}
+
+bool PngWriter::Deflate(const uint8_t *data, size_t size, int flush) {
+	m_Stream.next_in = const_cast<Bytef *>(data);
+	m_Stream.avail_in = static_cast<uInt>(size);
+
+	// the output buffer is kept between calls, every full buffer becomes one IDAT chunk
+	for (;;) {
+		int ret = deflate(&m_Stream, flush);
+		if (ret == Z_STREAM_ERROR) {
+			return false;
+		}
+
+		bool done = flush == Z_FINISH ? ret == Z_STREAM_END : m_Stream.avail_in == 0;
+		if (m_Stream.avail_out == 0 || (done && flush == Z_FINISH)) {
+			size_t have = idat_size - m_Stream.avail_out;
+			if (have > 0 && m_Frame > 0) {
+				// frames after the first one are stored in fdAT chunks
+				PutBE32(m_Out.data(), m_Sequence++);
+				if (!WriteChunk("fdAT", m_Out.data(), sequence_size + have)) {
+					return false;
+				}
+			} else if (have > 0 && !WriteChunk("IDAT", m_Out.data() + sequence_size, have)) {
+				return false;
+			}
+			m_Stream.next_out = m_Out.data() + sequence_size;
+			m_Stream.avail_out = static_cast<uInt>(idat_size);
+		}
+		if (done && m_Stream.avail_out > 0) {
+			return true;
+		}
+	}
+}
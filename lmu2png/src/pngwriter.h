@@ -0,0 +1,116 @@
+/* pngwriter.h, row by row PNG output.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+// Headers
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <zlib.h>
+
+// Colors of an image that has at most 256 of them, collected before it is
+// written as a paletted PNG. Pixels are compared as 32 bit values.
+class PngPalette {
+public:
+	// Adds the colors of width pixels, false once there are too many
+	bool AddRow(const uint8_t *row, int width);
+
+	// Adds one color, false once there are too many. Colors that were only
+	// added this way keep the order of the calls.
+	bool Add(uint32_t color);
+
+	const std::vector<uint32_t>& Colors() const { return m_Colors; }
+
+private:
+	std::unordered_set<uint32_t> m_Seen;
+	std::vector<uint32_t> m_Colors;
+};
+
+// Part of an animated PNG that is replaced by one frame
+struct PngFrame {
+	int x = 0;
+	int y = 0;
+	int width = 0;
+	int height = 0;
+	int delay_num = 0;   // shown for delay_num / delay_den seconds
+	int delay_den = 100;
+	bool blend = false;  // drawn over the previous frame instead of replacing it
+};
+
+// Writes an RGBA or paletted PNG while the image is still being rendered, so only
+// the current row has to be kept. Rows are passed in FreeImage pixel order.
+// Animated PNGs consist of frames, the first one covers the whole image.
+class PngWriter {
+public:
+	PngWriter() = default;
+	PngWriter(const PngWriter&) = delete;
+	PngWriter& operator=(const PngWriter&) = delete;
+	~PngWriter();
+
+	// Creates filename and writes the header. With a palette an 8 bit
+	// paletted image is written, every row must only use its colors.
+	bool Open(const std::string& filename, int width, int height, int level = Z_BEST_COMPRESSION,
+		const PngPalette *palette = nullptr, int frames = 0);
+
+	// Starts the next frame of an animated PNG, its rows follow
+	bool BeginFrame(const PngFrame& frame);
+
+	// Appends the next row of width pixels, or of the frame width
+	bool WriteRow(const uint8_t *row);
+
+	// Same for a paletted image, row holds the positions of the colors
+	// in the palette passed to Open
+	bool WriteIndexedRow(const uint8_t *row);
+
+	// Finishes the file, fails when rows or frames are missing
+	bool Close();
+
+private:
+	bool WriteChunk(const char *type, const uint8_t *data, size_t size);
+	bool Deflate(const uint8_t *data, size_t size, int flush);
+	void StartRows(int width, int height);
+	bool WritePalette(const PngPalette& palette);
+	void FilterRow();
+	bool FinishRow();
+
+	std::ofstream m_File;
+	z_stream m_Stream = {};
+	bool m_StreamOpen = false;
+	int m_Width = 0;
+	int m_Height = 0;
+	int m_Frames = 0;       // 0 for a still image
+	int m_Frame = -1;       // being written
+	uint32_t m_Sequence = 0;
+	int m_FrameHeight = 0;
+	int m_Rows = 0;         // of the image or the frame
+	int m_Level = Z_BEST_COMPRESSION;
+	bool m_Paletted = false;
+	std::unordered_map<uint32_t, uint8_t> m_Index;
+	uint8_t m_Remap[256] = {}; // palette position to PNG index
+	std::vector<uint8_t> m_Row;
+	std::vector<uint8_t> m_Prev;
+	std::vector<uint8_t> m_Filtered;
+	std::vector<uint8_t> m_Best;
+	std::vector<uint8_t> m_Out;
+};
+
+#endif
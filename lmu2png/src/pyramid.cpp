@@ -0,0 +1,152 @@
+/* pyramid.cpp, tile pyramid output for web map viewers.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// Headers
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include "pngwriter.h"
+#include "pyramid.h"
+
+TilePyramid::TilePyramid(const std::string& dir, int width, int height, int tile_size, int png_level) :
+	m_Dir(dir), m_TileSize(tile_size), m_PngLevel(png_level) {
+	// levels from the single tile (zoom 0) up to the full resolution
+	std::vector<Level> levels;
+	for (;;) {
+		levels.push_back({ width, height, 0, 0, {} });
+		if (width <= tile_size && height <= tile_size) {
+			break;
+		}
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+	m_Levels.assign(levels.rbegin(), levels.rend());
+
+	// the full resolution bands are passed in, no buffer needed
+	for (size_t z = 0; z + 1 < m_Levels.size(); z++) {
+		m_Levels[z].pixels.resize(static_cast<size_t>(m_Levels[z].width) * tile_size * 4);
+	}
+}
+
+bool TilePyramid::AddBand(const BlitSurface& band) {
+	int z = MaxZoom();
+	Level &level = m_Levels[z];
+
+	// pack the rows, the surface may have any stride
+	std::vector<uint8_t> pixels(static_cast<size_t>(level.width) * band.height * 4);
+	for (int y = 0; y < band.height; y++) {
+		memcpy(&pixels[static_cast<size_t>(y) * level.width * 4], band.Row(y), static_cast<size_t>(level.width) * 4);
+	}
+
+	bool ok = WriteBand(z, pixels.data(), level.width, band.height, level.band);
+	level.band++;
+	return ok;
+}
+
+bool TilePyramid::WriteBand(int z, const uint8_t *pixels, int width, int rows, int band) {
+	std::error_code ec;
+	std::vector<uint8_t> row(static_cast<size_t>(m_TileSize) * 4);
+	const uint8_t transparent[4] = {};
+
+	// edge tiles are padded with transparent pixels
+	for (int tx = 0; tx * m_TileSize < width; tx++) {
+		std::string dir = m_Dir + "/" + std::to_string(z) + "/" + std::to_string(tx);
+		std::filesystem::create_directories(dir, ec);
+
+		int x = tx * m_TileSize;
+		int w = std::min(m_TileSize, width - x);
+
+		// tiles with few colors are written paletted, padding is one more
+		PngPalette palette;
+		bool paletted = true;
+		if (w < m_TileSize || rows < m_TileSize) {
+			paletted = palette.AddRow(transparent, 1);
+		}
+		for (int y = 0; paletted && y < rows; y++) {
+			paletted = palette.AddRow(pixels + (static_cast<size_t>(y) * width + x) * 4, w);
+		}
+
+		PngWriter png;
+		if (!png.Open(dir + "/" + std::to_string(band) + ".png", m_TileSize, m_TileSize, m_PngLevel,
+			paletted ? &palette : nullptr)) {
+			return false;
+		}
+
+		for (int y = 0; y < m_TileSize; y++) {
+			std::fill(row.begin(), row.end(), 0);
+			if (y < rows) {
+				memcpy(row.data(), pixels + (static_cast<size_t>(y) * width + x) * 4, static_cast<size_t>(w) * 4);
+			}
+			if (!png.WriteRow(row.data())) {
+				return false;
+			}
+		}
+		if (!png.Close()) {
+			return false;
+		}
+	}
+
+	if (z > 0) {
+		Downsample(z, pixels, width, rows, band);
+
+		// two bands make up one band of the level below
+		Level &parent = m_Levels[z - 1];
+		bool last = (band + 1) * m_TileSize >= m_Levels[z].height;
+		if (band % 2 == 1 || last) {
+			bool ok = WriteBand(z - 1, parent.pixels.data(), parent.width, parent.rows, parent.band);
+			parent.band++;
+			parent.rows = 0;
+			std::fill(parent.pixels.begin(), parent.pixels.end(), 0);
+			return ok;
+		}
+	}
+
+	return true;
+}
+
+void TilePyramid::Downsample(int z, const uint8_t *pixels, int width, int rows, int band) {
+	Level &parent = m_Levels[z - 1];
+	int offset = (band % 2) * m_TileSize / 2;
+	int parent_rows = (rows + 1) / 2;
+
+	// 2x2 box filter, colors are weighted by alpha so transparent pixels
+	// do not darken the edges. Odd image edges have fewer samples, alpha is
+	// averaged over those that exist.
+	for (int py = 0; py < parent_rows; py++) {
+		uint8_t *out = &parent.pixels[static_cast<size_t>(offset + py) * parent.width * 4];
+		for (int px = 0; px < parent.width; px++) {
+			unsigned sum[4] = {};
+			unsigned alpha = 0;
+			unsigned samples = 0;
+			for (int sy = py * 2; sy < std::min(py * 2 + 2, rows); sy++) {
+				for (int sx = px * 2; sx < std::min(px * 2 + 2, width); sx++) {
+					const uint8_t *p = pixels + (static_cast<size_t>(sy) * width + sx) * 4;
+					unsigned a = p[FI_RGBA_ALPHA];
+					for (int c = 0; c < 4; c++) {
+						sum[c] += p[c] * a;
+					}
+					alpha += a;
+					samples++;
+				}
+			}
+			for (int c = 0; c < 4; c++) {
+				out[px * 4 + c] = alpha ? sum[c] / alpha : 0;
+			}
+			out[px * 4 + FI_RGBA_ALPHA] = alpha / samples;
+		}
+	}
+	parent.rows = offset + parent_rows;
+}
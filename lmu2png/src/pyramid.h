@@ -0,0 +1,58 @@
+/* pyramid.h, tile pyramid output for web map viewers.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+// Headers
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "blit.h"
+
+// Writes an image as dir/z/x/y.png tiles. The highest zoom level has the
+// full resolution, every level below is scaled down by two until the image
+// fits into one tile. The image is passed in bands of tile size rows from
+// top to bottom, each level only keeps one band of tiles in memory.
+class TilePyramid {
+public:
+	TilePyramid(const std::string& dir, int width, int height, int tile_size, int png_level);
+
+	int MaxZoom() const { return static_cast<int>(m_Levels.size()) - 1; }
+
+	// Adds the next band of the full resolution image, only the last band
+	// may have less than tile size rows
+	bool AddBand(const BlitSurface& band);
+
+private:
+	struct Level {
+		int width;
+		int height;
+		int band;                    // index of the band being collected
+		int rows;                    // rows of the band received so far
+		std::vector<uint8_t> pixels; // width x tile size
+	};
+
+	bool WriteBand(int z, const uint8_t *pixels, int width, int rows, int band);
+	void Downsample(int z, const uint8_t *pixels, int width, int rows, int band);
+
+	std::string m_Dir;
+	int m_TileSize;
+	int m_PngLevel;
+	std::vector<Level> m_Levels;
+};
+
+#endif
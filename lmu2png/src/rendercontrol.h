@@ -0,0 +1,68 @@
+/* rendercontrol.h, progress and cancellation of renders.
+   Copyright (C) 2026 EasyRPG Project <https://github.com/EasyRPG/>.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef RENDERCONTROL_H
+#define RENDERCONTROL_H
+
+// Headers
+#include <atomic>
+#include <functional>
+
+// Shared by a render running on another thread and its owner. Progress is
+// counted in drawn tile rows, the owner sets how many are expected.
+class RenderControl {
+public:
+	// Called from the render threads whenever the percentage changes
+	using ProgressFunc = std::function<void(int percent)>;
+
+	explicit RenderControl(ProgressFunc progress = nullptr) : m_Progress(std::move(progress)) {}
+
+	// Stops the render at the next tile row, the result is incomplete
+	void Cancel() { m_Cancelled = true; }
+	bool IsCancelled() const { return m_Cancelled; }
+
+	// Starts counting steps again
+	void Start(int steps) {
+		m_Steps = steps;
+		m_Done = 0;
+		m_Percent = -1;
+		Step(0);
+	}
+
+	// Thread safe, reports count more done steps
+	void Step(int count = 1) {
+		int done = m_Done += count;
+		int percent = m_Steps > 0 ? static_cast<int>(static_cast<long long>(done) * 100 / m_Steps) : 100;
+		int last = m_Percent;
+		while (percent > last) {
+			if (m_Percent.compare_exchange_weak(last, percent)) {
+				if (m_Progress) {
+					m_Progress(percent);
+				}
+				break;
+			}
+		}
+	}
+
+private:
+	std::atomic<bool> m_Cancelled{false};
+	std::atomic<int> m_Done{0};
+	std::atomic<int> m_Percent{-1};
+	std::atomic<int> m_Steps{0};
+	ProgressFunc m_Progress;
+};
+
+#endif
@@ -22,18 +22,51 @@
 #include <string>
 #include <algorithm>
 #include <map>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+#include <cctype>
+#include <cstring>
+#include <thread>
+#include <vector>
 #include <lcf/ldb/reader.h>
 #include <lcf/lmu/reader.h>
 #include <lcf/reader_lcf.h>
 #include <lcf/rpg/map.h>
 #include <lcf/rpg/chipset.h>
+#ifdef HAVE_NLOHMANN_JSON
+#	include <nlohmann/json.hpp>
+#endif
 #include "utils.h"
 #include "chipset.h"
-
-using CharsetCacheMap = std::map<std::string, BitmapPtr>;
+#include "chipsetcache.h"
+#include "indexed.h"
+#include "panoramacache.h"
+#include "rendercontrol.h"
+#include "stats.h"
 
 static std::vector<std::string> resource_dirs = {};
 
+// Lowercase "folder/basename" to file path, built once by CollectResourcePaths
+static std::unordered_map<std::string, std::string> resource_index;
+
+// Charsets are shared by all maps rendered by this process
+struct CharsetEntry {
+	BitmapPtr bitmap;
+	BlitSurface surface;
+};
+// keyed by name and scale
+static std::map<std::pair<std::string, int>, CharsetEntry> charsets;
+static std::mutex charsets_mutex;
+
+static Stats::Counter lookups_counter("resource lookups");
+static Stats::Counter charsets_counter("charsets loaded");
+static Stats::Counter sprites_counter("event sprites drawn");
+
+int ScaledTileSize(const L2IConfig& conf) {
+	return conf.scale > 1 ? TILE_SIZE / conf.scale : TILE_SIZE;
+}
+
 std::string GetFileDirectory(const std::string& file) {
 	size_t found = file.find_last_of("/\\");
 
@@ -46,7 +79,101 @@ bool Exists(const std::string& filename) {
 	return infile.good();
 }
 
-void CollectResourcePaths(std::string& main_path) {
+static std::string ToLower(std::string str) {
+	std::transform(str.begin(), str.end(), str.begin(),
+		[](unsigned char c) { return std::tolower(c); });
+	return str;
+}
+
+// Returns the priority of an image extension, lower is better, -1 if unsupported
+static int ImageExtensionRank(const std::string& lower_filename) {
+	int rank = 0;
+	for (const auto& ext : {".png", ".bmp", ".xyz"}) {
+		size_t len = strlen(ext);
+		if (lower_filename.size() > len && lower_filename.compare(lower_filename.size() - len, len, ext) == 0) {
+			return rank;
+		}
+		++rank;
+	}
+	return -1;
+}
+
+static bool IsImageFolder(const std::string& lower_folder) {
+	return lower_folder == "charset" || lower_folder == "chipset" || lower_folder == "panorama";
+}
+
+// Adds the image folders of dir, earlier directories take precedence
+static void IndexDirectory(const std::string& dir) {
+	std::map<std::string, std::pair<int, std::string>> found;
+	std::error_code ec;
+
+	for (const auto& folder : std::filesystem::directory_iterator(dir, ec)) {
+		std::string folder_name = folder.path().filename().string();
+		std::string lower_folder = ToLower(folder_name);
+		if (!IsImageFolder(lower_folder) || !folder.is_directory(ec)) {
+			continue;
+		}
+
+		for (const auto& file : std::filesystem::directory_iterator(folder.path(), ec)) {
+			std::string file_name = file.path().filename().string();
+			std::string lower_file = ToLower(file_name);
+			int rank = ImageExtensionRank(lower_file);
+			if (rank < 0) {
+				continue;
+			}
+
+			std::string key = lower_folder + "/" + lower_file.substr(0, lower_file.find_last_of('.'));
+			auto it = found.find(key);
+			if (it == found.end() || rank < it->second.first) {
+				found[key] = { rank, dir + "/" + folder_name + "/" + file_name };
+			}
+		}
+	}
+
+	for (auto& entry : found) {
+		resource_index.emplace(entry.first, std::move(entry.second.second));
+	}
+}
+
+#ifdef HAVE_NLOHMANN_JSON
+// Adds the image folders listed in a gencache index.json for dir
+static bool IndexFromCache(const std::string& dir, const std::string& index_file) {
+	std::ifstream in(index_file);
+	if (!in) {
+		std::cerr << "Cannot open index file \"" << index_file << "\".\n";
+		return false;
+	}
+
+	nlohmann::json index = nlohmann::json::parse(in, nullptr, false);
+	if (index.is_discarded() || !index.contains("cache") || !index["cache"].is_object()) {
+		std::cerr << "Index file \"" << index_file << "\" is invalid.\n";
+		return false;
+	}
+
+	for (const auto& folder : index["cache"].items()) {
+		const auto& entries = folder.value();
+		if (!IsImageFolder(folder.key()) || !entries.is_object() || !entries.contains("_dirname")) {
+			continue;
+		}
+
+		std::string folder_name = entries["_dirname"].get<std::string>();
+		for (const auto& file : entries.items()) {
+			if (file.key() == "_dirname" || !file.value().is_string()) {
+				continue;
+			}
+
+			std::string file_name = file.value().get<std::string>();
+			if (ImageExtensionRank(ToLower(file_name)) >= 0) {
+				resource_index.emplace(folder.key() + "/" + file.key(), dir + "/" + folder_name + "/" + file_name);
+			}
+		}
+	}
+
+	return true;
+}
+#endif
+
+void CollectResourcePaths(std::string& main_path, const std::string& index_file) {
 	auto split_path = [](std::string path) {
 		int start = 0;
 		for (int i = 0; i <= static_cast<int>(path.size()); i++) {
@@ -62,6 +189,9 @@ void CollectResourcePaths(std::string& main_path) {
 	resource_dirs.clear();
 	resource_dirs.emplace_back(main_path);
 
+	// names may resolve to different files now
+	charsets.clear();
+
 	char* rtp2k_ptr = getenv("RPG2K_RTP_PATH");
 	if (rtp2k_ptr) {
 		split_path(rtp2k_ptr);
@@ -71,92 +201,29 @@ void CollectResourcePaths(std::string& main_path) {
 	if (rtp2k3_ptr) {
 		split_path(rtp2k3_ptr);
 	}
-}
 
-std::string FindResource(const std::string& folder, const std::string& base_name) {
+	// List every directory only once, lookups are done in memory afterwards
+	resource_index.clear();
 	for (const auto& dir : resource_dirs) {
-		for (const auto& ext : {".png", ".bmp", ".xyz"}) {
-			if (Exists(dir + "/" + folder + "/" + base_name + ext))
-				return dir + "/" + folder + "/" + base_name + ext;
+#ifdef HAVE_NLOHMANN_JSON
+		if (&dir == &resource_dirs.front() && !index_file.empty()) {
+			if (IndexFromCache(dir, index_file)) {
+				continue;
+			}
 		}
+#endif
+		IndexDirectory(dir);
 	}
-
-	return "";
 }
 
-void CustomAlphaCombine(FIBITMAP *src, int sLeft, int sTop, FIBITMAP *dst, int dLeft, int dTop, int width, int height) {
-	if (!src || !dst) {
-		std::cout << "Source or Destination parameter undefined.\n";
-		return;
-	}
-
-	int sBpp = FreeImage_GetBPP(src);
-	int dBpp = FreeImage_GetBPP(dst);
-	if((sBpp != 32) || (dBpp != 32)) {
-		std::cout << "Source or Destination have wrong format.\n";
-		return;
-	}
-
-	int sWidth = FreeImage_GetWidth(src);
-	int sHeight = FreeImage_GetHeight(src);
-	int dWidth = FreeImage_GetWidth(dst);
-	int dHeight = FreeImage_GetHeight(dst);
-
-	// Sanitize src dims
-	if((sLeft < 0) || (sTop < 0) || (sLeft + width > sWidth) || (sTop + height > sHeight)) {
-		std::cout << "Source dimension error.\n";
-		return;
-	}
-
-	// Event special case: draw only part on borders
-	if(dLeft < 0) {
-		int amount = dLeft + width;
-		dLeft = 0;
-		width = amount;
-	}
-	if(dTop < 0) {
-		int amount = dTop + height;
-		dTop = 0;
-		height = amount;
-	}
-	if(dLeft + width > dWidth) {
-		int amount = dLeft + width - dWidth;
-		width -= amount;
-	}
-	if(dTop + height > dHeight) {
-		int amount = dTop + height - dHeight;
-		height -= amount;
-	}
-
-	// Sanitize final dims
-	if ((width <= 0) || (height <= 0)) {
-		std::cout << "Skipping zero/negative size copy.\n";
-		return;
-	}
-
-	int bytespp = sBpp / 8;
-	for(int y = 0; y < height; y++) {
-		// set position to upper left corner
-		BYTE *src_bits = FreeImage_GetScanLine(src, sHeight - 1 - (sTop + y)) + sLeft * bytespp;
-		BYTE *dst_bits = FreeImage_GetScanLine(dst, dHeight - 1 - (dTop + y)) + dLeft * bytespp;
-
-		for(int x = 0; x < width; x++) {
-			// skip fully transparent pixels
-			if (src_bits[FI_RGBA_ALPHA] != 0) {
-				dst_bits[FI_RGBA_RED]   = src_bits[FI_RGBA_RED];
-				dst_bits[FI_RGBA_GREEN] = src_bits[FI_RGBA_GREEN];
-				dst_bits[FI_RGBA_BLUE]  = src_bits[FI_RGBA_BLUE];
-				dst_bits[FI_RGBA_ALPHA] = src_bits[FI_RGBA_ALPHA];
-			}
+std::string FindResource(const std::string& folder, const std::string& base_name) {
+	lookups_counter.Add();
+	auto it = resource_index.find(ToLower(folder + "/" + base_name));
 
-			// next pixel
-			src_bits += bytespp;
-			dst_bits += bytespp;
-		}
-	}
+	return it == resource_index.end() ? "" : it->second;
 }
 
-FIBITMAP* LoadImage(std::string &image_path, bool transparent = false) {
+FIBITMAP* LoadImage(const std::string& image_path, bool transparent, bool keep_palette) {
 	BitmapPtr image;
 
 	FREE_IMAGE_FORMAT format = FreeImage_GetFileType(image_path.c_str());
@@ -169,6 +236,15 @@ FIBITMAP* LoadImage(std::string &image_path, bool transparent = false) {
 		return nullptr;
 	}
 
+	if (keep_palette && FreeImage_GetBPP(image.get()) <= 8 && FreeImage_GetPalette(image.get())
+		&& (transparent || !FreeImage_IsTransparent(image.get()))) {
+		// keyed images only use the transparency of index 0
+		if (FreeImage_GetBPP(image.get()) == 8) {
+			return image.release();
+		}
+		return FreeImage_ConvertTo8Bits(image.get());
+	}
+
 	if (transparent) {
 		// Set as color key the first color in the palette
 		FreeImage_SetTransparentIndex(image.get(), 0);
@@ -180,81 +256,147 @@ FIBITMAP* LoadImage(std::string &image_path, bool transparent = false) {
 	return output;
 }
 
-void DrawTiles(FIBITMAP* output_img, Chipset* gen, uint8_t * csflag, std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf, LAYER flaglayer) {
-	for (int y = 0; y < map->height; ++y) {
-		for (int x = 0; x < map->width; ++x) {
-			// Different logic between these.
-			int tindex = x + y * map->width;
-
-			if (!conf.no_lowertiles) {
-				uint16_t tid = map->lower_layer[tindex];
-				LAYER l = (csflag[tid] & 0x30) ? LAYER::UPPER : LAYER::LOWER;
-				if (l == flaglayer)
-					gen->RenderTile(output_img, x, y, map->lower_layer[x+y*map->width], 0);
+void DrawTiles(const RenderTarget& output_img, Chipset* gen, uint8_t * csflag, std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf, LAYER flaglayer, AnimationFrame frame) {
+	Stats::Scope scope("tiles");
+	const BlitSurface &output = output_img.Surface();
+	int tile = gen->TileSize();
+
+	// only the tiles covered by the target, the origin is tile aligned
+	int origin_x = output_img.OriginX() / tile;
+	int origin_y = output_img.OriginY() / tile;
+	int x_end = std::min(map->width, origin_x + (output.width + tile - 1) / tile);
+	int y_end = std::min(map->height, origin_y + (output.height + tile - 1) / tile);
+
+	auto draw_rows = [&](int y_begin, int y_end) {
+		for (int y = y_begin; y < y_end; ++y) {
+			if (conf.control && conf.control->IsCancelled()) {
+				return;
+			}
+
+			for (int x = origin_x; x < x_end; ++x) {
+				// Different logic between these.
+				int tindex = x + y * map->width;
+
+				if (!conf.no_lowertiles) {
+					uint16_t tid = map->lower_layer[tindex];
+					if (TileLayer(csflag, tid, false) == flaglayer)
+						gen->RenderTile(output, x - origin_x, y - origin_y, tid,
+							tid < TILETYPE::ANIMATED ? frame.water : frame.animated);
+				}
+
+				if (!conf.no_uppertiles) {
+					uint16_t tid = map->upper_layer[tindex];
+					if (TileLayer(csflag, tid, true) == flaglayer)
+						gen->RenderTile(output, x - origin_x, y - origin_y, tid, 0);
+				}
 			}
 
-			if (!conf.no_uppertiles) {
-				uint16_t tid = map->upper_layer[tindex];
-				LAYER l = (csflag[tid] & 0x10) ? LAYER::UPPER : LAYER::LOWER;
-				if (l == flaglayer)
-					gen->RenderTile(output_img, x, y, map->upper_layer[x+y*map->width], 0);
+			if (conf.control) {
+				conf.control->Step();
 			}
 		}
+	};
+
+	// Every tile only touches its own block, so horizontal bands of
+	// the map can be drawn at the same time. Events are drawn afterwards.
+	int rows = y_end - origin_y;
+	if (rows <= 0) {
+		return;
+	}
+	int threads = conf.threads > 0 ? conf.threads : static_cast<int>(std::thread::hardware_concurrency());
+	threads = std::max(1, std::min(threads, rows));
+	int band = (rows + threads - 1) / threads;
+
+	std::vector<std::thread> workers;
+	for (int y = origin_y + band; y < y_end; y += band) {
+		workers.emplace_back(draw_rows, y, std::min(y + band, y_end));
+	}
+	draw_rows(origin_y, std::min(origin_y + band, y_end));
+	for (auto &t : workers) {
+		t.join();
 	}
 }
 
-void DrawEvents(FIBITMAP* output_img, Chipset* gen, std::unique_ptr<lcf::rpg::Map> & map, LAYER layer, CharsetCacheMap &charsets, L2IConfig conf) {
-	for (const lcf::rpg::Event& ev : map->events) {
-		const lcf::rpg::EventPage* evp = nullptr;
+const BlitSurface* GetCharset(const std::string& name, bool verbose, int scale) {
+	scale = std::max(1, scale);
+	std::lock_guard<std::mutex> lock(charsets_mutex);
+	auto it = charsets.find({name, scale});
+	if (it != charsets.end()) {
+		// use from cache
+#ifndef NDEBUG
+		if(verbose) {
+			std::cerr << "Using CharSet \"" << name << "\" (cached)\n";
+		}
+#endif
+		return it->second.surface ? &it->second.surface : nullptr;
+	}
 
-		if (conf.ignore_conditions) {
-			evp = &ev.pages[0];
-		} else {
-			// Find highest page without conditions
-			for (int i = 0; i < (int)ev.pages.size(); ++i) {
-				const auto& flg = ev.pages[i].condition.flags;
-				if (flg.switch_a || flg.switch_b || flg.variable || flg.item || flg.actor || flg.timer || flg.timer2)
-					continue;
-				evp = &ev.pages[i];
+	if(verbose) {
+		std::cerr << "Loading CharSet \"" << name << "\"\n";
+	}
+
+	// add image to cache, failures are remembered as well
+	Stats::Scope scope("charsets");
+	CharsetEntry entry;
+	std::string charset{FindResource("CharSet", name)};
+	if (charset.empty()) {
+		std::cout << "Charset \"" << name << "\" not found.\n";
+	} else {
+		entry.bitmap.reset(LoadImage(charset, true));
+		BlitSurface full(entry.bitmap.get());
+		if (scale > 1 && full.width >= scale && full.height >= scale) {
+			// the sprites are 24x32 pixels, they stay aligned to the scale
+			BitmapPtr scaled(FreeImage_Allocate(full.width / scale, full.height / scale, 32));
+			if (scaled) {
+				Blit::Downscale(full, BlitSurface(scaled.get()), scale);
 			}
+			entry.bitmap = std::move(scaled);
 		}
-		if (!evp) {
-			continue;
+		entry.surface = BlitSurface(entry.bitmap.get());
+		charsets_counter.Add();
+	}
+	const BlitSurface &surface = charsets.emplace(std::make_pair(name, scale), std::move(entry)).first->second.surface;
+	return surface ? &surface : nullptr;
+}
+
+const lcf::rpg::EventPage* DrawnPage(const lcf::rpg::Event& ev, const L2IConfig& conf) {
+	const lcf::rpg::EventPage* evp = nullptr;
+
+	if (conf.ignore_conditions) {
+		evp = &ev.pages[0];
+	} else {
+		// Find highest page without conditions
+		for (int i = 0; i < (int)ev.pages.size(); ++i) {
+			const auto& flg = ev.pages[i].condition.flags;
+			if (flg.switch_a || flg.switch_b || flg.variable || flg.item || flg.actor || flg.timer || flg.timer2)
+				continue;
+			evp = &ev.pages[i];
 		}
+	}
+	return evp;
+}
 
-		// Event layering
-		if (evp->layer >= static_cast<int>(LAYER::LOWER)
-			&& evp->layer <= static_cast<int>(LAYER::EVENTS)
-			&& evp->layer != static_cast<int>(layer))
+EventLayers ResolveEvents(std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf, const IndexedScene* scene) {
+	EventLayers layers;
+	int tile = ScaledTileSize(conf);
+	int scale = TILE_SIZE / tile;
+
+	for (const lcf::rpg::Event& ev : map->events) {
+		const lcf::rpg::EventPage* evp = DrawnPage(ev, conf);
+		if (!evp) {
 			continue;
+		}
 
+		EventSprite sprite = {};
 		if (evp->character_name.empty()) {
-			gen->RenderTile(output_img, ev.x, ev.y, TILETYPE::UPPER + evp->character_index, 0);
+			sprite.x = ev.x;
+			sprite.y = ev.y;
+			sprite.tile = TILETYPE::UPPER + evp->character_index;
 		} else {
-			std::string cname = lcf::ToString(evp->character_name);
-			if(charsets.count(cname) == 0) {
-				if(conf.verbose) {
-					std::cerr << "Loading CharSet \"" << cname << "\"\n";
-				}
-
-				std::string charset{FindResource("CharSet", cname)};
-				if (charset.empty()) {
-					std::cout << "Charset \"" << evp->character_name << "\" not found.\n";
-					continue;
-				}
-
-				// add image to cache
-				BitmapPtr charset_img{LoadImage(charset, true)};
-				if(charset_img) {
-					charsets.emplace(cname, std::move(charset_img));
-				}
-			} else {
-				// use from cache
-#ifndef NDEBUG
-				if(conf.verbose) {
-					std::cerr << "Using CharSet \"" << cname << "\" (cached)\n";
-				}
-#endif
+			std::string name = lcf::ToString(evp->character_name);
+			sprite.charset = scene ? scene->GetCharset(name) : GetCharset(name, conf.verbose, scale);
+			if (!sprite.charset) {
+				continue;
 			}
 
 			int frame = evp->character_pattern;
@@ -264,85 +406,188 @@ void DrawEvents(FIBITMAP* output_img, Chipset* gen, std::unique_ptr<lcf::rpg::Ma
 				frame = 1;
 			}
 
-			CustomAlphaCombine(charsets[cname].get(), (evp->character_index % 4) * 72 + frame * 24,
-				(evp->character_index / 4) * 128 + evp->character_direction * 32,
-				output_img, ev.x * TILE_SIZE-4, ev.y * TILE_SIZE-16, // Why -4 and -16?
-				24, 32);
+			sprite.sx = ((evp->character_index % 4) * 72 + frame * 24) / scale;
+			sprite.sy = ((evp->character_index / 4) * 128 + evp->character_direction * 32) / scale;
+			// sprites are centered on the tile and stand on its bottom edge,
+			// at 1/8 scale the half pixel offset is dropped
+			sprite.x = ev.x * tile - 4 / scale;
+			sprite.y = ev.y * tile - 16 / scale;
+		}
+
+		// Event layering, unknown layers are drawn on every layer
+		if (evp->layer >= static_cast<int>(LAYER::LOWER)
+			&& evp->layer <= static_cast<int>(LAYER::EVENTS)) {
+			layers[evp->layer].push_back(sprite);
+		} else {
+			for (auto &layer : layers) {
+				layer.push_back(sprite);
+			}
 		}
 	}
+
+	return layers;
 }
 
-void RenderCore(FIBITMAP* output_img, uint8_t * csflag, std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf) {
-	BitmapPtr chipset_img;
-	if (!conf.chipset.empty()) {
-		chipset_img.reset(LoadImage(conf.chipset, true));
+void DrawEvents(const RenderTarget& output_img, Chipset* gen, const std::vector<EventSprite>& sprites) {
+	Stats::Scope scope("events");
+	sprites_counter.Add(sprites.size());
+	const BlitSurface &output = output_img.Surface();
+	int origin_x = output_img.OriginX();
+	int origin_y = output_img.OriginY();
+	int tile = gen->TileSize();
+	int scale = TILE_SIZE / tile;
+	int width = 24 / scale;
+	int height = 32 / scale;
+
+	for (const EventSprite& sprite : sprites) {
+		if (sprite.charset) {
+			int x = sprite.x - origin_x;
+			int y = sprite.y - origin_y;
+			if (x <= -width || y <= -height || x >= output.width || y >= output.height) {
+				continue;
+			}
+			if (scale == 1) {
+				Blit::Checked<24, 32>(*sprite.charset, sprite.sx, sprite.sy, output, x, y);
+			} else {
+				Blit::Rect(*sprite.charset, sprite.sx, sprite.sy, output, x, y, width, height);
+			}
+		} else {
+			int x = sprite.x - origin_x / tile;
+			int y = sprite.y - origin_y / tile;
+			if (x < 0 || y < 0 || x * tile >= output.width || y * tile >= output.height) {
+				continue;
+			}
+			gen->RenderTile(output, x, y, sprite.tile, 0);
+		}
 	}
+}
 
-	if(!chipset_img) {
-		if(conf.verbose) {
-			std::cerr << "Using empty chipset image.\n";
+void DrawPanorama(const RenderTarget& output_img, const std::string& background, int width, int height, L2IConfig conf) {
+	const BlitSurface &output = output_img.Surface();
+	// tiled backgrounds shrink with the tiles of reduced scale previews
+	int scale = TILE_SIZE / ScaledTileSize(conf);
+
+	if (output_img.OriginX() == 0 && output_img.OriginY() == 0
+		&& output.width == width && output.height == height) {
+		// Fill screen with scaled background
+		auto panorama = PanoramaCache::Instance().Get(background, width, height, conf.panorama_filter, conf.verbose,
+			scale);
+		if (!panorama) {
+			std::cout << "Unable to create parallax background.\n";
+		} else if (conf.panorama_filter == PanoramaFilter::Tile) {
+			Blit::Tile(panorama->Surface(), output);
+		} else {
+			Blit::Copy(panorama->Surface(), output);
 		}
+		return;
+	}
 
-		chipset_img.reset(FreeImage_Allocate(CHIPSET_WIDTH, CHIPSET_HEIGHT, 32));
-		if (!chipset_img) {
-			std::cout << "Unable to create empty chipset image.\n";
-			exit(EXIT_FAILURE);
+	if (conf.panorama_filter != PanoramaFilter::Nearest && conf.panorama_filter != PanoramaFilter::Tile) {
+		// interpolated backgrounds are only scaled as a whole, the caller
+		// decides whether that is affordable
+		auto panorama = PanoramaCache::Instance().Get(background, width, height, conf.panorama_filter, conf.verbose);
+		if (!panorama) {
+			std::cout << "Unable to create parallax background.\n";
+			return;
 		}
+		BlitSurface part = panorama->Surface();
+		part.pixels = part.Row(output_img.OriginY()) + static_cast<ptrdiff_t>(output_img.OriginX()) * 4;
+		part.width -= output_img.OriginX();
+		part.height -= output_img.OriginY();
+		Blit::Copy(part, output);
+		return;
 	}
-	Chipset gen(chipset_img.get());
 
-	// Draw parallax background
-	if (!conf.no_background) {
-		std::string pname = lcf::ToString(map->parallax_name);
-		if (pname.empty()) {
-			if(conf.verbose) {
-				std::cerr << "Using black background.\n";
-			}
-
-			// Fill screen with black
-			RGBQUAD black{0, 0, 0, 0xFF};
-			FreeImage_FillBackground(output_img, &black);
-		} else {
-			if(conf.verbose) {
-				std::cerr << "Loading Panorama \"" << pname << "\"\n";
-			}
+	// A part of the map, the scaled background would be as large as the
+	// whole map. Only the cheap filters are drawn from the original image.
+	auto panorama = PanoramaCache::Instance().Get(background, width, height, PanoramaFilter::Tile, conf.verbose,
+		conf.panorama_filter == PanoramaFilter::Tile ? scale : 1);
+	if (!panorama) {
+		std::cout << "Unable to create parallax background.\n";
+	} else if (conf.panorama_filter == PanoramaFilter::Tile) {
+		Blit::Tile(panorama->Surface(), output, output_img.OriginX(), output_img.OriginY());
+	} else {
+		Blit::Scale(panorama->Surface(), output, width, height, output_img.OriginX(), output_img.OriginY());
+	}
+}
 
-			std::string background{FindResource("Panorama", pname)};
-			if (background.empty()) {
-				std::cout << "Parallax background \"" << pname << "\" not found.\n";
-			} else {
-				BitmapPtr background_img{LoadImage(background)};
+void DrawBackground(const RenderTarget& output_img, std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf,
+	const IndexedScene* scene) {
+	Stats::Scope scope("background");
+	std::string pname = lcf::ToString(map->parallax_name);
+	if (pname.empty()) {
+		if(conf.verbose) {
+			std::cerr << "Using black background.\n";
+		}
 
-				// Fill screen with scaled background
-				int dw = FreeImage_GetWidth(output_img);
-				int dh = FreeImage_GetHeight(output_img);
-				BitmapPtr scaled{FreeImage_Rescale(background_img.get(), dw, dh, FILTER_BICUBIC)};
-				FreeImage_Paste(output_img, scaled.get(), 0, 0, 256);
+		// Fill screen with black
+		if (scene) {
+			Blit::Fill(output_img.Surface(), scene->Black());
+		} else {
+			RGBQUAD black{0, 0, 0, 0xFF};
+			Blit::Fill(output_img.Surface(), black);
+		}
+	} else {
+		if(conf.verbose) {
+			std::cerr << "Loading Panorama \"" << pname << "\"\n";
+		}
 
-				//FreeImage_Save(FIF_PNG, scaled.get(), "_back.png");
-			}
+		std::string background{FindResource("Panorama", pname)};
+		if (background.empty()) {
+			std::cout << "Parallax background \"" << pname << "\" not found.\n";
+		} else if (scene) {
+			scene->DrawPanorama(output_img, map->width * TILE_SIZE, map->height * TILE_SIZE);
+		} else {
+			int tile = ScaledTileSize(conf);
+			DrawPanorama(output_img, background, map->width * tile, map->height * tile, conf);
 		}
 	}
+}
 
-	CharsetCacheMap charsets;
-
+void RenderLayers(const RenderTarget& output_img, Chipset * gen, uint8_t * csflag, std::unique_ptr<lcf::rpg::Map> & map,
+	L2IConfig conf, const EventLayers& events, AnimationFrame frame) {
 	// Draw below tile layer
 	if (!(conf.no_lowertiles && conf.no_uppertiles)) {
-		DrawTiles(output_img, &gen, csflag, map, conf, LAYER::LOWER);
+		DrawTiles(output_img, gen, csflag, map, conf, LAYER::LOWER, frame);
 	}
 	// Draw below-player & player-level events
 	if (!conf.no_events) {
-		DrawEvents(output_img, &gen, map, LAYER::LOWER, charsets, conf);
-		DrawEvents(output_img, &gen, map, LAYER::UPPER, charsets, conf);
+		DrawEvents(output_img, gen, events[static_cast<int>(LAYER::LOWER)]);
+		DrawEvents(output_img, gen, events[static_cast<int>(LAYER::UPPER)]);
 	}
 	// Draw above tile layer
 	if (!(conf.no_lowertiles && conf.no_uppertiles)) {
-		DrawTiles(output_img, &gen, csflag, map, conf, LAYER::UPPER);
+		DrawTiles(output_img, gen, csflag, map, conf, LAYER::UPPER, frame);
 	}
 	// Draw events
 	if (!conf.no_events) {
-		DrawEvents(output_img, &gen, map, LAYER::EVENTS, charsets, conf);
+		DrawEvents(output_img, gen, events[static_cast<int>(LAYER::EVENTS)]);
 	}
+}
+
+void RenderCore(RenderTarget& output_img, uint8_t * csflag, std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf,
+	const IndexedScene* scene) {
+	std::shared_ptr<Chipset> cached;
+	if (!scene) {
+		cached = ChipsetCache::Instance().Get(conf.chipset, conf.cache_dir, conf.verbose, conf.scale);
+	}
+	Chipset* gen = scene ? scene->GetChipset() : cached.get();
+	if (!gen) {
+		std::cout << "Unable to create chipset image.\n";
+		exit(EXIT_FAILURE);
+	}
+
+	// Draw parallax background
+	if (!conf.no_background) {
+		DrawBackground(output_img, map, conf, scene);
+	}
+
+	EventLayers events;
+	if (!conf.no_events) {
+		events = ResolveEvents(map, conf, scene);
+	}
+
+	RenderLayers(output_img, gen, csflag, map, conf, events);
 
 	//for(auto &kv : charsets) {
 	//	FreeImage_Save(FIF_PNG, kv.second.get(), std::string("_cs_" + kv.first + ".png").c_str());
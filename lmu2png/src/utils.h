@@ -19,6 +19,7 @@
 
 // Headers
 #include <string>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
@@ -26,11 +27,16 @@
 #include <lcf/rpg/map.h>
 #include <FreeImage.h>
 #include <memory>
+#include <array>
+#include <vector>
 #include "main.h"
 
 // forward declarations
 
 struct Chipset;
+struct BlitSurface;
+class RenderTarget;
+class IndexedScene;
 
 // type and other definitions
 
@@ -47,26 +53,80 @@ struct FIBITMAPDeleter {
 };
 using BitmapPtr = std::unique_ptr<FIBITMAP, FIBITMAPDeleter>;
 
+// Size of a tile in the output, smaller than TILE_SIZE for reduced scale previews
+int ScaledTileSize(const L2IConfig& conf);
+
+// Layer a tile of the lower or upper map layer is drawn on
+inline LAYER TileLayer(const uint8_t *csflag, uint16_t tile, bool upper_layer) {
+	return (csflag[tile] & (upper_layer ? 0x10 : 0x30)) ? LAYER::UPPER : LAYER::LOWER;
+}
+
+// An event page resolved for drawing
+struct EventSprite {
+	const BlitSurface *charset; // nullptr for tile events
+	int x, y;                   // destination in pixels, tile position for tile events
+	int sx, sy;                 // position in the charset
+	                            // pixels are in the output and charset scale
+	unsigned short tile;
+};
+using EventLayers = std::array<std::vector<EventSprite>, 3>;
+
+// Step of the water and animated tile animations a map is drawn with
+struct AnimationFrame {
+	int water = 0;    // 0 to 2
+	int animated = 0; // 0 to 3
+
+	bool operator==(const AnimationFrame& other) const {
+		return water == other.water && animated == other.animated;
+	}
+	bool operator!=(const AnimationFrame& other) const { return !(*this == other); }
+};
+
+// A loaded map with the chipset flags and options it is rendered with
+struct MapData {
+	L2IConfig conf;
+	std::unique_ptr<lcf::rpg::Map> map;
+	std::vector<uint8_t> csflag;
+	// water animation of the chipset
+	bool water_cycle = false; // 1-2-3 instead of 1-2-3-2
+	bool water_fast = false;
+};
+
 std::string GetFileDirectory(const std::string& file);
 
 bool Exists(const std::string& filename);
 
-void CollectResourcePaths(std::string& main_path);
+void CollectResourcePaths(std::string& main_path, const std::string& index_file = "");
 
 std::string FindResource(const std::string& folder, const std::string& base_name);
 
-void CustomAlphaCombine(FIBITMAP *src, int sLeft, int sTop, FIBITMAP *dst, int dLeft,
-	int dTop, int width, int height);
+// Returns a 32bpp image, with keep_palette paletted images that need no
+// alpha channel are returned as 8bpp instead
+FIBITMAP* LoadImage(const std::string& image_path, bool transparent = false, bool keep_palette = false);
+
+void DrawTiles(const RenderTarget& output_img, Chipset * gen, uint8_t * csflag,
+	std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf, LAYER flaglayer, AnimationFrame frame = {});
+
+// With scale the charset is box filtered to 1/scale of its size
+const BlitSurface* GetCharset(const std::string& name, bool verbose, int scale = 1);
 
-FIBITMAP* LoadImage(const char* image_path, bool transparent = false);
+// Page of the event that is drawn, nullptr when none qualifies
+const lcf::rpg::EventPage* DrawnPage(const lcf::rpg::Event& ev, const L2IConfig& conf);
 
-void DrawTiles(FIBITMAP* output_img, Chipset * gen, uint8_t * csflag,
-	std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf, LAYER flaglayer);
+// Charsets are taken from the scene when the map is rendered in 8 bit
+EventLayers ResolveEvents(std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf,
+	const IndexedScene* scene = nullptr);
 
-void DrawEvents(FIBITMAP* output_img, Chipset * gen,
-	std::unique_ptr<lcf::rpg::Map> & map, LAYER layer);
+void DrawEvents(const RenderTarget& output_img, Chipset * gen, const std::vector<EventSprite>& sprites);
+void DrawPanorama(const RenderTarget& output_img, const std::string& background,
+	int width, int height, L2IConfig conf);
 
-void RenderCore(FIBITMAP* output_img, uint8_t * csflag,
-	std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf);
+void DrawBackground(const RenderTarget& output_img, std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf,
+	const IndexedScene* scene = nullptr);
+void RenderLayers(const RenderTarget& output_img, Chipset * gen, uint8_t * csflag,
+	std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf, const EventLayers& events, AnimationFrame frame = {});
+// 8 bit targets are drawn with the graphics of the scene
+void RenderCore(RenderTarget& output_img, uint8_t * csflag,
+	std::unique_ptr<lcf::rpg::Map> & map, L2IConfig conf, const IndexedScene* scene = nullptr);
 
 #endif
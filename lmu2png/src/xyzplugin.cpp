@@ -15,9 +15,12 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include "xyzplugin.h"
+#include <algorithm>
 #include <cstring>
 #include <cstdio>
+#include <memory>
 #include <zlib.h>
+#include "libxyz.h"
 
 // for internal use
 
@@ -41,12 +44,12 @@ static const char *MimeType() {
 	return "image/x-xyz";
 }
 
-static BOOL SupportsExportDepth(int /* depth */) {
-	return FALSE;
+static BOOL SupportsExportDepth(int depth) {
+	return depth == 8;
 }
 
-static BOOL SupportsExportType(FREE_IMAGE_TYPE /* type */) {
-	return FALSE;
+static BOOL SupportsExportType(FREE_IMAGE_TYPE type) {
+	return type == FIT_BITMAP;
 }
 
 static BOOL SupportsICCProfiles() {
@@ -64,105 +67,53 @@ static BOOL Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(xyz_signature, signature, sizeof(xyz_signature)) == 0);
 }
 
-#ifdef FREEIMAGE_BIGENDIAN
-static inline void SwapShort(unsigned short *sp) {
-	unsigned char *cp = (unsigned char *)sp, t = cp[0];
-	cp[0] = cp[1];
-	cp[1] = t;
-}
-#endif
-
-static inline unsigned short ReadShort(FreeImageIO *io, fi_handle handle) {
-	unsigned short level = 0;
-	io->read_proc(&level, 2, 1, handle);
-#ifdef FREEIMAGE_BIGENDIAN
-	SwapShort(&level);
-#endif
-	return level;
-}
-
 // load image
 
 static FIBITMAP *Load(FreeImageIO *io, fi_handle handle, int /* page */, int /* flags */, void */* data */) {
 	FIBITMAP *dib = nullptr;
-	Bytef *compressedData = nullptr, *decompressedData = nullptr;
-	constexpr int paletteEntries = 256;
-	constexpr int paletteSize = paletteEntries * 3;
 
 	if (!handle)
 		return nullptr;
 
 	try {
-		// skip (already validated) magic
-		io->seek_proc(handle, 4, SEEK_CUR);
-
-		// get dimensions
-		int width = ReadShort(io, handle);
-		int height = ReadShort(io, handle);
+		// inflated straight from the handle, no copy of the file is kept
+		std::unique_ptr<Xyz::Reader> reader(new Xyz::Reader());
+		auto read = [io, handle](uint8_t* buf, size_t len) -> size_t {
+			return io->read_proc(buf, 1, static_cast<unsigned>(len), handle);
+		};
+		if (reader->Open(read) != Xyz::Reader::Result::Ok)
+			throw "Failed to read XYZ header.";
+
+		const Xyz::Header& header = reader->GetHeader();
+		if (header.width == 0 || header.height == 0)
+			throw "Failed to read XYZ header.";
 
 		// create a dib and write the bitmap header
-		dib = FreeImage_Allocate(width, height, 8);
+		dib = FreeImage_Allocate(header.width, header.height, 8);
 		if(!dib) {
 			throw "Failed to allocate memory for BITMAP.";
 		}
 
-		// get file size without header
-		io->seek_proc(handle, 0, SEEK_END);
-		long compressedDataSize = io->tell_proc(handle) - 8;
-		io->seek_proc(handle, 8, SEEK_SET);
-
-		uLongf total = paletteSize + (width * height);
-		uLongf totalBackup = total;
-
-		// Now the room for error has mostly ceded, allocate & fill buffers
-		compressedData = new Bytef[compressedDataSize];
-		if (!compressedData)
-			throw "Failed to allocate memory for file buffer.";
-
-		io->read_proc(compressedData, 1, compressedDataSize, handle);
-
-		decompressedData = new Bytef[total];
-		if (!decompressedData)
-			throw "Failed to allocate memory for decompression buffer.";
-
-		int status = uncompress(decompressedData, &total, compressedData, compressedDataSize);
-
-		if (totalBackup != total)
+		// store the palette
+		uint8_t colors[Xyz::palette_size];
+		if (!reader->Read(colors, sizeof(colors)))
 			throw "Failed to uncompress image.";
-
-		if (status == Z_OK) {
-			// store the palette
-			RGBQUAD *palette = FreeImage_GetPalette(dib);
-			for(int i = 0; i < paletteEntries; i++) {
-				palette[i].rgbRed   = decompressedData[(i * 3) + 0];
-				palette[i].rgbGreen = decompressedData[(i * 3) + 1];
-				palette[i].rgbBlue  = decompressedData[(i * 3) + 2];
-			}
-
-			// copy in the bitmap bits via the pointer table
-			const BYTE* line = decompressedData + paletteSize;
-			for (int y = 0; y < height; y++) {
-				BYTE *dst_line = FreeImage_GetScanLine(dib, height - 1 - y);
-				memcpy(dst_line, line, width);
-
-				// advance to next
-				line += width;
-			}
+		RGBQUAD *palette = FreeImage_GetPalette(dib);
+		for(int i = 0; i < Xyz::palette_entries; i++) {
+			palette[i].rgbRed   = colors[i * 3];
+			palette[i].rgbGreen = colors[i * 3 + 1];
+			palette[i].rgbBlue  = colors[i * 3 + 2];
 		}
 
-		// cleanup
-		delete[] compressedData;
-		delete[] decompressedData;
+		// FreeImage stores the lines bottom-up
+		for (int y = 0; y < header.height; y++) {
+			if (!reader->Read(FreeImage_GetScanLine(dib, header.height - 1 - y), header.width))
+				throw "Failed to uncompress image.";
+		}
 
 		return dib;
 
 	} catch (const char *text) {
-		// free zlib buffers
-		if(compressedData)
-			delete[] compressedData;
-		if(decompressedData)
-			delete[] decompressedData;
-
 		// free bitmap struct
 		if (dib) {
 			FreeImage_Unload(dib);
@@ -177,6 +128,61 @@ static FIBITMAP *Load(FreeImageIO *io, fi_handle handle, int /* page */, int /*
 	}
 }
 
+// save image
+
+static BOOL Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int /* page */, int flags, void */* data */) {
+	if (!dib || !handle)
+		return FALSE;
+
+	try {
+		if (FreeImage_GetBPP(dib) != 8 || !FreeImage_GetPalette(dib))
+			throw "Only 8 bit images with a palette can be saved as XYZ.";
+
+		unsigned width = FreeImage_GetWidth(dib);
+		unsigned height = FreeImage_GetHeight(dib);
+		if (width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF)
+			throw "Image dimensions not supported by XYZ.";
+
+		Xyz::Header header;
+		header.width = static_cast<uint16_t>(width);
+		header.height = static_cast<uint16_t>(height);
+
+		// unused entries of smaller palettes are black
+		uint8_t colors[Xyz::palette_size] = {};
+		const RGBQUAD *palette = FreeImage_GetPalette(dib);
+		unsigned used = std::min<unsigned>(FreeImage_GetColorsUsed(dib), Xyz::palette_entries);
+		for (unsigned i = 0; i < used; i++) {
+			colors[i * 3] = palette[i].rgbRed;
+			colors[i * 3 + 1] = palette[i].rgbGreen;
+			colors[i * 3 + 2] = palette[i].rgbBlue;
+		}
+
+		// deflated straight to the handle
+		int level = (flags & 0x100) ? (flags & 0xF) : Z_BEST_COMPRESSION;
+		std::unique_ptr<Xyz::Writer> writer(new Xyz::Writer(level));
+		if (!writer->Begin(header, [io, handle](const uint8_t *data, size_t size) {
+				return io->write_proc(const_cast<uint8_t *>(data), 1, static_cast<unsigned>(size), handle) == size;
+			}))
+			throw "Failed to write file.";
+		if (!writer->Write(colors, sizeof(colors)))
+			throw "Failed to compress image.";
+
+		// FreeImage stores the lines bottom-up
+		for (unsigned y = 0; y < height; y++) {
+			if (!writer->Write(FreeImage_GetScanLine(dib, height - 1 - y), width))
+				throw "Failed to compress image.";
+		}
+		if (!writer->Finish())
+			throw "Failed to compress image.";
+
+		return TRUE;
+
+	} catch (const char *text) {
+		FreeImage_OutputMessageProc(s_format_id, text);
+		return FALSE;
+	}
+}
+
 // finally describe the plugin
 
 void InitXYZ(Plugin *plugin, int format_id) {
@@ -191,7 +197,7 @@ void InitXYZ(Plugin *plugin, int format_id) {
 	plugin->pagecount_proc = nullptr;
 	plugin->pagecapability_proc = nullptr;
 	plugin->load_proc = Load;
-	plugin->save_proc = nullptr;
+	plugin->save_proc = Save;
 	plugin->validate_proc = Validate;
 	plugin->mime_proc = MimeType;
 	plugin->supports_export_bpp_proc = SupportsExportDepth;
@@ -19,6 +19,11 @@
 
 #include <FreeImage.h>
 
+// Save flags, the zlib level is taken from the low bits. Without it the
+// best compression is used.
+#define XYZ_DEFAULT 0
+#define XYZ_LEVEL(level) (0x100 | (level))
+
 void InitXYZ(Plugin *plugin, int format_id);
 
 #endif
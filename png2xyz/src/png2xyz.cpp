@@ -19,12 +19,18 @@
 #include <png.h>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <sstream>
-#ifdef _WIN32
-# include <algorithm>
-#endif
+#include <thread>
+#include <vector>
+#include <argparse.hpp>
+#include <zlib_container.h>
+#include "fileio.h"
+#include "libxyz.h"
+#include "pipeline.h"
+#include "stats.h"
 
 # ifdef __MINGW64_VERSION_MAJOR
 int _dowildcard = -1; /* enable wildcard expansion for mingw-w64 */
@@ -76,181 +82,455 @@ std::string GetPath(const std::string& str) {
 	return s;
 }
 
-int main(int argc, char* argv[]) {
-	if(argc < 2)
-	{
-		std::cout << "Usage: " << argv[0]
-			<< " filename" << std::endl;
-		return 1;
+/**
+ * Compresses XYZ data while it is read. The zlib output is streamed into
+ * the output file by Xyz::Writer, which is reused for every file. Zopfli
+ * needs all data at once and only writes when the image is complete.
+ */
+class XyzCompressor {
+public:
+	/**
+	 * @param level zlib compression level
+	 * @param zopfli_iterations use Zopfli instead of zlib when > 0
+	 */
+	XyzCompressor(int level, int zopfli_iterations) : writer(level) {
+		ZopfliInitOptions(&zopfli);
+		zopfli.numiterations = zopfli_iterations;
 	}
 
-	for(int arg = 1; arg < argc; arg++) {
-		FILE *png_file;
-		unsigned char* header;
-		png_structp png_ptr;
-		png_infop info_ptr;
-		unsigned short width;
-		unsigned short height;
-		unsigned int bit_depth;
-		unsigned int color_type;
-		png_colorp palette;
-		int num_palette;
-		png_bytep *row_pointers;
-		Bytef* xyz_data;
-		uLong comp_size;
-		Bytef* comp_data;
-		std::string xyz_filename;
-
-		// Open PNG file
-		png_file = fopen(argv[arg], "rb");
-		if(png_file == NULL) {
-			std::cerr << "Error reading file "
-				<< argv[arg] << "." << std::endl;
-			return 1;
+	/** Writes the header to file and starts a new stream, returns false on error. */
+	bool Begin(const Xyz::Header& header, Xyz::AtomicFile& file) {
+		this->file = &file;
+		if(zopfli.numiterations > 0) {
+			raw.clear();
+			raw.reserve(Xyz::DecodedSize(header));
+			uint8_t data[Xyz::header_size];
+			Xyz::WriteHeader(header, data);
+			return file.Write(data, sizeof(data));
 		}
 
-		// Read PNG file header
-		header = new unsigned char[8];
-		if (fread(header, 1, 8, png_file) != 8) {
-			std::cerr << "Error reading PNG header of file "
-				<< argv[arg] << "." << std::endl;
-			delete[] header;
-			return 1;
-		}
+		return writer.Begin(header, [&file](const uint8_t* data, size_t size) {
+			return file.Write(data, size);
+		});
+	}
 
-		// Check PNG validity
-		if(png_sig_cmp(header, 0, 8) != 0) {
-			std::cerr << "Input file " << argv[arg]
-				<< " is not a PNG file." << std::endl;
-			delete[] header;
-			return 1;
-		}
-		delete[] header;
-
-		// Create PNG read structure
-		png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
-			NULL, NULL);
-		if(png_ptr == NULL)
-		{
-			std::cerr << "Error creating PNG read structure for "
-				<< argv[arg] << "." << std::endl;
-			fclose(png_file);
-			return 1;
+	/** Compresses the next len bytes, returns false on error. */
+	bool Write(const Bytef* data, size_t len) {
+		if(zopfli.numiterations > 0) {
+			raw.insert(raw.end(), data, data + len);
+			return true;
 		}
+		return writer.Write(data, len);
+	}
 
-		// Create PNG info structure
-		info_ptr = png_create_info_struct(png_ptr);
-		if(info_ptr == NULL)
-		{
-			std::cerr << "Error creating PNG info structure for "
-				<< argv[arg] << "." << std::endl;
-			png_destroy_read_struct(&png_ptr, NULL, NULL);
-			fclose(png_file);
-			return 1;
+	/** Finishes the stream, returns false on error. */
+	bool Finish() {
+		if(zopfli.numiterations > 0) {
+			Stats::Scope scope("zopfli");
+			unsigned char* comp_data = nullptr;
+			size_t comp_size = 0;
+			ZopfliZlibCompress(&zopfli, raw.data(), raw.size(),
+				&comp_data, &comp_size);
+			bool ok = file->Write(comp_data, comp_size);
+			free(comp_data);
+			zopfli_written = comp_size;
+			return ok;
 		}
+		return writer.Finish();
+	}
+
+	/** @return compressed bytes written since Begin */
+	size_t Written() const {
+		return zopfli.numiterations > 0 ? zopfli_written : writer.Written();
+	}
+
+private:
+	Xyz::Writer writer;
+	ZopfliOptions zopfli;
+	Xyz::AtomicFile* file = nullptr;
+	std::vector<Bytef> raw;
+	size_t zopfli_written = 0;
+};
+
+/** Remaining bytes of a mapped PNG file. */
+struct MemoryInput {
+	const uint8_t* data;
+	size_t size;
+};
+
+/** libpng read callback for MemoryInput. */
+void ReadMemory(png_structp png_ptr, png_bytep out, size_t len) {
+	MemoryInput* input = static_cast<MemoryInput*>(png_get_io_ptr(png_ptr));
+	if(len > input->size) {
+		png_error(png_ptr, "Truncated PNG file");
+	}
+	memcpy(out, input->data, len);
+	input->data += len;
+	input->size -= len;
+}
+
+static Stats::Counter files_counter("files converted");
+static Stats::Counter deflated_counter("bytes deflated");
+
+/** One file passing through the conversion pipeline. */
+struct ConvertJob {
+	std::string png_filename;
+	std::string xyz_filename;
+	/** from the --batch list, errors do not stop the conversion */
+	bool batch = false;
+	Xyz::MappedFile png_file;
+	bool read = false;
+	/** receives the XYZ while it is compressed, committed by the write stage */
+	Xyz::AtomicFile xyz_file;
+	bool ok = false;
+	/** messages, printed in input order */
+	std::ostringstream err;
+};
+
+/** Bytes of each input read ahead, the rest is paged in while converting. */
+constexpr size_t prefetch_size = 4 * 1024 * 1024;
+
+/** Maps the input of job and reads it ahead, returns false on error. */
+bool ReadFile(ConvertJob& job) {
+	Stats::Scope scope("read");
+
+	if(!job.png_file.Open(job.png_filename)) {
+		job.err << "Error reading file "
+			<< job.png_filename << "." << std::endl;
+		return false;
+	}
+	job.png_file.Prefetch(prefetch_size);
+	return true;
+}
+
+/**
+ * Converts the input of job to a temporary XYZ file, returns false on error.
+ * The output is written while it is compressed, only WriteFile makes it visible.
+ */
+bool ConvertFile(XyzCompressor& compressor, ConvertJob& job) {
+	Stats::Scope scope("convert");
+	const std::string& png_filename = job.png_filename;
+	Xyz::MappedFile& png_file = job.png_file;
+	std::ostringstream& err = job.err;
+	png_structp png_ptr;
+	png_infop info_ptr;
+	unsigned short width;
+	unsigned short height;
+	unsigned int bit_depth;
+	unsigned int color_type;
+	png_colorp palette;
+	int num_palette;
+	int num_passes;
+	std::vector<Bytef> row;
+	std::vector<Bytef> image;
+
+	// Check PNG validity, libpng reads straight from the mapping
+	if(png_file.Size() < 8 || png_sig_cmp(png_file.Data(), 0, 8) != 0) {
+		err << "Input file " << png_filename
+			<< " is not a PNG file." << std::endl;
+		return false;
+	}
+	MemoryInput input = { png_file.Data() + 8, png_file.Size() - 8 };
+
+	// Create PNG read structure
+	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+		NULL, NULL);
+	if(png_ptr == NULL)
+	{
+		err << "Error creating PNG read structure for "
+			<< png_filename << "." << std::endl;
+		return false;
+	}
+
+	// Create PNG info structure
+	info_ptr = png_create_info_struct(png_ptr);
+	if(info_ptr == NULL)
+	{
+		err << "Error creating PNG info structure for "
+			<< png_filename << "." << std::endl;
+		png_destroy_read_struct(&png_ptr, NULL, NULL);
+		return false;
+	}
+
+	// Init I/O functions
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		err << "Error initializing PNG I/O for "
+			<< png_filename << "." << std::endl;
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+	}
+	png_set_read_fn(png_ptr, &input, ReadMemory);
+
+	// Already read 8 header bytes, let libpng know about this
+	png_set_sig_bytes(png_ptr, 8);
+
+	// Read PNG header, the image rows are read one at a time below
+	png_read_info(png_ptr, info_ptr);
+
+	// Check PNG dimensions
+	width = png_get_image_width(png_ptr, info_ptr);
+	height = png_get_image_height(png_ptr, info_ptr);
+
+	// Check bit depth validity
+	bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+	if(bit_depth != 8) {
+		err << "PNG file " << png_filename
+			<< " is not using 8 bit depth." << std::endl;
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+	}
+
+	// Check color type validity
+	color_type = png_get_color_type(png_ptr, info_ptr);
+	if(color_type != PNG_COLOR_TYPE_PALETTE) {
+		err << "PNG file " << png_filename
+			<< " is not palette based." << std::endl;
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+	}
+
+	// Check palette chunk validity
+	if(png_get_valid(png_ptr, info_ptr, PNG_INFO_PLTE) == 0) {
+		err << "PNG file " << png_filename
+			<< " has an invalid palette chunk."
+			<< std::endl;
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+	}
 
-		// Init I/O functions
-		if(setjmp(png_jmpbuf(png_ptr)))
-		{
-			std::cerr << "Error initializing PNG I/O for "
-				<< argv[arg] << "." << std::endl;
-			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-			fclose(png_file);
-			return 1;
+	// Get palette and color count
+	png_get_PLTE(png_ptr, info_ptr, &palette, &num_palette);
+
+	// Create XYZ palette
+	Bytef xyz_palette[768] = {};
+	for (int i = 0; i < num_palette; i++) {
+		xyz_palette[i * 3] = palette[i].red;
+		xyz_palette[i * 3 + 1] = palette[i].green;
+		xyz_palette[i * 3 + 2] = palette[i].blue;
+	}
+
+	// the header only depends on the dimensions, the compressed data follows
+	Xyz::Header xyz_header;
+	xyz_header.width = width;
+	xyz_header.height = height;
+	if(!job.xyz_file.Open(job.xyz_filename) ||
+			!compressor.Begin(xyz_header, job.xyz_file)) {
+		err << "Error writing file "
+			<< job.xyz_filename << "." << std::endl;
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+	}
+
+	bool compressed = compressor.Write(xyz_palette, sizeof(xyz_palette));
+
+	// Read image rows
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		err << "Error reading PNG image of "
+			<< png_filename << "." << std::endl;
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+	}
+
+	num_passes = png_set_interlace_handling(png_ptr);
+	png_read_update_info(png_ptr, info_ptr);
+
+	if(num_passes > 1) {
+		// Interlaced rows are only complete after the last pass
+		image.resize(static_cast<size_t>(width) * height);
+		for (int pass = 0; pass < num_passes; pass++) {
+			for (size_t y = 0; y < height; y++) {
+				png_read_row(png_ptr, &image[y * width], NULL);
+			}
 		}
-		png_init_io(png_ptr, png_file);
-
-		// Already read 8 header bytes, let libpng know about this
-		png_set_sig_bytes(png_ptr, 8);
-
-		// Read PNG
-		png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
-
-		// Check PNG dimensions
-		width = png_get_image_width(png_ptr, info_ptr);
-		height = png_get_image_height(png_ptr, info_ptr);
-
-		// Check bit depth validity
-		bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-		if(bit_depth != 8) {
-			std::cerr << "PNG file " << argv[arg]
-				<< " is not using 8 bit depth." << std::endl;
-			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-			fclose(png_file);
-			return 1;
+		compressed = compressed && compressor.Write(image.data(), image.size());
+	} else {
+		// Compress every row directly after decoding it
+		row.resize(width);
+		for (size_t y = 0; y < height; y++) {
+			png_read_row(png_ptr, row.data(), NULL);
+			compressed = compressed && compressor.Write(row.data(), width);
 		}
+	}
 
-		// Check color type validity
-		color_type = png_get_color_type(png_ptr, info_ptr);
-		if(color_type != PNG_COLOR_TYPE_PALETTE) {
-			std::cerr << "PNG file " << argv[arg]
-				<< " is not palette based." << std::endl;
-			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-			fclose(png_file);
-			return 1;
-		}
+	// Close PNG file
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	png_file.Close();
 
-		// Check palette chunk validity
-		if(png_get_valid(png_ptr, info_ptr, PNG_INFO_PLTE) == 0) {
-			std::cerr << "PNG file " << argv[arg]
-				<< " has an invalid palette chunk."
-				<< std::endl;
-			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-			fclose(png_file);
-			return 1;
-		}
+	// Compress XYZ data
+	if(!compressed || !compressor.Finish()) {
+		err << "Error while compressing XYZ data from "
+			<< png_filename << "." << std::endl;
+		return false;
+	}
 
-		// Get palette and color count
-		png_get_PLTE(png_ptr, info_ptr, &palette, &num_palette);
+	deflated_counter.Add(compressor.Written());
+	return true;
+}
 
-		xyz_data = new unsigned char[768 + width * height];
-		memset(xyz_data, 0, 768);
+/**
+ * Renames the temporary XYZ file of job to the XYZ filename,
+ * returns false on error.
+ */
+bool WriteFile(ConvertJob& job) {
+	Stats::Scope scope("write");
 
-		// Create XYZ palette
-		for (int i = 0; i < num_palette; i++) {
-			xyz_data[i * 3] = palette[i].red;
-			xyz_data[i * 3 + 1] = palette[i].green;
-			xyz_data[i * 3 + 2] = palette[i].blue;
-		}
+	if(!job.xyz_file.Commit()) {
+		job.err << "Error writing file "
+			<< job.xyz_filename << "." << std::endl;
+		return false;
+	}
 
-		// Get image rows
-		row_pointers = png_get_rows(png_ptr, info_ptr);
+	files_counter.Add();
+	return true;
+}
 
-		// Create XYZ image
-		for (size_t y = 0; y < height; y++) {
-			memcpy(&xyz_data[768 + y * width],
-			row_pointers[y], width);
+/**
+ * Reads the next input and output path from a batch list.
+ * Paths are separated by delim, an empty output path selects the default.
+ */
+bool ReadBatchEntry(std::istream& in, char delim, std::string& input, std::string& output) {
+	do {
+		if(!std::getline(in, input, delim)) {
+			return false;
 		}
+	} while(input.empty());
 
-		// Close PNG file
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		fclose(png_file);
-
-		// Compress XYZ data
-		comp_size = compressBound(768 + width * height);
-		comp_data = new Bytef[comp_size];
-
-		int errorcode = compress2(comp_data, &comp_size, xyz_data,
-			768 + width * height, Z_BEST_COMPRESSION);
-		delete[] xyz_data;
-		if(errorcode != Z_OK) {
-			std::cerr << "Error while compressing XYZ data from "
-				<< argv[arg] << "." << std::endl;
-			delete[] comp_data;
-			return 1;
+	if(!std::getline(in, output, delim)) {
+		output.clear();
+	}
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<std::string> files;
+	bool batch = false;
+	bool null_delim = false;
+	bool fast = false;
+	int zopfli_iterations = 0;
+	std::string output_dir;
+	int jobs = 1;
+	int read_ahead = 4;
+	bool stats = false;
+	std::string trace_file;
+
+	// --zopfli without value uses the default iteration count
+	std::vector<char*> args(argv, argv + argc);
+	char zopfli_default[] = "--zopfli=15";
+	for(auto& arg : args) {
+		if(strcmp(arg, "--zopfli") == 0) {
+			arg = zopfli_default;
 		}
+	}
+
+	argparse::ArgumentParser cli("png2xyz", PACKAGE_VERSION);
+	cli.set_usage_max_line_width(100);
+	cli.add_description("Convert PNG images into XYZ images");
+	cli.add_epilog("Homepage " PACKAGE_URL " - Report bugs at: " PACKAGE_BUGREPORT);
+
+	cli.add_argument("FILE").nargs(argparse::nargs_pattern::any).store_into(files)
+		.help("PNG files to convert");
+	cli.add_argument("--batch", "--stdin").store_into(batch)
+		.help("Read pairs of input and output paths from stdin, separated\n"
+			"by newlines, and print one status line per file. An empty\n"
+			"output path uses the default name");
+	cli.add_argument("-z", "--null").store_into(null_delim)
+		.help("Paths on stdin are separated by NUL instead of newline");
+	cli.add_argument("-o", "--output").metavar("DIR").store_into(output_dir)
+		.help("Directory of the XYZ files (default: current directory),\n"
+			"explicit output paths of --batch are not changed");
+	cli.add_argument("-j", "--jobs").metavar("N").store_into(jobs)
+		.help("Number of files to convert in parallel (default: 1)\n"
+			"0 uses one job per CPU core");
+	cli.add_argument("--read-ahead").metavar("N").store_into(read_ahead)
+		.help("Number of files read while the others are converted and\n"
+			"written, hides slow storage (default: 4)");
+	auto& mode = cli.add_mutually_exclusive_group();
+	mode.add_argument("--fast").store_into(fast)
+		.help("Use the fastest zlib level, intended for development");
+	mode.add_argument("--zopfli").metavar("N").scan<'i', int>()
+		.store_into(zopfli_iterations)
+		.help("Compress with Zopfli, slow but smallest, makes a later\n"
+			"xyzcrush run unnecessary. Use --zopfli=N for N iterations\n"
+			"(default: 15)");
+	cli.add_argument("--stats").store_into(stats)
+		.help("Print the time of each phase and the counters to stderr");
+	cli.add_argument("--trace").metavar("FILE").store_into(trace_file)
+		.help("Write the phases as Chrome trace_event JSON to FILE");
+
+	try {
+		cli.parse_args(args.size(), args.data());
+	} catch (const std::exception& err) {
+		std::cerr << err.what() << "\n";
+		// print usage message
+		std::cerr << cli.usage() << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	if(files.empty() && !batch) {
+		std::cerr << cli.usage() << "\n";
+		return 1;
+	}
+
+	if(zopfli_iterations < 0) {
+		std::cerr << "Invalid Zopfli iteration count.\n";
+		return 1;
+	}
+
+	if(!output_dir.empty()) {
+		output_dir += "/";
+	}
+
+	Stats::Session stats_session(stats, trace_file);
+
+	if(jobs <= 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
 
-		std::stringstream ss;
-		ss << GetFilename(argv[arg]) + std::string(".xyz");
-		xyz_filename = ss.str();
-		std::ofstream xyz_file(xyz_filename.c_str(), std::ofstream::binary);
-		xyz_file.write("XYZ1", 4);
-		xyz_file.write(reinterpret_cast<char*>(&width), 2);
-		xyz_file.write(reinterpret_cast<char*>(&height), 2);
-		xyz_file.write(reinterpret_cast<char*>(comp_data), comp_size);
-		xyz_file.close();
-		delete[] comp_data;
+	// the deflate stream of each job is reused for every file
+	std::vector<std::unique_ptr<XyzCompressor>> compressors;
+	for(int i = 0; i < jobs; i++) {
+		compressors.emplace_back(new XyzCompressor(fast ? Z_BEST_SPEED : Z_BEST_COMPRESSION, zopfli_iterations));
 	}
 
-	return 0;
+	// the command line files are converted first, then the batch list
+	size_t next_file = 0;
+	char delim = null_delim ? '\0' : '\n';
+	unsigned int errors = 0;
+
+	Xyz::RunPipeline<ConvertJob>(jobs, read_ahead,
+		[&](ConvertJob& job) {
+			if(next_file < files.size()) {
+				job.png_filename = files[next_file++];
+			} else if(batch && ReadBatchEntry(std::cin, delim, job.png_filename, job.xyz_filename)) {
+				job.batch = true;
+			} else {
+				return false;
+			}
+			if(job.xyz_filename.empty()) {
+				job.xyz_filename = output_dir + GetFilename(job.png_filename) + ".xyz";
+			}
+			job.read = ReadFile(job);
+			return true;
+		},
+		[&](ConvertJob& job, int worker) {
+			job.ok = job.read && ConvertFile(*compressors[worker], job);
+		},
+		[&](ConvertJob& job) {
+			job.ok = job.ok && WriteFile(job);
+			std::cerr << job.err.str();
+			if(!job.ok) {
+				errors++;
+			}
+			if(!job.batch) {
+				// the first failing command line file ends the conversion
+				return job.ok;
+			}
+			std::cout << (job.ok ? "ok\t" : "error\t") << job.png_filename
+				<< "\t" << job.xyz_filename << std::endl;
+			return true;
+		});
+
+	return errors > 0 ? 1 : 0;
 }
@@ -11,54 +11,84 @@
 
 #include <QString>
 #include <QImage>
-#include <zlib.h>
+#include <QVector>
+#include <cstring>
+#include <vector>
+#include "libxyz.h"
 
-bool XyzImage::toImage(char* data, size_t size, QImage &img) {
-	if (strncmp((char *) data, "XYZ1", 4) != 0) {
+namespace {
+	// Reads the header from the device and checks it against the file size
+	bool openReader(QIODevice* device, Xyz::Reader& reader) {
+		qint64 size = device->size();
+		if (size <= 0 || static_cast<uint64_t>(size) > Xyz::thumbnail_max_file_size) {
+			return false;
+		}
+
+		Xyz::Reader::Result result = reader.Open([device](uint8_t* buf, size_t len) -> size_t {
+			qint64 res = device->read((char*) buf, len);
+			return res > 0 ? res : 0;
+		});
+
+		return result == Xyz::Reader::Result::Ok &&
+			Xyz::IsPlausible(reader.GetHeader(), size);
+	}
+}
+
+bool XyzImage::toImage(QIODevice* device, QImage &img) {
+	Xyz::Reader reader;
+	if (!openReader(device, reader)) {
 		return false;
 	}
 
-	unsigned short w;
-	memcpy(&w, &data[4], 2);
-	unsigned short h;
-	memcpy(&h, &data[6], 2);
+	const Xyz::Header& header = reader.GetHeader();
+	uint8_t palette[Xyz::palette_size];
+	if (!reader.Read(palette, sizeof(palette))) {
+		return false;
+	}
+
+	// the indices are kept, Qt converts when drawing or scaling
+	QImage q(header.width, header.height, QImage::Format_Indexed8);
+	if (q.isNull()) {
+		return false;
+	}
 
-	uLongf src_size = (uLongf)(size - 8);
-	Bytef* src_buffer = (Bytef*)&data[8];
-	uLongf dst_size = 768 + (w * h);
-	std::vector<Bytef> dst_buffer(dst_size);
+	QVector<QRgb> colors(Xyz::palette_entries);
+	for (int i = 0; i < Xyz::palette_entries; i++) {
+		colors[i] = qRgb(palette[i * 3], palette[i * 3 + 1], palette[i * 3 + 2]);
+	}
+	q.setColorTable(colors);
 
-	int status = uncompress(&dst_buffer.front(), &dst_size, src_buffer, src_size);
+	// scanlines are padded to 4 bytes, so every row is inflated on its own
+	for (int y = 0; y < header.height; y++) {
+		if (!reader.Read(q.scanLine(y), header.width)) {
+			return false;
+		}
+	}
+	img = q;
 
-	free(data);
+	return !img.isNull();
+}
 
-	if (status != Z_OK) {
+bool XyzImage::toThumbnail(QIODevice* device, int max_size, QImage &img) {
+	Xyz::Reader reader;
+	if (!openReader(device, reader)) {
 		return false;
 	}
-	const uint8_t (*palette)[3] = (const uint8_t(*)[3]) &dst_buffer.front();
 
-	void* pixels = malloc(w * h * 4);
-
-	if (!pixels) {
+	std::vector<uint8_t> pixels;
+	int w, h;
+	if (!Xyz::DecodeThumbnail(reader, max_size, Xyz::PixelFormat::BGRA, pixels, w, h)) {
 		return false;
 	}
 
-	uint8_t* dst = (uint8_t*) pixels;
-	const uint8_t* src = (const uint8_t*) &dst_buffer[768];
+	QImage q(w, h, QImage::Format_ARGB32);
+	if (q.isNull()) {
+		return false;
+	}
 	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			uint8_t pix = *src++;
-			const uint8_t* color = palette[pix];
-			*dst++ = color[2];
-			*dst++ = color[1];
-			*dst++ = color[0];
-			*dst++ = 255;
-		}
+		memcpy(q.scanLine(y), &pixels[y * w * 4], w * 4);
 	}
-	QImage q((uchar*)pixels, w, h, QImage::Format_ARGB32);
 	img = q;
 
-	// pixels owned by QImage
-
 	return !img.isNull();
 }
@@ -11,10 +11,16 @@
 #define XYZ_H
 
 #include <QImage>
+#include <QIODevice>
 
 // Shared code for creating a XYZ QImage
+// The device is inflated in chunks, the header is checked before that
 namespace XyzImage {
-	bool toImage(char* xyz_buf, size_t size, QImage &img);
+	// Indexed8 image with the palette as color table
+	bool toImage(QIODevice* device, QImage &img);
+
+	// Scales down to max_size while decoding
+	bool toThumbnail(QIODevice* device, int max_size, QImage &img);
 }
 
 #endif // XYZ_H
@@ -12,7 +12,9 @@
 
 #include <QString>
 #include <QImage>
-#include <zlib.h>
+#include <QSize>
+#include <QVariant>
+#include "libxyz.h"
 
 QImageIOHandler* XyzImageIOPlugin::create(QIODevice *device, const QByteArray &format) const {
 	if (format.isNull() || format.toLower() == "xyz") {
@@ -62,21 +64,26 @@ bool XyzImageIOHandler::read(QImage* image) {
 		 return false;
 	}
 
-	qint64 fsize = device()->size();
+	return XyzImage::toImage(device(), *image);
+}
 
-	if (fsize <= 8 || fsize > 1024*1024*1024) {
-		return false;
-	}
+bool XyzImageIOHandler::supportsOption(ImageOption option) const {
+	return option == Size || option == ImageFormat;
+}
 
-	char* data = (char*)malloc(fsize);
-	if (!data) {
-		return false;
+QVariant XyzImageIOHandler::option(ImageOption option) const {
+	if (option == ImageFormat) {
+		return QImage::Format_Indexed8;
 	}
 
-	qint64 res = device()->read(data, fsize);
-	if (res != fsize) {
-		return false;
+	if (option == Size && device()) {
+		// only the header is peeked, reading starts at the magic later
+		QByteArray data = device()->peek(Xyz::header_size);
+		Xyz::Header header;
+		if (Xyz::ParseHeader(reinterpret_cast<const uint8_t*>(data.constData()), data.size(), header)) {
+			return QSize(header.width, header.height);
+		}
 	}
 
-	return XyzImage::toImage(data, fsize, *image);
+	return {};
 }
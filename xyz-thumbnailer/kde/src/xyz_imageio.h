@@ -29,6 +29,8 @@ public:
 	bool canRead() const override;
 	static bool canRead(QIODevice *device);
 	bool read(QImage* image) override;
+	bool supportsOption(ImageOption option) const override;
+	QVariant option(ImageOption option) const override;
 };
 
 #endif // XYZ_IMAGEIO_H
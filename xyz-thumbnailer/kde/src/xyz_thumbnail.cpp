@@ -10,9 +10,10 @@
 #include "xyz_thumbnail.h"
 #include "xyz.h"
 
+#include <QFile>
 #include <QString>
 #include <QImage>
-#include <zlib.h>
+#include <algorithm>
 
 #include <KPluginFactory>
 
@@ -28,34 +29,16 @@ XyzThumbnailCreator::~XyzThumbnailCreator()
 }
 
 KIO::ThumbnailResult XyzThumbnailCreator::create(const KIO::ThumbnailRequest &request) {
-	FILE* f = fopen(request.url().toLocalFile().toUtf8().data(), "rb");
-	if (!f) {
-		KIO::ThumbnailResult::fail();
+	QFile file(request.url().toLocalFile());
+	if (!file.open(QIODevice::ReadOnly)) {
+		return KIO::ThumbnailResult::fail();
 	}
 
-	fseek(f, 0, SEEK_END);
-	size_t size = ftell(f);
-	fseek(f, 0, SEEK_SET);
-
-	if (size <= 8 || size > 1024*1024*1024) {
-		fclose(f);
-		KIO::ThumbnailResult::fail();
-	}
-
-	char* data = (char*)malloc(size);
-	if (!data) {
-		fclose(f);
-		KIO::ThumbnailResult::fail();
-	}
-
-	size_t res = fread(data, size, 1, f);
-	if (res != 1) {
-		KIO::ThumbnailResult::fail();
-	}
-	fclose(f);
-
 	QImage img;
-	XyzImage::toImage(data, size, img);
+	QSize target = request.targetSize();
+	if (!XyzImage::toThumbnail(&file, std::max(target.width(), target.height()), img)) {
+		return KIO::ThumbnailResult::fail();
+	}
 	return KIO::ThumbnailResult::pass(img);
 }
 
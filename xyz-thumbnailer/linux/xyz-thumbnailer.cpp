@@ -0,0 +1,131 @@
+/*
+ * This file is part of xyz-thumbnailer. Copyright (c) 2015 xyz-thumbnailer authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * xyz-thumbnailer is Free/Libre Open Source Software, released under the MIT License.
+ * http://opensource.org/licenses/MIT
+ */
+
+#include <png.h>
+#include <zlib.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "libxyz.h"
+
+namespace {
+	int ErrorOut(const std::string& message) {
+		std::cerr << message << std::endl;
+		return 1;
+	}
+
+	/** Writes an RGBA image with the fastest zlib level, returns false on error. */
+	bool WritePng(const std::string& filename, const std::vector<uint8_t>& pixels, int width, int height) {
+		FILE* png_file = fopen(filename.c_str(), "wb");
+		if (!png_file) {
+			return false;
+		}
+
+		png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+		if (!png_ptr) {
+			fclose(png_file);
+			return false;
+		}
+
+		png_infop info_ptr = png_create_info_struct(png_ptr);
+		if (!info_ptr) {
+			png_destroy_write_struct(&png_ptr, NULL);
+			fclose(png_file);
+			return false;
+		}
+
+		if (setjmp(png_jmpbuf(png_ptr))) {
+			png_destroy_write_struct(&png_ptr, &info_ptr);
+			fclose(png_file);
+			return false;
+		}
+
+		png_init_io(png_ptr, png_file);
+		png_set_compression_level(png_ptr, Z_BEST_SPEED);
+		png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+
+		png_set_IHDR(png_ptr, info_ptr, width, height, 8,
+			PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+		png_write_info(png_ptr, info_ptr);
+
+		for (int y = 0; y < height; y++) {
+			png_write_row(png_ptr, &pixels[static_cast<size_t>(y) * width * 4]);
+		}
+		png_write_end(png_ptr, info_ptr);
+
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return fclose(png_file) == 0;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 3 || argc > 4) {
+		return ErrorOut("Usage: xyz-thumbnailer path/to/input.xyz path/to/output.png [size in pixels]");
+	}
+
+	std::string input = argv[1];
+	std::string output = argv[2];
+	int size = 128;
+	if (argc == 4) {
+		char* end;
+		long value = strtol(argv[3], &end, 10);
+		if (*argv[3] == '\0' || *end != '\0' || value <= 0 || value > 4096) {
+			return ErrorOut("Size argument is not a valid number!");
+		}
+		size = static_cast<int>(value);
+	}
+
+	Xyz::Reader reader;
+	switch (reader.Open(input)) {
+		case Xyz::Reader::Result::Ok:
+			break;
+		case Xyz::Reader::Result::IoError:
+			return ErrorOut("Input file not found!");
+		case Xyz::Reader::Result::NotXyz:
+			return ErrorOut("Input file is not a XYZ file!");
+	}
+
+	// like the KDE and Windows providers, files from anywhere are thumbnailed
+	std::error_code size_ec;
+	uintmax_t file_size = std::filesystem::file_size(input, size_ec);
+	if (size_ec || !Xyz::IsPlausible(reader.GetHeader(), file_size)) {
+		return ErrorOut("Input file is not a valid XYZ file!");
+	}
+
+	std::vector<uint8_t> thumb;
+	int width, height;
+	if (!Xyz::DecodeThumbnail(reader, size, Xyz::PixelFormat::RGBA, thumb, width, height)) {
+		return ErrorOut("Could not decode xyz file!");
+	}
+
+	// Center on a transparent size x size canvas
+	std::vector<uint8_t> canvas(static_cast<size_t>(size) * size * 4, 0);
+	int off_x = (size - width) / 2;
+	int off_y = (size - height) / 2;
+	for (int y = 0; y < height; y++) {
+		memcpy(&canvas[(static_cast<size_t>(y + off_y) * size + off_x) * 4],
+			&thumb[static_cast<size_t>(y) * width * 4], width * 4);
+	}
+
+	std::error_code ec;
+	std::filesystem::path output_folder = std::filesystem::path(output).parent_path();
+	if (!output_folder.empty() && !std::filesystem::is_directory(output_folder, ec)) {
+		std::filesystem::create_directories(output_folder, ec);
+	}
+
+	if (!WritePng(output, canvas, size, size)) {
+		return ErrorOut("Could not write thumbnail!");
+	}
+
+	return 0;
+}
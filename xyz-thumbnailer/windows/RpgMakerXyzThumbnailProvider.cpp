@@ -11,11 +11,11 @@ WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
 #include "RpgMakerXyzThumbnailProvider.h"
 #include <Shlwapi.h>
 
+#include <algorithm>
 #include <sstream>
 #include <vector>
-#include <zlib.h>
-
-typedef UCHAR uint8_t;
+#include "libxyz.h"
+#include "ThumbnailCache.h"
 
 #pragma comment(lib, "Shlwapi.lib")
 #pragma comment(lib, "Crypt32.lib")
@@ -114,83 +114,88 @@ IFACEMETHODIMP RpgMakerXyzThumbnailProvider::GetThumbnail(UINT cx, HBITMAP *phbm
 
 HRESULT RpgMakerXyzThumbnailProvider::GetXyzImage(UINT cx, HBITMAP *phbmp, WTS_ALPHATYPE *pdwAlpha)
 {
-	ULONG bytesRead;
 	STATSTG statstg;
 	HRESULT hr;
 
 	*pdwAlpha = WTSAT_ARGB;
 
 	hr = m_pStream->Stat(&statstg, STATFLAG_NONAME);
+	if (FAILED(hr)) {
+		return hr;
+	}
 
-	if (SUCCEEDED(hr)) {
-		if (statstg.cbSize.QuadPart > 1024*1024*1024) {
-			// Skip too large files (> 1 MB) to save parsing time
-			return E_NOT_SUFFICIENT_BUFFER;
-		}
-
-		size_t size = (size_t)statstg.cbSize.QuadPart;
+	if (statstg.cbSize.QuadPart > Xyz::thumbnail_max_file_size) {
+		// Skip too large files to save parsing time
+		return E_NOT_SUFFICIENT_BUFFER;
+	}
 
-		char* data = (char*)malloc(size);
-		if (!data) {
-			return E_OUTOFMEMORY;
+	// The beginning of the file identifies it for the thumbnail cache
+	HRESULT read_hr = S_OK;
+	auto read_stream = [&](uint8_t* buf, size_t len) -> size_t {
+		ULONG bytesRead = 0;
+		read_hr = m_pStream->Read(buf, (ULONG)len, &bytesRead);
+		return FAILED(read_hr) ? 0 : bytesRead;
+	};
+
+	uint8_t prefix[4096];
+	size_t prefix_size = 0;
+	while (prefix_size < sizeof(prefix)) {
+		size_t n = read_stream(prefix + prefix_size, sizeof(prefix) - prefix_size);
+		if (n == 0) {
+			break;
 		}
+		prefix_size += n;
+	}
+	if (FAILED(read_hr)) {
+		return read_hr;
+	}
 
-		hr = m_pStream->Read(data, (ULONG)size, &bytesRead);
-
-		if (SUCCEEDED(hr)) {
-			if (size < 8 || strncmp((char *) data, "XYZ1", 4) != 0) {
-				return E_INVALIDARG;
-			}
-	
-			unsigned short w;
-			memcpy(&w, &data[4], 2);
-			unsigned short h;
-			memcpy(&h, &data[6], 2);
-
-			uLongf src_size = (uLongf)(size - 8);
-			Bytef* src_buffer = (Bytef*)&data[8];
-			uLongf dst_size = 768 + (w * h);
-			std::vector<Bytef> dst_buffer(dst_size);
-
-			int status = uncompress(&dst_buffer.front(), &dst_size, src_buffer, src_size);
+	std::vector<uint8_t> pixels;
+	int width, height;
 
-			free(data);
+	ThumbnailCache& cache = ThumbnailCache::Instance();
+	uint64_t key = 0;
+	if (cache.Enabled()) {
+		key = ThumbnailCache::MakeKey(prefix, prefix_size,
+			statstg.cbSize.QuadPart, statstg.mtime, cx);
+	}
 
-			if (status != Z_OK) {
-				return E_INVALIDARG;
+	if (!cache.Enabled() || !cache.Lookup(key, pixels, width, height)) {
+		// Inflate straight from the stream in fixed chunks, only the header
+		// is parsed before the size checks
+		size_t prefix_pos = 0;
+		Xyz::Reader reader;
+		Xyz::Reader::Result result = reader.Open([&](uint8_t* buf, size_t len) -> size_t {
+			if (prefix_pos < prefix_size) {
+				len = std::min(len, prefix_size - prefix_pos);
+				memcpy(buf, prefix + prefix_pos, len);
+				prefix_pos += len;
+				return len;
 			}
-			const uint8_t (*palette)[3] = (const uint8_t(*)[3]) &dst_buffer.front();
-
-			int width = w;
-			int height = h;
-			void* pixels = malloc(w * h * 4);
+			return read_stream(buf, len);
+		});
 
-			if (!pixels) {
-				return E_OUTOFMEMORY;
-			}
+		if (result != Xyz::Reader::Result::Ok ||
+				!Xyz::IsPlausible(reader.GetHeader(), statstg.cbSize.QuadPart)) {
+			return E_INVALIDARG;
+		}
 
-			uint8_t* dst = (uint8_t*) pixels;
-			const uint8_t* src = (const uint8_t*) &dst_buffer[768];
-			for (int y = 0; y < h; y++) {
-				for (int x = 0; x < w; x++) {
-					uint8_t pix = *src++;
-					const uint8_t* color = palette[pix];
-					*dst++ = color[2];
-					*dst++ = color[1];
-					*dst++ = color[0];
-					*dst++ = 255;
-				}
-			}
+		// Scale down to cx while inflating instead of letting the
+		// shell scale a full size bitmap
+		if (!Xyz::DecodeThumbnail(reader, cx, Xyz::PixelFormat::BGRA, pixels, width, height)) {
+			return FAILED(read_hr) ? read_hr : E_INVALIDARG;
+		}
 
-			*phbmp = CreateBitmap(w, h, 1, 32, pixels);
+		if (cache.Enabled()) {
+			cache.Store(key, pixels, width, height);
+		}
+	}
 
-			free(pixels);
+	*phbmp = CreateBitmap(width, height, 1, 32, pixels.data());
 
-			if (!(*phbmp)) {
-				return E_UNEXPECTED;
-			}
-		}
+	if (!(*phbmp)) {
+		return E_UNEXPECTED;
 	}
 
-	return hr;
-}
\ No newline at end of file
+	return S_OK;
+}
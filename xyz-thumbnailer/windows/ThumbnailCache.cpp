@@ -0,0 +1,104 @@
+/*
+ * This file is part of xyz-thumbnailer. Copyright (c) 2026 xyz-thumbnailer authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * Released under the Microsoft Public License.
+ * See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+ */
+
+#include "ThumbnailCache.h"
+
+#pragma comment(lib, "Advapi32.lib")
+
+namespace
+{
+	constexpr DWORD default_cache_size_mb = 32;
+
+	// FNV-1a
+	uint64_t Hash(const void* data, size_t size, uint64_t hash)
+	{
+		const uint8_t* p = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash ^= p[i];
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	size_t ReadBudget()
+	{
+		DWORD size_mb = default_cache_size_mb;
+		DWORD value;
+		DWORD len = sizeof(value);
+		if (RegGetValueW(HKEY_CURRENT_USER, L"Software\\EasyRPG\\XyzThumbnailer",
+				L"CacheSizeMB", RRF_RT_REG_DWORD, NULL, &value, &len) == ERROR_SUCCESS) {
+			size_mb = value;
+		}
+		return static_cast<size_t>(size_mb) * 1024 * 1024;
+	}
+}
+
+ThumbnailCache& ThumbnailCache::Instance()
+{
+	static ThumbnailCache cache(ReadBudget());
+	return cache;
+}
+
+ThumbnailCache::ThumbnailCache(size_t budget) : m_budget(budget)
+{
+}
+
+uint64_t ThumbnailCache::MakeKey(const uint8_t* prefix, size_t prefix_size,
+	ULONGLONG file_size, FILETIME mtime, UINT cx)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	hash = Hash(prefix, prefix_size, hash);
+	hash = Hash(&file_size, sizeof(file_size), hash);
+	hash = Hash(&mtime, sizeof(mtime), hash);
+	hash = Hash(&cx, sizeof(cx), hash);
+	return hash;
+}
+
+bool ThumbnailCache::Lookup(uint64_t key, std::vector<uint8_t>& pixels, int& width, int& height)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_index.find(key);
+	if (it == m_index.end()) {
+		return false;
+	}
+
+	// mark as most recently used
+	m_entries.splice(m_entries.begin(), m_entries, it->second);
+
+	const Entry& entry = *it->second;
+	pixels = entry.pixels;
+	width = entry.width;
+	height = entry.height;
+	return true;
+}
+
+void ThumbnailCache::Store(uint64_t key, const std::vector<uint8_t>& pixels, int width, int height)
+{
+	if (pixels.size() > m_budget) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_index.find(key) != m_index.end()) {
+		return;
+	}
+
+	m_entries.push_front(Entry { key, pixels, width, height });
+	m_index[key] = m_entries.begin();
+	m_used += pixels.size();
+
+	// evict least recently used entries
+	while (m_used > m_budget) {
+		const Entry& last = m_entries.back();
+		m_used -= last.pixels.size();
+		m_index.erase(last.key);
+		m_entries.pop_back();
+	}
+}
@@ -0,0 +1,55 @@
+/*
+ * This file is part of xyz-thumbnailer. Copyright (c) 2026 xyz-thumbnailer authors.
+ * https://github.com/EasyRPG/Tools - https://easyrpg.org
+ *
+ * Released under the Microsoft Public License.
+ * See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+ */
+
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// In-process LRU cache of produced thumbnail pixels, so Explorer asking
+// again for the same file (scrolling, view changes) skips the decoding
+class ThumbnailCache
+{
+public:
+	// Cache shared by all provider instances of the process.
+	// The budget is read once from the CacheSizeMB value (DWORD) below
+	// HKCU\Software\EasyRPG\XyzThumbnailer, 0 disables the cache.
+	static ThumbnailCache& Instance();
+
+	// Builds the key from the beginning of the file, its size,
+	// modification time and the requested size
+	static uint64_t MakeKey(const uint8_t* prefix, size_t prefix_size,
+		ULONGLONG file_size, FILETIME mtime, UINT cx);
+
+	bool Lookup(uint64_t key, std::vector<uint8_t>& pixels, int& width, int& height);
+	void Store(uint64_t key, const std::vector<uint8_t>& pixels, int width, int height);
+
+	bool Enabled() const { return m_budget > 0; }
+
+private:
+	explicit ThumbnailCache(size_t budget);
+
+	struct Entry
+	{
+		uint64_t key;
+		std::vector<uint8_t> pixels;
+		int width;
+		int height;
+	};
+
+	std::mutex m_mutex;
+	// most recently used first
+	std::list<Entry> m_entries;
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> m_index;
+	size_t m_budget;
+	size_t m_used = 0;
+};
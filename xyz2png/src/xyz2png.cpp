@@ -17,14 +17,19 @@
 
 #include <zlib.h>
 #include <png.h>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <thread>
 #include <vector>
 #include <sstream>
-#ifdef _WIN32
-# include <algorithm>
-#endif
+#include <argparse.hpp>
+#include <zlib_container.h>
+#include "fileio.h"
+#include "libxyz.h"
+#include "pipeline.h"
+#include "stats.h"
 
 # ifdef __MINGW64_VERSION_MAJOR
 int _dowildcard = -1; /* enable wildcard expansion for mingw-w64 */
@@ -76,167 +81,413 @@ std::string GetPath(const std::string& str) {
 	return s;
 }
 
-int main(int argc, char* argv[]) {
-	if(argc < 2)
-	{
-		std::cout << "Usage: " << argv[0]
-			<< " filename" << std::endl;
-		return 1;
+/** Speed/size trade-off of the written PNG files. */
+enum class Profile {
+	Fast,
+	Balanced,
+	Max
+};
+
+struct PngOptions {
+	Profile profile = Profile::Max;
+	/** Zopfli iterations for the image data, 0 uses zlib */
+	int zopfli_iterations = 0;
+};
+
+static Stats::Counter files_counter("files converted");
+static Stats::Counter inflated_counter("bytes inflated");
+
+/** One file passing through the conversion pipeline. */
+struct ConvertJob {
+	std::string xyz_filename;
+	std::string png_filename;
+	/** from the --batch list, errors do not stop the conversion */
+	bool batch = false;
+	Xyz::MappedFile xyz_file;
+	bool read = false;
+	/** receives the PNG while it is encoded, committed by the write stage */
+	Xyz::AtomicFile png_file;
+	bool ok = false;
+	/** messages, printed in input order */
+	std::ostringstream err;
+};
+
+/** libpng write callback appending to a ConvertJob::png_file. */
+void WriteAtomic(png_structp png_ptr, png_bytep data, size_t len) {
+	Xyz::AtomicFile* png_file = static_cast<Xyz::AtomicFile*>(png_get_io_ptr(png_ptr));
+	if(!png_file->Write(data, len)) {
+		png_error(png_ptr, "Write error");
 	}
+}
 
-	for(int arg = 1; arg < argc; arg++) {
-		std::ifstream file(argv[arg],
-			std::ios::binary | std::ios::ate);
-		if(!file) {
-			std::cerr << "Error reading file "
-				<< argv[arg] << "." << std::endl;
-			return 1;
-		}
+void FlushAtomic(png_structp) {
+}
 
-		long size = file.tellg();
-		char* header = new char[4];
-
-		file.seekg(0, std::ios::beg);
-		file.read((char*) header, 4);
-		if(memcmp(header, "XYZ1", 4) != 0) {
-			std::cerr << "Input file " << argv[arg]
-				<< " is not a XYZ file: '"
-				<< header << "'." << std::endl;
-			delete[] header;
-			return 1;
-		}
-		delete[] header;
+/** Bytes of each input read ahead, the rest is paged in while converting. */
+constexpr size_t prefetch_size = 4 * 1024 * 1024;
 
-		unsigned short width;
-		unsigned short height;
-		file.read((char*) &width, 2);
-		file.read((char*) &height, 2);
+/** Maps the input of job and reads it ahead, returns false on error. */
+bool ReadFile(ConvertJob& job) {
+	Stats::Scope scope("read");
 
-		int compressed_xyz_size = size - 8;
-		Bytef* compressed_xyz_data = new Bytef[compressed_xyz_size];
+	if(!job.xyz_file.Open(job.xyz_filename)) {
+		job.err << "Error reading file "
+			<< job.xyz_filename << "." << std::endl;
+		return false;
+	}
+	job.xyz_file.Prefetch(prefetch_size);
+	return true;
+}
 
-		file.read((char*) compressed_xyz_data, compressed_xyz_size);
+/**
+ * Converts the input of job to a temporary PNG file, returns false on error.
+ * The output is written while it is encoded, only WriteFile makes it visible.
+ */
+bool ConvertFile(Xyz::Reader& xyz, ConvertJob& job, const PngOptions& options) {
+	Stats::Scope scope("convert");
+	const std::string& xyz_filename = job.xyz_filename;
+	const std::string& png_filename = job.png_filename;
+	std::ostringstream& err = job.err;
+
+	// inflated directly from the mapping
+	switch(xyz.Open(job.xyz_file.Data(), job.xyz_file.Size())) {
+		case Xyz::Reader::Result::Ok:
+			break;
+		case Xyz::Reader::Result::IoError:
+			err << "Error reading file "
+				<< xyz_filename << "." << std::endl;
+			return false;
+		case Xyz::Reader::Result::NotXyz:
+			err << "Input file " << xyz_filename
+				<< " is not a XYZ file." << std::endl;
+			return false;
+	}
 
-		uLongf xyz_size = 768 + (width * height);
-		std::vector<Bytef> xyz_data(
-			xyz_size);
+	unsigned short width = xyz.GetHeader().width;
+	unsigned short height = xyz.GetHeader().height;
 
-		int status = uncompress(&xyz_data.front(),
-			&xyz_size, compressed_xyz_data,
-			compressed_xyz_size);
+	// Only the palette and one row are kept besides the PNG output,
+	// rows are encoded as soon as they are inflated
+	Bytef xyz_palette[Xyz::palette_size];
+	std::vector<Bytef> row(width);
 
-		if(status != Z_OK) {
-			std::cerr << "Error uncompressing XYZ file "
-				<< argv[arg] << "." << std::endl;
-			return 1;
-		}
+	if(!xyz.Read(xyz_palette, sizeof(xyz_palette))) {
+		err << "Error uncompressing XYZ file "
+			<< xyz_filename << "." << std::endl;
+		return false;
+	}
 
-		FILE *png_file;
-		png_structp png_ptr;
-		png_infop info_ptr;
-		std::string png_filename;
-		std::stringstream ss;
-
-		ss << GetFilename(argv[arg]) << ".png";
-		png_filename = ss.str();
-
-		// Open file for writing
-		png_file = fopen(png_filename.c_str(), "wb");
-		if(png_file == NULL) {
-			std::cerr << "Error creating file "
-				<< png_filename<< "." << std::endl;
-			return 1;
-		}
+	png_structp png_ptr;
+	png_infop info_ptr;
 
-		// Create PNG write structure
-		png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
-			NULL, NULL);
-		if(png_ptr == NULL)
-		{
-			std::cerr << "Error creating PNG write structure for "
-				<< png_filename << "." << std::endl;
-			fclose(png_file);
-			return 1;
-		}
+	// Create PNG write structure
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
+		NULL, NULL);
+	if(png_ptr == NULL)
+	{
+		err << "Error creating PNG write structure for "
+			<< png_filename << "." << std::endl;
+		return false;
+	}
 
-		// Create PNG info structure
-		info_ptr = png_create_info_struct(png_ptr);
-		if(info_ptr == NULL)
-		{
-			std::cerr << "Error creating PNG info structure for "
-				<< png_filename << "." << std::endl;
-			fclose(png_file);
-			png_destroy_write_struct(&png_ptr, NULL);
-			return 1;
+	// Create PNG info structure
+	info_ptr = png_create_info_struct(png_ptr);
+	if(info_ptr == NULL)
+	{
+		err << "Error creating PNG info structure for "
+			<< png_filename << "." << std::endl;
+		png_destroy_write_struct(&png_ptr, NULL);
+		return false;
+	}
+
+	// Init I/O functions
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		err << "Error initializing PNG I/O for "
+			<< png_filename << "." << std::endl;
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return false;
+	}
+	if(!job.png_file.Open(png_filename)) {
+		err << "Error writing file "
+			<< png_filename << "." << std::endl;
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return false;
+	}
+	png_set_write_fn(png_ptr, &job.png_file, WriteAtomic, FlushAtomic);
+
+	// Set compression parameters, filtering does not help indexed images
+	switch(options.profile) {
+		case Profile::Fast:
+			png_set_compression_level(png_ptr, Z_BEST_SPEED);
+			break;
+		case Profile::Balanced:
+			png_set_compression_level(png_ptr, Z_DEFAULT_COMPRESSION);
+			break;
+		case Profile::Max:
+			png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
+			break;
+	}
+	png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+	png_set_compression_mem_level(png_ptr, MAX_MEM_LEVEL);
+	png_set_compression_buffer_size(png_ptr, 1024 * 1024);
+
+	// Write header
+	if(setjmp(png_jmpbuf(png_ptr))) {
+		err << "Error writing PNG header for "
+			<< png_filename << "." << std::endl;
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return false;
+	}
+	png_set_IHDR(png_ptr, info_ptr, width, height, 8,
+		PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+	// Write palette
+	if(setjmp(png_jmpbuf(png_ptr))) {
+		err << "Error writing PNG palette for "
+			<< png_filename << "." << std::endl;
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return false;
+	}
+	png_color palette[PNG_MAX_PALETTE_LENGTH];
+	for(int i = 0; i < PNG_MAX_PALETTE_LENGTH; i++)
+	{
+		palette[i].red = xyz_palette[i * 3];
+		palette[i].green = xyz_palette[i * 3 + 1];
+		palette[i].blue = xyz_palette[i * 3 + 2];
+	}
+	png_set_PLTE(png_ptr, info_ptr, palette,
+		PNG_MAX_PALETTE_LENGTH);
+
+	png_write_info(png_ptr, info_ptr);
+
+	// Write image rows
+	if(setjmp(png_jmpbuf(png_ptr))) {
+		err << "Error writing PNG image for "
+			<< png_filename << "." << std::endl;
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return false;
+	}
+	if(options.zopfli_iterations > 0) {
+		// Zopfli needs the whole filtered image, every row starts
+		// with filter type none
+		std::vector<Bytef> image((static_cast<size_t>(width) + 1) * height);
+		for(int i = 0; i < height; i++) {
+			Bytef* image_row = &image[i * (static_cast<size_t>(width) + 1)];
+			image_row[0] = PNG_FILTER_VALUE_NONE;
+			if(!xyz.Read(image_row + 1, width)) {
+				err << "Error uncompressing XYZ file "
+					<< xyz_filename << "." << std::endl;
+				png_destroy_write_struct(&png_ptr, &info_ptr);
+				return false;
+			}
 		}
 
-		// Init I/O functions
-		if(setjmp(png_jmpbuf(png_ptr)))
+		ZopfliOptions zopfli;
+		ZopfliInitOptions(&zopfli);
+		zopfli.numiterations = options.zopfli_iterations;
+
+		unsigned char* comp_data = nullptr;
+		size_t comp_size = 0;
 		{
-			std::cerr << "Error initializing PNG I/O for "
-				<< png_filename << "." << std::endl;
-			fclose(png_file);
-			png_destroy_write_struct(&png_ptr, &info_ptr);
-			return 1;
-		}
-		png_init_io(png_ptr, png_file);
-
-		// Set compression parameters
-		png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
-		png_set_compression_mem_level(png_ptr, MAX_MEM_LEVEL);
-		png_set_compression_buffer_size(png_ptr, 1024 * 1024);
-
-		// Write header
-		if(setjmp(png_jmpbuf(png_ptr))) {
-			std::cerr << "Error writing PNG header for "
-				<< png_filename << "." << std::endl;
-			fclose(png_file);
-			png_destroy_write_struct(&png_ptr, &info_ptr);
-			return 1;
+			Stats::Scope zopfli_scope("zopfli");
+			ZopfliZlibCompress(&zopfli, image.data(), image.size(),
+				&comp_data, &comp_size);
 		}
-		png_set_IHDR(png_ptr, info_ptr, width, height, 8,
-			PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
-			PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-
-		// Write palette
-		if(setjmp(png_jmpbuf(png_ptr))) {
-			std::cerr << "Error writing PNG palette for "
-				<< png_filename << "." << std::endl;
-			fclose(png_file);
-			png_destroy_write_struct(&png_ptr, &info_ptr);
-			return 1;
+
+		// libpng writes the remaining chunks unmodified
+		png_write_chunk(png_ptr, (png_const_bytep) "IDAT", comp_data, comp_size);
+		png_write_chunk(png_ptr, (png_const_bytep) "IEND", NULL, 0);
+		free(comp_data);
+	} else {
+		for(int i = 0; i < height; i++) {
+			if(!xyz.Read(row.data(), width)) {
+				err << "Error uncompressing XYZ file "
+					<< xyz_filename << "." << std::endl;
+				png_destroy_write_struct(&png_ptr, &info_ptr);
+				return false;
+			}
+			png_write_row(png_ptr, row.data());
 		}
-		png_colorp palette = (png_colorp) png_malloc(png_ptr,
-			PNG_MAX_PALETTE_LENGTH * (sizeof (png_color)));
 
-	 	for(int i = 0; i < PNG_MAX_PALETTE_LENGTH; i++)
-		{
-			palette[i].red = xyz_data[i * 3];
-			palette[i].green = xyz_data[i * 3 + 1];
-			palette[i].blue = xyz_data[i * 3 + 2];
+		png_write_end(png_ptr, info_ptr);
+	}
+
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+
+	// the pages are not needed anymore, the next files are read ahead
+	job.xyz_file.Close();
+	inflated_counter.Add(Xyz::DecodedSize(xyz.GetHeader()));
+	return true;
+}
+
+/**
+ * Renames the temporary PNG file of job to the PNG filename,
+ * returns false on error.
+ */
+bool WriteFile(ConvertJob& job) {
+	Stats::Scope scope("write");
+
+	if(!job.png_file.Commit()) {
+		job.err << "Error writing file "
+			<< job.png_filename << "." << std::endl;
+		return false;
+	}
+
+	files_counter.Add();
+	return true;
+}
+
+/**
+ * Reads the next input and output path from a batch list.
+ * Paths are separated by delim, an empty output path selects the default.
+ */
+bool ReadBatchEntry(std::istream& in, char delim, std::string& input, std::string& output) {
+	do {
+		if(!std::getline(in, input, delim)) {
+			return false;
 		}
-		png_set_PLTE(png_ptr, info_ptr, palette,
-			PNG_MAX_PALETTE_LENGTH);
+	} while(input.empty());
 
-		png_write_info(png_ptr, info_ptr);
+	if(!std::getline(in, output, delim)) {
+		output.clear();
+	}
+	return true;
+}
 
-		png_bytep* row_pointers = new png_bytep[height];
-		for(int i = 0; i < height; i++) {
-			row_pointers[i] =
-				&xyz_data[768 + width * i];
+int main(int argc, char* argv[]) {
+	std::vector<std::string> files;
+	bool batch = false;
+	bool null_delim = false;
+	std::string profile = "max";
+	PngOptions options;
+	std::string output_dir;
+	int jobs = 1;
+	int read_ahead = 4;
+	bool stats = false;
+	std::string trace_file;
+
+	// --zopfli without value uses the default iteration count
+	std::vector<char*> args(argv, argv + argc);
+	char zopfli_default[] = "--zopfli=15";
+	for(auto& arg : args) {
+		if(strcmp(arg, "--zopfli") == 0) {
+			arg = zopfli_default;
 		}
-		png_write_image(png_ptr, row_pointers);
-		delete[] row_pointers;
-	
-		png_write_end(png_ptr, info_ptr);
+	}
 
-		png_free(png_ptr, palette);
-		palette = NULL;
+	argparse::ArgumentParser cli("xyz2png", PACKAGE_VERSION);
+	cli.set_usage_max_line_width(100);
+	cli.add_description("Convert XYZ images into PNG images");
+	cli.add_epilog("Homepage " PACKAGE_URL " - Report bugs at: " PACKAGE_BUGREPORT);
+
+	cli.add_argument("FILE").nargs(argparse::nargs_pattern::any).store_into(files)
+		.help("XYZ files to convert");
+	cli.add_argument("--batch", "--stdin").store_into(batch)
+		.help("Read pairs of input and output paths from stdin, separated\n"
+			"by newlines, and print one status line per file. An empty\n"
+			"output path uses the default name");
+	cli.add_argument("-z", "--null").store_into(null_delim)
+		.help("Paths on stdin are separated by NUL instead of newline");
+	cli.add_argument("-o", "--output").metavar("DIR").store_into(output_dir)
+		.help("Directory of the PNG files (default: current directory),\n"
+			"explicit output paths of --batch are not changed");
+	cli.add_argument("-j", "--jobs").metavar("N").store_into(jobs)
+		.help("Number of files to convert in parallel (default: 1)\n"
+			"0 uses one job per CPU core");
+	cli.add_argument("--read-ahead").metavar("N").store_into(read_ahead)
+		.help("Number of files read while the others are converted and\n"
+			"written, hides slow storage (default: 4)");
+	cli.add_argument("-p", "--profile").metavar("P").store_into(profile)
+		.choices("fast", "balanced", "max")
+		.help("Compression profile of the PNG files:\n"
+			"fast: Fastest zlib level, intended for previews\n"
+			"balanced: Default zlib level\n"
+			"max: Best zlib level (default)");
+	cli.add_argument("--zopfli").metavar("N").scan<'i', int>()
+		.store_into(options.zopfli_iterations)
+		.help("Compress the image data with Zopfli, slow but smallest,\n"
+			"use --zopfli=N for N iterations (default: 15)");
+	cli.add_argument("--stats").store_into(stats)
+		.help("Print the time of each phase and the counters to stderr");
+	cli.add_argument("--trace").metavar("FILE").store_into(trace_file)
+		.help("Write the phases as Chrome trace_event JSON to FILE");
+
+	try {
+		cli.parse_args(args.size(), args.data());
+	} catch (const std::exception& err) {
+		std::cerr << err.what() << "\n";
+		// print usage message
+		std::cerr << cli.usage() << "\n";
+		std::exit(EXIT_FAILURE);
+	}
 
-		png_destroy_write_struct(&png_ptr, &info_ptr);
+	if(files.empty() && !batch) {
+		std::cerr << cli.usage() << "\n";
+		return 1;
+	}
+
+	if(profile == "fast") {
+		options.profile = Profile::Fast;
+	} else if(profile == "balanced") {
+		options.profile = Profile::Balanced;
+	}
+	if(options.zopfli_iterations < 0) {
+		std::cerr << "Invalid Zopfli iteration count.\n";
+		return 1;
+	}
+
+	if(!output_dir.empty()) {
+		output_dir += "/";
+	}
+
+	Stats::Session stats_session(stats, trace_file);
 
-		fclose(png_file);
+	if(jobs <= 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
 	}
 
-	return 0;
+	// the inflate stream of each job is reused for every file
+	std::vector<Xyz::Reader> readers(jobs);
+
+	// the command line files are converted first, then the batch list
+	size_t next_file = 0;
+	char delim = null_delim ? '\0' : '\n';
+	unsigned int errors = 0;
+
+	Xyz::RunPipeline<ConvertJob>(jobs, read_ahead,
+		[&](ConvertJob& job) {
+			if(next_file < files.size()) {
+				job.xyz_filename = files[next_file++];
+			} else if(batch && ReadBatchEntry(std::cin, delim, job.xyz_filename, job.png_filename)) {
+				job.batch = true;
+			} else {
+				return false;
+			}
+			if(job.png_filename.empty()) {
+				job.png_filename = output_dir + GetFilename(job.xyz_filename) + ".png";
+			}
+			job.read = ReadFile(job);
+			return true;
+		},
+		[&](ConvertJob& job, int worker) {
+			job.ok = job.read && ConvertFile(readers[worker], job, options);
+		},
+		[&](ConvertJob& job) {
+			job.ok = job.ok && WriteFile(job);
+			std::cerr << job.err.str();
+			if(!job.ok) {
+				errors++;
+			}
+			if(!job.batch) {
+				// the first failing command line file ends the conversion
+				return job.ok;
+			}
+			std::cout << (job.ok ? "ok\t" : "error\t") << job.xyz_filename
+				<< "\t" << job.png_filename << std::endl;
+			return true;
+		});
+
+	return errors > 0 ? 1 : 0;
 }
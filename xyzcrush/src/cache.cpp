@@ -0,0 +1,105 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2017 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+uint64_t HashData(const unsigned char* data, size_t size, uint64_t seed) {
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+namespace {
+	std::string MakeKey(uint64_t key, const std::string& settings) {
+		char hex[17];
+		snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+		return std::string(hex) + " " + settings;
+	}
+}
+
+bool CrushCache::Load(const std::string& filename) {
+	std::ifstream in(filename);
+	if (!in) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream iss(line);
+		std::string hash, settings, strategy;
+		size_t size;
+		if (iss >> hash >> settings >> size) {
+			// older caches have no strategy
+			iss >> strategy;
+			entries[hash + " " + settings] = { size, strategy };
+		}
+	}
+	return true;
+}
+
+bool CrushCache::Save(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!modified) {
+		return true;
+	}
+
+	std::ofstream out(filename);
+	for (const auto& e : entries) {
+		out << e.first << " " << e.second.size;
+		if (!e.second.strategy.empty()) {
+			out << " " << e.second.strategy;
+		}
+		out << "\n";
+	}
+	out.close();
+	modified = !out;
+	return !modified;
+}
+
+bool CrushCache::Lookup(uint64_t key, const std::string& settings, size_t& size,
+		std::string* strategy) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(MakeKey(key, settings));
+	if (it == entries.end()) {
+		return false;
+	}
+	size = it->second.size;
+	if (strategy) {
+		*strategy = it->second.strategy;
+	}
+	return true;
+}
+
+void CrushCache::Store(uint64_t key, const std::string& settings, size_t size,
+		const std::string& strategy) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto res = entries.emplace(MakeKey(key, settings), Entry{ size, strategy });
+	if (res.second) {
+		modified = true;
+	} else if (size < res.first->second.size) {
+		res.first->second = { size, strategy };
+		modified = true;
+	}
+}
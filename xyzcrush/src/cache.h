@@ -0,0 +1,73 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2017 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_CACHE_H
+#define XYZCRUSH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/** 64 bit FNV-1a hash, used to identify the decompressed image data. */
+uint64_t HashData(const unsigned char* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
+/**
+ * Persistent record of already crushed images.
+ *
+ * Maps the hash of the decompressed palette and pixel data plus the
+ * compression settings to the smallest zlib stream size reached so far.
+ * A file whose stream is not larger than the recorded size cannot get any
+ * smaller with the same settings and is skipped. With --race the name of
+ * the winning strategy is kept as well.
+ * The cache is one entry per line in a plain text sidecar file.
+ */
+class CrushCache {
+public:
+	/** Reads entries from filename, a missing file is an empty cache. */
+	bool Load(const std::string& filename);
+
+	/** Writes all entries to filename when anything changed. */
+	bool Save(const std::string& filename);
+
+	/**
+	 * @param key hash of the image data
+	 * @param settings compression settings identifier
+	 * @param size receives the recorded stream size
+	 * @param strategy receives the recorded strategy when not nullptr
+	 * @return whether an entry exists
+	 */
+	bool Lookup(uint64_t key, const std::string& settings, size_t& size,
+		std::string* strategy = nullptr);
+
+	/** Records size and strategy for key and settings, keeps the smaller one. */
+	void Store(uint64_t key, const std::string& settings, size_t size,
+		const std::string& strategy = "");
+
+private:
+	struct Entry {
+		size_t size;
+		std::string strategy;
+	};
+
+	std::unordered_map<std::string, Entry> entries;
+	std::mutex mutex;
+	bool modified = false;
+};
+
+#endif
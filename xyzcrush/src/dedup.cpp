@@ -0,0 +1,275 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dedup.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <tuple>
+#include "cache.h"
+#include "fileio.h"
+#include "libxyz.h"
+#include "pipeline.h"
+#include "stats.h"
+
+namespace fs = std::filesystem;
+
+static Stats::Counter duplicates_counter("duplicates found");
+static Stats::Counter linked_counter("files linked");
+
+namespace {
+	/** One file passing through the hash pipeline. */
+	struct HashJob {
+		std::string filename;
+		Xyz::MappedFile file;
+		uint16_t width = 0;
+		uint16_t height = 0;
+		uint64_t key = 0;
+		size_t size = 0;
+		std::ostringstream err;
+		bool failed = false;
+	};
+
+	bool HasXyzExtension(const fs::path& path) {
+		std::string ext = path.extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) {
+			return static_cast<char>(std::tolower(c));
+		});
+		return ext == ".xyz";
+	}
+
+	/** Decodes filename into data, the view describes the image. */
+	bool DecodeFile(const std::string& filename, std::vector<uint8_t>& data, Xyz::ImageView& view) {
+		Xyz::MappedFile file;
+		return file.Open(filename) && Xyz::Decode(file.Data(), file.Size(), data, view);
+	}
+}
+
+bool CollectXyzFiles(const std::vector<std::string>& paths, std::vector<std::string>& files) {
+	Stats::Scope scope("scan");
+	std::set<std::string> found;
+	bool ok = true;
+
+	for (const auto& path : paths) {
+		std::error_code ec;
+		if (!fs::is_directory(path, ec)) {
+			found.insert(path);
+			continue;
+		}
+
+		fs::recursive_directory_iterator it(path, ec), end;
+		for (; !ec && it != end; it.increment(ec)) {
+			if (it->is_regular_file(ec) && HasXyzExtension(it->path())) {
+				found.insert(it->path().string());
+			}
+		}
+		if (ec) {
+			std::cerr << "Error reading directory " << path << ": " << ec.message() << "." << std::endl;
+			ok = false;
+		}
+	}
+
+	files.assign(found.begin(), found.end());
+	return ok;
+}
+
+bool FindDuplicates(const std::vector<std::string>& files, int jobs, int read_ahead,
+		std::vector<DuplicateGroup>& groups) {
+	// the dimensions are part of the key, the decoded size does not tell them apart
+	std::map<std::tuple<uint64_t, uint16_t, uint16_t>, DuplicateGroup> images;
+
+	size_t next_file = 0;
+	bool ok = true;
+	Xyz::RunPipeline<HashJob>(jobs, read_ahead,
+		[&](HashJob& job) {
+			if (next_file >= files.size()) {
+				return false;
+			}
+			Stats::Scope read_scope("read");
+			job.filename = files[next_file++];
+			if (!job.file.Open(job.filename)) {
+				job.err << "Error reading file " << job.filename << "." << std::endl;
+				job.failed = true;
+			} else {
+				job.file.Prefetch();
+			}
+			return true;
+		},
+		[&](HashJob& job, int) {
+			if (job.failed) {
+				return;
+			}
+			Stats::Scope decode_scope("decode");
+			std::vector<uint8_t> data;
+			Xyz::ImageView view;
+			if (!Xyz::Decode(job.file.Data(), job.file.Size(), data, view)) {
+				job.err << "XYZ error in file " << job.filename << "." << std::endl;
+				job.failed = true;
+				return;
+			}
+			job.width = view.width;
+			job.height = view.height;
+			job.key = HashData(data.data(), data.size());
+			job.size = job.file.Size();
+			job.file.Close();
+		},
+		[&](HashJob& job) {
+			std::cerr << job.err.str();
+			if (job.failed) {
+				ok = false;
+				return true;
+			}
+			DuplicateGroup& group = images[std::make_tuple(job.key, job.width, job.height)];
+			group.key = job.key;
+			group.files.push_back(job.filename);
+			group.sizes.push_back(job.size);
+			return true;
+		});
+
+	groups.clear();
+	for (auto& image : images) {
+		DuplicateGroup& group = image.second;
+		if (group.files.size() < 2) {
+			continue;
+		}
+
+		// keep the smallest file, the others need no crushing then
+		std::vector<size_t> order(group.files.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return group.sizes[a] < group.sizes[b];
+		});
+
+		// the hash only proposes the groups, the images are compared before
+		// they are reported, linked or written to the manifest. A colliding
+		// image starts a group of its own.
+		Stats::Scope verify_scope("verify");
+		struct Verified {
+			DuplicateGroup group;
+			std::vector<uint8_t> data;
+		};
+		std::vector<Verified> verified;
+		for (size_t i : order) {
+			std::vector<uint8_t> data;
+			Xyz::ImageView view;
+			if (!DecodeFile(group.files[i], data, view)) {
+				std::cerr << "XYZ error in file " << group.files[i] << "." << std::endl;
+				ok = false;
+				continue;
+			}
+			auto same = std::find_if(verified.begin(), verified.end(), [&](const Verified& v) {
+				return v.data == data;
+			});
+			if (same == verified.end()) {
+				verified.push_back({ DuplicateGroup(), std::move(data) });
+				same = verified.end() - 1;
+				same->group.key = group.key;
+			}
+			same->group.files.push_back(group.files[i]);
+			same->group.sizes.push_back(group.sizes[i]);
+		}
+
+		for (auto& v : verified) {
+			if (v.group.files.size() > 1) {
+				duplicates_counter.Add(v.group.files.size() - 1);
+				groups.push_back(std::move(v.group));
+			}
+		}
+	}
+
+	// in the order of the kept files
+	std::sort(groups.begin(), groups.end(), [](const DuplicateGroup& a, const DuplicateGroup& b) {
+		return a.files[0] < b.files[0];
+	});
+	return ok;
+}
+
+bool LinkDuplicates(const DuplicateGroup& group) {
+	Stats::Scope scope("link");
+	const std::string& kept = group.files[0];
+
+	std::vector<uint8_t> kept_data;
+	Xyz::ImageView kept_view;
+	if (!DecodeFile(kept, kept_data, kept_view)) {
+		std::cerr << "XYZ error in file " << kept << "." << std::endl;
+		return false;
+	}
+
+	bool ok = true;
+	for (size_t i = 1; i < group.files.size(); i++) {
+		const std::string& file = group.files[i];
+
+		std::error_code ec;
+		if (fs::equivalent(kept, file, ec)) {
+			continue;
+		}
+
+		std::vector<uint8_t> data;
+		Xyz::ImageView view;
+		if (!DecodeFile(file, data, view)) {
+			std::cerr << "XYZ error in file " << file << "." << std::endl;
+			ok = false;
+			continue;
+		}
+		if (view.width != kept_view.width || view.height != kept_view.height || data != kept_data) {
+			std::cerr << "Not linking " << file << ", it changed since the scan and differs from "
+				<< kept << "." << std::endl;
+			continue;
+		}
+
+		// the link appears under the final name in one step, like AtomicFile
+		std::string temp_file = file + ".link.tmp";
+		fs::remove(temp_file, ec);
+		fs::create_hard_link(kept, temp_file, ec);
+		if (!ec) {
+			fs::rename(temp_file, file, ec);
+			if (ec) {
+				std::error_code ignored;
+				fs::remove(temp_file, ignored);
+			}
+		}
+		if (ec) {
+			std::cerr << "Error linking " << file << " to " << kept << ": "
+				<< ec.message() << "." << std::endl;
+			ok = false;
+			continue;
+		}
+		linked_counter.Add();
+	}
+	return ok;
+}
+
+bool WriteDedupManifest(const std::string& filename, const std::vector<DuplicateGroup>& groups) {
+	std::ostringstream ss;
+	for (const auto& group : groups) {
+		for (size_t i = 1; i < group.files.size(); i++) {
+			ss << group.files[i] << "\t" << group.files[0] << "\n";
+		}
+	}
+	std::string text = ss.str();
+
+	Xyz::AtomicFile file;
+	return file.Open(filename) &&
+		file.Write(text.data(), text.size()) &&
+		file.Commit();
+}
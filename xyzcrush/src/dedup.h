@@ -0,0 +1,79 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_DEDUP_H
+#define XYZCRUSH_DEDUP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** Files with the same decoded image. */
+struct DuplicateGroup {
+	/** hash of the decompressed palette and pixel data */
+	uint64_t key = 0;
+	/** the smallest file first, it is the one that is kept */
+	std::vector<std::string> files;
+	/** file size of every entry of files */
+	std::vector<size_t> sizes;
+};
+
+/**
+ * Expands paths to the XYZ files they contain, directories are searched
+ * recursively for files with the .xyz extension in any case. Files are
+ * taken as they are. The result is sorted and contains no path twice.
+ *
+ * @param paths files and directories
+ * @param files receives the XYZ files
+ * @return false when one of the paths cannot be read
+ */
+bool CollectXyzFiles(const std::vector<std::string>& paths, std::vector<std::string>& files);
+
+/**
+ * Decodes files on jobs threads and groups those with identical palette
+ * and pixels, no matter how they are compressed. Converted RTP graphics
+ * that many games ship are found even when one copy was crushed. Files
+ * with the same hash are compared after decoding, a hash collision never
+ * puts different images into one group.
+ *
+ * @param files XYZ files
+ * @param jobs number of files decoded in parallel
+ * @param read_ahead files read while the others are decoded
+ * @param groups receives the groups with more than one file
+ * @return false when a file could not be decoded, the others are grouped
+ */
+bool FindDuplicates(const std::vector<std::string>& files, int jobs, int read_ahead,
+	std::vector<DuplicateGroup>& groups);
+
+/**
+ * Replaces the duplicates of group by hardlinks to its first file.
+ * Every file is decoded and compared again before, it may have changed
+ * since FindDuplicates. The files are replaced atomically.
+ *
+ * @return false when a file could not be linked
+ */
+bool LinkDuplicates(const DuplicateGroup& group);
+
+/**
+ * Writes one line "duplicate<TAB>kept file" for every duplicate, files
+ * that are not listed are unique. Upload and crush scripts then handle
+ * each image once and map the duplicates to the kept file.
+ */
+bool WriteDedupManifest(const std::string& filename, const std::vector<DuplicateGroup>& groups);
+
+#endif
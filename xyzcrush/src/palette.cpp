@@ -0,0 +1,102 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2017 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "palette.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+constexpr int palette_entries = 256;
+constexpr int palette_size = palette_entries * 3;
+
+PaletteMode ParsePaletteMode(const std::string& name) {
+	if (name == "frequency") {
+		return PaletteMode::Frequency;
+	} else if (name == "luma") {
+		return PaletteMode::Luma;
+	}
+	return PaletteMode::None;
+}
+
+std::string PaletteModeName(PaletteMode mode) {
+	switch (mode) {
+		case PaletteMode::Frequency:
+			return "frequency";
+		case PaletteMode::Luma:
+			return "luma";
+		default:
+			return "none";
+	}
+}
+
+bool OptimizePalette(std::vector<unsigned char>& xyz_data, PaletteMode mode) {
+	if (mode == PaletteMode::None || xyz_data.size() < palette_size) {
+		return false;
+	}
+
+	unsigned char* palette = xyz_data.data();
+	unsigned char* pixels = xyz_data.data() + palette_size;
+	size_t num_pixels = xyz_data.size() - palette_size;
+
+	std::array<size_t, palette_entries> count = {};
+	for (size_t i = 0; i < num_pixels; i++) {
+		count[pixels[i]]++;
+	}
+
+	auto luma = [&](int i) {
+		return palette[i * 3] * 299 + palette[i * 3 + 1] * 587 + palette[i * 3 + 2] * 114;
+	};
+
+	// New order of the old entries, transparent color first
+	std::array<int, palette_entries> order;
+	for (int i = 0; i < palette_entries; i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin() + 1, order.end(), [&](int a, int b) {
+		// unused entries last
+		if ((count[a] == 0) != (count[b] == 0)) {
+			return count[a] != 0;
+		}
+		if (mode == PaletteMode::Frequency) {
+			return count[a] > count[b];
+		}
+		return luma(a) < luma(b);
+	});
+
+	std::array<unsigned char, palette_size> new_palette = {};
+	std::array<unsigned char, palette_entries> remap;
+	for (int i = 0; i < palette_entries; i++) {
+		int old = order[i];
+		remap[old] = i;
+		if (i == 0 || count[old] > 0) {
+			memcpy(&new_palette[i * 3], &palette[old * 3], 3);
+		}
+	}
+
+	bool modified = memcmp(palette, new_palette.data(), palette_size) != 0;
+	if (!modified) {
+		return false;
+	}
+
+	memcpy(palette, new_palette.data(), palette_size);
+	for (size_t i = 0; i < num_pixels; i++) {
+		pixels[i] = remap[pixels[i]];
+	}
+
+	return true;
+}
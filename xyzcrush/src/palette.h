@@ -0,0 +1,48 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2017 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_PALETTE_H
+#define XYZCRUSH_PALETTE_H
+
+#include <string>
+#include <vector>
+
+enum class PaletteMode {
+	None,
+	Frequency,
+	Luma
+};
+
+PaletteMode ParsePaletteMode(const std::string& name);
+
+std::string PaletteModeName(PaletteMode mode);
+
+/**
+ * Lossless pre-pass that renumbers the palette, so neighboring pixels get
+ * similar indices and deflate finds more matches.
+ *
+ * Used colors are sorted by pixel count (Frequency) or brightness (Luma),
+ * unused entries are moved to the end and zeroed. Index 0 is the
+ * transparent color of RPG Maker and always stays in place.
+ *
+ * @param xyz_data decompressed XYZ data (768 byte palette + indices)
+ * @param mode sort order
+ * @return whether the data was modified
+ */
+bool OptimizePalette(std::vector<unsigned char>& xyz_data, PaletteMode mode);
+
+#endif
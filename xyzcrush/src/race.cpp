@@ -0,0 +1,242 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2017 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "race.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <zlib.h>
+#include "zlib_container.h"
+#include "stats.h"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	Stats::Counter tried_counter("race candidates");
+	Stats::Counter skipped_counter("race candidates skipped");
+
+	double Seconds(Clock::time_point since) {
+		return std::chrono::duration<double>(Clock::now() - since).count();
+	}
+
+	bool CompressZlib(const Strategy& strategy, const unsigned char* in, size_t insize,
+			std::vector<unsigned char>& out) {
+		z_stream strm = {};
+		if (deflateInit2(&strm, strategy.level, Z_DEFLATED, 15, 9, strategy.zlib_strategy) != Z_OK) {
+			return false;
+		}
+
+		out.resize(deflateBound(&strm, insize));
+		strm.next_in = const_cast<Bytef*>(in);
+		strm.avail_in = insize;
+		strm.next_out = out.data();
+		strm.avail_out = out.size();
+		int res = deflate(&strm, Z_FINISH);
+		out.resize(strm.total_out);
+		deflateEnd(&strm);
+		return res == Z_STREAM_END;
+	}
+
+	void CompressZopfli(const Strategy& strategy, const unsigned char* in, size_t insize,
+			ZopfliMemoryBudget* memory, std::vector<unsigned char>& out) {
+		ZopfliOptions options;
+		ZopfliInitOptions(&options);
+		options.numiterations = strategy.iterations;
+		options.blocksplitting = 1;
+		options.blocksplittingmax = strategy.blocksplittingmax;
+
+		if (memory) {
+			ZopfliZlibCompressParallel(&options, in, insize, 1, out, memory);
+			return;
+		}
+
+		unsigned char* data = nullptr;
+		size_t size = 0;
+		ZopfliZlibCompress(&options, in, insize, &data, &size);
+		out.assign(data, data + size);
+		free(data);
+	}
+
+	bool Inflates(const std::vector<unsigned char>& stream, const unsigned char* in, size_t insize) {
+		std::vector<unsigned char> check(insize);
+		uLongf size = insize;
+		return uncompress(check.data(), &size, stream.data(), stream.size()) == Z_OK
+			&& size == insize && memcmp(check.data(), in, insize) == 0;
+	}
+
+	struct Candidate {
+		const Strategy* strategy = nullptr;
+		std::vector<unsigned char> data = {};
+		bool done = false;
+	};
+}
+
+std::vector<Strategy> RaceStrategies() {
+	using Kind = Strategy::Kind;
+	// Zopfli time grows with the iterations, the large ones come last so
+	// the budget stops them first
+	return {
+		{ "zlib", Kind::Zlib, 9, Z_DEFAULT_STRATEGY },
+		{ "zlib-filtered", Kind::Zlib, 9, Z_FILTERED },
+		{ "zlib-rle", Kind::Zlib, 9, Z_RLE },
+		{ "zopfli-i5", Kind::Zopfli, 0, 0, 5, 15 },
+		{ "zopfli-i15", Kind::Zopfli, 0, 0, 15, 15 },
+		{ "zopfli-i15-split", Kind::Zopfli, 0, 0, 15, 0 },
+		{ "zopfli-i50", Kind::Zopfli, 0, 0, 50, 15 },
+		{ "zopfli-i100-split", Kind::Zopfli, 0, 0, 100, 0 }
+	};
+}
+
+bool CompressRace(const unsigned char* in, size_t insize, const RaceOptions& options,
+		RaceResult& result) {
+	static const std::vector<Strategy> strategies = RaceStrategies();
+
+	std::vector<Candidate> candidates;
+	for (const auto& strategy : strategies) {
+		candidates.push_back({ &strategy });
+	}
+	auto preferred = std::find_if(candidates.begin(), candidates.end(), [&](const Candidate& c) {
+		return c.strategy->name == options.preferred;
+	});
+	if (preferred != candidates.end()) {
+		std::rotate(candidates.begin(), preferred, preferred + 1);
+	}
+
+	// With a budget the cheapest Zopfli candidate runs alone first, the time
+	// of the others is unknown before. It is handed out before every other
+	// Zopfli candidate, so the workers waiting for it never wait in vain.
+	auto is_zopfli = [](const Candidate& c) {
+		return c.strategy->kind == Strategy::Kind::Zopfli;
+	};
+	const Strategy* calibration = nullptr;
+	if (options.budget > 0.0) {
+		auto cheapest = candidates.end();
+		for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+			if (is_zopfli(*it) && (cheapest == candidates.end() ||
+					it->strategy->iterations < cheapest->strategy->iterations)) {
+				cheapest = it;
+			}
+		}
+		if (cheapest != candidates.end()) {
+			auto first = std::find_if(candidates.begin(), candidates.end(), is_zopfli);
+			std::rotate(first, cheapest, cheapest + 1);
+			calibration = first->strategy;
+		}
+	}
+
+	Clock::time_point start = Clock::now();
+	std::atomic<size_t> next(0);
+	std::atomic<int> skipped(0);
+	std::mutex mutex;
+	std::condition_variable calibrated_cv;
+	// slowest Zopfli run so far, predicts the time of the remaining ones
+	double seconds_per_iteration = 0.0;
+	bool calibrated = calibration == nullptr;
+
+	// waits until the time of a Zopfli run is known
+	auto worst_case = [&](const Strategy& strategy) {
+		std::unique_lock<std::mutex> lock(mutex);
+		calibrated_cv.wait(lock, [&]() { return calibrated; });
+		return seconds_per_iteration * strategy.iterations;
+	};
+
+	auto worker = [&]() {
+		for (size_t i = next++; i < candidates.size(); i = next++) {
+			Candidate& candidate = candidates[i];
+			const Strategy& strategy = *candidate.strategy;
+
+			if (strategy.kind == Strategy::Kind::Zlib) {
+				candidate.done = CompressZlib(strategy, in, insize, candidate.data);
+				continue;
+			}
+
+			bool fits;
+			if (&strategy == calibration) {
+				fits = Seconds(start) < options.budget;
+			} else {
+				double cost = options.budget > 0.0 ? worst_case(strategy) : 0.0;
+				fits = options.budget <= 0.0 || Seconds(start) + cost <= options.budget;
+			}
+			if (!fits) {
+				skipped++;
+				if (&strategy == calibration) {
+					// nothing is known, none of the others is started either
+					std::lock_guard<std::mutex> lock(mutex);
+					seconds_per_iteration = options.budget;
+					calibrated = true;
+					calibrated_cv.notify_all();
+				}
+				continue;
+			}
+
+			Clock::time_point zopfli_start = Clock::now();
+			{
+				Stats::Scope scope("race zopfli");
+				CompressZopfli(strategy, in, insize, options.memory, candidate.data);
+			}
+			candidate.done = true;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			seconds_per_iteration = std::max(seconds_per_iteration,
+				Seconds(zopfli_start) / std::max(1, strategy.iterations));
+			calibrated = true;
+			calibrated_cv.notify_all();
+		}
+	};
+
+	int threads = std::max(1, std::min<int>(options.threads, candidates.size()));
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; i++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	std::vector<Candidate*> finished;
+	for (auto& candidate : candidates) {
+		if (candidate.done) {
+			finished.push_back(&candidate);
+		}
+	}
+	// the earlier candidate wins a tie
+	std::stable_sort(finished.begin(), finished.end(), [](const Candidate* a, const Candidate* b) {
+		return a->data.size() < b->data.size();
+	});
+
+	result.tried = static_cast<int>(finished.size());
+	result.skipped = skipped;
+	tried_counter.Add(result.tried);
+	skipped_counter.Add(result.skipped);
+
+	Stats::Scope scope("verify");
+	for (Candidate* candidate : finished) {
+		if (Inflates(candidate->data, in, insize)) {
+			result.data = std::move(candidate->data);
+			result.strategy = candidate->strategy->name;
+			return true;
+		}
+	}
+	return false;
+}
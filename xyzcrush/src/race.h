@@ -0,0 +1,85 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2017 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_RACE_H
+#define XYZCRUSH_RACE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "zopfli_parallel.h"
+
+/** One candidate encoding of a compression race. */
+struct Strategy {
+	enum class Kind {
+		Zlib,
+		Zopfli
+	};
+
+	std::string name;
+	Kind kind = Kind::Zlib;
+	/** zlib compression level and Z_FILTERED, Z_RLE, ... */
+	int level = 9;
+	int zlib_strategy = 0;
+	/** Zopfli iterations and block split limit, 0 is unlimited */
+	int iterations = 0;
+	int blocksplittingmax = 0;
+};
+
+/** The candidates of --race, cheapest first. */
+std::vector<Strategy> RaceStrategies();
+
+struct RaceOptions {
+	/** Candidates compressed at the same time */
+	int threads = 1;
+	/**
+	 * Wall time in seconds after which no further candidate is started,
+	 * 0 runs all of them. Candidates that would not finish in time
+	 * according to the earlier Zopfli runs are skipped as well. The
+	 * cheapest Zopfli candidate runs before the others start to measure
+	 * the speed, also when another one is preferred.
+	 */
+	double budget = 0.0;
+	/** Name of a strategy that is started first, e.g. the last winner */
+	std::string preferred;
+	/** Limits the memory of the Zopfli candidates, may be nullptr */
+	ZopfliMemoryBudget* memory = nullptr;
+};
+
+struct RaceResult {
+	/** Smallest zlib stream that inflates to the input */
+	std::vector<unsigned char> data;
+	std::string strategy;
+	int tried = 0;
+	int skipped = 0;
+};
+
+/**
+ * Compresses in with several strategies concurrently and keeps the
+ * smallest stream. Every result is inflated and compared against the
+ * input before it is accepted.
+ *
+ * @param in uncompressed data
+ * @param insize size of in
+ * @param options race settings
+ * @param result receives the winner
+ * @return whether any candidate produced a valid stream
+ */
+bool CompressRace(const unsigned char* in, size_t insize, const RaceOptions& options,
+	RaceResult& result);
+
+#endif
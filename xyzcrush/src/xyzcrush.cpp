@@ -16,15 +16,25 @@
  */
 
 #include <zlib.h>
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <filesystem>
 #include <iostream>
-#include <fstream>
 #include <sstream>
+#include <thread>
 #include <vector>
-#ifdef _WIN32
-# include <algorithm>
-#endif
+#include <argparse.hpp>
 #include "zlib_container.h"
+#include "zopfli_parallel.h"
+#include "cache.h"
+#include "dedup.h"
+#include "palette.h"
+#include "race.h"
+#include "fileio.h"
+#include "libxyz.h"
+#include "pipeline.h"
+#include "stats.h"
 
 # ifdef __MINGW64_VERSION_MAJOR
 int _dowildcard = -1; /* enable wildcard expansion for mingw-w64 */
@@ -73,8 +83,261 @@ std::string GetPath(const std::string& str) {
 	return s;
 }
 
+struct CrushOptions {
+	ZopfliOptions zopfli;
+	int block_jobs = 1;
+	PaletteMode palette = PaletteMode::None;
+	CrushCache* cache = nullptr;
+	ZopfliMemoryBudget* memory = nullptr;
+	/** Tries RaceStrategies() instead of the zopfli options */
+	bool race = false;
+	double race_budget = 0.0;
+	/** Prefix of the written files, empty or ending with a slash */
+	std::string output_dir;
+};
+
+/** Identifies the settings that influence the compressed stream. */
+std::string CacheSettings(const CrushOptions& options) {
+	std::ostringstream ss;
+	if (options.race) {
+		// one entry for any block job count, the budget already limits the effort
+		ss << "race:t" << options.race_budget
+			<< ",p" << PaletteModeName(options.palette);
+	} else {
+		ss << "zopfli:i" << options.zopfli.numiterations
+			<< ",s" << options.zopfli.blocksplitting
+			<< ",m" << options.zopfli.blocksplittingmax
+			<< ",b" << options.block_jobs
+			<< ",p" << PaletteModeName(options.palette);
+	}
+	// the part size limits the matches
+	if (options.memory) {
+		ss << ",l" << options.memory->MaxPart();
+	}
+	return ss.str();
+}
+
+/**
+ * Writes an XYZ file from the header values and the zlib stream.
+ * The file is replaced atomically, an aborted run keeps the old image.
+ */
+bool WriteXyz(const std::string& filename, const Xyz::Header& header,
+		const unsigned char* comp_data, size_t comp_size) {
+	uint8_t header_data[Xyz::header_size];
+	Xyz::WriteHeader(header, header_data);
+
+	Xyz::AtomicFile xyz_file;
+	return xyz_file.Open(filename) &&
+		xyz_file.Write(header_data, sizeof(header_data)) &&
+		xyz_file.Write(comp_data, comp_size) &&
+		xyz_file.Commit();
+}
+
+static Stats::Counter files_counter("files crushed");
+static Stats::Counter cache_hits_counter("cache hits");
+static Stats::Counter saved_counter("bytes saved");
+
+/** One file passing through the crush pipeline. */
+struct CrushJob {
+	std::string filename;
+	std::string xyz_filename;
+	Xyz::MappedFile file;
+	Xyz::Header header;
+	/** stream for xyz_filename, empty when nothing is written */
+	std::vector<unsigned char> comp_data;
+	/** messages, printed in input order */
+	std::ostringstream out, err;
+	bool failed = false;
+};
+
+/** Maps the input of job and reads it ahead. */
+void ReadFile(CrushJob& job) {
+	Stats::Scope read_scope("read");
+	if (!job.file.Open(job.filename)) {
+		job.err << "Error reading file " << job.filename << "." << std::endl;
+		job.failed = true;
+		return;
+	}
+	job.file.Prefetch();
+}
+
+/** Recompresses the input of job, the result is written by WriteFile. */
+void CrushFile(CrushJob& job, const CrushOptions& options) {
+	const std::string& filename = job.filename;
+	const std::string& xyz_filename = job.xyz_filename;
+	Xyz::MappedFile& file = job.file;
+	Xyz::Header& header = job.header;
+	std::vector<unsigned char>& comp_data = job.comp_data;
+	std::ostringstream& out = job.out;
+	std::ostringstream& err = job.err;
+
+	auto fail = [&]() {
+		job.failed = true;
+	};
+
+	Stats::Scope read_scope("decode");
+	size_t size = file.Size();
+	if (!Xyz::ParseHeader(file.Data(), size, header)) {
+		err << "Input file " << filename
+			<< " is not an XYZ file." << std::endl;
+		return fail();
+	}
+
+	// the original stream, written back when it stays the smallest
+	const uint8_t* compressed_xyz_data = file.Data() + Xyz::header_size;
+	size_t compressed_xyz_size = size - Xyz::header_size;
+
+	std::vector<Bytef> xyz_data;
+	Xyz::ImageView view;
+	if (!Xyz::Decode(file.Data(), size, xyz_data, view)) {
+		err << "XYZ error in file " << filename << "." << std::endl;
+		return fail();
+	}
+	size_t xyz_size = xyz_data.size();
+	read_scope.Stop();
+
+	// Skip images that were already crushed with the same settings
+	std::string settings = CacheSettings(options);
+	uint64_t key = 0;
+	std::string last_strategy;
+	if (options.cache) {
+		key = HashData(xyz_data.data(), xyz_size);
+
+		size_t cached_size;
+		if (options.cache->Lookup(key, settings, cached_size, &last_strategy) &&
+				compressed_xyz_size <= cached_size) {
+			if (xyz_filename != filename) {
+				comp_data.assign(compressed_xyz_data, compressed_xyz_data + compressed_xyz_size);
+			}
+			cache_hits_counter.Add();
+			out << "Input file " << filename << ": " << size
+				<< " (already crushed)" << std::endl;
+			return;
+		}
+	}
+
+	bool remapped = OptimizePalette(xyz_data, options.palette);
+
+	// Compress XYZ data
+	std::string strategy;
+	Stats::Scope compress_scope("compress");
+	if (options.race) {
+		RaceOptions race;
+		race.threads = options.block_jobs;
+		race.budget = options.race_budget;
+		race.preferred = last_strategy;
+		race.memory = options.memory;
+
+		RaceResult winner;
+		if (CompressRace(xyz_data.data(), xyz_size, race, winner)) {
+			comp_data = std::move(winner.data);
+			strategy = winner.strategy;
+		}
+	} else if (options.block_jobs > 1 || options.memory) {
+		ZopfliZlibCompressParallel(&options.zopfli, xyz_data.data(), xyz_size,
+			options.block_jobs, comp_data, options.memory);
+	} else {
+		size_t size = 0;
+		unsigned char* data = 0;
+		ZopfliZlibCompress(&options.zopfli, xyz_data.data(), xyz_size, &data,
+			&size);
+		comp_data.assign(data, data + size);
+		free(data);
+	}
+	compress_scope.Stop();
+
+	// Never replace the original with a larger stream
+	bool kept = false;
+	if (comp_data.empty() || comp_data.size() >= compressed_xyz_size) {
+		comp_data.assign(compressed_xyz_data, compressed_xyz_data + compressed_xyz_size);
+		kept = true;
+	}
+	size_t comp_size = comp_data.size();
+	// the pages are not needed anymore, the next files are read ahead
+	file.Close();
+
+	if (options.cache) {
+		// remember the data that is actually written
+		if (remapped && !kept) {
+			key = HashData(xyz_data.data(), xyz_size);
+		}
+		options.cache->Store(key, settings, comp_size, kept ? "" : strategy);
+	}
+
+	saved_counter.Add(compressed_xyz_size - comp_size);
+
+	out << "Input file " << filename << ": " << size << "->"
+		<< comp_size + 8 << " (" << (comp_size + 8) * 100 / size << "%)"
+		<< (kept ? " (kept original)" : "")
+		<< (!kept && !strategy.empty() ? " (" + strategy + ")" : "") << std::endl;
+}
+
+/** Writes the stream of a crushed job, returns false on error. */
+bool WriteFile(CrushJob& job) {
+	Stats::Scope write_scope("write");
+	if (job.failed || job.comp_data.empty()) {
+		return !job.failed;
+	}
+
+	// Windows cannot replace a file that is still mapped
+	job.file.Close();
+	if (!WriteXyz(job.xyz_filename, job.header, job.comp_data.data(), job.comp_data.size())) {
+		job.err << "Error writing file " << job.xyz_filename << "." << std::endl;
+		return false;
+	}
+
+	files_counter.Add();
+	return true;
+}
+
+/** Runs --dedup on paths, returns the exit code. */
+int Dedup(const std::vector<std::string>& paths, int jobs, int read_ahead,
+		bool link, const std::string& manifest_file) {
+	unsigned int errors = 0;
+	std::vector<std::string> files;
+	if (!CollectXyzFiles(paths, files)) {
+		errors++;
+	}
+	jobs = std::max(1, std::min<int>(jobs, files.size()));
+
+	std::vector<DuplicateGroup> groups;
+	if (!FindDuplicates(files, jobs, read_ahead, groups)) {
+		errors++;
+	}
+
+	size_t duplicates = 0;
+	size_t duplicate_size = 0;
+	for (const auto& group : groups) {
+		std::cout << group.files[0] << ": " << group.sizes[0] << std::endl;
+		for (size_t i = 1; i < group.files.size(); i++) {
+			// hardlinks of the kept file take no extra space
+			std::error_code ec;
+			bool linked = std::filesystem::equivalent(group.files[0], group.files[i], ec);
+			std::cout << "  = " << group.files[i] << ": " << group.sizes[i]
+				<< (linked ? " (linked)" : "") << std::endl;
+			duplicates++;
+			if (!linked) {
+				duplicate_size += group.sizes[i];
+			}
+		}
+		if (link && !LinkDuplicates(group)) {
+			errors++;
+		}
+	}
+	std::cout << files.size() << " files, " << duplicates << " duplicates of "
+		<< groups.size() << " images (" << duplicate_size << " bytes)" << std::endl;
+
+	if (!manifest_file.empty() && !WriteDedupManifest(manifest_file, groups)) {
+		std::cerr << "Error writing manifest file " << manifest_file << "." << std::endl;
+		errors++;
+	}
+
+	return errors > 0 ? 1 : 0;
+}
+
 int main(int argc, char* argv[]) {
-	ZopfliOptions zopfli_options;
+	CrushOptions options;
+	ZopfliOptions& zopfli_options = options.zopfli;
 	ZopfliInitOptions(&zopfli_options);
 	zopfli_options.verbose = 0;
 	zopfli_options.verbose_more = 0;
@@ -83,84 +346,158 @@ int main(int argc, char* argv[]) {
 	zopfli_options.blocksplittinglast = 0;
 	zopfli_options.blocksplittingmax = 15;
 
-	if (argc < 2) {
-		std::cout << "Usage: " << argv[0]
-			<< " filename" << std::endl;
-		return 1;
+	std::vector<std::string> files;
+	std::string cache_file;
+	std::string palette_mode = "none";
+	int jobs = 1;
+	int memory_mb = 0;
+	int read_ahead = 4;
+	std::string output_dir;
+	bool stats = false;
+	std::string trace_file;
+	bool dedup = false;
+	bool link = false;
+	std::string manifest_file;
+
+	argparse::ArgumentParser cli("xyzcrush", PACKAGE_VERSION);
+	cli.set_usage_max_line_width(100);
+	cli.add_description("Recompress XYZ images into smaller files");
+	cli.add_epilog("Homepage " PACKAGE_URL " - Report bugs at: " PACKAGE_BUGREPORT);
+
+	cli.add_argument("FILE").nargs(argparse::nargs_pattern::at_least_one)
+		.store_into(files).help("XYZ files to recompress, with --dedup also directories");
+	cli.add_argument("-j", "--jobs").store_into(jobs).metavar("N")
+		.help("Number of files to recompress in parallel (default: 1)\n"
+			"0 uses one job per CPU core");
+	cli.add_argument("--read-ahead").store_into(read_ahead).metavar("N")
+		.help("Number of files read while the others are recompressed and\n"
+			"written, hides slow storage (default: 4)");
+	cli.add_argument("-b", "--block-jobs").store_into(options.block_jobs).metavar("N")
+		.help("Compress independent blocks of each image on N threads\n"
+			"(default: 1). Speeds up large images, total thread count\n"
+			"is jobs * block jobs");
+	cli.add_argument("-c", "--cache").store_into(cache_file).metavar("FILE")
+		.help("Remember crushed images in FILE and skip them on later\n"
+			"runs with the same settings");
+	cli.add_argument("-o", "--output").store_into(output_dir).metavar("DIR")
+		.help("Directory of the crushed files (default: current directory)");
+	cli.add_argument("-p", "--palette").store_into(palette_mode).metavar("MODE")
+		.choices("none", "frequency", "luma")
+		.help("Reorder the palette before compressing, by pixel count\n"
+			"(frequency) or brightness (luma). Unused colors are zeroed,\n"
+			"the transparent color 0 is kept (default: none)");
+	cli.add_argument("-m", "--memory").store_into(memory_mb).metavar("MB")
+		.help("Limit the Zopfli working memory of all jobs to about MB\n"
+			"megabytes. Large images are compressed in smaller parts and\n"
+			"jobs wait for free memory (default: 0, no limit)");
+	cli.add_argument("-r", "--race").store_into(options.race)
+		.help("Compress every image with several zlib and Zopfli settings\n"
+			"and keep the smallest stream. Block jobs (-b) are used for\n"
+			"the candidates instead");
+	cli.add_argument("--race-budget").store_into(options.race_budget).metavar("SECONDS")
+		.help("With --race, start no Zopfli candidate that would end after\n"
+			"SECONDS per image (default: 0, no limit)");
+	cli.add_argument("-d", "--dedup").store_into(dedup)
+		.help("Recompress nothing, report the files with the same palette\n"
+			"and pixels instead. Directories are searched for *.xyz files");
+	cli.add_argument("--link").store_into(link)
+		.help("With --dedup, replace the duplicates by hardlinks to the\n"
+			"smallest file of their group");
+	cli.add_argument("--manifest").store_into(manifest_file).metavar("FILE")
+		.help("With --dedup, write one line \"duplicate<TAB>kept file\" per\n"
+			"duplicate to FILE");
+	cli.add_argument("--stats").store_into(stats)
+		.help("Print the time of each phase and the counters to stderr");
+	cli.add_argument("--trace").metavar("FILE").store_into(trace_file)
+		.help("Write the phases as Chrome trace_event JSON to FILE");
+
+	try {
+		cli.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		std::cerr << err.what() << "\n";
+		// print usage message
+		std::cerr << cli.usage() << "\n";
+		std::exit(EXIT_FAILURE);
 	}
 
-	unsigned int errors = 0;
-	char header[5];
-
-	for (int arg = 1; arg < argc; arg++) {
-		std::ifstream file(argv[arg],
-			std::ios::binary | std::ios::ate);
-		if (!file) {
-			std::cerr << "Error reading file " << argv[arg] << "."
-				<< std::endl;
-			errors++;
-			continue;
-		}
+	if (memory_mb < 0) {
+		std::cerr << "--memory: Must not be negative.\n";
+		std::cerr << cli.usage() << "\n";
+		std::exit(EXIT_FAILURE);
+	}
 
-		long size = file.tellg();
-		header[4] = '\0';
+	if ((link || !manifest_file.empty()) && !dedup) {
+		std::cerr << "--link and --manifest need --dedup.\n";
+		std::cerr << cli.usage() << "\n";
+		std::exit(EXIT_FAILURE);
+	}
 
-		file.seekg(0, std::ios::beg);
-		file.read(header, 4);
+	if (jobs <= 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
 
-		if (memcmp(header, "XYZ1", 4) != 0) {
-			std::cerr << "Input file " << argv[arg]
-				<< " is not an XYZ file: '" << header << "'." << std::endl;
-			errors++;
-			continue;
-		}
+	if (dedup) {
+		Stats::Session stats_session(stats, trace_file);
+		return Dedup(files, jobs, read_ahead, link, manifest_file);
+	}
 
-		unsigned short width;
-		unsigned short height;
-		file.read((char*) &width, 2);
-		file.read((char*) &height, 2);
+	jobs = std::min<int>(jobs, files.size());
+	options.palette = ParsePaletteMode(palette_mode);
+	if (options.block_jobs <= 0) {
+		options.block_jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	if (!output_dir.empty()) {
+		options.output_dir = output_dir + "/";
+	}
 
-		int compressed_xyz_size = size - 8;
-		Bytef* compressed_xyz_data = new Bytef[compressed_xyz_size];
+	Stats::Session stats_session(stats, trace_file);
 
-		file.read((char*) compressed_xyz_data, compressed_xyz_size);
+	ZopfliMemoryBudget memory_budget(static_cast<size_t>(memory_mb) << 20);
+	if (memory_mb > 0) {
+		options.memory = &memory_budget;
+	}
 
-		uLongf xyz_size = 768 + (width * height);
-		Bytef* xyz_data = new Bytef[xyz_size];
+	CrushCache cache;
+	if (!cache_file.empty()) {
+		cache.Load(cache_file);
+		options.cache = &cache;
+	}
 
-		int status = uncompress(xyz_data, &xyz_size, compressed_xyz_data,
-			compressed_xyz_size);
+	// Files are read ahead on one thread, crushed by the jobs and written
+	// in command line order, so slow storage overlaps with the compression
+	size_t next_file = 0;
+	unsigned int errors = 0;
+	Xyz::RunPipeline<CrushJob>(jobs, read_ahead,
+		[&](CrushJob& job) {
+			if (next_file >= files.size()) {
+				return false;
+			}
+			job.filename = files[next_file++];
+			job.xyz_filename = options.output_dir + GetFilename(job.filename) + ".xyz";
+			ReadFile(job);
+			return true;
+		},
+		[&](CrushJob& job, int) {
+			if (!job.failed) {
+				CrushFile(job, options);
+			}
+		},
+		[&](CrushJob& job) {
+			if (!WriteFile(job)) {
+				job.failed = true;
+			}
+			std::cout << job.out.str() << std::flush;
+			std::cerr << job.err.str();
+			if (job.failed) {
+				errors++;
+			}
+			return true;
+		});
 
-		if (status != Z_OK) {
-			std::cerr << "XYZ error in file " << argv[arg] << "." << std::endl;
-			errors++;
-			continue;
-		}
-		delete[] compressed_xyz_data;
-
-		// Compress XYZ data
-		size_t comp_size = 0;
-		unsigned char* comp_data = 0;
-
-		ZopfliZlibCompress(&zopfli_options, xyz_data, xyz_size, &comp_data,
-			&comp_size);
-
-		delete[] xyz_data;
-
-		std::stringstream ss;
-		ss << GetFilename(argv[arg]) + std::string(".xyz");
-		std::string xyz_filename = ss.str();
-		std::ofstream xyz_file(xyz_filename.c_str(), std::ofstream::binary);
-		xyz_file.write("XYZ1", 4);
-		xyz_file.write(reinterpret_cast<char*>(&width), 2);
-		xyz_file.write(reinterpret_cast<char*>(&height), 2);
-		xyz_file.write(reinterpret_cast<char*>(comp_data), comp_size);
-		xyz_file.close();
-		delete[] comp_data;
-
-		std::cout << "Input file " << argv[arg] << ": " << size << "->"
-			<< comp_size + 8 << " (" << (comp_size + 8) * 100 / size << "%)"
-			<< std::endl;
+	if (options.cache && !cache.Save(cache_file)) {
+		std::cerr << "Error writing cache file " << cache_file << "." << std::endl;
+		errors++;
 	}
 
 	if (errors > 0) {
@@ -0,0 +1,208 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2017 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "zopfli_parallel.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include "deflate.h"
+extern "C" {
+// header lacks C++ guards
+#include "blocksplitter.h"
+}
+
+namespace {
+	// measured peak was about 40 bytes per input byte, plus the hash tables
+	constexpr size_t memory_per_byte = 48;
+	constexpr size_t memory_fixed = 1 << 20;
+	// smaller parts compress noticeably worse
+	constexpr size_t min_part_size = 64 * 1024;
+
+	struct Part {
+		size_t start;
+		size_t end;
+		unsigned char* data = nullptr;
+		size_t size = 0;
+		unsigned char bp = 0;
+	};
+
+	// Appends the deflate bits of part to out, continuing at bit position bp
+	void AppendBits(std::vector<unsigned char>& out, unsigned char& bp, const Part& part) {
+		size_t nbits = part.size * 8 - (part.bp ? 8 - part.bp : 0);
+
+		if (bp == 0) {
+			// byte aligned, plain copy
+			out.insert(out.end(), part.data, part.data + part.size);
+			bp = part.bp;
+			return;
+		}
+
+		for (size_t i = 0; i < nbits; i++) {
+			int bit = (part.data[i / 8] >> (i % 8)) & 1;
+			if (bp == 0) {
+				out.push_back(0);
+			}
+			out.back() |= bit << bp;
+			bp = (bp + 1) & 7;
+		}
+	}
+
+	// Picks at most count parts of [start, end) from the split points, balanced by input size
+	void SelectParts(const size_t* splitpoints, size_t npoints, size_t start, size_t end, int count,
+			std::vector<Part>& parts) {
+		size_t next_point = 0;
+
+		for (int k = 1; k < count && next_point < npoints; k++) {
+			size_t target = start + (end - start) * k / count;
+
+			// nearest split point behind the last one used
+			size_t best = next_point;
+			for (size_t i = next_point; i < npoints; i++) {
+				size_t dist = splitpoints[i] > target ? splitpoints[i] - target : target - splitpoints[i];
+				size_t best_dist = splitpoints[best] > target ? splitpoints[best] - target : target - splitpoints[best];
+				if (dist < best_dist) {
+					best = i;
+				}
+			}
+
+			if (splitpoints[best] > start) {
+				Part p;
+				p.start = start;
+				p.end = splitpoints[best];
+				parts.push_back(p);
+				start = splitpoints[best];
+			}
+			next_point = best + 1;
+		}
+
+		Part last;
+		last.start = start;
+		last.end = end;
+		parts.push_back(last);
+	}
+}
+
+ZopfliMemoryBudget::ZopfliMemoryBudget(size_t bytes) : total(bytes) {}
+
+size_t ZopfliMemoryBudget::Cost(size_t part_size) const {
+	return memory_fixed + part_size * memory_per_byte;
+}
+
+size_t ZopfliMemoryBudget::MaxPart() const {
+	size_t part = total > memory_fixed ? (total - memory_fixed) / memory_per_byte : 0;
+	return std::max(part, min_part_size);
+}
+
+void ZopfliMemoryBudget::Acquire(size_t part_size) {
+	size_t cost = Cost(part_size);
+	std::unique_lock<std::mutex> lock(mutex);
+	// a part larger than the budget still runs, but alone
+	cv.wait(lock, [&]() { return used == 0 || used + cost <= total; });
+	used += cost;
+}
+
+void ZopfliMemoryBudget::Release(size_t part_size) {
+	std::lock_guard<std::mutex> lock(mutex);
+	used -= Cost(part_size);
+	cv.notify_all();
+}
+
+void ZopfliZlibCompressParallel(const ZopfliOptions* options,
+	const unsigned char* in, size_t insize, int threads,
+	std::vector<unsigned char>& out, ZopfliMemoryBudget* budget) {
+	std::vector<Part> parts;
+
+	size_t master_size = budget ? budget->MaxPart() : insize;
+	size_t master_start = 0;
+	do {
+		size_t master_end = insize - master_start > master_size ? master_start + master_size : insize;
+
+		if (threads > 1 && options->blocksplitting) {
+			if (budget) {
+				budget->Acquire(master_end - master_start);
+			}
+			size_t* splitpoints = nullptr;
+			size_t npoints = 0;
+			ZopfliBlockSplit(options, in, master_start, master_end, options->blocksplittingmax,
+				&splitpoints, &npoints);
+			if (budget) {
+				budget->Release(master_end - master_start);
+			}
+			SelectParts(splitpoints, npoints, master_start, master_end, threads, parts);
+			free(splitpoints);
+		} else {
+			Part p;
+			p.start = master_start;
+			p.end = master_end;
+			parts.push_back(p);
+		}
+		master_start = master_end;
+	} while (master_start < insize);
+
+	auto deflate_part = [&](Part& p, bool final) {
+		if (budget) {
+			budget->Acquire(p.end - p.start);
+		}
+		ZopfliDeflatePart(options, 2 /* dynamic block */, final ? 1 : 0,
+			in, p.start, p.end, &p.bp, &p.data, &p.size);
+		if (budget) {
+			budget->Release(p.end - p.start);
+		}
+	};
+
+	std::atomic<size_t> next_part(0);
+	auto worker = [&]() {
+		for (size_t i = next_part++; i < parts.size(); i = next_part++) {
+			deflate_part(parts[i], i + 1 == parts.size());
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (int i = 1; i < std::min<int>(threads, parts.size()); i++) {
+		workers.emplace_back(worker);
+	}
+	// the calling thread compresses as well
+	worker();
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	// zlib header, same values as ZopfliZlibCompress
+	unsigned cmf = 120;  // CM 8, CINFO 7
+	unsigned flevel = 3;
+	unsigned cmfflg = 256 * cmf + flevel * 64;
+	cmfflg += 31 - cmfflg % 31;
+
+	out.clear();
+	out.push_back(cmfflg / 256);
+	out.push_back(cmfflg % 256);
+
+	unsigned char bp = 0;
+	for (auto& p : parts) {
+		AppendBits(out, bp, p);
+		free(p.data);
+	}
+
+	uLong checksum = adler32(adler32(0L, Z_NULL, 0), in, insize);
+	out.push_back((checksum >> 24) & 0xFF);
+	out.push_back((checksum >> 16) & 0xFF);
+	out.push_back((checksum >> 8) & 0xFF);
+	out.push_back(checksum & 0xFF);
+}
@@ -0,0 +1,78 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2017 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_ZOPFLI_PARALLEL_H
+#define XYZCRUSH_ZOPFLI_PARALLEL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "zopfli.h"
+
+/**
+ * Upper bound for the Zopfli working memory of all threads.
+ *
+ * The longest match cache and the LZ77 stores grow with the size of the
+ * deflated part, about 40 bytes per input byte were measured. Inputs are
+ * cut into parts small enough to fit the budget and every part reserves
+ * its memory before it is compressed, so parallel jobs wait instead of
+ * exceeding the limit.
+ */
+class ZopfliMemoryBudget {
+public:
+	/** @param bytes memory shared by all jobs */
+	explicit ZopfliMemoryBudget(size_t bytes);
+
+	/** Largest part that fits into the budget on its own. */
+	size_t MaxPart() const;
+
+	/** Waits until the memory for a part of part_size bytes is free. */
+	void Acquire(size_t part_size);
+
+	void Release(size_t part_size);
+
+private:
+	size_t Cost(size_t part_size) const;
+
+	size_t total;
+	size_t used = 0;
+	std::mutex mutex;
+	std::condition_variable cv;
+};
+
+/**
+ * Compresses in to a zlib stream like ZopfliZlibCompress, but splits the
+ * input at the block boundaries found by ZopfliBlockSplit and deflates up to
+ * threads parts concurrently. Every part still uses the preceding input as
+ * LZ77 window, the resulting deflate blocks are joined on bit level.
+ *
+ * With a memory budget the input is first cut into master blocks of at most
+ * MaxPart() bytes, like ZOPFLI_MASTER_BLOCK_SIZE does in ZopfliDeflate.
+ *
+ * @param options zopfli options
+ * @param in uncompressed data
+ * @param insize size of in
+ * @param threads maximum number of parts compressed at the same time
+ * @param out receives the zlib stream
+ * @param budget limits the working memory, may be nullptr
+ */
+void ZopfliZlibCompressParallel(const ZopfliOptions* options,
+	const unsigned char* in, size_t insize, int threads,
+	std::vector<unsigned char>& out, ZopfliMemoryBudget* budget = nullptr);
+
+#endif